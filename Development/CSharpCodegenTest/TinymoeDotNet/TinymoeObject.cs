@@ -7,29 +7,83 @@ namespace TinymoeDotNet
 {
     public delegate TinymoeContinuation TinymoeContinuation();
 
+    public class TinymoeLayout
+    {
+        private static readonly Dictionary<Type, TinymoeLayout> roots = new Dictionary<Type, TinymoeLayout>();
+        private readonly Dictionary<string, TinymoeLayout> transitions = new Dictionary<string, TinymoeLayout>();
+        private readonly Dictionary<string, int> slots = new Dictionary<string, int>();
+
+        public Type Type { get; private set; }
+        public string[] FieldNames { get; private set; }
+
+        private TinymoeLayout(Type type, string[] fieldNames)
+        {
+            this.Type = type;
+            this.FieldNames = fieldNames;
+            for (int i = 0; i < fieldNames.Length; i++)
+            {
+                this.slots[fieldNames[i]] = i;
+            }
+        }
+
+        public static TinymoeLayout GetRoot(Type type)
+        {
+            TinymoeLayout layout;
+            if (!roots.TryGetValue(type, out layout))
+            {
+                layout = new TinymoeLayout(type, new string[0]);
+                roots.Add(type, layout);
+            }
+            return layout;
+        }
+
+        public int GetSlot(string name)
+        {
+            int slot;
+            return this.slots.TryGetValue(name, out slot) ? slot : -1;
+        }
+
+        public TinymoeLayout AddField(string name)
+        {
+            TinymoeLayout layout;
+            if (!this.transitions.TryGetValue(name, out layout))
+            {
+                layout = new TinymoeLayout(this.Type, this.FieldNames.Concat(new string[] { name }).ToArray());
+                this.transitions.Add(name, layout);
+            }
+            return layout;
+        }
+    }
+
     public class TinymoeObject
     {
         private static UInt64 counter = 0;
-        internal Dictionary<string, TinymoeObject> fields = new Dictionary<string, TinymoeObject>();
-        private List<string> fieldNames = new List<string>();
+        internal TinymoeLayout layout;
+        internal TinymoeObject[] slots = new TinymoeObject[0];
         private bool finishedConstruction = false;
         private UInt64 id = counter++;
 
+        public TinymoeObject()
+        {
+            this.layout = TinymoeLayout.GetRoot(this.GetType());
+        }
+
         public void SetField(string name, TinymoeObject value)
         {
-            if (finishedConstruction)
+            int slot = this.layout.GetSlot(name);
+            if (slot == -1)
             {
-                if (!this.fieldNames.Contains(name))
+                if (finishedConstruction)
                 {
                     throw new ArgumentOutOfRangeException("name");
                 }
-                this.fields[name] = value;
-            }
-            else
-            {
-                this.fields[name] = value;
-                this.fieldNames.Add(name);
+                this.layout = this.layout.AddField(name);
+                slot = this.slots.Length;
+                var slots = this.slots;
+                Array.Resize(ref slots, slot + 1);
+                this.slots = slots;
             }
+            this.slots[slot] = value;
         }
 
         public TinymoeObject FinishConstruction()
@@ -40,10 +94,7 @@ namespace TinymoeDotNet
 
         public TinymoeObject SetFields(TinymoeObject[] values)
         {
-            foreach (var x in this.fieldNames.Zip(values, Tuple.Create))
-            {
-                this.fields[x.Item1] = x.Item2;
-            }
+            Array.Copy(values, this.slots, Math.Min(values.Length, this.slots.Length));
             return this;
         }
 
@@ -171,6 +222,201 @@ namespace TinymoeDotNet
         }
     }
 
+    public class TinymoeFieldSite
+    {
+        public const int MaxPolymorphicEntries = 4;
+
+        private static readonly List<TinymoeFieldSite> sites = new List<TinymoeFieldSite>();
+        internal static int extensionVersion = 0;
+
+        private readonly TinymoeLayout[] layouts = new TinymoeLayout[MaxPolymorphicEntries];
+        private readonly int[] slots = new int[MaxPolymorphicEntries];
+        private readonly TinymoeObject[] extensions = new TinymoeObject[MaxPolymorphicEntries];
+        private int count = 0;
+        private int version = 0;
+
+        public string Name { get; private set; }
+        public bool Megamorphic { get; private set; }
+        public UInt64 Hits { get; private set; }
+        public UInt64 Misses { get; private set; }
+
+        public TinymoeFieldSite(string name)
+        {
+            this.Name = name;
+            sites.Add(this);
+        }
+
+        private int Find(TinymoeLayout layout)
+        {
+            if (this.version != extensionVersion)
+            {
+                this.version = extensionVersion;
+                this.count = 0;
+            }
+            for (int i = 0; i < this.count; i++)
+            {
+                if (this.layouts[i] == layout)
+                {
+                    this.Hits++;
+                    return i;
+                }
+            }
+            this.Misses++;
+            return -1;
+        }
+
+        private void Add(TinymoeLayout layout, int slot, TinymoeObject extension)
+        {
+            if (this.count == MaxPolymorphicEntries)
+            {
+                this.Megamorphic = true;
+                return;
+            }
+            this.layouts[this.count] = layout;
+            this.slots[this.count] = slot;
+            this.extensions[this.count] = extension;
+            this.count++;
+        }
+
+        public TinymoeObject Get(TinymoeObject target)
+        {
+            if (target == null || this.Megamorphic)
+            {
+                this.Misses++;
+                return TinymoeOperations.LookupField(target, this.Name);
+            }
+
+            int entry = Find(target.layout);
+            if (entry != -1)
+            {
+                int slot = this.slots[entry];
+                return slot == -1 ? this.extensions[entry] : target.slots[slot];
+            }
+
+            {
+                int slot = target.layout.GetSlot(this.Name);
+                if (slot != -1)
+                {
+                    Add(target.layout, slot, null);
+                    return target.slots[slot];
+                }
+                var extension = TinymoeOperations.LookupField(target, this.Name);
+                Add(target.layout, -1, extension);
+                return extension;
+            }
+        }
+
+        public void Set(TinymoeObject target, TinymoeObject value)
+        {
+            if (!this.Megamorphic)
+            {
+                int entry = Find(target.layout);
+                if (entry != -1 && this.slots[entry] != -1)
+                {
+                    target.slots[this.slots[entry]] = value;
+                    return;
+                }
+
+                int slot = target.layout.GetSlot(this.Name);
+                if (slot != -1)
+                {
+                    Add(target.layout, slot, null);
+                }
+            }
+            else
+            {
+                this.Misses++;
+            }
+            target.SetField(this.Name, value);
+        }
+
+        public static void WriteStatistics(System.IO.TextWriter writer)
+        {
+            foreach (var site in sites.OrderByDescending(x => x.Hits + x.Misses))
+            {
+                if (site.Hits + site.Misses == 0) continue;
+                var kind = site.Megamorphic ? "megamorphic" : site.count > 1 ? "polymorphic" : "monomorphic";
+                writer.WriteLine("{0}: {1}, {2} hits, {3} misses", site.Name, kind, site.Hits, site.Misses);
+            }
+        }
+    }
+
+    public class TinymoeDispatchSite
+    {
+        internal Type[] types;
+        internal TinymoeObject target;
+    }
+
+    public class TinymoeDispatchTable
+    {
+        private readonly Type[][] dimensions;
+        private readonly Dictionary<Type, int>[] indexes;
+        private readonly TinymoeObject[] targets;
+
+        public TinymoeDispatchTable(Type[][] dimensions, TinymoeObject[] targets)
+        {
+            this.dimensions = dimensions;
+            this.indexes = new Dictionary<Type, int>[dimensions.Length];
+            for (int i = 0; i < dimensions.Length; i++)
+            {
+                this.indexes[i] = new Dictionary<Type, int>();
+                for (int j = 0; j < dimensions[i].Length; j++)
+                {
+                    if (!this.indexes[i].ContainsKey(dimensions[i][j]))
+                    {
+                        this.indexes[i].Add(dimensions[i][j], j);
+                    }
+                }
+            }
+            this.targets = targets;
+        }
+
+        private static Type GetType(TinymoeObject value)
+        {
+            return value == null ? typeof(TinymoeObject) : value.GetType();
+        }
+
+        private int GetIndex(int dimension, Type type)
+        {
+            int index;
+            if (!this.indexes[dimension].TryGetValue(type, out index))
+            {
+                // typeof(TinymoeObject) is always the first candidate, so this stops at the root of the type hierarchy
+                index = GetIndex(dimension, type.BaseType);
+                this.indexes[dimension].Add(type, index);
+            }
+            return index;
+        }
+
+        public TinymoeObject Lookup(TinymoeDispatchSite site, TinymoeObject[] arguments)
+        {
+            var types = site.types;
+            if (types != null)
+            {
+                int i = 0;
+                while (i < arguments.Length && types[i] == GetType(arguments[i]))
+                {
+                    i++;
+                }
+                if (i == arguments.Length)
+                {
+                    return site.target;
+                }
+            }
+
+            int offset = 0;
+            types = new Type[arguments.Length];
+            for (int i = 0; i < arguments.Length; i++)
+            {
+                types[i] = GetType(arguments[i]);
+                offset = offset * this.dimensions[i].Length + GetIndex(i, types[i]);
+            }
+            site.types = types;
+            site.target = this.targets[offset];
+            return site.target;
+        }
+    }
+
     public class TinymoeOperations
     {
         static readonly Dictionary<Tuple<Type, string>, TinymoeObject> extensions = new Dictionary<Tuple<Type, string>, TinymoeObject>();
@@ -194,19 +440,21 @@ namespace TinymoeDotNet
         public static void SetExtension(Type type, string name, TinymoeObject value)
         {
             extensions[Tuple.Create(type, name)] = value;
+            TinymoeFieldSite.extensionVersion++;
         }
 
-        public TinymoeObject GetField(TinymoeObject target, string name)
+        public static TinymoeObject LookupField(TinymoeObject target, string name)
         {
-            TinymoeObject value = null;
             if (target != null)
             {
-                if (target.fields.TryGetValue(name, out value))
+                int slot = target.layout.GetSlot(name);
+                if (slot != -1)
                 {
-                    return value;
+                    return target.slots[slot];
                 }
             }
 
+            TinymoeObject value = null;
             Type type = target == null ? typeof(TinymoeObject) : target.GetType();
             while (type != null)
             {
@@ -220,6 +468,11 @@ namespace TinymoeDotNet
             throw new ArgumentOutOfRangeException("name");
         }
 
+        public TinymoeObject GetField(TinymoeObject target, string name)
+        {
+            return LookupField(target, name);
+        }
+
         public static TinymoeObject ArrayLength(TinymoeObject array)
         {
             return new TinymoeInteger(((TinymoeArray)array).Elements.Length);
@@ -235,14 +488,167 @@ namespace TinymoeDotNet
             ((TinymoeArray)array).Elements[CastToInteger(index).Value - 1] = value;
         }
 
+        private static double ToDouble(TinymoeObject value, string message)
+        {
+            if (value is TinymoeInteger)
+            {
+                return ((TinymoeInteger)value).Value;
+            }
+            else if (value is TinymoeFloat)
+            {
+                return ((TinymoeFloat)value).Value;
+            }
+            else
+            {
+                throw new ArgumentException(message);
+            }
+        }
+
+        private static bool IsSame(TinymoeObject a, TinymoeObject b)
+        {
+            if (a == null || b == null)
+            {
+                return a == b;
+            }
+            else if (a.GetType() != b.GetType())
+            {
+                return false;
+            }
+            else if (a is TinymoeInteger)
+            {
+                return ((TinymoeInteger)a).Value == ((TinymoeInteger)b).Value;
+            }
+            else if (a is TinymoeFloat)
+            {
+                return ((TinymoeFloat)a).Value == ((TinymoeFloat)b).Value;
+            }
+            else if (a is TinymoeBoolean)
+            {
+                return ((TinymoeBoolean)a).Value == ((TinymoeBoolean)b).Value;
+            }
+            else if (a is TinymoeString)
+            {
+                return ((TinymoeString)a).Value == ((TinymoeString)b).Value;
+            }
+            else
+            {
+                return a == b;
+            }
+        }
+
+        public static TinymoeObject ArraySum(TinymoeObject array)
+        {
+            int integerSum = 0;
+            double floatSum = 0;
+            bool isFloat = false;
+            foreach (var element in ((TinymoeArray)array).Elements)
+            {
+                floatSum += ToDouble(element, "Only an array of numbers can be summed.");
+                if (element is TinymoeInteger)
+                {
+                    integerSum = unchecked(integerSum + ((TinymoeInteger)element).Value);
+                }
+                else
+                {
+                    isFloat = true;
+                }
+            }
+            return isFloat ? (TinymoeObject)new TinymoeFloat(floatSum) : new TinymoeInteger(integerSum);
+        }
+
+        public static TinymoeObject ArrayExtreme(TinymoeObject array, bool maximum)
+        {
+            var elements = ((TinymoeArray)array).Elements;
+            if (elements.Length == 0)
+            {
+                throw new ArgumentException("An empty array has no minimum or maximum.");
+            }
+
+            int index = 0;
+            double result = 0;
+            for (int i = 0; i < elements.Length; i++)
+            {
+                var value = ToDouble(elements[i], "Only an array of numbers has a minimum or maximum.");
+                if (i == 0 || (maximum ? value > result : value < result))
+                {
+                    index = i;
+                    result = value;
+                }
+            }
+            return elements[index];
+        }
+
+        public static TinymoeObject ArrayFind(TinymoeObject value, TinymoeObject array)
+        {
+            var elements = ((TinymoeArray)array).Elements;
+            for (int i = 0; i < elements.Length; i++)
+            {
+                if (IsSame(elements[i], value))
+                {
+                    return new TinymoeInteger(i + 1);
+                }
+            }
+            return new TinymoeInteger(0);
+        }
+
+        public static TinymoeObject ArrayFill(TinymoeObject array, TinymoeObject value)
+        {
+            var elements = ((TinymoeArray)array).Elements;
+            for (int i = 0; i < elements.Length; i++)
+            {
+                elements[i] = value;
+            }
+            return null;
+        }
+
+        public static TinymoeObject ArrayCopy(TinymoeObject source, TinymoeObject target)
+        {
+            var from = ((TinymoeArray)source).Elements;
+            var to = ((TinymoeArray)target).Elements;
+            if (from.Length > to.Length)
+            {
+                throw new ArgumentException("The target array is shorter than the source array.");
+            }
+            Array.Copy(from, to, from.Length);
+            return null;
+        }
+
+        // integer operands give integers except for division, which gives floats like i_div_i
+        public static TinymoeObject ArrayElementwise(TinymoeObject a, TinymoeObject b, Func<int, int, int> integerOperation, Func<double, double, double> floatOperation)
+        {
+            var x = ((TinymoeArray)a).Elements;
+            var y = ((TinymoeArray)b).Elements;
+            if (x.Length != y.Length)
+            {
+                throw new ArgumentException("Elementwise operations require arrays of the same length.");
+            }
+
+            var results = new TinymoeObject[x.Length];
+            for (int i = 0; i < x.Length; i++)
+            {
+                var left = ToDouble(x[i], "Elementwise operations require arrays of numbers.");
+                var right = ToDouble(y[i], "Elementwise operations require arrays of numbers.");
+                if (x[i] is TinymoeInteger && y[i] is TinymoeInteger && integerOperation != null)
+                {
+                    results[i] = new TinymoeInteger(integerOperation(((TinymoeInteger)x[i]).Value, ((TinymoeInteger)y[i]).Value));
+                }
+                else
+                {
+                    results[i] = new TinymoeFloat(floatOperation(left, right));
+                }
+            }
+            return new TinymoeArray(results);
+        }
+
         private static readonly Dictionary<string, TinymoeObject> externalFunctions = new Dictionary<string, TinymoeObject>();
+        private static readonly Dictionary<string, Func<TinymoeObject[], TinymoeObject>> directExternalFunctions = new Dictionary<string, Func<TinymoeObject[], TinymoeObject>>();
 
         public static TinymoeObject BuildExternalFunction(Func<TinymoeObject[], TinymoeObject> function)
         {
             return new TinymoeFunction(__args__ =>
             {
                 var result = function(__args__.Skip(1).Take(__args__.Length - 2).ToArray());
-                return () => Invoke(__args__[2], new TinymoeObject[] { __args__[0], result });
+                return () => Invoke(__args__.Last(), new TinymoeObject[] { __args__[0], result });
             });
         }
 
@@ -373,17 +779,17 @@ namespace TinymoeDotNet
             return a == b;
         }
 
-        private static int i_c_i(int a, int b)
+        protected static int i_c_i(int a, int b)
         {
             return a < b ? -1 : a > b ? 1 : 0;
         }
 
-        private static int f_c_f(double a, double b)
+        protected static int f_c_f(double a, double b)
         {
             return a < b ? -1 : a > b ? 1 : 0;
         }
 
-        private static int s_c_s(string a, string b)
+        protected static int s_c_s(string a, string b)
         {
             return i_c_i(a.CompareTo(b), 0);
         }
@@ -454,40 +860,68 @@ namespace TinymoeDotNet
             }
         }
 
-        private static TinymoeObject BuildStringTypedExternalFunction(MethodInfo function)
+        private static Func<TinymoeObject[], TinymoeObject> BuildStringTypedExternalFunction(MethodInfo function)
         {
-            return new TinymoeFunction(__args__ =>
+            var parameters = function.GetParameters();
+            return __args__ =>
             {
                 var arguments = __args__
-                    .Skip(1)
-                    .Take(__args__.Length - 2)
-                    .Select((v, i) => FromTinymoe(v, function.GetParameters()[i].ParameterType))
+                    .Select((v, i) => FromTinymoe(v, parameters[i].ParameterType))
                     .ToArray();
-                var result = function.Invoke(null, arguments);
-                return () => Invoke(__args__.Last(), new TinymoeObject[] { __args__[0], ToTinymoe(result) });
-            });
+                return ToTinymoe(function.Invoke(null, arguments));
+            };
         }
 
         #endregion
 
-        public static TinymoeObject GetExternalFunction(string name)
+        public static Func<TinymoeObject[], TinymoeObject> GetDirectExternalFunction(string name)
         {
-            TinymoeObject function;
-            if (!externalFunctions.TryGetValue(name, out function))
+            Func<TinymoeObject[], TinymoeObject> function;
+            if (!directExternalFunctions.TryGetValue(name, out function))
             {
                 switch (name)
                 {
                     case "s_to_n":
-                        function = BuildExternalFunction(__args__ => CastToNumber(__args__[0]));
+                        function = __args__ => CastToNumber(__args__[0]);
                         break;
                     case "to_s":
-                        function = BuildExternalFunction(__args__ => CastToString(__args__[0]));
+                        function = __args__ => CastToString(__args__[0]);
                         break;
                     case "Print":
-                        function = BuildExternalFunction(__args__ => Print(__args__[0]));
+                        function = __args__ => Print(__args__[0]);
                         break;
                     case "Sqrt":
-                        function = BuildExternalFunction(__args__ => Sqrt(__args__[0]));
+                        function = __args__ => Sqrt(__args__[0]);
+                        break;
+                    case "array_sum":
+                        function = __args__ => ArraySum(__args__[0]);
+                        break;
+                    case "array_min":
+                        function = __args__ => ArrayExtreme(__args__[0], false);
+                        break;
+                    case "array_max":
+                        function = __args__ => ArrayExtreme(__args__[0], true);
+                        break;
+                    case "array_find":
+                        function = __args__ => ArrayFind(__args__[0], __args__[1]);
+                        break;
+                    case "array_fill":
+                        function = __args__ => ArrayFill(__args__[0], __args__[1]);
+                        break;
+                    case "array_copy":
+                        function = __args__ => ArrayCopy(__args__[0], __args__[1]);
+                        break;
+                    case "array_add_array":
+                        function = __args__ => ArrayElementwise(__args__[0], __args__[1], (i, j) => unchecked(i + j), (i, j) => i + j);
+                        break;
+                    case "array_sub_array":
+                        function = __args__ => ArrayElementwise(__args__[0], __args__[1], (i, j) => unchecked(i - j), (i, j) => i - j);
+                        break;
+                    case "array_mul_array":
+                        function = __args__ => ArrayElementwise(__args__[0], __args__[1], (i, j) => unchecked(i * j), (i, j) => i * j);
+                        break;
+                    case "array_div_array":
+                        function = __args__ => ArrayElementwise(__args__[0], __args__[1], null, (i, j) => i / j);
                         break;
                     default:
                         {
@@ -500,11 +934,27 @@ namespace TinymoeDotNet
                         }
                         break;
                 }
+                directExternalFunctions.Add(name, function);
+            }
+            return function;
+        }
+
+        public static TinymoeObject GetExternalFunction(string name)
+        {
+            TinymoeObject function;
+            if (!externalFunctions.TryGetValue(name, out function))
+            {
+                function = BuildExternalFunction(GetDirectExternalFunction(name));
                 externalFunctions.Add(name, function);
             }
             return function;
         }
 
+        public static TinymoeObject InvokeExternal(string name, TinymoeObject[] arguments)
+        {
+            return GetDirectExternalFunction(name)(arguments);
+        }
+
         public static TinymoeBoolean CastToBoolean(TinymoeObject a)
         {
             return (TinymoeBoolean)a;
@@ -0,0 +1,71 @@
+#define TINYMOE_EMBEDDED
+#include "ArrayBenchmarkAst.cpp"
+#include "TinymoeNative/TinymoeEmbedding.h"
+
+using namespace TinymoeProgramNamespace;
+
+// sums the same unboxed array with a repeat loop in the script and with "sum of array" from the standard library,
+// every iteration of the loop creates about 70 functions: "repeat" traps the body and selects on the flag of the state with about 10 "=" calls,
+// and "add ... to" reads and writes the variable through continuations, while the bulk phrase is one external call,
+// so the difference is the per-continuation overhead of the script, not the speed of the summing loop,
+// running "repeat with ... from ... to" on integer bounds as a native loop would remove most of it
+
+uint64_t AllocatedBytes(TinymoeEmbeddedIsolate<TinymoeProgram>& isolate)
+{
+	uint64_t bytes = 0;
+	isolate.Enter([&]() { bytes = TinymoeHeap::Current().statistics.allocatedBytes; });
+	return bytes;
+}
+
+template<typename TCallback>
+void Measure(TinymoeEmbeddedIsolate<TinymoeProgram>& isolate, const string& name, int count, int repeat, const TCallback& callback)
+{
+	auto bytes = AllocatedBytes(isolate);
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < repeat; i++)
+	{
+		callback();
+	}
+	auto time = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+	double elements = (double)count * repeat;
+	cout << name << ": " << time.count() / 1000000.0 << " ms, "
+		<< time.count() / elements << " ns per element, "
+		<< (AllocatedBytes(isolate) - bytes) / elements << " bytes allocated per element" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	int count = argc > 1 ? atoi(argv[1]) : 20000;
+	int repeat = 100;
+	int64_t expected = (int64_t)count * (count + 1) / 2;
+
+	TinymoeEmbeddedProgram<TinymoeProgram> program;
+	TinymoeEmbeddedIsolate<TinymoeProgram> isolate(program);
+	try
+	{
+		auto numbers = isolate.Invoke<TinymoeObject::Ptr>("array_benchmark::first_$expression_numbers", count);
+		cout << count << " integers" << endl;
+
+		int64_t loopSum = 0, bulkSum = 0;
+		Measure(isolate, "loop sum", count, 1, [&]()
+		{
+			loopSum = isolate.Invoke<int>("array_benchmark::loop_sum_of_$primitive", numbers);
+		});
+		Measure(isolate, "bulk sum x " + to_string(repeat), count, repeat, [&]()
+		{
+			bulkSum = isolate.Invoke<int>("array_benchmark::bulk_sum_of_$primitive", numbers);
+		});
+
+		if (loopSum != expected || bulkSum != expected)
+		{
+			cerr << "Wrong sums: " << loopSum << ", " << bulkSum << ", expected " << expected << endl;
+			return 1;
+		}
+	}
+	catch (const exception& ex)
+	{
+		cerr << ex.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,59 @@
+#define TINYMOE_EMBEDDED
+#include "AsynchronousIOAst.cpp"
+#include "TinymoeNative/TinymoeEmbedding.h"
+#include <chrono>
+
+using namespace TinymoeProgramNamespace;
+
+// calls the asynchronous sentences of TestCases/AsynchronousIO.txt through an embedded isolate, which returns their results,
+// the standard input should be a pipe that writes "Hello, pipe!"
+
+int failures = 0;
+
+void Check(bool condition, const string& message)
+{
+	if (!condition)
+	{
+		cerr << "Failed: " << message << endl;
+		failures++;
+	}
+}
+
+int main()
+{
+	TinymoeEmbeddedProgram<TinymoeProgram> program;
+	TinymoeEmbeddedIsolate<TinymoeProgram> isolate(program);
+	try
+	{
+		isolate.Invoke<TinymoeObject::Ptr>("asynchronous_io::write_file_$expression_with_$expression", string("Bin/AsynchronousIO.tmp"), string("Hello, file!"));
+		Check(isolate.Invoke<string>("asynchronous_io::read_file_$expression", string("Bin/AsynchronousIO.tmp")) == "Hello, file!", "read file");
+
+		auto start = chrono::steady_clock::now();
+		isolate.Invoke<TinymoeObject::Ptr>("asynchronous_io::sleep_$expression_milliseconds", 50);
+		Check(chrono::steady_clock::now() - start >= chrono::milliseconds(50), "sleep");
+
+		Check(isolate.Invoke<string>("asynchronous_io::read_input") == "Hello, pipe!", "read input");
+	}
+	catch (const exception& ex)
+	{
+		Check(false, ex.what());
+	}
+
+	// a failed operation raises an exception in the script, and the isolate can still be used
+	try
+	{
+		isolate.Invoke<string>("asynchronous_io::read_file_$expression", string("Bin/AsynchronousIO.missing"));
+		Check(false, "read a missing file");
+	}
+	catch (const TinymoeException& ex)
+	{
+		Check(string(ex.what()) == "Failed to open file \"Bin/AsynchronousIO.missing\".", ex.what());
+	}
+	Check(isolate.Invoke<string>("asynchronous_io::read_file_$expression", string("Bin/AsynchronousIO.tmp")) == "Hello, file!", "read file after an exception");
+
+	if (failures == 0)
+	{
+		cout << "Passed." << endl;
+	}
+	return failures == 0 ? 0 : 1;
+}
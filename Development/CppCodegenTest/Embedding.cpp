@@ -0,0 +1,105 @@
+#define TINYMOE_EMBEDDED
+#include "StandardLibraryAst.cpp"
+#include "TinymoeNative/TinymoeEmbedding.h"
+#include <thread>
+
+using namespace TinymoeProgramNamespace;
+
+// embeds TestCases/HelloWorld.txt, calls its functions from isolates on several threads, and checks how errors reach the host
+
+atomic<int> failures{ 0 };
+atomic<int> printedLines{ 0 };
+
+void Check(bool condition, const string& message)
+{
+	if (!condition)
+	{
+		cerr << "Failed: " << message << endl;
+		failures++;
+	}
+}
+
+template<typename TCallback>
+void CheckThrows(const TCallback& callback, const string& expectedMessage)
+{
+	try
+	{
+		callback();
+		Check(false, "expected an exception: " + expectedMessage);
+	}
+	catch (const TinymoeException& ex)
+	{
+		Check(ex.what() == expectedMessage, ex.what());
+	}
+}
+
+// replaces "Print" in the script
+void CountLine(const string& message)
+{
+	printedLines++;
+}
+
+int main()
+{
+	TinymoeEmbeddedProgram<TinymoeProgram> program;
+	program.RegisterFunction("Print", &CountLine);
+
+	// isolates run in parallel, and every thread creates its isolates one after another
+	const int threadCount = 4;
+	const int isolateCount = 50;
+	vector<thread> threads;
+	for (int i = 0; i < threadCount; i++)
+	{
+		threads.push_back(thread([&program, i]()
+		{
+			for (int j = 0; j < isolateCount; j++)
+			{
+				try
+				{
+					TinymoeEmbeddedIsolate<TinymoeProgram> isolate(program);
+					int last = i * isolateCount + j;
+					Check(isolate.Invoke<int>("hello_world::sum_from_$expression_to_$primitive", 1, last) == last * (last + 1) / 2, "sum from 1 to " + to_string(last));
+					isolate.Invoke<TinymoeObject::Ptr>("hello_world::main");
+				}
+				catch (const exception& ex)
+				{
+					Check(false, ex.what());
+				}
+			}
+		}));
+	}
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+	// main prints 5 lines
+	Check(printedLines == threadCount * isolateCount * 5, "printed " + to_string(printedLines) + " lines");
+
+	TinymoeEmbeddedIsolate<TinymoeProgram> isolate(program);
+	CheckThrows([&]() { program.RegisterFunction("Sqrt", &CountLine); }, "Host functions cannot be registered after an isolate is created.");
+	CheckThrows([&]() { isolate.Invoke<int>("hello_world::product_from_$expression_to_$primitive", 1, 10); }, "Function \"hello_world::product_from_$expression_to_$primitive\" does not exist.");
+	CheckThrows([&]() { isolate.Invoke<int>("hello_world::sum_from_$expression_to_$primitive", 1); }, "Function \"hello_world::sum_from_$expression_to_$primitive\" takes 2 arguments.");
+	CheckThrows([&]() { isolate.Invoke<int>("hello_world::print_$expression", string("a"), string("b")); }, "Function \"hello_world::print_$expression\" takes 1 arguments.");
+	CheckThrows([&]() { isolate.Invoke<int>("hello_world::sum_from_$expression_to_$primitive", 1, string("ten")); }, "A value of TinymoeObject cannot be converted to TinymoeInteger.");
+
+	// a raise that no try catches falls into the trap that NewState creates for the call, so the call finishes with a null result
+	Check(!isolate.Invoke<TinymoeObject::Ptr>("standard_library::raise_$expression", string("raised by the script")), "raise without try");
+
+	// an exception thrown by a host function goes through the script to the host
+	TinymoeEmbeddedProgram<TinymoeProgram> failingProgram;
+	failingProgram.RegisterFunction("Print", [](TinymoeArgumentSpan arguments) -> TinymoeObject::Ptr
+	{
+		throw TinymoeException("Print is not available.");
+	});
+	TinymoeEmbeddedIsolate<TinymoeProgram> failingIsolate(failingProgram);
+	CheckThrows([&]() { failingIsolate.Invoke<TinymoeObject::Ptr>("hello_world::main"); }, "Print is not available.");
+
+	// the isolate is still usable after errors
+	Check(isolate.Invoke<int>("hello_world::sum_from_$expression_to_$primitive", 1, 10) == 55, "sum from 1 to 10 after errors");
+
+	if (failures == 0)
+	{
+		cout << "Passed." << endl;
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+#ifndef VCZH_NATIVE_TINYMOEEMBEDDING
+#define VCZH_NATIVE_TINYMOEEMBEDDING
+
+#include "TinymoeObject.h"
+#include <atomic>
+
+namespace tinymoe
+{
+	namespace native
+	{
+		/*************************************************************
+		Host Functions
+		*************************************************************/
+
+		template<int ...I>
+		struct TinymoeIndexes
+		{
+		};
+
+		template<int N, int ...I>
+		struct TinymoeMakeIndexes : TinymoeMakeIndexes<N - 1, N - 1, I...>
+		{
+		};
+
+		template<int ...I>
+		struct TinymoeMakeIndexes<0, I...>
+		{
+			typedef TinymoeIndexes<I...>				Type;
+		};
+
+		template<typename R>
+		struct TinymoeHostCall
+		{
+			template<typename TFunction, typename ...TArgs>
+			static TinymoeObject::Ptr Call(const TFunction& function, TArgs&& ...arguments)
+			{
+				return TinymoeValue<typename decay<R>::type>::To(function(forward<TArgs>(arguments)...));
+			}
+		};
+
+		template<>
+		struct TinymoeHostCall<void>
+		{
+			template<typename TFunction, typename ...TArgs>
+			static TinymoeObject::Ptr Call(const TFunction& function, TArgs&& ...arguments)
+			{
+				function(forward<TArgs>(arguments)...);
+				return nullptr;
+			}
+		};
+
+		/*************************************************************
+		Embedded Program
+		*************************************************************/
+
+		template<typename TProgram>
+		class TinymoeEmbeddedIsolate;
+
+		// a program compiled into TProgram and the host functions its "redirect to" names are bound to,
+		// functions are registered before the first isolate is created, after that it is immutable and shared by every thread
+		template<typename TProgram>
+		class TinymoeEmbeddedProgram
+		{
+			friend class TinymoeEmbeddedIsolate<TProgram>;
+		private:
+			map<string, TinymoeDirectExternalFunction>	hostFunctions;
+			atomic<bool>								frozen{ false };
+
+			template<typename R, typename ...A, int ...I>
+			static TinymoeDirectExternalFunction BuildHostFunction(const function<R(A...)>& function, TinymoeIndexes<I...>)
+			{
+				return [=](TinymoeArgumentSpan arguments)
+				{
+					if (arguments.size() != sizeof...(A))
+					{
+						throw TinymoeException("A host function is called with a wrong number of arguments.");
+					}
+					return TinymoeHostCall<R>::Call(function, TinymoeValue<typename decay<A>::type>::From(arguments[I])...);
+				};
+			}
+
+		public:
+			TinymoeEmbeddedProgram()
+			{
+			}
+
+			TinymoeEmbeddedProgram(const TinymoeEmbeddedProgram<TProgram>&) = delete;
+
+			void RegisterFunction(const string& name, const TinymoeDirectExternalFunction& function)
+			{
+				if (frozen)
+				{
+					throw TinymoeException("Host functions cannot be registered after an isolate is created.");
+				}
+				hostFunctions[name] = function;
+			}
+
+			// arguments and the result are converted by TinymoeValue, so they can be int, double, bool, string or TinymoeObject::Ptr
+			template<typename R, typename ...A>
+			void RegisterFunction(const string& name, const function<R(A...)>& function)
+			{
+				RegisterFunction(name, BuildHostFunction(function, typename TinymoeMakeIndexes<sizeof...(A)>::Type()));
+			}
+
+			template<typename R, typename ...A>
+			void RegisterFunction(const string& name, R(*function)(A...))
+			{
+				RegisterFunction(name, std::function<R(A...)>(function));
+			}
+		};
+
+		/*************************************************************
+		Embedded Isolate
+		*************************************************************/
+
+		// an instance of the program with its own heap, it is used by one thread at a time and instances run in parallel,
+		// creating one is cheap because program layouts are shared and dispatch targets are created on demand
+		template<typename TProgram>
+		class TinymoeEmbeddedIsolate
+		{
+		private:
+			// declared first so that handles below are unlinked before it goes away
+			TinymoeIsolate								isolate;
+			unique_ptr<TProgram>						program;
+			map<int, TinymoeObject::Ptr>				functions;
+
+			TinymoeObject::Ptr GetFunction(const string& name, size_t argumentCount)
+			{
+				auto& table = TProgram::GetFunctionTable();
+				auto it = table.find(name);
+				if (it == table.end())
+				{
+					throw TinymoeException("Function \"" + name + "\" does not exist.");
+				}
+				// the state and the continuation are added by Invoke
+				if ((size_t)it->second.second != argumentCount + 2)
+				{
+					throw TinymoeException("Function \"" + name + "\" takes " + to_string(it->second.second - 2) + " arguments.");
+				}
+
+				auto itFunction = functions.find(it->second.first);
+				if (itFunction == functions.end())
+				{
+					itFunction = functions.insert(make_pair(it->second.first, program->NewFunctionValue(it->second.first))).first;
+				}
+				return itFunction->second;
+			}
+
+		public:
+			TinymoeEmbeddedIsolate(TinymoeEmbeddedProgram<TProgram>& _program)
+			{
+				_program.frozen = true;
+				isolate.hostFunctions = &_program.hostFunctions;
+				TinymoeIsolateScope scope(&isolate);
+				program.reset(new TProgram);
+			}
+
+			TinymoeEmbeddedIsolate(const TinymoeEmbeddedIsolate<TProgram>&) = delete;
+
+			// calls a function by the name printed in the AST, like "unit_test::main", and runs until the script finishes,
+			// asynchronous external functions are waited for, a raised exception that is not trapped is thrown as TinymoeException
+			TinymoeObject::Ptr Invoke(const string& name, const TinymoeArguments& arguments)
+			{
+				TinymoeIsolateScope scope(&isolate);
+				auto function = GetFunction(name, arguments.size());
+
+				TinymoeObject::Ptr result;
+				auto resultSlot = &result;
+				TinymoeObject::Ptr continuation = NewFunction([=](TinymoeArgumentSpan values)
+				{
+					*resultSlot = values[1];
+					return TinymoeContinuation();
+				});
+
+				TinymoeArguments values;
+				values.push_back(program->NewState(continuation));
+				values.insert(values.end(), arguments.begin(), arguments.end());
+				values.push_back(continuation);
+				TinymoeOperations::RunContinuation(TinymoeOperations::Invoke(function, values));
+				return result;
+			}
+
+			// arguments and the result are converted by TinymoeValue, a TinymoeObject::Ptr result belongs to this isolate
+			template<typename R, typename ...A>
+			R Invoke(const string& name, const A& ...arguments)
+			{
+				TinymoeIsolateScope scope(&isolate);
+				auto result = Invoke(name, TinymoeArguments{ TinymoeValue<A>::To(arguments)... });
+				return TinymoeValue<R>::From(result);
+			}
+
+			// handles created by the callback belong to this isolate
+			template<typename TCallback>
+			void Enter(const TCallback& callback)
+			{
+				TinymoeIsolateScope scope(&isolate);
+				callback();
+			}
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef VCZH_NATIVE_TINYMOEEVENTLOOP
+#define VCZH_NATIVE_TINYMOEEVENTLOOP
+
+#include <cerrno>
+#include <deque>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace tinymoe
+{
+	namespace native
+	{
+		using namespace std;
+
+		/*************************************************************
+		Event Loop
+		*************************************************************/
+
+		// waits for file descriptors with epoll, a watch fires once and is removed before its callback runs
+		class TinymoeEventLoop
+		{
+		public:
+			typedef function<void()>					Callback;
+
+		private:
+			static const int							MaxEvents = 64;
+
+			int											epoll = -1;
+			map<int, Callback>							watches;
+			deque<Callback>								posted;
+
+		public:
+			TinymoeEventLoop()
+			{
+			}
+
+			TinymoeEventLoop(const TinymoeEventLoop&) = delete;
+
+			~TinymoeEventLoop()
+			{
+				if (epoll != -1)
+				{
+					close(epoll);
+				}
+			}
+
+			bool IsEmpty()const
+			{
+				return watches.size() == 0 && posted.size() == 0;
+			}
+
+			// the callback runs in the next Poll, for operations that never wait, like reading a regular file
+			void Post(const Callback& callback)
+			{
+				posted.push_back(callback);
+			}
+
+			// returns false if epoll cannot wait for this kind of file, regular files are always ready and should be posted instead
+			bool Watch(int fd, bool write, const Callback& callback)
+			{
+				if (epoll == -1)
+				{
+					epoll = epoll_create1(EPOLL_CLOEXEC);
+					if (epoll == -1)
+					{
+						throw runtime_error("Failed to create an epoll instance.");
+					}
+				}
+
+				epoll_event event = {};
+				event.events = (write ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+				event.data.fd = fd;
+				if (epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) == -1)
+				{
+					if (errno == EPERM)
+					{
+						return false;
+					}
+					throw runtime_error("Failed to watch a file descriptor.");
+				}
+				watches[fd] = callback;
+				return true;
+			}
+
+			// runs posted callbacks if there are any, otherwise waits at most timeout milliseconds (-1 means forever) for watched files
+			int Poll(int timeout)
+			{
+				if (posted.size() > 0)
+				{
+					deque<Callback> callbacks;
+					callbacks.swap(posted);
+					for (auto& callback : callbacks)
+					{
+						callback();
+					}
+					return (int)callbacks.size();
+				}
+				if (watches.size() == 0)
+				{
+					return 0;
+				}
+
+				epoll_event events[MaxEvents];
+				int count = epoll_wait(epoll, events, MaxEvents, timeout);
+				if (count == -1)
+				{
+					if (errno == EINTR)
+					{
+						return 0;
+					}
+					throw runtime_error("Failed to wait for file descriptors.");
+				}
+				for (int i = 0; i < count; i++)
+				{
+					auto it = watches.find(events[i].data.fd);
+					if (it != watches.end())
+					{
+						auto callback = move(it->second);
+						watches.erase(it);
+						epoll_ctl(epoll, EPOLL_CTL_DEL, events[i].data.fd, nullptr);
+						callback();
+					}
+				}
+				return count;
+			}
+		};
+	}
+}
+
+#endif
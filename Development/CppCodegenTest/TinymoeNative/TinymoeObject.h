@@ -0,0 +1,3200 @@
+#ifndef VCZH_NATIVE_TINYMOEOBJECT
+#define VCZH_NATIVE_TINYMOEOBJECT
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include "TinymoeEventLoop.h"
+
+namespace tinymoe
+{
+	namespace native
+	{
+		using namespace std;
+
+		class TinymoeObject;
+		class TinymoeType;
+		class TinymoeThunk;
+
+		template<typename T>
+		class TinymoeHandle;
+
+		class TinymoeArgumentSpan;
+
+		typedef shared_ptr<TinymoeThunk>					TinymoeContinuation;
+		typedef vector<TinymoeHandle<TinymoeObject>>		TinymoeArguments;
+		typedef function<TinymoeHandle<TinymoeObject>(TinymoeArgumentSpan)>	TinymoeDirectExternalFunction;
+
+		class TinymoeException : public runtime_error
+		{
+		public:
+			TinymoeException(const string& message)
+				:runtime_error(message)
+			{
+			}
+		};
+
+		/*************************************************************
+		Closure Memory
+		*************************************************************/
+
+		// closures and thunks are created and released at the rate of calls, and a minor collection releases most closures at once,
+		// so released blocks are kept in a free list of the thread by size instead of going back to malloc
+		class TinymoeClosurePool
+		{
+		public:
+			static const size_t							Granularity = 16;
+			static const size_t							MaxPooledSize = 1024;
+
+		private:
+			struct Block
+			{
+				Block*									next;
+			};
+
+			// trivially destructible, so it is still usable while other thread locals are destroyed
+			struct Lists
+			{
+				Block*									free[MaxPooledSize / Granularity];
+				bool									drained;
+			};
+
+			// gives the blocks back to malloc when the thread exits, blocks released after that are deleted directly
+			class Drain
+			{
+			public:
+				~Drain()
+				{
+					auto& lists = GetLists();
+					for (auto& list : lists.free)
+					{
+						while (auto block = list)
+						{
+							list = block->next;
+							::operator delete(block);
+						}
+					}
+					lists.drained = true;
+				}
+			};
+
+			static Lists& GetLists()
+			{
+				static thread_local Lists lists = {};
+				return lists;
+			}
+
+		public:
+			static void* Allocate(size_t size)
+			{
+				if (size > MaxPooledSize)
+				{
+					return ::operator new(size);
+				}
+				auto& list = GetLists().free[(size - 1) / Granularity];
+				if (auto block = list)
+				{
+					list = block->next;
+					return block;
+				}
+				return ::operator new((size + Granularity - 1) / Granularity * Granularity);
+			}
+
+			static void Free(void* memory, size_t size)
+			{
+				auto& lists = GetLists();
+				if (size > MaxPooledSize || lists.drained)
+				{
+					::operator delete(memory);
+					return;
+				}
+				static thread_local Drain drain;
+				auto block = static_cast<Block*>(memory);
+				auto& list = lists.free[(size - 1) / Granularity];
+				block->next = list;
+				list = block;
+			}
+		};
+
+		template<typename T>
+		class TinymoeClosureAllocator
+		{
+		public:
+			typedef T									value_type;
+
+			TinymoeClosureAllocator()
+			{
+			}
+
+			template<typename U>
+			TinymoeClosureAllocator(const TinymoeClosureAllocator<U>&)
+			{
+			}
+
+			T* allocate(size_t count)
+			{
+				return static_cast<T*>(TinymoeClosurePool::Allocate(count * sizeof(T)));
+			}
+
+			void deallocate(T* memory, size_t count)
+			{
+				TinymoeClosurePool::Free(memory, count * sizeof(T));
+			}
+
+			template<typename U>
+			bool operator==(const TinymoeClosureAllocator<U>&)const
+			{
+				return true;
+			}
+
+			template<typename U>
+			bool operator!=(const TinymoeClosureAllocator<U>&)const
+			{
+				return false;
+			}
+		};
+
+		/*************************************************************
+		Continuation
+		*************************************************************/
+
+		class TinymoeThunk
+		{
+		public:
+			virtual ~TinymoeThunk()
+			{
+			}
+
+			virtual TinymoeContinuation					Run() = 0;
+		};
+
+		template<typename F>
+		class TinymoeLambdaThunk : public TinymoeThunk
+		{
+		private:
+			F											function;
+
+		public:
+			TinymoeLambdaThunk(const F& _function)
+				:function(_function)
+			{
+			}
+
+			TinymoeContinuation Run()override
+			{
+				return function();
+			}
+		};
+
+		template<typename F>
+		TinymoeContinuation MakeContinuation(const F& function)
+		{
+			return allocate_shared<TinymoeLambdaThunk<F>>(TinymoeClosureAllocator<TinymoeLambdaThunk<F>>(), function);
+		}
+
+		// counts tail calls that are running directly on the C++ stack of the current thread
+		class TinymoeTailCallScope
+		{
+		public:
+			static const int							MaxDepth = 32;
+
+			static int& Depth()
+			{
+				static thread_local int depth = 0;
+				return depth;
+			}
+
+			TinymoeTailCallScope()
+			{
+				Depth()++;
+			}
+
+			~TinymoeTailCallScope()
+			{
+				Depth()--;
+			}
+		};
+
+		// a tail call runs directly until the stack is MaxDepth calls deep, then it is returned to the trampoline,
+		// so most calls do not allocate a thunk, and a scheduler slice may run up to MaxDepth calls in one step
+		template<typename F>
+		TinymoeContinuation TailCall(const F& function)
+		{
+			if (TinymoeTailCallScope::Depth() < TinymoeTailCallScope::MaxDepth)
+			{
+				TinymoeTailCallScope scope;
+				return function();
+			}
+			return MakeContinuation(function);
+		}
+
+		/*************************************************************
+		Handle
+		*************************************************************/
+
+		class TinymoeHandleBase;
+
+		// an intrusive list of handles, the collector reads and updates every handle in a list
+		class TinymoeHandleList
+		{
+		public:
+			TinymoeHandleBase*							first;
+
+			// handles on the C++ stack, in thunks, and in runtime tables, every isolate has its own roots
+			static TinymoeHandleList*					Roots();
+
+			// handles inside a heap object, they are reached by TinymoeObject::Trace instead of a list
+			static TinymoeHandleList* Embedded()
+			{
+				static TinymoeHandleList embedded = { nullptr };
+				return &embedded;
+			}
+
+			static TinymoeHandleList*& Current()
+			{
+				static thread_local TinymoeHandleList* current = nullptr;
+				return current;
+			}
+		};
+
+		// handles created while a scope is alive are put in the scope's list instead of the roots
+		class TinymoeHandleScope
+		{
+		private:
+			TinymoeHandleList*							previous;
+
+		public:
+			TinymoeHandleScope(TinymoeHandleList* list)
+				:previous(TinymoeHandleList::Current())
+			{
+				TinymoeHandleList::Current() = list;
+			}
+
+			~TinymoeHandleScope()
+			{
+				TinymoeHandleList::Current() = previous;
+			}
+		};
+
+		// the only kind of reference to a heap object that may live across an allocation, the collector moves objects and fixes handles
+		class TinymoeHandleBase
+		{
+			friend class TinymoeHeap;
+			friend class TinymoeFunction;
+		protected:
+			// handles in the array behind an initializer list are const, the collector and the list still update them
+			mutable TinymoeObject*						object;
+			mutable TinymoeHandleBase**					link = nullptr;
+			mutable TinymoeHandleBase*					next = nullptr;
+
+			TinymoeHandleBase(TinymoeObject* _object)
+				:object(_object)
+			{
+				auto list = TinymoeHandleList::Current();
+				if (!list)
+				{
+					list = TinymoeHandleList::Roots();
+				}
+				if (list != TinymoeHandleList::Embedded())
+				{
+					link = &list->first;
+					next = list->first;
+					if (next)
+					{
+						next->link = &next;
+					}
+					list->first = this;
+				}
+			}
+
+			~TinymoeHandleBase()
+			{
+				if (link)
+				{
+					*link = next;
+					if (next)
+					{
+						next->link = link;
+					}
+				}
+			}
+
+		public:
+			TinymoeObject* GetObject()const
+			{
+				return object;
+			}
+
+			explicit operator bool()const
+			{
+				return object != nullptr;
+			}
+		};
+
+		template<typename T>
+		class TinymoeHandle : public TinymoeHandleBase
+		{
+		public:
+			TinymoeHandle()
+				:TinymoeHandleBase(nullptr)
+			{
+			}
+
+			TinymoeHandle(nullptr_t)
+				:TinymoeHandleBase(nullptr)
+			{
+			}
+
+			explicit TinymoeHandle(T* _object)
+				:TinymoeHandleBase(_object)
+			{
+			}
+
+			TinymoeHandle(const TinymoeHandle<T>& handle)
+				:TinymoeHandleBase(handle.object)
+			{
+			}
+
+			template<typename U, typename = typename enable_if<is_convertible<U*, T*>::value>::type>
+			TinymoeHandle(const TinymoeHandle<U>& handle)
+				:TinymoeHandleBase(handle.GetObject())
+			{
+			}
+
+			// assignment only changes the target, the handle stays in the list it was created in
+			TinymoeHandle<T>& operator=(const TinymoeHandle<T>& handle)
+			{
+				object = handle.object;
+				return *this;
+			}
+
+			template<typename U, typename = typename enable_if<is_convertible<U*, T*>::value>::type>
+			TinymoeHandle<T>& operator=(const TinymoeHandle<U>& handle)
+			{
+				object = handle.GetObject();
+				return *this;
+			}
+
+			T* get()const
+			{
+				return static_cast<T*>(object);
+			}
+
+			T* operator->()const
+			{
+				return static_cast<T*>(object);
+			}
+		};
+
+		inline bool operator==(const TinymoeHandleBase& a, const TinymoeHandleBase& b)
+		{
+			return a.GetObject() == b.GetObject();
+		}
+
+		inline bool operator!=(const TinymoeHandleBase& a, const TinymoeHandleBase& b)
+		{
+			return a.GetObject() != b.GetObject();
+		}
+
+		// arguments of a call that are owned by the caller, usually the array behind an initializer list, so passing them does not allocate
+		class TinymoeArgumentSpan
+		{
+		private:
+			const TinymoeHandle<TinymoeObject>*			first = nullptr;
+			size_t										count = 0;
+
+		public:
+			TinymoeArgumentSpan()
+			{
+			}
+
+			TinymoeArgumentSpan(const TinymoeHandle<TinymoeObject>* _first, size_t _count)
+				:first(_first)
+				, count(_count)
+			{
+			}
+
+			// the array behind the initializer list lives until the end of the full expression that makes the call
+			// a span is only used as a parameter, so it never outlives the array
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winit-list-lifetime"
+#endif
+			TinymoeArgumentSpan(initializer_list<TinymoeHandle<TinymoeObject>> arguments)
+				:first(arguments.begin())
+				, count(arguments.size())
+			{
+			}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+			TinymoeArgumentSpan(const TinymoeArguments& arguments)
+				:first(arguments.data())
+				, count(arguments.size())
+			{
+			}
+
+			size_t size()const
+			{
+				return count;
+			}
+
+			const TinymoeHandle<TinymoeObject>* begin()const
+			{
+				return first;
+			}
+
+			const TinymoeHandle<TinymoeObject>* end()const
+			{
+				return first + count;
+			}
+
+			const TinymoeHandle<TinymoeObject>& operator[](size_t index)const
+			{
+				return first[index];
+			}
+
+			const TinymoeHandle<TinymoeObject>& at(size_t index)const
+			{
+				if (index >= count)
+				{
+					throw out_of_range("An argument does not exist.");
+				}
+				return first[index];
+			}
+
+			const TinymoeHandle<TinymoeObject>& front()const
+			{
+				return first[0];
+			}
+
+			const TinymoeHandle<TinymoeObject>& back()const
+			{
+				return first[count - 1];
+			}
+		};
+
+		class TinymoeTracer
+		{
+		public:
+			virtual void								Visit(TinymoeHandleBase& handle) = 0;
+		};
+
+		/*************************************************************
+		Object
+		*************************************************************/
+
+		// declares the runtime type of a struct, fields are listed by TINYMOE_FIELD
+#define TINYMOE_TYPE(NAME, BASE, ...)\
+			static TinymoeType* Type()\
+			{\
+				static TinymoeType type(#NAME, BASE::Type(), { __VA_ARGS__ });\
+				return &type;\
+			}\
+			TinymoeType* GetType()override\
+			{\
+				return Type();\
+			}\
+			TinymoeObject* Relocate(void* memory)override\
+			{\
+				return new(memory) NAME(*this);\
+			}\
+
+#define TINYMOE_FIELD(NAME, FIELD) make_pair(string(#FIELD), static_cast<TinymoeObject::Field>(&NAME::FIELD))
+
+		class TinymoeObject
+		{
+			friend class TinymoeHeap;
+		public:
+			typedef TinymoeHandle<TinymoeObject>		Ptr;
+			typedef Ptr TinymoeObject::*				Field;
+
+		private:
+			static const uint8_t						GCOld = 1;
+			static const uint8_t						GCMarked = 2;
+			static const uint8_t						GCRemembered = 4;
+			static const uint8_t						GCArena = 8;
+			static const uint8_t						GCArenaOwner = 16;
+
+			TinymoeObject*								gcForward = nullptr;
+			uint32_t									gcSize = 0;
+			uint8_t										gcFlags = 0;
+
+		public:
+			TinymoeObject()
+			{
+			}
+
+			// a copy is a new object for the collector
+			TinymoeObject(const TinymoeObject&)
+			{
+			}
+
+			virtual ~TinymoeObject()
+			{
+			}
+
+			static TinymoeType*							Type();
+			virtual TinymoeType*						GetType();
+			virtual void								Trace(TinymoeTracer& tracer);
+			void										SetField(const string& name, const Ptr& value);
+
+			virtual TinymoeObject* Relocate(void* memory)
+			{
+				return new(memory) TinymoeObject(*this);
+			}
+		};
+
+		class TinymoeType
+		{
+		public:
+			typedef vector<pair<string, TinymoeObject::Field>>		FieldList;
+
+			string										name;
+			TinymoeType*								baseType;
+			FieldList									fields;			// fields of base types come first
+
+			TinymoeType(const string& _name, TinymoeType* _baseType, initializer_list<FieldList::value_type> _fields = {})
+				:name(_name)
+				, baseType(_baseType)
+			{
+				if (baseType)
+				{
+					fields = baseType->fields;
+				}
+				fields.insert(fields.end(), _fields.begin(), _fields.end());
+			}
+
+			int GetSlot(const string& fieldName)
+			{
+				for (int i = 0; (size_t)i < fields.size(); i++)
+				{
+					if (fields[i].first == fieldName)
+					{
+						return i;
+					}
+				}
+				return -1;
+			}
+
+			bool IsSubtypeOf(TinymoeType* type)
+			{
+				for (auto current = this; current; current = current->baseType)
+				{
+					if (current == type) return true;
+				}
+				return false;
+			}
+		};
+
+		inline TinymoeType* TinymoeObject::Type()
+		{
+			static TinymoeType type("TinymoeObject", nullptr);
+			return &type;
+		}
+
+		inline TinymoeType* TinymoeObject::GetType()
+		{
+			return Type();
+		}
+
+		inline void TinymoeObject::Trace(TinymoeTracer& tracer)
+		{
+			for (auto& field : GetType()->fields)
+			{
+				tracer.Visit(this->*field.second);
+			}
+		}
+
+		/*************************************************************
+		Heap
+		*************************************************************/
+
+		class TinymoeHeapStatistics
+		{
+		public:
+			uint64_t									minorCollections = 0;
+			uint64_t									majorCollections = 0;
+			uint64_t									allocatedBytes = 0;
+			uint64_t									promotedBytes = 0;
+			uint64_t									freedBytes = 0;
+			uint64_t									arenaRuns = 0;
+			uint64_t									arenaBytes = 0;
+			uint64_t									escapedBytes = 0;
+			chrono::nanoseconds							totalPause = chrono::nanoseconds::zero();
+			chrono::nanoseconds							maxPause = chrono::nanoseconds::zero();
+			chrono::steady_clock::time_point			startTime = chrono::steady_clock::now();
+		};
+
+		// a region that serves every allocation of one run, it is freed as a whole when the run finishes
+		class TinymoeArena
+		{
+			friend class TinymoeHeap;
+		private:
+			static const size_t							ChunkSize = 64 << 10;
+
+			vector<pair<char*, size_t>>					chunks;
+			size_t										chunkIndex = 0;
+			size_t										chunkUsed = 0;
+			vector<TinymoeObject*>						objects;
+
+			void* Allocate(size_t size)
+			{
+				while (chunkIndex < chunks.size() && chunkUsed + size > chunks[chunkIndex].second)
+				{
+					chunkIndex++;
+					chunkUsed = 0;
+				}
+				if (chunkIndex == chunks.size())
+				{
+					size_t chunkSize = size > ChunkSize ? size : ChunkSize;
+					chunks.push_back(make_pair((char*)::operator new(chunkSize), chunkSize));
+				}
+				void* memory = chunks[chunkIndex].first + chunkUsed;
+				chunkUsed += size;
+				return memory;
+			}
+
+			// chunks are kept for the next run
+			void Reset()
+			{
+				for (auto object : objects)
+				{
+					object->~TinymoeObject();
+				}
+				objects.clear();
+				chunkIndex = 0;
+				chunkUsed = 0;
+			}
+
+		public:
+			TinymoeArena()
+			{
+			}
+
+			TinymoeArena(const TinymoeArena&) = delete;
+
+			~TinymoeArena()
+			{
+				Reset();
+				for (auto chunk : chunks)
+				{
+					::operator delete(chunk.first);
+				}
+			}
+		};
+
+		// new objects are bump allocated in the nursery, survivors of a minor collection are copied to the old generation,
+		// and the old generation is collected by mark-sweep when it doubles since the last major collection
+		class TinymoeHeap
+		{
+		private:
+			static const size_t							Alignment = 16;
+			static const size_t							DefaultNurserySize = 4 << 20;
+			static const size_t							MinimumOldThreshold = 16 << 20;
+
+			class Promoter : public TinymoeTracer
+			{
+			public:
+				TinymoeHeap*							heap;
+				vector<TinymoeObject*>					worklist;
+
+				void Visit(TinymoeHandleBase& handle)override
+				{
+					handle.object = heap->Promote(handle.object, worklist);
+				}
+			};
+
+			class Marker : public TinymoeTracer
+			{
+			public:
+				vector<TinymoeObject*>					worklist;
+
+				void Visit(TinymoeHandleBase& handle)override
+				{
+					auto object = handle.object;
+					if (object && !(object->gcFlags & TinymoeObject::GCMarked))
+					{
+						object->gcFlags |= TinymoeObject::GCMarked;
+						worklist.push_back(object);
+					}
+				}
+			};
+
+			unique_ptr<char[]>							nursery;			// not zero filled, so untouched pages of a new isolate are never committed
+			size_t										nurserySize = 0;
+			size_t										nurseryUsed = 0;
+			vector<TinymoeObject*>						nurseryObjects;
+			vector<TinymoeObject*>						oldObjects;
+			vector<TinymoeObject*>						rememberedSet;
+			TinymoeArena*								arena = nullptr;
+			vector<TinymoeObject*>						arenaOwners;
+			size_t										oldBytes = 0;
+			size_t										oldMinimum = MinimumOldThreshold;
+			size_t										oldThreshold = MinimumOldThreshold;
+
+			static size_t Align(size_t size)
+			{
+				return (size + Alignment - 1) & ~(Alignment - 1);
+			}
+
+			static void VisitList(TinymoeHandleList* list, TinymoeTracer& tracer)
+			{
+				for (auto handle = list->first; handle; handle = handle->next)
+				{
+					tracer.Visit(*handle);
+				}
+			}
+
+			class Evacuator : public TinymoeTracer
+			{
+			public:
+				TinymoeHeap*							heap;
+				vector<TinymoeObject*>					worklist;
+
+				void Visit(TinymoeHandleBase& handle)override
+				{
+					handle.object = heap->Evacuate(handle.object, worklist);
+				}
+			};
+
+			bool InNursery(TinymoeObject* object)
+			{
+				return object && !(object->gcFlags & (TinymoeObject::GCOld | TinymoeObject::GCArena));
+			}
+
+			bool InArena(TinymoeObject* object)
+			{
+				return object && (object->gcFlags & TinymoeObject::GCArena);
+			}
+
+			TinymoeObject* CopyToOld(TinymoeObject* object, vector<TinymoeObject*>& worklist)
+			{
+				if (!object->gcForward)
+				{
+					auto size = object->gcSize;
+					TinymoeObject* copy = nullptr;
+					{
+						TinymoeHandleScope scope(TinymoeHandleList::Embedded());
+						copy = object->Relocate(::operator new(size));
+					}
+					RegisterOld(copy, size);
+					object->gcForward = copy;
+					worklist.push_back(copy);
+				}
+				return object->gcForward;
+			}
+
+			TinymoeObject* Promote(TinymoeObject* object, vector<TinymoeObject*>& worklist)
+			{
+				if (!InNursery(object))
+				{
+					return object;
+				}
+				if (!object->gcForward)
+				{
+					statistics.promotedBytes += object->gcSize;
+				}
+				return CopyToOld(object, worklist);
+			}
+
+			TinymoeObject* Evacuate(TinymoeObject* object, vector<TinymoeObject*>& worklist)
+			{
+				if (!InArena(object))
+				{
+					return object;
+				}
+				if (!object->gcForward)
+				{
+					statistics.escapedBytes += object->gcSize;
+					auto copy = CopyToOld(object, worklist);
+					// the copy may point to the nursery like any other object written after its promotion
+					copy->gcFlags |= TinymoeObject::GCRemembered;
+					rememberedSet.push_back(copy);
+				}
+				return object->gcForward;
+			}
+
+			void RegisterOld(TinymoeObject* object, size_t size)
+			{
+				object->gcSize = (uint32_t)size;
+				object->gcFlags = TinymoeObject::GCOld;
+				oldObjects.push_back(object);
+				oldBytes += size;
+			}
+
+			void Pause(chrono::steady_clock::time_point start)
+			{
+				auto pause = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+				statistics.totalPause += pause;
+				statistics.maxPause = max(statistics.maxPause, pause);
+			}
+
+		public:
+			TinymoeHeapStatistics						statistics;
+
+			TinymoeHeap()
+			{
+				size_t size = DefaultNurserySize;
+				if (auto value = getenv("TINYMOE_NURSERY_SIZE"))
+				{
+					size = (size_t)strtoul(value, nullptr, 10);
+				}
+				nurserySize = Align(size > Alignment ? size : Alignment);
+				nursery.reset(new char[nurserySize]);
+				if (auto value = getenv("TINYMOE_OLD_GENERATION_SIZE"))
+				{
+					oldMinimum = oldThreshold = (size_t)strtoul(value, nullptr, 10);
+				}
+			}
+
+			TinymoeHeap(const TinymoeHeap&) = delete;
+
+			// only heaps of finished isolates are destroyed, the default isolate lives until exit
+			~TinymoeHeap()
+			{
+				for (auto object : nurseryObjects)
+				{
+					object->~TinymoeObject();
+				}
+				for (auto object : oldObjects)
+				{
+					object->~TinymoeObject();
+					::operator delete(object);
+				}
+			}
+
+			static TinymoeHeap&							Current();
+
+			template<typename T, typename ...TArgs>
+			TinymoeHandle<T> New(TArgs ...arguments)
+			{
+				size_t size = Align(sizeof(T));
+				if (arena)
+				{
+					T* object = nullptr;
+					{
+						TinymoeHandleScope scope(TinymoeHandleList::Embedded());
+						object = new(arena->Allocate(size)) T(arguments...);
+					}
+					object->gcSize = (uint32_t)size;
+					object->gcFlags = TinymoeObject::GCArena;
+					arena->objects.push_back(object);
+					statistics.arenaBytes += size;
+					return TinymoeHandle<T>(object);
+				}
+
+				bool old = size > nurserySize / 4;
+				if (old && oldBytes + size > oldThreshold)
+				{
+					CollectMajor();
+				}
+				else if (!old && nurseryUsed + size > nurserySize)
+				{
+					CollectMinor();
+					if (oldBytes > oldThreshold)
+					{
+						CollectMajor();
+					}
+				}
+
+				void* memory = old ? ::operator new(size) : nursery.get() + nurseryUsed;
+				T* object = nullptr;
+				{
+					TinymoeHandleScope scope(TinymoeHandleList::Embedded());
+					object = new(memory) T(arguments...);
+				}
+
+				statistics.allocatedBytes += size;
+				if (old)
+				{
+					// fields initialized by the constructor may point to the nursery without passing the write barrier
+					RegisterOld(object, size);
+					object->gcFlags |= TinymoeObject::GCRemembered;
+					rememberedSet.push_back(object);
+				}
+				else
+				{
+					object->gcSize = (uint32_t)size;
+					nurseryUsed += size;
+					nurseryObjects.push_back(object);
+				}
+				return TinymoeHandle<T>(object);
+			}
+
+			// must be called after storing a handle in an existing object, an old object pointing to the nursery becomes a root of minor collections
+			void WriteBarrier(TinymoeObject* owner, const TinymoeHandleBase& value)
+			{
+				if (InArena(value.object) && !(owner->gcFlags & (TinymoeObject::GCArena | TinymoeObject::GCArenaOwner)))
+				{
+					// an object outside of the arena keeps an arena object alive after the run
+					owner->gcFlags |= TinymoeObject::GCArenaOwner;
+					arenaOwners.push_back(owner);
+					return;
+				}
+				if ((owner->gcFlags & (TinymoeObject::GCOld | TinymoeObject::GCRemembered)) == TinymoeObject::GCOld && InNursery(value.object))
+				{
+					owner->gcFlags |= TinymoeObject::GCRemembered;
+					rememberedSet.push_back(owner);
+				}
+			}
+
+			// allocations go to the arena until LeaveArena, and no collection happens in between
+			void EnterArena(TinymoeArena* _arena)
+			{
+				if (arena)
+				{
+					throw TinymoeException("An arena is already in use.");
+				}
+				arena = _arena;
+				statistics.arenaRuns++;
+			}
+
+			// arena objects that are still referenced by roots or by objects outside of the arena escape to the old generation
+			void LeaveArena()
+			{
+				Evacuator evacuator;
+				evacuator.heap = this;
+				VisitList(TinymoeHandleList::Roots(), evacuator);
+				for (auto object : arenaOwners)
+				{
+					object->gcFlags &= ~TinymoeObject::GCArenaOwner;
+					object->Trace(evacuator);
+				}
+				while (evacuator.worklist.size() > 0)
+				{
+					auto object = evacuator.worklist.back();
+					evacuator.worklist.pop_back();
+					object->Trace(evacuator);
+				}
+				arenaOwners.clear();
+				arena->Reset();
+				arena = nullptr;
+			}
+
+			void CollectMinor()
+			{
+				if (arena) return;
+				auto start = chrono::steady_clock::now();
+				Promoter promoter;
+				promoter.heap = this;
+				VisitList(TinymoeHandleList::Roots(), promoter);
+				for (auto object : rememberedSet)
+				{
+					object->gcFlags &= ~TinymoeObject::GCRemembered;
+					object->Trace(promoter);
+				}
+				while (promoter.worklist.size() > 0)
+				{
+					auto object = promoter.worklist.back();
+					promoter.worklist.pop_back();
+					object->Trace(promoter);
+				}
+
+				for (auto object : nurseryObjects)
+				{
+					if (!object->gcForward)
+					{
+						statistics.freedBytes += object->gcSize;
+					}
+					object->~TinymoeObject();
+				}
+				nurseryObjects.clear();
+				rememberedSet.clear();
+				nurseryUsed = 0;
+				statistics.minorCollections++;
+				Pause(start);
+			}
+
+			void CollectMajor()
+			{
+				if (arena) return;
+				if (nurseryObjects.size() > 0 || rememberedSet.size() > 0)
+				{
+					CollectMinor();
+				}
+
+				auto start = chrono::steady_clock::now();
+				Marker marker;
+				VisitList(TinymoeHandleList::Roots(), marker);
+				while (marker.worklist.size() > 0)
+				{
+					auto object = marker.worklist.back();
+					marker.worklist.pop_back();
+					object->Trace(marker);
+				}
+
+				size_t live = 0;
+				for (auto object : oldObjects)
+				{
+					if (object->gcFlags & TinymoeObject::GCMarked)
+					{
+						object->gcFlags &= ~TinymoeObject::GCMarked;
+						oldObjects[live++] = object;
+					}
+					else
+					{
+						statistics.freedBytes += object->gcSize;
+						oldBytes -= object->gcSize;
+						object->~TinymoeObject();
+						::operator delete(object);
+					}
+				}
+				oldObjects.resize(live);
+				oldThreshold = oldBytes * 2 > oldMinimum ? oldBytes * 2 : oldMinimum;
+				statistics.majorCollections++;
+				Pause(start);
+			}
+
+			void WriteStatistics(ostream& o)
+			{
+				auto total = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - statistics.startTime);
+				auto milliseconds = [](chrono::nanoseconds time) { return time.count() / 1000000.0; };
+				o << "gc: " << statistics.minorCollections << " minor collections, " << statistics.majorCollections << " major collections" << endl;
+				o << "gc: " << statistics.allocatedBytes << " bytes allocated, " << statistics.promotedBytes << " bytes promoted, " << statistics.freedBytes << " bytes freed" << endl;
+				o << "gc: " << milliseconds(statistics.totalPause) << " ms paused, " << milliseconds(statistics.maxPause) << " ms max pause, "
+					<< (total.count() == 0 ? 100.0 : 100.0 - 100.0 * statistics.totalPause.count() / total.count()) << "% throughput" << endl;
+				if (statistics.arenaRuns > 0)
+				{
+					o << "gc: " << statistics.arenaRuns << " arena runs, " << statistics.arenaBytes << " bytes allocated in arenas, " << statistics.escapedBytes << " bytes escaped" << endl;
+				}
+			}
+		};
+
+		/*************************************************************
+		Isolate
+		*************************************************************/
+
+		class TinymoeFieldSite;
+
+		// everything a program instance owns, isolates never share objects so different threads may run different isolates at the same time
+		class TinymoeIsolate
+		{
+			friend class TinymoeIsolateScope;
+		private:
+			static TinymoeIsolate*& CurrentSlot()
+			{
+				static thread_local TinymoeIsolate* current = nullptr;
+				return current;
+			}
+
+		public:
+			// declared first so that handles in the tables below are unlinked before it goes away
+			TinymoeHandleList							roots = { nullptr };
+			TinymoeHeap									heap;
+			vector<TinymoeFieldSite*>					fieldSites;
+			int											extensionVersion = 0;
+			map<TinymoeType*, map<string, TinymoeObject::Ptr>>	extensions;
+			map<string, TinymoeObject::Ptr>				externalFunctions;
+			const map<string, TinymoeDirectExternalFunction>*	hostFunctions = nullptr;	// registered by an embedding host, shared by isolates of the same program
+			TinymoeEventLoop							eventLoop;
+			deque<TinymoeContinuation>					ready;				// continuations resumed by asynchronous external functions
+			int											suspended = 0;		// asynchronous external functions that have not resumed yet
+
+			TinymoeIsolate()
+			{
+			}
+
+			TinymoeIsolate(const TinymoeIsolate&) = delete;
+
+			// used by threads that have not entered an isolate, it is never destroyed
+			static TinymoeIsolate* Default()
+			{
+				static TinymoeIsolate* isolate = new TinymoeIsolate;
+				return isolate;
+			}
+
+			static TinymoeIsolate* Current()
+			{
+				auto current = CurrentSlot();
+				return current ? current : Default();
+			}
+		};
+
+		// an isolate must not be entered by two threads at the same time
+		class TinymoeIsolateScope
+		{
+		private:
+			TinymoeIsolate*								previous;
+
+		public:
+			TinymoeIsolateScope(TinymoeIsolate* isolate)
+				:previous(TinymoeIsolate::CurrentSlot())
+			{
+				TinymoeIsolate::CurrentSlot() = isolate;
+			}
+
+			TinymoeIsolateScope(const TinymoeIsolateScope&) = delete;
+
+			~TinymoeIsolateScope()
+			{
+				TinymoeIsolate::CurrentSlot() = previous;
+			}
+		};
+
+		inline TinymoeHandleList* TinymoeHandleList::Roots()
+		{
+			return &TinymoeIsolate::Current()->roots;
+		}
+
+		inline TinymoeHeap& TinymoeHeap::Current()
+		{
+			return TinymoeIsolate::Current()->heap;
+		}
+
+		class TinymoeArenaScope
+		{
+		private:
+			bool										entered;
+
+		public:
+			// a null arena leaves allocations in the collected heap
+			TinymoeArenaScope(TinymoeArena* arena)
+				:entered(arena != nullptr)
+			{
+				if (entered)
+				{
+					TinymoeHeap::Current().EnterArena(arena);
+				}
+			}
+
+			TinymoeArenaScope(const TinymoeArenaScope&) = delete;
+
+			~TinymoeArenaScope()
+			{
+				if (entered)
+				{
+					TinymoeHeap::Current().LeaveArena();
+				}
+			}
+		};
+
+		template<typename T, typename ...TArgs>
+		TinymoeHandle<T> New(const TArgs& ...arguments)
+		{
+			return TinymoeHeap::Current().New<T>(arguments...);
+		}
+
+		inline void TinymoeObject::SetField(const string& name, const Ptr& value)
+		{
+			int slot = GetType()->GetSlot(name);
+			if (slot == -1)
+			{
+				throw TinymoeException("Field \"" + name + "\" does not exist.");
+			}
+			this->*(GetType()->fields[slot].second) = value;
+			TinymoeHeap::Current().WriteBarrier(this, value);
+		}
+
+		inline TinymoeType* GetTypeOf(const TinymoeHandleBase& value)
+		{
+			return value ? value.GetObject()->GetType() : TinymoeObject::Type();
+		}
+
+		// the result is only valid until the next allocation
+		template<typename T>
+		T* Cast(const TinymoeHandleBase& value)
+		{
+			auto result = dynamic_cast<T*>(value.GetObject());
+			if (!result)
+			{
+				throw TinymoeException("A value of " + GetTypeOf(value)->name + " cannot be converted to " + T::Type()->name + ".");
+			}
+			return result;
+		}
+
+		template<typename T>
+		TinymoeHandle<T> NewObject(TinymoeArgumentSpan values)
+		{
+			auto object = New<T>();
+			auto& fields = T::Type()->fields;
+			for (int i = 0; (size_t)i < values.size() && (size_t)i < fields.size(); i++)
+			{
+				object.get()->*(fields[i].second) = values[i];
+			}
+			return object;
+		}
+
+		class TinymoeBoolean : public TinymoeObject
+		{
+		public:
+			bool										value;
+
+			TinymoeBoolean(bool _value)
+				:value(_value)
+			{
+			}
+
+			TINYMOE_TYPE(TinymoeBoolean, TinymoeObject)
+		};
+
+		class TinymoeInteger : public TinymoeObject
+		{
+		public:
+			int											value;
+
+			TinymoeInteger(int _value)
+				:value(_value)
+			{
+			}
+
+			TINYMOE_TYPE(TinymoeInteger, TinymoeObject)
+		};
+
+		class TinymoeFloat : public TinymoeObject
+		{
+		public:
+			double										value;
+
+			TinymoeFloat(double _value)
+				:value(_value)
+			{
+			}
+
+			TINYMOE_TYPE(TinymoeFloat, TinymoeObject)
+		};
+
+		// a flat string is a prefix of a buffer, a longer string appended to it may share the same buffer,
+		// a concatenation that cannot append in place is a rope of two strings until its characters are needed
+		class TinymoeString : public TinymoeObject
+		{
+		private:
+			static const size_t							ShortLength = 64;
+
+			shared_ptr<string>							buffer;
+			size_t										length;
+			Ptr											left;
+			Ptr											right;
+
+		public:
+			TinymoeString(const string& value)
+				:buffer(make_shared<string>(value))
+				, length(value.size())
+			{
+			}
+
+			TinymoeString(const shared_ptr<string>& _buffer, size_t _length)
+				:buffer(_buffer)
+				, length(_length)
+			{
+			}
+
+			TinymoeString(const Ptr& _left, const Ptr& _right, size_t _length)
+				:length(_length)
+				, left(_left)
+				, right(_right)
+			{
+			}
+
+			size_t Length()
+			{
+				return length;
+			}
+
+			// a rope becomes flat, children are left as they are because other strings may still share them
+			void Flatten()
+			{
+				if (!left) return;
+				auto result = make_shared<string>();
+				result->reserve(length);
+				vector<TinymoeString*> pieces(1, this);
+				while (pieces.size() > 0)
+				{
+					auto piece = pieces.back();
+					pieces.pop_back();
+					if (piece->left)
+					{
+						pieces.push_back(static_cast<TinymoeString*>(piece->right.GetObject()));
+						pieces.push_back(static_cast<TinymoeString*>(piece->left.GetObject()));
+					}
+					else
+					{
+						result->append(*piece->buffer, 0, piece->length);
+					}
+				}
+				buffer = result;
+				left = nullptr;
+				right = nullptr;
+			}
+
+			string Value()
+			{
+				Flatten();
+				return length == buffer->size() ? *buffer : buffer->substr(0, length);
+			}
+
+			// a string that ends its buffer owns the free space after it, so a shorter string is appended without copying this one,
+			// appending a longer string would copy more than the rope saves
+			static TinymoeHandle<TinymoeString> Concat(const TinymoeHandle<TinymoeString>& a, const TinymoeHandle<TinymoeString>& b)
+			{
+				if (a->length == 0) return b;
+				if (b->length == 0) return a;
+				auto length = a->length + b->length;
+				if (length <= ShortLength)
+				{
+					return New<TinymoeString>(a->Value() + b->Value());
+				}
+				if (!a->left && a->length == a->buffer->size() && b->length <= a->length)
+				{
+					b->Flatten();
+					a->buffer->append(*b->buffer, 0, b->length);
+					return New<TinymoeString>(a->buffer, length);
+				}
+				return New<TinymoeString>(a, b, length);
+			}
+
+			void Trace(TinymoeTracer& tracer)override
+			{
+				tracer.Visit(left);
+				tracer.Visit(right);
+			}
+
+			TINYMOE_TYPE(TinymoeString, TinymoeObject)
+		};
+
+		class TinymoeSymbol : public TinymoeObject
+		{
+		public:
+			string										value;
+
+			TinymoeSymbol(const string& _value)
+				:value(_value)
+			{
+			}
+
+			TINYMOE_TYPE(TinymoeSymbol, TinymoeObject)
+		};
+
+		// elements are stored unboxed while all of them are integers, floats or booleans of the same type,
+		// writing an element of another type upgrades the array to boxed objects
+		class TinymoeArray : public TinymoeObject
+		{
+		public:
+			enum class Storage
+			{
+				Null,			// no element has been written
+				Integer,
+				Float,
+				Boolean,
+				Object,
+			};
+
+		private:
+			Storage										storage = Storage::Null;
+			size_t										length;
+			vector<int>									integers;
+			vector<double>								floats;
+			vector<char>								booleans;
+			TinymoeArguments							objects;
+			vector<char>								nulls;			// unboxed elements that are still null, released when every element is written
+			size_t										nullCount = 0;
+
+			static Storage GetStorage(const Ptr& value)
+			{
+				if (!value) return Storage::Null;
+				auto type = value->GetType();
+				if (type == TinymoeInteger::Type()) return Storage::Integer;
+				if (type == TinymoeFloat::Type()) return Storage::Float;
+				if (type == TinymoeBoolean::Type()) return Storage::Boolean;
+				return Storage::Object;
+			}
+
+			void Allocate(Storage _storage)
+			{
+				storage = _storage;
+				switch (storage)
+				{
+				case Storage::Integer:
+					integers.resize(length);
+					break;
+				case Storage::Float:
+					floats.resize(length);
+					break;
+				case Storage::Boolean:
+					booleans.resize(length);
+					break;
+				default:
+					{
+						TinymoeHandleScope scope(TinymoeHandleList::Embedded());
+						objects.resize(length);
+					}
+					return;
+				}
+				nulls.assign(length, 1);
+				nullCount = length;
+			}
+
+			void SetNull(size_t position, bool isNull)
+			{
+				if (isNull)
+				{
+					if (nulls.size() == 0)
+					{
+						nulls.assign(length, 0);
+					}
+					if (!nulls[position])
+					{
+						nulls[position] = 1;
+						nullCount++;
+					}
+				}
+				else if (nulls.size() > 0 && nulls[position])
+				{
+					nulls[position] = 0;
+					if (--nullCount == 0)
+					{
+						vector<char>().swap(nulls);
+					}
+				}
+			}
+
+			void Release()
+			{
+				vector<int>().swap(integers);
+				vector<double>().swap(floats);
+				vector<char>().swap(booleans);
+				TinymoeArguments().swap(objects);
+				vector<char>().swap(nulls);
+				nullCount = 0;
+				storage = Storage::Null;
+			}
+
+			// for bulk operations that write every element
+			void Assign(Storage _storage)
+			{
+				Release();
+				Allocate(_storage);
+				vector<char>().swap(nulls);
+				nullCount = 0;
+			}
+
+			bool IsNumbers()
+			{
+				return (storage == Storage::Integer || storage == Storage::Float) && nullCount == 0;
+			}
+
+			// an integer operand of a float operation is widened once, so the loop only sees doubles
+			const double* GetFloats(vector<double>& widened)
+			{
+				if (storage == Storage::Float) return floats.data();
+				widened.assign(integers.begin(), integers.end());
+				return widened.data();
+			}
+
+			static bool IsSame(const Ptr& a, const Ptr& b)
+			{
+				auto kind = GetStorage(a);
+				if (kind != GetStorage(b)) return false;
+				switch (kind)
+				{
+				case Storage::Null:
+					return true;
+				case Storage::Integer:
+					return static_cast<TinymoeInteger*>(a.GetObject())->value == static_cast<TinymoeInteger*>(b.GetObject())->value;
+				case Storage::Float:
+					return static_cast<TinymoeFloat*>(a.GetObject())->value == static_cast<TinymoeFloat*>(b.GetObject())->value;
+				case Storage::Boolean:
+					return static_cast<TinymoeBoolean*>(a.GetObject())->value == static_cast<TinymoeBoolean*>(b.GetObject())->value;
+				default:
+					if (a->GetType() == TinymoeString::Type() && b->GetType() == TinymoeString::Type())
+					{
+						return static_cast<TinymoeString*>(a.GetObject())->Value() == static_cast<TinymoeString*>(b.GetObject())->Value();
+					}
+					return a == b;
+				}
+			}
+
+			template<typename T>
+			int FindValue(const vector<T>& data, T value)
+			{
+				for (size_t i = 0; i < length; i++)
+				{
+					if (data[i] == value && (nullCount == 0 || !nulls[i])) return (int)i + 1;
+				}
+				return 0;
+			}
+
+			template<typename T, typename TOperation>
+			static void Map(T* result, const T* a, const T* b, size_t count, TOperation operation)
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					result[i] = operation(a[i], b[i]);
+				}
+			}
+
+			void Store(size_t position, const Ptr& value)
+			{
+				switch (storage)
+				{
+				case Storage::Integer:
+					integers[position] = static_cast<TinymoeInteger*>(value.GetObject())->value;
+					break;
+				case Storage::Float:
+					floats[position] = static_cast<TinymoeFloat*>(value.GetObject())->value;
+					break;
+				case Storage::Boolean:
+					booleans[position] = static_cast<TinymoeBoolean*>(value.GetObject())->value;
+					break;
+				default:
+					return;
+				}
+				SetNull(position, false);
+			}
+
+		public:
+			TinymoeArray(int _length)
+				:length(_length < 0 ? 0 : (size_t)_length)
+			{
+			}
+
+			TinymoeArray(const TinymoeArguments& values)
+				:length(values.size())
+			{
+				auto common = values.size() > 0 ? GetStorage(values[0]) : Storage::Null;
+				for (auto& value : values)
+				{
+					if (GetStorage(value) != common)
+					{
+						common = Storage::Object;
+						break;
+					}
+				}
+				if (common == Storage::Object)
+				{
+					storage = Storage::Object;
+					objects = values;
+				}
+				else if (common != Storage::Null)
+				{
+					Allocate(common);
+					for (size_t i = 0; i < length; i++)
+					{
+						Store(i, values[i]);
+					}
+				}
+			}
+
+			Storage GetStorage()
+			{
+				return storage;
+			}
+
+			size_t Length()
+			{
+				return length;
+			}
+
+			// reading an unboxed element allocates a box
+			Ptr Get(size_t position)
+			{
+				if (position >= length)
+				{
+					throw TinymoeException("Array index out of range.");
+				}
+				if (storage == Storage::Object) return objects[position];
+				if (storage == Storage::Null || (nulls.size() > 0 && nulls[position])) return nullptr;
+				switch (storage)
+				{
+				case Storage::Integer:
+					return New<TinymoeInteger>(integers[position]);
+				case Storage::Float:
+					return New<TinymoeFloat>(floats[position]);
+				default:
+					return New<TinymoeBoolean>(booleans[position] != 0);
+				}
+			}
+
+			// boxing existing elements may allocate, so the array is passed by a handle
+			static void Set(const TinymoeHandle<TinymoeArray>& array, size_t position, const Ptr& value)
+			{
+				if (position >= array->length)
+				{
+					throw TinymoeException("Array index out of range.");
+				}
+
+				auto kind = GetStorage(value);
+				if (array->storage == Storage::Null)
+				{
+					if (kind == Storage::Null) return;
+					array->Allocate(kind);
+				}
+				else if (array->storage != Storage::Object && kind != array->storage && kind != Storage::Null)
+				{
+					TinymoeArguments boxed(array->length);
+					for (size_t i = 0; i < boxed.size(); i++)
+					{
+						boxed[i] = array->Get(i);
+					}
+					auto target = array.get();
+					target->Release();
+					target->storage = Storage::Object;
+					{
+						TinymoeHandleScope scope(TinymoeHandleList::Embedded());
+						target->objects = boxed;
+					}
+					for (auto& element : target->objects)
+					{
+						TinymoeHeap::Current().WriteBarrier(target, element);
+					}
+				}
+
+				auto target = array.get();
+				if (target->storage == Storage::Object)
+				{
+					target->objects[position] = value;
+					TinymoeHeap::Current().WriteBarrier(target, value);
+				}
+				else if (kind == Storage::Null)
+				{
+					target->SetNull(position, true);
+				}
+				else
+				{
+					target->Store(position, value);
+				}
+			}
+
+			/*************************************************************
+			Bulk operations
+			*************************************************************/
+
+			enum class Arithmetic
+			{
+				Add,
+				Sub,
+				Mul,
+				Div,
+			};
+
+			// integers wrap around like i_add_i, floats are added from left to right so the result is the same as a loop in the script
+			Ptr Sum()
+			{
+				if (length == 0) return New<TinymoeInteger>(0);
+				if (storage == Storage::Integer && nullCount == 0)
+				{
+					unsigned sum = 0;
+					auto data = integers.data();
+					for (size_t i = 0; i < length; i++)
+					{
+						sum += (unsigned)data[i];
+					}
+					return New<TinymoeInteger>((int)sum);
+				}
+				if (storage == Storage::Float && nullCount == 0)
+				{
+					double sum = 0;
+					auto data = floats.data();
+					for (size_t i = 0; i < length; i++)
+					{
+						sum += data[i];
+					}
+					return New<TinymoeFloat>(sum);
+				}
+				if (storage == Storage::Object)
+				{
+					unsigned integerSum = 0;
+					double floatSum = 0;
+					bool isFloat = false;
+					for (auto& element : objects)
+					{
+						switch (GetStorage(element))
+						{
+						case Storage::Integer:
+							integerSum += (unsigned)static_cast<TinymoeInteger*>(element.GetObject())->value;
+							floatSum += static_cast<TinymoeInteger*>(element.GetObject())->value;
+							break;
+						case Storage::Float:
+							floatSum += static_cast<TinymoeFloat*>(element.GetObject())->value;
+							isFloat = true;
+							break;
+						default:
+							throw TinymoeException("Only an array of numbers can be summed.");
+						}
+					}
+					if (isFloat) return New<TinymoeFloat>(floatSum);
+					return New<TinymoeInteger>((int)integerSum);
+				}
+				throw TinymoeException("Only an array of numbers can be summed.");
+			}
+
+			// integers and floats in an array of objects are compared as floats, the element itself is returned
+			Ptr Extreme(bool maximum)
+			{
+				if (length == 0)
+				{
+					throw TinymoeException("An empty array has no minimum or maximum.");
+				}
+				if (storage == Storage::Integer && nullCount == 0)
+				{
+					auto data = integers.data();
+					int result = data[0];
+					for (size_t i = 1; i < length; i++)
+					{
+						result = maximum ? (data[i] > result ? data[i] : result) : (data[i] < result ? data[i] : result);
+					}
+					return New<TinymoeInteger>(result);
+				}
+				if (storage == Storage::Float && nullCount == 0)
+				{
+					auto data = floats.data();
+					double result = data[0];
+					for (size_t i = 1; i < length; i++)
+					{
+						result = maximum ? (data[i] > result ? data[i] : result) : (data[i] < result ? data[i] : result);
+					}
+					return New<TinymoeFloat>(result);
+				}
+				if (storage == Storage::Object)
+				{
+					size_t index = 0;
+					double result = 0;
+					for (size_t i = 0; i < length; i++)
+					{
+						double value = 0;
+						switch (GetStorage(objects[i]))
+						{
+						case Storage::Integer:
+							value = static_cast<TinymoeInteger*>(objects[i].GetObject())->value;
+							break;
+						case Storage::Float:
+							value = static_cast<TinymoeFloat*>(objects[i].GetObject())->value;
+							break;
+						default:
+							throw TinymoeException("Only an array of numbers has a minimum or maximum.");
+						}
+						if (i == 0 || (maximum ? value > result : value < result))
+						{
+							index = i;
+							result = value;
+						}
+					}
+					return objects[index];
+				}
+				throw TinymoeException("Only an array of numbers has a minimum or maximum.");
+			}
+
+			// returns the position of the first element that equals to the value starting from 1, or 0,
+			// numbers, booleans and strings are compared by value without conversion, other objects by reference
+			int Find(const Ptr& value)
+			{
+				auto kind = GetStorage(value);
+				if (storage == Storage::Null)
+				{
+					return kind == Storage::Null && length > 0 ? 1 : 0;
+				}
+				if (storage == Storage::Object)
+				{
+					for (size_t i = 0; i < length; i++)
+					{
+						if (IsSame(objects[i], value)) return (int)i + 1;
+					}
+					return 0;
+				}
+				if (kind == Storage::Null)
+				{
+					for (size_t i = 0; i < nulls.size(); i++)
+					{
+						if (nulls[i]) return (int)i + 1;
+					}
+					return 0;
+				}
+				if (kind != storage)
+				{
+					return 0;
+				}
+
+				switch (storage)
+				{
+				case Storage::Integer:
+					return FindValue(integers, static_cast<TinymoeInteger*>(value.GetObject())->value);
+				case Storage::Float:
+					return FindValue(floats, static_cast<TinymoeFloat*>(value.GetObject())->value);
+				default:
+					return FindValue(booleans, (char)static_cast<TinymoeBoolean*>(value.GetObject())->value);
+				}
+			}
+
+			static void Fill(const TinymoeHandle<TinymoeArray>& array, const Ptr& value)
+			{
+				auto target = array.get();
+				auto kind = GetStorage(value);
+				target->Release();
+				switch (kind)
+				{
+				case Storage::Null:
+					break;
+				case Storage::Integer:
+					target->Assign(kind);
+					fill(target->integers.begin(), target->integers.end(), static_cast<TinymoeInteger*>(value.GetObject())->value);
+					break;
+				case Storage::Float:
+					target->Assign(kind);
+					fill(target->floats.begin(), target->floats.end(), static_cast<TinymoeFloat*>(value.GetObject())->value);
+					break;
+				case Storage::Boolean:
+					target->Assign(kind);
+					fill(target->booleans.begin(), target->booleans.end(), (char)static_cast<TinymoeBoolean*>(value.GetObject())->value);
+					break;
+				default:
+					target->storage = Storage::Object;
+					{
+						TinymoeHandleScope scope(TinymoeHandleList::Embedded());
+						target->objects.assign(target->length, value);
+					}
+					TinymoeHeap::Current().WriteBarrier(target, value);
+				}
+			}
+
+			// copies the source to the beginning of the target, elements after the source are not changed
+			static void Copy(const TinymoeHandle<TinymoeArray>& source, const TinymoeHandle<TinymoeArray>& target)
+			{
+				if (source->length > target->length)
+				{
+					throw TinymoeException("The target array is shorter than the source array.");
+				}
+
+				auto from = source.get();
+				auto to = target.get();
+				if (from == to)
+				{
+					return;
+				}
+				if (from->length == to->length)
+				{
+					to->Release();
+					to->storage = from->storage;
+					to->integers = from->integers;
+					to->floats = from->floats;
+					to->booleans = from->booleans;
+					to->nulls = from->nulls;
+					to->nullCount = from->nullCount;
+					if (from->storage == Storage::Object)
+					{
+						{
+							TinymoeHandleScope scope(TinymoeHandleList::Embedded());
+							to->objects = from->objects;
+						}
+						for (auto& element : to->objects)
+						{
+							TinymoeHeap::Current().WriteBarrier(to, element);
+						}
+					}
+					return;
+				}
+				if (from->storage == to->storage && from->storage != Storage::Object && from->nullCount == 0)
+				{
+					copy(from->integers.begin(), from->integers.end(), to->integers.begin());
+					copy(from->floats.begin(), from->floats.end(), to->floats.begin());
+					copy(from->booleans.begin(), from->booleans.end(), to->booleans.begin());
+					for (size_t i = 0; i < from->length && to->nullCount > 0; i++)
+					{
+						to->SetNull(i, false);
+					}
+					return;
+				}
+				for (size_t i = 0; i < source->length; i++)
+				{
+					Set(target, i, source->Get(i));
+				}
+			}
+
+			// integer operands give integers except for division, which gives floats like i_div_i
+			static Ptr Elementwise(const TinymoeHandle<TinymoeArray>& a, const TinymoeHandle<TinymoeArray>& b, Arithmetic operation)
+			{
+				if (a->length != b->length)
+				{
+					throw TinymoeException("Elementwise operations require arrays of the same length.");
+				}
+				auto length = a->length;
+				if (length == 0)
+				{
+					return New<TinymoeArray>(0);
+				}
+
+				if (a->IsNumbers() && b->IsNumbers())
+				{
+					auto result = New<TinymoeArray>((int)length);
+					auto x = a.get();
+					auto y = b.get();
+					auto z = result.get();
+					if (x->storage == Storage::Integer && y->storage == Storage::Integer && operation != Arithmetic::Div)
+					{
+						z->Assign(Storage::Integer);
+						auto r = reinterpret_cast<unsigned*>(z->integers.data());
+						auto p = reinterpret_cast<const unsigned*>(x->integers.data());
+						auto q = reinterpret_cast<const unsigned*>(y->integers.data());
+						switch (operation)
+						{
+						case Arithmetic::Add:
+							Map(r, p, q, length, [](unsigned i, unsigned j) { return i + j; });
+							break;
+						case Arithmetic::Sub:
+							Map(r, p, q, length, [](unsigned i, unsigned j) { return i - j; });
+							break;
+						default:
+							Map(r, p, q, length, [](unsigned i, unsigned j) { return i * j; });
+						}
+					}
+					else
+					{
+						z->Assign(Storage::Float);
+						vector<double> widenedX, widenedY;
+						auto r = z->floats.data();
+						auto p = x->GetFloats(widenedX);
+						auto q = y->GetFloats(widenedY);
+						switch (operation)
+						{
+						case Arithmetic::Add:
+							Map(r, p, q, length, [](double i, double j) { return i + j; });
+							break;
+						case Arithmetic::Sub:
+							Map(r, p, q, length, [](double i, double j) { return i - j; });
+							break;
+						case Arithmetic::Mul:
+							Map(r, p, q, length, [](double i, double j) { return i * j; });
+							break;
+						default:
+							Map(r, p, q, length, [](double i, double j) { return i / j; });
+						}
+					}
+					return result;
+				}
+
+				TinymoeArguments results(length);
+				for (size_t i = 0; i < length; i++)
+				{
+					results[i] = Apply(a->Get(i), b->Get(i), operation);
+				}
+				return New<TinymoeArray>(results);
+			}
+
+			static Ptr Apply(const Ptr& a, const Ptr& b, Arithmetic operation)
+			{
+				auto ka = GetStorage(a);
+				auto kb = GetStorage(b);
+				if ((ka != Storage::Integer && ka != Storage::Float) || (kb != Storage::Integer && kb != Storage::Float))
+				{
+					throw TinymoeException("Elementwise operations require arrays of numbers.");
+				}
+				if (ka == Storage::Integer && kb == Storage::Integer && operation != Arithmetic::Div)
+				{
+					auto i = (unsigned)static_cast<TinymoeInteger*>(a.GetObject())->value;
+					auto j = (unsigned)static_cast<TinymoeInteger*>(b.GetObject())->value;
+					return New<TinymoeInteger>((int)(operation == Arithmetic::Add ? i + j : operation == Arithmetic::Sub ? i - j : i * j));
+				}
+				auto i = ka == Storage::Integer ? (double)static_cast<TinymoeInteger*>(a.GetObject())->value : static_cast<TinymoeFloat*>(a.GetObject())->value;
+				auto j = kb == Storage::Integer ? (double)static_cast<TinymoeInteger*>(b.GetObject())->value : static_cast<TinymoeFloat*>(b.GetObject())->value;
+				switch (operation)
+				{
+				case Arithmetic::Add: return New<TinymoeFloat>(i + j);
+				case Arithmetic::Sub: return New<TinymoeFloat>(i - j);
+				case Arithmetic::Mul: return New<TinymoeFloat>(i * j);
+				default: return New<TinymoeFloat>(i / j);
+				}
+			}
+
+			void Trace(TinymoeTracer& tracer)override
+			{
+				for (auto& element : objects)
+				{
+					tracer.Visit(element);
+				}
+			}
+
+			TINYMOE_TYPE(TinymoeArray, TinymoeObject)
+		};
+
+		// a variable that is captured by lambdas lives in a cell, so that all of them see the latest assignment
+		class TinymoeCell : public TinymoeObject
+		{
+		public:
+			Ptr											value;
+
+			TinymoeCell(const Ptr& _value)
+				:value(_value)
+			{
+			}
+
+			TINYMOE_TYPE(TinymoeCell, TinymoeObject, TINYMOE_FIELD(TinymoeCell, value))
+		};
+
+		inline TinymoeHandle<TinymoeCell> NewCell(const TinymoeObject::Ptr& value = nullptr)
+		{
+			return New<TinymoeCell>(value);
+		}
+
+		inline TinymoeObject::Ptr Cell(const TinymoeHandle<TinymoeCell>& cell)
+		{
+			return cell->value;
+		}
+
+		inline void SetCell(const TinymoeHandle<TinymoeCell>& cell, const TinymoeObject::Ptr& value)
+		{
+			cell->value = value;
+			TinymoeHeap::Current().WriteBarrier(cell.get(), value);
+		}
+
+		// reads the value of a proven primitive without checking its type
+		template<typename T>
+		auto Unbox(const TinymoeHandleBase& value) -> decltype(T::value)
+		{
+			return static_cast<T*>(value.GetObject())->value;
+		}
+
+		template<typename T>
+		auto Unbox(const TinymoeHandleBase& value) -> decltype(static_cast<T*>(nullptr)->Value())
+		{
+			return static_cast<T*>(value.GetObject())->Value();
+		}
+
+		// both operands are strings, the result may share storage with them
+		inline TinymoeObject::Ptr ConcatStrings(const TinymoeObject::Ptr& a, const TinymoeObject::Ptr& b)
+		{
+			return TinymoeString::Concat(TinymoeHandle<TinymoeString>(static_cast<TinymoeString*>(a.GetObject())), TinymoeHandle<TinymoeString>(static_cast<TinymoeString*>(b.GetObject())));
+		}
+
+		// the handler and the handles it captured, it is shared by all copies of a relocated function
+		class TinymoeClosure
+		{
+		public:
+			TinymoeHandleList							captures = { nullptr };
+
+			virtual ~TinymoeClosure()
+			{
+			}
+
+			virtual TinymoeContinuation					Run(TinymoeArgumentSpan arguments) = 0;
+		};
+
+		// the handler is stored in the closure, so a function allocates once outside of the heap instead of also allocating in a std::function
+		template<typename F>
+		class TinymoeLambdaClosure : public TinymoeClosure
+		{
+		private:
+			F											handler;
+
+		public:
+			TinymoeLambdaClosure(const F& _handler)
+				:handler(_handler)
+			{
+			}
+
+			TinymoeContinuation Run(TinymoeArgumentSpan arguments)override
+			{
+				return handler(arguments);
+			}
+		};
+
+		class TinymoeFunction : public TinymoeObject
+		{
+		public:
+			shared_ptr<TinymoeClosure>					closure;
+
+			void Trace(TinymoeTracer& tracer)override
+			{
+				for (auto handle = closure->captures.first; handle; handle = handle->next)
+				{
+					tracer.Visit(*handle);
+				}
+			}
+
+			// the closure does not exist until the handler is copied into it, so captured handles are put in a local list first and then moved to the closure
+			template<typename F>
+			void SetHandler(const F& handler)
+			{
+				TinymoeHandleList captures = { nullptr };
+				{
+					TinymoeHandleScope scope(&captures);
+					closure = allocate_shared<TinymoeLambdaClosure<F>>(TinymoeClosureAllocator<TinymoeLambdaClosure<F>>(), handler);
+				}
+				closure->captures.first = captures.first;
+				if (captures.first)
+				{
+					captures.first->link = &closure->captures.first;
+				}
+			}
+
+			TINYMOE_TYPE(TinymoeFunction, TinymoeObject)
+		};
+
+		template<typename F>
+		TinymoeHandle<TinymoeFunction> NewFunction(const F& handler)
+		{
+			auto function = New<TinymoeFunction>();
+			function->SetHandler(handler);
+			return function;
+		}
+
+
+		/*************************************************************
+		Field Site
+		*************************************************************/
+
+		inline TinymoeObject::Ptr LookupField(const TinymoeObject::Ptr& target, const string& name);
+
+		class TinymoeFieldSite
+		{
+		public:
+			static const int							MaxPolymorphicEntries = 4;
+
+		private:
+			TinymoeType*								types[MaxPolymorphicEntries];
+			int											slots[MaxPolymorphicEntries];
+			TinymoeObject::Ptr							extensions[MaxPolymorphicEntries];
+			int											count = 0;
+			int											version = 0;
+			TinymoeIsolate*								isolate = TinymoeIsolate::Current();
+
+			int Find(TinymoeType* type)
+			{
+				if (version != isolate->extensionVersion)
+				{
+					version = isolate->extensionVersion;
+					count = 0;
+				}
+				for (int i = 0; i < count; i++)
+				{
+					if (types[i] == type)
+					{
+						hits++;
+						return i;
+					}
+				}
+				misses++;
+				return -1;
+			}
+
+			void Add(TinymoeType* type, int slot, const TinymoeObject::Ptr& extension)
+			{
+				if (count == MaxPolymorphicEntries)
+				{
+					megamorphic = true;
+					return;
+				}
+				types[count] = type;
+				slots[count] = slot;
+				extensions[count] = extension;
+				count++;
+			}
+
+		public:
+			string										name;
+			bool										megamorphic = false;
+			uint64_t									hits = 0;
+			uint64_t									misses = 0;
+
+			TinymoeFieldSite(const string& _name)
+				:name(_name)
+			{
+				isolate->fieldSites.push_back(this);
+			}
+
+			TinymoeFieldSite(const TinymoeFieldSite&) = delete;
+
+			~TinymoeFieldSite()
+			{
+				auto& sites = isolate->fieldSites;
+				sites.erase(remove(sites.begin(), sites.end(), this), sites.end());
+			}
+
+			TinymoeObject::Ptr Get(const TinymoeObject::Ptr& target)
+			{
+				if (!target || megamorphic)
+				{
+					misses++;
+					return LookupField(target, name);
+				}
+
+				auto type = target->GetType();
+				int entry = Find(type);
+				if (entry != -1)
+				{
+					int slot = slots[entry];
+					return slot == -1 ? extensions[entry] : target.get()->*(type->fields[slot].second);
+				}
+
+				int slot = type->GetSlot(name);
+				if (slot != -1)
+				{
+					Add(type, slot, nullptr);
+					return target.get()->*(type->fields[slot].second);
+				}
+				auto extension = LookupField(target, name);
+				Add(type, -1, extension);
+				return extension;
+			}
+
+			void Set(const TinymoeObject::Ptr& target, const TinymoeObject::Ptr& value)
+			{
+				if (target && !megamorphic)
+				{
+					auto type = target->GetType();
+					int entry = Find(type);
+					if (entry != -1 && slots[entry] != -1)
+					{
+						target.get()->*(type->fields[slots[entry]].second) = value;
+						TinymoeHeap::Current().WriteBarrier(target.get(), value);
+						return;
+					}
+
+					int slot = type->GetSlot(name);
+					if (slot != -1)
+					{
+						Add(type, slot, nullptr);
+					}
+				}
+				else
+				{
+					misses++;
+				}
+				if (!target)
+				{
+					throw TinymoeException("Cannot set field \"" + name + "\" of null.");
+				}
+				target->SetField(name, value);
+			}
+
+			static void WriteStatistics(ostream& o)
+			{
+				auto sites = TinymoeIsolate::Current()->fieldSites;
+				stable_sort(sites.begin(), sites.end(), [](TinymoeFieldSite* a, TinymoeFieldSite* b)
+				{
+					return a->hits + a->misses > b->hits + b->misses;
+				});
+				for (auto site : sites)
+				{
+					if (site->hits + site->misses == 0) continue;
+					auto kind = site->megamorphic ? "megamorphic" : site->count > 1 ? "polymorphic" : "monomorphic";
+					o << site->name << ": " << kind << ", " << site->hits << " hits, " << site->misses << " misses" << endl;
+				}
+			}
+		};
+
+		/*************************************************************
+		Dispatch Table
+		*************************************************************/
+
+		class TinymoeDispatchSite
+		{
+		public:
+			vector<TinymoeType*>						types;
+			TinymoeObject::Ptr							target;
+		};
+
+		// the candidate types of every argument, it never changes after construction, so one instance is shared by every isolate
+		class TinymoeDispatchLayout
+		{
+		public:
+			vector<vector<TinymoeType*>>				dimensions;
+			vector<map<TinymoeType*, int>>				indexes;
+			size_t										count = 1;
+
+			TinymoeDispatchLayout(initializer_list<vector<TinymoeType*>> _dimensions)
+				:dimensions(_dimensions)
+				, indexes(_dimensions.size())
+			{
+				for (int i = 0; (size_t)i < dimensions.size(); i++)
+				{
+					for (int j = 0; (size_t)j < dimensions[i].size(); j++)
+					{
+						indexes[i].insert(make_pair(dimensions[i][j], j));
+					}
+					count *= dimensions[i].size();
+				}
+			}
+
+			TinymoeDispatchLayout(const TinymoeDispatchLayout&) = delete;
+		};
+
+		// targets are created by the factory when a call first reaches them, so constructing a program allocates nothing
+		class TinymoeDispatchTable
+		{
+		public:
+			typedef function<TinymoeObject::Ptr(int)>	Factory;
+
+		private:
+			const TinymoeDispatchLayout*				layout = nullptr;
+			Factory										factory;
+			map<pair<int, TinymoeType*>, int>			derivedIndexes;		// types that are not candidates, resolved to their nearest candidate base type
+			TinymoeArguments							targets;
+
+			int GetIndex(int dimension, TinymoeType* type)
+			{
+				auto& index = layout->indexes[dimension];
+				auto it = index.find(type);
+				if (it != index.end())
+				{
+					return it->second;
+				}
+
+				auto key = make_pair(dimension, type);
+				auto itDerived = derivedIndexes.find(key);
+				if (itDerived != derivedIndexes.end())
+				{
+					return itDerived->second;
+				}
+
+				// TinymoeObject is always the first candidate, so this stops at the root of the type hierarchy
+				int result = GetIndex(dimension, type->baseType);
+				derivedIndexes.insert(make_pair(key, result));
+				return result;
+			}
+
+		public:
+			TinymoeDispatchTable()
+			{
+			}
+
+			TinymoeDispatchTable(const TinymoeDispatchLayout& _layout, const Factory& _factory)
+				:layout(&_layout)
+				, factory(_factory)
+			{
+			}
+
+			TinymoeObject::Ptr Lookup(TinymoeDispatchSite& site, TinymoeArgumentSpan arguments)
+			{
+				if (site.types.size() == arguments.size())
+				{
+					size_t i = 0;
+					while (i < arguments.size() && site.types[i] == GetTypeOf(arguments[i]))
+					{
+						i++;
+					}
+					if (i == arguments.size())
+					{
+						return site.target;
+					}
+				}
+
+				int offset = 0;
+				site.types.resize(arguments.size());
+				for (int i = 0; (size_t)i < arguments.size(); i++)
+				{
+					site.types[i] = GetTypeOf(arguments[i]);
+					offset = offset * layout->dimensions[i].size() + GetIndex(i, site.types[i]);
+				}
+
+				if (targets.size() == 0)
+				{
+					TinymoeHandleScope scope(TinymoeHandleList::Roots());
+					targets.resize(layout->count);
+				}
+				auto& target = targets[offset];
+				if (!target)
+				{
+					target = factory(offset);
+				}
+				site.target = target;
+				return site.target;
+			}
+		};
+
+		/*************************************************************
+		Operations
+		*************************************************************/
+
+		inline TinymoeObject::Ptr LookupField(const TinymoeObject::Ptr& target, const string& name)
+		{
+			auto type = GetTypeOf(target);
+			if (target)
+			{
+				int slot = type->GetSlot(name);
+				if (slot != -1)
+				{
+					return target.get()->*(type->fields[slot].second);
+				}
+			}
+
+			auto& extensions = TinymoeIsolate::Current()->extensions;
+			for (; type; type = type->baseType)
+			{
+				auto table = extensions.find(type);
+				if (table != extensions.end())
+				{
+					auto it = table->second.find(name);
+					if (it != table->second.end())
+					{
+						return it->second;
+					}
+				}
+			}
+			throw TinymoeException("Field \"" + name + "\" does not exist.");
+		}
+
+		template<typename T>
+		struct TinymoeValue
+		{
+			static TinymoeObject::Ptr From(const TinymoeObject::Ptr& value)
+			{
+				return value;
+			}
+
+			static TinymoeObject::Ptr To(const TinymoeObject::Ptr& value)
+			{
+				return value;
+			}
+		};
+
+		template<>
+		struct TinymoeValue<bool>
+		{
+			static bool From(const TinymoeObject::Ptr& value)
+			{
+				return Cast<TinymoeBoolean>(value)->value;
+			}
+
+			static TinymoeObject::Ptr To(bool value)
+			{
+				return New<TinymoeBoolean>(value);
+			}
+		};
+
+		template<>
+		struct TinymoeValue<int>
+		{
+			static int From(const TinymoeObject::Ptr& value)
+			{
+				return Cast<TinymoeInteger>(value)->value;
+			}
+
+			static TinymoeObject::Ptr To(int value)
+			{
+				return New<TinymoeInteger>(value);
+			}
+		};
+
+		template<>
+		struct TinymoeValue<double>
+		{
+			static double From(const TinymoeObject::Ptr& value)
+			{
+				return Cast<TinymoeFloat>(value)->value;
+			}
+
+			static TinymoeObject::Ptr To(double value)
+			{
+				return New<TinymoeFloat>(value);
+			}
+		};
+
+		template<>
+		struct TinymoeValue<string>
+		{
+			static string From(const TinymoeObject::Ptr& value)
+			{
+				return Cast<TinymoeString>(value)->Value();
+			}
+
+			static TinymoeObject::Ptr To(const string& value)
+			{
+				return New<TinymoeString>(value);
+			}
+		};
+
+		// given to an asynchronous external function, the script continues after Resume or Raise is called in the same isolate, usually from an event loop callback
+		class TinymoeResumption
+		{
+		private:
+			TinymoeIsolate*								isolate;
+			TinymoeObject::Ptr							state;
+			TinymoeObject::Ptr							continuation;
+			bool										finished = false;
+
+			void Finish(const TinymoeContinuation& next)
+			{
+				if (finished)
+				{
+					throw TinymoeException("An asynchronous operation cannot be resumed twice.");
+				}
+				finished = true;
+				isolate->suspended--;
+				isolate->ready.push_back(next);
+			}
+
+		public:
+			TinymoeResumption(const TinymoeObject::Ptr& _state, const TinymoeObject::Ptr& _continuation)
+				:isolate(TinymoeIsolate::Current())
+				, state(_state)
+				, continuation(_continuation)
+			{
+				isolate->suspended++;
+			}
+
+			TinymoeResumption(const TinymoeResumption&) = delete;
+
+			// an operation that is dropped without resuming never continues the script
+			~TinymoeResumption()
+			{
+				if (!finished)
+				{
+					isolate->suspended--;
+				}
+			}
+
+			void Resume(const TinymoeObject::Ptr& result);
+			void Raise(const string& message);
+		};
+
+		typedef function<void(TinymoeArgumentSpan, const shared_ptr<TinymoeResumption>&)>	TinymoeAsyncExternalFunction;
+
+		class TinymoeOperations
+		{
+		public:
+			// returns a continuation resumed by an asynchronous external function, waiting at most timeout milliseconds (-1 means forever) for the event loop
+			static TinymoeContinuation WaitForContinuation(int timeout)
+			{
+				auto isolate = TinymoeIsolate::Current();
+				if (isolate->ready.size() == 0 && isolate->suspended > 0)
+				{
+					if (isolate->eventLoop.IsEmpty())
+					{
+						throw TinymoeException("The program is waiting for an asynchronous operation that never completes.");
+					}
+					isolate->eventLoop.Poll(timeout);
+				}
+				if (isolate->ready.size() == 0)
+				{
+					return nullptr;
+				}
+				auto continuation = isolate->ready.front();
+				isolate->ready.pop_front();
+				return continuation;
+			}
+
+			// the program finishes when the trampoline stops and no asynchronous external function is still running
+			static void RunContinuation(TinymoeContinuation continuation)
+			{
+				auto isolate = TinymoeIsolate::Current();
+				while (true)
+				{
+					while (continuation)
+					{
+						continuation = continuation->Run();
+					}
+					if (isolate->ready.size() == 0 && isolate->suspended == 0)
+					{
+						break;
+					}
+					continuation = WaitForContinuation(-1);
+				}
+			}
+
+			static TinymoeContinuation Invoke(const TinymoeObject::Ptr& function, TinymoeArgumentSpan arguments)
+			{
+				// the closure outlives the call even if the collector relocates the function
+				auto closure = Cast<TinymoeFunction>(function)->closure;
+				return closure->Run(arguments);
+			}
+
+			static void SetExtension(TinymoeType* type, const string& name, const TinymoeObject::Ptr& value)
+			{
+				auto isolate = TinymoeIsolate::Current();
+				isolate->extensions[type][name] = value;
+				isolate->extensionVersion++;
+			}
+
+			static TinymoeObject::Ptr ArrayLength(const TinymoeObject::Ptr& array)
+			{
+				return New<TinymoeInteger>((int)Cast<TinymoeArray>(array)->Length());
+			}
+
+			// a negative position becomes a huge size_t, so one comparison checks both bounds
+			static TinymoeObject::Ptr ArrayGet(const TinymoeObject::Ptr& array, const TinymoeObject::Ptr& index)
+			{
+				int position = CastToInteger(index)->value - 1;
+				return Cast<TinymoeArray>(array)->Get((size_t)position);
+			}
+
+			static void ArraySet(const TinymoeObject::Ptr& array, const TinymoeObject::Ptr& index, const TinymoeObject::Ptr& value)
+			{
+				// converting the index may allocate, so it happens before the element is located
+				int position = CastToInteger(index)->value - 1;
+				TinymoeArray::Set(TinymoeHandle<TinymoeArray>(Cast<TinymoeArray>(array)), (size_t)position, value);
+			}
+
+			static TinymoeObject::Ptr ArraySum(const TinymoeObject::Ptr& array)
+			{
+				return Cast<TinymoeArray>(array)->Sum();
+			}
+
+			static TinymoeObject::Ptr ArrayExtreme(const TinymoeObject::Ptr& array, bool maximum)
+			{
+				return Cast<TinymoeArray>(array)->Extreme(maximum);
+			}
+
+			static TinymoeObject::Ptr ArrayFind(const TinymoeObject::Ptr& value, const TinymoeObject::Ptr& array)
+			{
+				int position = Cast<TinymoeArray>(array)->Find(value);
+				return New<TinymoeInteger>(position);
+			}
+
+			static TinymoeObject::Ptr ArrayFill(const TinymoeObject::Ptr& array, const TinymoeObject::Ptr& value)
+			{
+				TinymoeArray::Fill(TinymoeHandle<TinymoeArray>(Cast<TinymoeArray>(array)), value);
+				return nullptr;
+			}
+
+			static TinymoeObject::Ptr ArrayCopy(const TinymoeObject::Ptr& source, const TinymoeObject::Ptr& target)
+			{
+				TinymoeArray::Copy(TinymoeHandle<TinymoeArray>(Cast<TinymoeArray>(source)), TinymoeHandle<TinymoeArray>(Cast<TinymoeArray>(target)));
+				return nullptr;
+			}
+
+			static TinymoeObject::Ptr ArrayElementwise(const TinymoeObject::Ptr& a, const TinymoeObject::Ptr& b, TinymoeArray::Arithmetic operation)
+			{
+				return TinymoeArray::Elementwise(TinymoeHandle<TinymoeArray>(Cast<TinymoeArray>(a)), TinymoeHandle<TinymoeArray>(Cast<TinymoeArray>(b)), operation);
+			}
+
+			static TinymoeObject::Ptr BuildExternalFunction(const TinymoeDirectExternalFunction& function)
+			{
+				return NewFunction([=](TinymoeArgumentSpan arguments)
+				{
+					auto result = function(TinymoeArgumentSpan(arguments.begin() + 1, arguments.size() - 2));
+					auto state = arguments.front();
+					auto continuation = arguments.back();
+					return TailCall([=]()
+					{
+						return Invoke(continuation, { state, result });
+					});
+				});
+			}
+
+			// a direct-style function receives the state and the arguments, the continuation is called with its result
+			static TinymoeObject::Ptr BuildDirectFunction(const TinymoeDirectExternalFunction& function)
+			{
+				return NewFunction([=](TinymoeArgumentSpan arguments)
+				{
+					auto result = function(TinymoeArgumentSpan(arguments.begin(), arguments.size() - 1));
+					auto state = arguments.front();
+					auto continuation = arguments.back();
+					return TailCall([=]()
+					{
+						return Invoke(continuation, { state, result });
+					});
+				});
+			}
+
+			// the trampoline stops after the call, the continuation is scheduled again when the function resumes
+			static TinymoeObject::Ptr BuildAsyncExternalFunction(const TinymoeAsyncExternalFunction& function)
+			{
+				return NewFunction([=](TinymoeArgumentSpan arguments)
+				{
+					function(TinymoeArgumentSpan(arguments.begin() + 1, arguments.size() - 2), make_shared<TinymoeResumption>(arguments.front(), arguments.back()));
+					return TinymoeContinuation();
+				});
+			}
+
+		protected:
+
+			/*************************************************************
+			Strong Typed External Functions
+			*************************************************************/
+
+			static int f_to_i(double v) { return (int)v; }
+			static int s_to_i(string v) { return stoi(v); }
+			static double i_to_f(int v) { return (double)v; }
+			static double s_to_f(string v) { return stod(v); }
+			static int pos_i(int v) { return v; }
+			static double pos_f(double v) { return v; }
+			static int neg_i(int v) { return -v; }
+			static double neg_f(double v) { return -v; }
+			static bool not_b(bool v) { return !v; }
+			static int i_add_i(int a, int b) { return a + b; }
+			static double f_add_f(double a, double b) { return a + b; }
+			static int i_sub_i(int a, int b) { return a - b; }
+			static double f_sub_f(double a, double b) { return a - b; }
+			static int i_mul_i(int a, int b) { return a * b; }
+			static double f_mul_f(double a, double b) { return a * b; }
+			static double i_div_i(int a, int b) { return (double)a / (double)b; }
+			static double f_div_f(double a, double b) { return a / b; }
+			static int i_intdiv_i(int a, int b) { if (b == 0) throw TinymoeException("Divided by zero."); return a / b; }
+			static int i_mod_i(int a, int b) { if (b == 0) throw TinymoeException("Divided by zero."); return a % b; }
+			static bool o_e_o(TinymoeObject::Ptr a, TinymoeObject::Ptr b) { return a == b; }
+			static bool i_e_i(int a, int b) { return a == b; }
+			static bool f_e_f(double a, double b) { return a == b; }
+			static bool s_e_s(string a, string b) { return a == b; }
+			static bool b_e_b(bool a, bool b) { return a == b; }
+			static int i_c_i(int a, int b) { return a < b ? -1 : a > b ? 1 : 0; }
+			static int f_c_f(double a, double b) { return a < b ? -1 : a > b ? 1 : 0; }
+			static int s_c_s(const string& a, const string& b) { return i_c_i(a.compare(b), 0); }
+			static bool b_and_b(bool a, bool b) { return a && b; }
+			static bool b_or_b(bool a, bool b) { return a || b; }
+
+			template<typename R, typename A>
+			static TinymoeDirectExternalFunction BuildStrongTypedExternalFunction(R(*function)(A))
+			{
+				typedef typename decay<A>::type TA;
+				return [=](TinymoeArgumentSpan arguments)
+				{
+					return TinymoeValue<R>::To(function(TinymoeValue<TA>::From(arguments.at(0))));
+				};
+			}
+
+			template<typename R, typename A, typename B>
+			static TinymoeDirectExternalFunction BuildStrongTypedExternalFunction(R(*function)(A, B))
+			{
+				typedef typename decay<A>::type TA;
+				typedef typename decay<B>::type TB;
+				return [=](TinymoeArgumentSpan arguments)
+				{
+					return TinymoeValue<R>::To(function(TinymoeValue<TA>::From(arguments.at(0)), TinymoeValue<TB>::From(arguments.at(1))));
+				};
+			}
+
+			static TinymoeObject::Ptr Print(const TinymoeObject::Ptr& a)
+			{
+				// isolates on different threads print whole lines
+				static mutex lock;
+				auto value = CastToString(a)->Value();
+				lock_guard<mutex> guard(lock);
+				cout << value << endl;
+				return nullptr;
+			}
+
+			static TinymoeObject::Ptr Sqrt(const TinymoeObject::Ptr& a)
+			{
+				return New<TinymoeFloat>(sqrt(CastToFloat(a)->value));
+			}
+
+			/*************************************************************
+			Asynchronous External Functions
+			*************************************************************/
+
+			// stand-in file and pipe I/O, pipes wait in the event loop and regular files, which epoll cannot wait for, continue in posted callbacks
+			static void Schedule(int fd, bool write, const TinymoeEventLoop::Callback& callback)
+			{
+				auto& eventLoop = TinymoeIsolate::Current()->eventLoop;
+				if (!eventLoop.Watch(fd, write, callback))
+				{
+					eventLoop.Post(callback);
+				}
+			}
+
+			// a descriptor shared with the host stays blocking, and every isolate watching it wakes up when it is ready,
+			// so reads are serialized and only happen while it is still ready, otherwise EAGAIN makes the isolate wait again
+			static ssize_t ReadShared(int fd, char* block, size_t size)
+			{
+				static mutex lock;
+				lock_guard<mutex> guard(lock);
+				pollfd ready = { fd, POLLIN, 0 };
+				if (poll(&ready, 1, 0) <= 0)
+				{
+					errno = EAGAIN;
+					return -1;
+				}
+				return read(fd, block, size);
+			}
+
+			static void ContinueRead(int fd, bool owned, shared_ptr<string> buffer, shared_ptr<TinymoeResumption> resumption)
+			{
+				char block[65536];
+				auto size = owned ? read(fd, block, sizeof(block)) : ReadShared(fd, block, sizeof(block));
+				if (size > 0)
+				{
+					buffer->append(block, (size_t)size);
+				}
+				else if (size == 0 || (errno != EINTR && errno != EAGAIN))
+				{
+					if (owned)
+					{
+						close(fd);
+					}
+					if (size == 0)
+					{
+						resumption->Resume(New<TinymoeString>(*buffer));
+					}
+					else
+					{
+						resumption->Raise("Failed to read a file.");
+					}
+					return;
+				}
+				Schedule(fd, false, [=]() { ContinueRead(fd, owned, buffer, resumption); });
+			}
+
+			static void ContinueWrite(int fd, shared_ptr<string> buffer, size_t offset, shared_ptr<TinymoeResumption> resumption)
+			{
+				auto size = write(fd, buffer->data() + offset, buffer->size() - offset);
+				if (size >= 0)
+				{
+					offset += (size_t)size;
+				}
+				else if (errno != EINTR && errno != EAGAIN)
+				{
+					close(fd);
+					resumption->Raise("Failed to write a file.");
+					return;
+				}
+				if (offset == buffer->size())
+				{
+					close(fd);
+					resumption->Resume(nullptr);
+					return;
+				}
+				Schedule(fd, true, [=]() { ContinueWrite(fd, buffer, offset, resumption); });
+			}
+
+			static void ReadFile(const string& path, const shared_ptr<TinymoeResumption>& resumption)
+			{
+				int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+				if (fd == -1)
+				{
+					resumption->Raise("Failed to open file \"" + path + "\".");
+					return;
+				}
+				auto buffer = make_shared<string>();
+				Schedule(fd, false, [=]() { ContinueRead(fd, true, buffer, resumption); });
+			}
+
+			static void WriteFile(const string& path, const string& content, const shared_ptr<TinymoeResumption>& resumption)
+			{
+				int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK | O_CLOEXEC, 0644);
+				if (fd == -1)
+				{
+					resumption->Raise("Failed to open file \"" + path + "\".");
+					return;
+				}
+				auto buffer = make_shared<string>(content);
+				Schedule(fd, true, [=]() { ContinueWrite(fd, buffer, 0, resumption); });
+			}
+
+			// reads the standard input until it is closed, the descriptor is shared with the host so it is not switched to non-blocking,
+			// isolates reading it at the same time never block a worker, but each one only receives a part of the input
+			static void ReadInput(const shared_ptr<TinymoeResumption>& resumption)
+			{
+				auto buffer = make_shared<string>();
+				Schedule(0, false, [=]() { ContinueRead(0, false, buffer, resumption); });
+			}
+
+			static void Sleep(int milliseconds, const shared_ptr<TinymoeResumption>& resumption)
+			{
+				int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+				if (fd == -1)
+				{
+					resumption->Raise("Failed to create a timer.");
+					return;
+				}
+				itimerspec time = {};
+				time.it_value.tv_sec = milliseconds / 1000;
+				time.it_value.tv_nsec = (milliseconds % 1000) * 1000000;
+				if (milliseconds <= 0)
+				{
+					// a zero time disarms the timer
+					time.it_value.tv_sec = 0;
+					time.it_value.tv_nsec = 1;
+				}
+				timerfd_settime(fd, 0, &time, nullptr);
+				TinymoeIsolate::Current()->eventLoop.Watch(fd, false, [=]()
+				{
+					close(fd);
+					resumption->Resume(nullptr);
+				});
+			}
+
+		public:
+			static const TinymoeDirectExternalFunction& GetDirectExternalFunction(const string& name)
+			{
+				static map<string, TinymoeDirectExternalFunction> functions =
+				{
+#define TINYMOE_STRONG_TYPED_EXTERNAL(NAME) { #NAME, BuildStrongTypedExternalFunction(&NAME) }
+					TINYMOE_STRONG_TYPED_EXTERNAL(f_to_i),
+					TINYMOE_STRONG_TYPED_EXTERNAL(s_to_i),
+					TINYMOE_STRONG_TYPED_EXTERNAL(i_to_f),
+					TINYMOE_STRONG_TYPED_EXTERNAL(s_to_f),
+					TINYMOE_STRONG_TYPED_EXTERNAL(pos_i),
+					TINYMOE_STRONG_TYPED_EXTERNAL(pos_f),
+					TINYMOE_STRONG_TYPED_EXTERNAL(neg_i),
+					TINYMOE_STRONG_TYPED_EXTERNAL(neg_f),
+					TINYMOE_STRONG_TYPED_EXTERNAL(not_b),
+					TINYMOE_STRONG_TYPED_EXTERNAL(i_add_i),
+					TINYMOE_STRONG_TYPED_EXTERNAL(f_add_f),
+					TINYMOE_STRONG_TYPED_EXTERNAL(i_sub_i),
+					TINYMOE_STRONG_TYPED_EXTERNAL(f_sub_f),
+					TINYMOE_STRONG_TYPED_EXTERNAL(i_mul_i),
+					TINYMOE_STRONG_TYPED_EXTERNAL(f_mul_f),
+					TINYMOE_STRONG_TYPED_EXTERNAL(i_div_i),
+					TINYMOE_STRONG_TYPED_EXTERNAL(f_div_f),
+					TINYMOE_STRONG_TYPED_EXTERNAL(i_intdiv_i),
+					TINYMOE_STRONG_TYPED_EXTERNAL(i_mod_i),
+					TINYMOE_STRONG_TYPED_EXTERNAL(o_e_o),
+					TINYMOE_STRONG_TYPED_EXTERNAL(i_e_i),
+					TINYMOE_STRONG_TYPED_EXTERNAL(f_e_f),
+					TINYMOE_STRONG_TYPED_EXTERNAL(s_e_s),
+					TINYMOE_STRONG_TYPED_EXTERNAL(b_e_b),
+					TINYMOE_STRONG_TYPED_EXTERNAL(i_c_i),
+					TINYMOE_STRONG_TYPED_EXTERNAL(f_c_f),
+					TINYMOE_STRONG_TYPED_EXTERNAL(s_c_s),
+					TINYMOE_STRONG_TYPED_EXTERNAL(b_and_b),
+					TINYMOE_STRONG_TYPED_EXTERNAL(b_or_b),
+#undef TINYMOE_STRONG_TYPED_EXTERNAL
+					{ "s_to_n", [](TinymoeArgumentSpan arguments) { return CastToNumber(arguments.at(0)); } },
+					{ "s_concat_s", [](TinymoeArgumentSpan arguments)
+						{
+							// checked without unboxing, so a rope is not flattened
+							Cast<TinymoeString>(arguments.at(0));
+							Cast<TinymoeString>(arguments.at(1));
+							return ConcatStrings(arguments.at(0), arguments.at(1));
+						}
+					},
+					{ "to_s", [](TinymoeArgumentSpan arguments) -> TinymoeObject::Ptr { return CastToString(arguments.at(0)); } },
+					{ "Print", [](TinymoeArgumentSpan arguments) { return Print(arguments.at(0)); } },
+					{ "Sqrt", [](TinymoeArgumentSpan arguments) { return Sqrt(arguments.at(0)); } },
+					{ "array_sum", [](TinymoeArgumentSpan arguments) { return ArraySum(arguments.at(0)); } },
+					{ "array_min", [](TinymoeArgumentSpan arguments) { return ArrayExtreme(arguments.at(0), false); } },
+					{ "array_max", [](TinymoeArgumentSpan arguments) { return ArrayExtreme(arguments.at(0), true); } },
+					{ "array_find", [](TinymoeArgumentSpan arguments) { return ArrayFind(arguments.at(0), arguments.at(1)); } },
+					{ "array_fill", [](TinymoeArgumentSpan arguments) { return ArrayFill(arguments.at(0), arguments.at(1)); } },
+					{ "array_copy", [](TinymoeArgumentSpan arguments) { return ArrayCopy(arguments.at(0), arguments.at(1)); } },
+					{ "array_add_array", [](TinymoeArgumentSpan arguments) { return ArrayElementwise(arguments.at(0), arguments.at(1), TinymoeArray::Arithmetic::Add); } },
+					{ "array_sub_array", [](TinymoeArgumentSpan arguments) { return ArrayElementwise(arguments.at(0), arguments.at(1), TinymoeArray::Arithmetic::Sub); } },
+					{ "array_mul_array", [](TinymoeArgumentSpan arguments) { return ArrayElementwise(arguments.at(0), arguments.at(1), TinymoeArray::Arithmetic::Mul); } },
+					{ "array_div_array", [](TinymoeArgumentSpan arguments) { return ArrayElementwise(arguments.at(0), arguments.at(1), TinymoeArray::Arithmetic::Div); } },
+				};
+
+				auto it = functions.find(name);
+				if (it == functions.end())
+				{
+					throw TinymoeException("External function \"" + name + "\" does not exist.");
+				}
+				return it->second;
+			}
+
+			static const TinymoeAsyncExternalFunction* GetAsyncExternalFunction(const string& name)
+			{
+				static map<string, TinymoeAsyncExternalFunction> functions =
+				{
+					{ "ReadFile", [](TinymoeArgumentSpan arguments, const shared_ptr<TinymoeResumption>& resumption)
+						{
+							ReadFile(CastToString(arguments.at(0))->Value(), resumption);
+						}
+					},
+					{ "WriteFile", [](TinymoeArgumentSpan arguments, const shared_ptr<TinymoeResumption>& resumption)
+						{
+							auto path = CastToString(arguments.at(0))->Value();
+							auto content = CastToString(arguments.at(1))->Value();
+							WriteFile(path, content, resumption);
+						}
+					},
+					{ "ReadInput", [](TinymoeArgumentSpan arguments, const shared_ptr<TinymoeResumption>& resumption)
+						{
+							ReadInput(resumption);
+						}
+					},
+					{ "Sleep", [](TinymoeArgumentSpan arguments, const shared_ptr<TinymoeResumption>& resumption)
+						{
+							Sleep(CastToInteger(arguments.at(0))->value, resumption);
+						}
+					},
+				};
+
+				auto it = functions.find(name);
+				return it == functions.end() ? nullptr : &it->second;
+			}
+
+			// host functions take precedence over built-in ones, so a host can redirect names like "Print"
+			static const TinymoeDirectExternalFunction* GetHostFunction(const string& name)
+			{
+				auto functions = TinymoeIsolate::Current()->hostFunctions;
+				if (!functions) return nullptr;
+				auto it = functions->find(name);
+				return it == functions->end() ? nullptr : &it->second;
+			}
+
+			static TinymoeObject::Ptr GetExternalFunction(const string& name)
+			{
+				auto& functions = TinymoeIsolate::Current()->externalFunctions;
+				auto it = functions.find(name);
+				if (it == functions.end())
+				{
+					auto host = GetHostFunction(name);
+					auto async = host ? nullptr : GetAsyncExternalFunction(name);
+					auto function = host ? BuildExternalFunction(*host) : async ? BuildAsyncExternalFunction(*async) : BuildExternalFunction(GetDirectExternalFunction(name));
+					it = functions.insert(make_pair(name, function)).first;
+				}
+				return it->second;
+			}
+
+			// the function that a direct-style call to an external function runs, TinymoeExternalSite calls this once per site
+			static const TinymoeDirectExternalFunction& GetInvokedExternalFunction(const string& name)
+			{
+				if (auto host = GetHostFunction(name))
+				{
+					return *host;
+				}
+				if (GetAsyncExternalFunction(name))
+				{
+					throw TinymoeException("External function \"" + name + "\" is asynchronous and can only be redirected to from a sentence declared with cps (state) (continuation).");
+				}
+				return GetDirectExternalFunction(name);
+			}
+
+			static TinymoeHandle<TinymoeBoolean> CastToBoolean(const TinymoeObject::Ptr& a)
+			{
+				return TinymoeHandle<TinymoeBoolean>(Cast<TinymoeBoolean>(a));
+			}
+
+			static TinymoeObject::Ptr CastToNumber(const TinymoeObject::Ptr& a)
+			{
+				if (dynamic_cast<TinymoeInteger*>(a.get()) || dynamic_cast<TinymoeFloat*>(a.get()))
+				{
+					return a;
+				}
+
+				auto value = Cast<TinymoeString>(a)->Value();
+				char* end = nullptr;
+				long i = strtol(value.c_str(), &end, 10);
+				if (value.size() > 0 && *end == 0 && i >= INT32_MIN && i <= INT32_MAX)
+				{
+					return New<TinymoeInteger>((int)i);
+				}
+				return New<TinymoeFloat>(stod(value));
+			}
+
+			static TinymoeHandle<TinymoeInteger> CastToInteger(const TinymoeObject::Ptr& a)
+			{
+				if (auto i = dynamic_cast<TinymoeInteger*>(a.get()))
+				{
+					return TinymoeHandle<TinymoeInteger>(i);
+				}
+				else if (auto f = dynamic_cast<TinymoeFloat*>(a.get()))
+				{
+					return New<TinymoeInteger>((int)f->value);
+				}
+				return New<TinymoeInteger>(stoi(Cast<TinymoeString>(a)->Value()));
+			}
+
+			static TinymoeHandle<TinymoeFloat> CastToFloat(const TinymoeObject::Ptr& a)
+			{
+				if (auto i = dynamic_cast<TinymoeInteger*>(a.get()))
+				{
+					return New<TinymoeFloat>((double)i->value);
+				}
+				else if (auto f = dynamic_cast<TinymoeFloat*>(a.get()))
+				{
+					return TinymoeHandle<TinymoeFloat>(f);
+				}
+				return New<TinymoeFloat>(stod(Cast<TinymoeString>(a)->Value()));
+			}
+
+			static string FloatToString(double value)
+			{
+				// the shortest representation that reads back to the same value
+				char buffer[32];
+				for (int precision = 15; precision <= 17; precision++)
+				{
+					snprintf(buffer, sizeof(buffer), "%.*G", precision, value);
+					if (strtod(buffer, nullptr) == value) break;
+				}
+				return buffer;
+			}
+
+			static TinymoeHandle<TinymoeString> CastToString(const TinymoeObject::Ptr& a)
+			{
+				if (!a)
+				{
+					return New<TinymoeString>("<null>");
+				}
+				else if (auto i = dynamic_cast<TinymoeInteger*>(a.get()))
+				{
+					return New<TinymoeString>(to_string(i->value));
+				}
+				else if (auto f = dynamic_cast<TinymoeFloat*>(a.get()))
+				{
+					return New<TinymoeString>(FloatToString(f->value));
+				}
+				else if (auto b = dynamic_cast<TinymoeBoolean*>(a.get()))
+				{
+					return New<TinymoeString>(b->value ? "True" : "False");
+				}
+				else if (auto s = dynamic_cast<TinymoeSymbol*>(a.get()))
+				{
+					return New<TinymoeString>(s->value);
+				}
+				else if (auto s = dynamic_cast<TinymoeString*>(a.get()))
+				{
+					return TinymoeHandle<TinymoeString>(s);
+				}
+				else if (dynamic_cast<TinymoeArray*>(a.get()))
+				{
+					return New<TinymoeString>("<array>");
+				}
+				else if (dynamic_cast<TinymoeFunction*>(a.get()))
+				{
+					return New<TinymoeString>("<function>");
+				}
+				return New<TinymoeString>("<" + a->GetType()->name + ">");
+			}
+		};
+
+		/*************************************************************
+		External Site
+		*************************************************************/
+
+		// a direct-style call to an external function, the function is resolved by the first call,
+		// host functions are registered before the isolate is created and the built-in tables never change, so the result is kept
+		class TinymoeExternalSite
+		{
+		private:
+			const char*									name;
+			const TinymoeDirectExternalFunction*		function = nullptr;
+
+		public:
+			TinymoeExternalSite(const char* _name)
+				:name(_name)
+			{
+			}
+
+			TinymoeExternalSite(const TinymoeExternalSite&) = delete;
+
+			TinymoeObject::Ptr Invoke(TinymoeArgumentSpan arguments)
+			{
+				if (!function)
+				{
+					function = &TinymoeOperations::GetInvokedExternalFunction(name);
+				}
+				return (*function)(arguments);
+			}
+		};
+
+		inline void TinymoeResumption::Resume(const TinymoeObject::Ptr& result)
+		{
+			auto resumedState = state;
+			auto resumedContinuation = continuation;
+			Finish(MakeContinuation([=]()
+			{
+				return TinymoeOperations::Invoke(resumedContinuation, { resumedState, result });
+			}));
+		}
+
+		inline void TinymoeResumption::Raise(const string& message)
+		{
+			Finish(MakeContinuation([=]() -> TinymoeContinuation
+			{
+				throw TinymoeException(message);
+			}));
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,310 @@
+#ifndef VCZH_NATIVE_TINYMOESCHEDULER
+#define VCZH_NATIVE_TINYMOESCHEDULER
+
+#include "TinymoeObject.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <thread>
+
+namespace tinymoe
+{
+	namespace native
+	{
+		/*************************************************************
+		Task
+		*************************************************************/
+
+		// one program instance, it is run by one worker at a time and may move to another worker between slices,
+		// a task suspended by asynchronous external functions stays in the queues and polls the event loop of its isolate
+		class TinymoeTask
+		{
+		public:
+			typedef function<TinymoeContinuation(shared_ptr<void>&)>	Starter;
+
+			// declared first so that the program and the continuation release their handles before it goes away
+			unique_ptr<TinymoeIsolate>					isolate;
+			shared_ptr<void>							program;
+			Starter										starter;
+			TinymoeContinuation							continuation;
+			bool										waiting = false;	// nothing to run until an asynchronous operation resumes
+		};
+
+		/*************************************************************
+		Scheduler
+		*************************************************************/
+
+		// runs independent program instances on a thread pool, every worker owns a queue and steals from other queues when its own is empty
+		class TinymoeScheduler
+		{
+		public:
+			// continuations a task runs before it gives other tasks in the same queue a chance to be stolen
+			static const int							SliceSize = 1024;
+			// milliseconds a worker with nothing else to run waits for the asynchronous operations of a task
+			static const int							WaitTimeout = 10;
+
+		private:
+			class Worker
+			{
+			public:
+				mutex									lock;
+				deque<shared_ptr<TinymoeTask>>			tasks;
+				thread									runner;
+			};
+
+			vector<unique_ptr<Worker>>					workers;
+			mutex										lock;
+			condition_variable							available;
+			condition_variable							finished;
+			atomic<int>									queued{ 0 };
+			atomic<int>									queuedWaiting{ 0 };
+			atomic<int>									sleeping{ 0 };
+			atomic<int>									remaining{ 0 };
+			bool										stopping = false;
+			exception_ptr								error;
+
+			void Push(Worker& worker, const shared_ptr<TinymoeTask>& task, bool front)
+			{
+				{
+					lock_guard<mutex> guard(worker.lock);
+					if (front)
+					{
+						worker.tasks.push_front(task);
+					}
+					else
+					{
+						worker.tasks.push_back(task);
+					}
+				}
+				if (task->waiting)
+				{
+					queuedWaiting++;
+				}
+				queued++;
+				if (sleeping > 0)
+				{
+					lock_guard<mutex> guard(lock);
+					available.notify_one();
+				}
+			}
+
+			// the owner takes the task it just yielded from the front, thieves take tasks that have waited the longest from the back
+			shared_ptr<TinymoeTask> Take(int index)
+			{
+				for (int i = 0; (size_t)i < workers.size(); i++)
+				{
+					auto& worker = *workers[(index + i) % workers.size()];
+					lock_guard<mutex> guard(worker.lock);
+					if (worker.tasks.size() > 0)
+					{
+						shared_ptr<TinymoeTask> task;
+						if (i == 0)
+						{
+							task = worker.tasks.front();
+							worker.tasks.pop_front();
+						}
+						else
+						{
+							task = worker.tasks.back();
+							worker.tasks.pop_back();
+							steals++;
+						}
+						if (task->waiting)
+						{
+							queuedWaiting--;
+						}
+						queued--;
+						return task;
+					}
+				}
+				return nullptr;
+			}
+
+			void Run(Worker& worker, shared_ptr<TinymoeTask> task)
+			{
+				bool completed = false;
+				{
+					// the isolate is created on the first slice, so tasks waiting in queues stay small
+					if (!task->isolate)
+					{
+						task->isolate.reset(new TinymoeIsolate);
+					}
+					TinymoeIsolateScope scope(task->isolate.get());
+					try
+					{
+						if (task->starter)
+						{
+							auto starter = move(task->starter);
+							task->continuation = starter(task->program);
+						}
+						for (int i = 0; i < SliceSize; i++)
+						{
+							if (!task->continuation && !(task->continuation = TinymoeOperations::WaitForContinuation(0)))
+							{
+								break;
+							}
+							task->continuation = task->continuation->Run();
+						}
+
+						auto isolate = task->isolate.get();
+						if (!task->continuation && isolate->ready.size() == 0 && isolate->suspended > 0 && queued == queuedWaiting)
+						{
+							// every queued task is waiting too, so block here instead of spinning through the queues
+							task->continuation = TinymoeOperations::WaitForContinuation(WaitTimeout);
+						}
+						task->waiting = !task->continuation && isolate->ready.size() == 0;
+						completed = task->waiting && isolate->suspended == 0;
+					}
+					catch (...)
+					{
+						lock_guard<mutex> guard(lock);
+						if (!error)
+						{
+							error = current_exception();
+						}
+						failures++;
+						completed = true;
+					}
+					slices++;
+					if (completed)
+					{
+						task->continuation = nullptr;
+						task->program = nullptr;
+					}
+				}
+
+				if (completed)
+				{
+					task = nullptr;
+					if (--remaining == 0)
+					{
+						lock_guard<mutex> guard(lock);
+						finished.notify_all();
+					}
+				}
+				else
+				{
+					// a task waiting for asynchronous operations lets other tasks in the queue run first
+					Push(worker, task, !task->waiting);
+				}
+			}
+
+			void WorkerMain(int index)
+			{
+				while (true)
+				{
+					if (auto task = Take(index))
+					{
+						Run(*workers[index], move(task));
+						continue;
+					}
+
+					unique_lock<mutex> guard(lock);
+					sleeping++;
+					available.wait(guard, [&]() { return stopping || queued > 0; });
+					sleeping--;
+					if (stopping)
+					{
+						return;
+					}
+				}
+			}
+
+			void Stop()
+			{
+				{
+					lock_guard<mutex> guard(lock);
+					stopping = true;
+					available.notify_all();
+				}
+				for (auto& worker : workers)
+				{
+					if (worker->runner.joinable())
+					{
+						worker->runner.join();
+					}
+				}
+			}
+
+		public:
+			atomic<uint64_t>							spawned{ 0 };
+			atomic<uint64_t>							slices{ 0 };
+			atomic<uint64_t>							steals{ 0 };
+			uint64_t									failures = 0;
+
+			// 0 threads means TINYMOE_THREADS, or one thread per core
+			TinymoeScheduler(int threads = 0)
+			{
+				if (threads <= 0)
+				{
+					if (auto value = getenv("TINYMOE_THREADS"))
+					{
+						threads = atoi(value);
+					}
+				}
+				if (threads <= 0)
+				{
+					threads = (int)thread::hardware_concurrency();
+				}
+				if (threads <= 0)
+				{
+					threads = 1;
+				}
+
+				for (int i = 0; i < threads; i++)
+				{
+					workers.push_back(unique_ptr<Worker>(new Worker));
+				}
+				for (int i = 0; i < threads; i++)
+				{
+					workers[i]->runner = thread([=]() { WorkerMain(i); });
+				}
+			}
+
+			TinymoeScheduler(const TinymoeScheduler&) = delete;
+
+			~TinymoeScheduler()
+			{
+				Stop();
+			}
+
+			// the program is constructed in the task's own isolate, start returns the first continuation of the instance
+			template<typename TProgram>
+			void Spawn(TinymoeContinuation(*start)(TProgram&))
+			{
+				auto task = make_shared<TinymoeTask>();
+				task->starter = [=](shared_ptr<void>& program)
+				{
+					auto instance = make_shared<TProgram>();
+					program = instance;
+					return start(*instance);
+				};
+				remaining++;
+				Push(*workers[spawned++ % workers.size()], task, false);
+			}
+
+			// blocks until every spawned task finishes, the first failure is rethrown
+			void Wait()
+			{
+				{
+					unique_lock<mutex> guard(lock);
+					finished.wait(guard, [&]() { return remaining == 0; });
+				}
+				Stop();
+				if (error)
+				{
+					rethrow_exception(error);
+				}
+			}
+
+			void WriteStatistics(ostream& o)
+			{
+				o << "scheduler: " << workers.size() << " workers, " << spawned << " tasks, " << failures << " failed" << endl;
+				o << "scheduler: " << slices << " slices, " << steals << " steals" << endl;
+			}
+		};
+	}
+}
+
+#endif
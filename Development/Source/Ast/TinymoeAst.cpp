@@ -8,7 +8,8 @@ namespace tinymoe
 		AstNode
 		*************************************************************/
 
-		AstNode::AstNode()
+		AstNode::AstNode(AstNodeKind _kind)
+			:kind(_kind)
 		{
 		}
 
@@ -64,26 +65,51 @@ namespace tinymoe
 		Node
 		*************************************************************/
 
+		AstType::AstType(AstNodeKind _kind)
+			:AstNode(_kind)
+		{
+		}
+
 		void AstType::Accept(AstVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstExpression::AstExpression(AstNodeKind _kind)
+			:AstNode(_kind)
+		{
+		}
+
 		void AstExpression::Accept(AstVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstStatement::AstStatement(AstNodeKind _kind)
+			:AstNode(_kind)
+		{
+		}
+
 		void AstStatement::Accept(AstVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstDeclaration::AstDeclaration(AstNodeKind _kind)
+			:AstNode(_kind)
+		{
+		}
+
 		void AstDeclaration::Accept(AstVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstAssembly::AstAssembly()
+			:AstNode(NodeKind)
+		{
+		}
+
 		void AstAssembly::Accept(AstVisitor* visitor)
 		{
 			visitor->Visit(this);
@@ -93,11 +119,21 @@ namespace tinymoe
 		Type
 		*************************************************************/
 
+		AstPredefinedType::AstPredefinedType()
+			:AstType(NodeKind)
+		{
+		}
+
 		void AstPredefinedType::Accept(AstTypeVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstReferenceType::AstReferenceType()
+			:AstType(NodeKind)
+		{
+		}
+
 		void AstReferenceType::Accept(AstTypeVisitor* visitor)
 		{
 			visitor->Visit(this);
@@ -107,105 +143,225 @@ namespace tinymoe
 		Expression
 		*************************************************************/
 
+		AstLiteralExpression::AstLiteralExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstLiteralExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstIntegerExpression::AstIntegerExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstIntegerExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstFloatExpression::AstFloatExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstFloatExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstStringExpression::AstStringExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstStringExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstExternalSymbolExpression::AstExternalSymbolExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstExternalSymbolExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstReferenceExpression::AstReferenceExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstReferenceExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstNewTypeExpression::AstNewTypeExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstNewTypeExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstTestTypeExpression::AstTestTypeExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstTestTypeExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstNewArrayExpression::AstNewArrayExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstNewArrayExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstNewArrayLiteralExpression::AstNewArrayLiteralExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstNewArrayLiteralExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstArrayLengthExpression::AstArrayLengthExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstArrayLengthExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstArrayAccessExpression::AstArrayAccessExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstArrayAccessExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstFieldAccessExpression::AstFieldAccessExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstFieldAccessExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstInvokeExpression::AstInvokeExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstInvokeExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstLambdaExpression::AstLambdaExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
 		void AstLambdaExpression::Accept(AstExpressionVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstDispatchExpression::AstDispatchExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
+		void AstDispatchExpression::Accept(AstExpressionVisitor* visitor)
+		{
+			visitor->Visit(this);
+		}
+
+		AstPrimitiveExpression::AstPrimitiveExpression()
+			:AstExpression(NodeKind)
+		{
+		}
+
+		void AstPrimitiveExpression::Accept(AstExpressionVisitor* visitor)
+		{
+			visitor->Visit(this);
+		}
+
 		/*************************************************************
 		Statement
 		*************************************************************/
 
+		AstBlockStatement::AstBlockStatement()
+			:AstStatement(NodeKind)
+		{
+		}
+
 		void AstBlockStatement::Accept(AstStatementVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstExpressionStatement::AstExpressionStatement()
+			:AstStatement(NodeKind)
+		{
+		}
+
 		void AstExpressionStatement::Accept(AstStatementVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstDeclarationStatement::AstDeclarationStatement()
+			:AstStatement(NodeKind)
+		{
+		}
+
 		void AstDeclarationStatement::Accept(AstStatementVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstAssignmentStatement::AstAssignmentStatement()
+			:AstStatement(NodeKind)
+		{
+		}
+
 		void AstAssignmentStatement::Accept(AstStatementVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstIfStatement::AstIfStatement()
+			:AstStatement(NodeKind)
+		{
+		}
+
 		void AstIfStatement::Accept(AstStatementVisitor* visitor)
 		{
 			visitor->Visit(this);
@@ -215,20 +371,45 @@ namespace tinymoe
 		Declaration
 		*************************************************************/
 
+		AstSymbolDeclaration::AstSymbolDeclaration()
+			:AstDeclaration(NodeKind)
+		{
+		}
+
 		void AstSymbolDeclaration::Accept(AstDeclarationVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstTypeDeclaration::AstTypeDeclaration()
+			:AstDeclaration(NodeKind)
+		{
+		}
+
 		void AstTypeDeclaration::Accept(AstDeclarationVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstFunctionDeclaration::AstFunctionDeclaration()
+			:AstDeclaration(NodeKind)
+		{
+		}
+
 		void AstFunctionDeclaration::Accept(AstDeclarationVisitor* visitor)
 		{
 			visitor->Visit(this);
 		}
 
+		AstDispatchTableDeclaration::AstDispatchTableDeclaration()
+			:AstDeclaration(NodeKind)
+		{
+		}
+
+		void AstDispatchTableDeclaration::Accept(AstDeclarationVisitor* visitor)
+		{
+			visitor->Visit(this);
+		}
+
 	}
 }
\ No newline at end of file
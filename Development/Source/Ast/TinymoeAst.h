@@ -2,6 +2,7 @@
 #define VCZH_AST_TINYMOEAST
 
 #include "../TinymoeSTL.h"
+#include "../TinymoeEmitter.h"
 
 namespace tinymoe
 {
@@ -22,15 +23,55 @@ namespace tinymoe
 		class AstStatementVisitor;
 		class AstDeclarationVisitor;
 
+		// node kinds of the same category are put together, so a category is a range of kinds
+		enum class AstNodeKind
+		{
+			SymbolDeclaration,
+			TypeDeclaration,
+			FunctionDeclaration,
+			DispatchTableDeclaration,
+
+			LiteralExpression,
+			IntegerExpression,
+			FloatExpression,
+			StringExpression,
+			ExternalSymbolExpression,
+			ReferenceExpression,
+			NewTypeExpression,
+			TestTypeExpression,
+			NewArrayExpression,
+			NewArrayLiteralExpression,
+			ArrayLengthExpression,
+			ArrayAccessExpression,
+			FieldAccessExpression,
+			InvokeExpression,
+			LambdaExpression,
+			DispatchExpression,
+			PrimitiveExpression,
+
+			BlockStatement,
+			ExpressionStatement,
+			DeclarationStatement,
+			AssignmentStatement,
+			IfStatement,
+
+			PredefinedType,
+			ReferenceType,
+
+			Assembly,
+		};
+
 		class AstNode : public enable_shared_from_this<AstNode>
 		{
 		public:
 			typedef shared_ptr<AstNode>				Ptr;
 			typedef weak_ptr<AstNode>				WeakPtr;
 
+			const AstNodeKind						kind;				// the class of the node, for testing and dispatching without virtual functions
 			WeakPtr									parent;
+			bool									shared = false;		// set by InternAst, a shared node is owned by many nodes, so parent is empty
 
-			AstNode();
+			AstNode(AstNodeKind _kind);
 			virtual ~AstNode();
 			
 			virtual void							Accept(AstVisitor* visitor) = 0;
@@ -43,6 +84,8 @@ namespace tinymoe
 			typedef weak_ptr<AstType>				WeakPtr;
 			typedef vector<Ptr>						List;
 
+			AstType(AstNodeKind _kind);
+
 			void									Accept(AstVisitor* visitor)override;
 			virtual void							Accept(AstTypeVisitor* visitor) = 0;
 		};
@@ -54,6 +97,8 @@ namespace tinymoe
 			typedef weak_ptr<AstExpression>			WeakPtr;
 			typedef vector<Ptr>						List;
 			
+			AstExpression(AstNodeKind _kind);
+
 			void									Accept(AstVisitor* visitor)override;
 			virtual void							Accept(AstExpressionVisitor* visitor) = 0;
 		};
@@ -65,6 +110,8 @@ namespace tinymoe
 			typedef weak_ptr<AstStatement>			WeakPtr;
 			typedef vector<Ptr>						List;
 			
+			AstStatement(AstNodeKind _kind);
+
 			void									Accept(AstVisitor* visitor)override;
 			virtual void							Accept(AstStatementVisitor* visitor) = 0;
 		};
@@ -78,6 +125,8 @@ namespace tinymoe
 
 			string_t								composedName;
 			
+			AstDeclaration(AstNodeKind _kind);
+
 			void									Accept(AstVisitor* visitor)override;
 			virtual void							Accept(AstDeclarationVisitor* visitor) = 0;
 		};
@@ -92,6 +141,10 @@ namespace tinymoe
 			typedef shared_ptr<AstSymbolDeclaration>			Ptr;
 			typedef vector<Ptr>									List;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::SymbolDeclaration;
+
+			AstSymbolDeclaration();
+
 			void									Accept(AstDeclarationVisitor* visitor)override;
 		};
 
@@ -103,6 +156,10 @@ namespace tinymoe
 			AstType::WeakPtr						baseType;
 			AstSymbolDeclaration::List				fields;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::TypeDeclaration;
+
+			AstTypeDeclaration();
+
 			void									Accept(AstDeclarationVisitor* visitor)override;
 		};
 
@@ -122,8 +179,30 @@ namespace tinymoe
 			AstSymbolDeclaration::Ptr				stateArgument;				// for function
 			AstSymbolDeclaration::Ptr				signalArgument;				// (optional) for block
 			AstSymbolDeclaration::Ptr				blockBodyArgument;			// (optional) for block
-			AstSymbolDeclaration::Ptr				continuationArgument;		// for function
+			AstSymbolDeclaration::Ptr				continuationArgument;		// (optional) for function, a direct-style function has no continuation and returns resultVariable
+			
+			static const AstNodeKind				NodeKind = AstNodeKind::FunctionDeclaration;
+
+			AstFunctionDeclaration();
+
+			void									Accept(AstDeclarationVisitor* visitor)override;
+		};
+
+		class AstDispatchTableDeclaration : public AstDeclaration
+		{
+		public:
+			typedef shared_ptr<AstDispatchTableDeclaration>		Ptr;
+			typedef weak_ptr<AstDispatchTableDeclaration>		WeakPtr;
+
+			weak_ptr<AstFunctionDeclaration>		rootFunction;
+			vector<int>								dispatchArguments;	// indexes of dispatched arguments in rootFunction->arguments
+			vector<AstType::List>					dimensions;			// candidate types for each dispatched argument, $Object always comes first
+			vector<weak_ptr<AstFunctionDeclaration>>	targets;			// the function to call for each type tuple, the last dimension changes fastest
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::DispatchTableDeclaration;
+
+			AstDispatchTableDeclaration();
+
 			void									Accept(AstDeclarationVisitor* visitor)override;
 		};
 
@@ -143,6 +222,10 @@ namespace tinymoe
 		public:
 			AstLiteralName							literalName;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::LiteralExpression;
+
+			AstLiteralExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -151,6 +234,10 @@ namespace tinymoe
 		public:
 			int64_t									value;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::IntegerExpression;
+
+			AstIntegerExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -159,6 +246,10 @@ namespace tinymoe
 		public:
 			double									value;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::FloatExpression;
+
+			AstFloatExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -167,6 +258,10 @@ namespace tinymoe
 		public:
 			string_t								value;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::StringExpression;
+
+			AstStringExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -174,7 +269,13 @@ namespace tinymoe
 		{
 		public:
 			string_t								name;
+			bool									directStyle = false;	// if true, invoking this function returns the result instead of calling the continuation
+			bool									asynchronous = false;	// if true, the function may keep the continuation and call it later, so it is never invoked in direct style
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::ExternalSymbolExpression;
+
+			AstExternalSymbolExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -185,6 +286,10 @@ namespace tinymoe
 																		//     AstSymbolDeclaration
 																		//     AstFunctionDeclaration
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::ReferenceExpression;
+
+			AstReferenceExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -194,6 +299,10 @@ namespace tinymoe
 			AstType::Ptr							type;
 			AstExpression::List						fields;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::NewTypeExpression;
+
+			AstNewTypeExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -203,6 +312,10 @@ namespace tinymoe
 			AstExpression::Ptr						target;
 			AstType::Ptr							type;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::TestTypeExpression;
+
+			AstTestTypeExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -211,6 +324,10 @@ namespace tinymoe
 		public:
 			AstExpression::Ptr						length;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::NewArrayExpression;
+
+			AstNewArrayExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -219,6 +336,10 @@ namespace tinymoe
 		public:
 			AstExpression::List						elements;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::NewArrayLiteralExpression;
+
+			AstNewArrayLiteralExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -227,6 +348,10 @@ namespace tinymoe
 		public:
 			AstExpression::Ptr						target;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::ArrayLengthExpression;
+
+			AstArrayLengthExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -236,6 +361,10 @@ namespace tinymoe
 			AstExpression::Ptr						target;
 			AstExpression::Ptr						index;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::ArrayAccessExpression;
+
+			AstArrayAccessExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -245,6 +374,10 @@ namespace tinymoe
 			AstExpression::Ptr						target;
 			string_t								composedFieldName;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::FieldAccessExpression;
+
+			AstFieldAccessExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -254,6 +387,10 @@ namespace tinymoe
 			AstExpression::Ptr						function;
 			AstExpression::List						arguments;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::InvokeExpression;
+
+			AstInvokeExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -263,6 +400,66 @@ namespace tinymoe
 			AstSymbolDeclaration::List				arguments;
 			AstStatement::Ptr						statement;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::LambdaExpression;
+
+			AstLambdaExpression();
+
+			void									Accept(AstExpressionVisitor* visitor)override;
+		};
+
+		class AstDispatchExpression : public AstExpression
+		{
+		public:
+			AstDispatchTableDeclaration::WeakPtr	table;
+			AstExpression::List						arguments;			// values of the dispatched arguments, evaluates to the selected function
+			
+			static const AstNodeKind				NodeKind = AstNodeKind::DispatchExpression;
+
+			AstDispatchExpression();
+
+			void									Accept(AstExpressionVisitor* visitor)override;
+		};
+
+		enum class AstPrimitiveOperator
+		{
+			IntegerPositive,
+			FloatPositive,
+			IntegerNegative,
+			FloatNegative,
+			BooleanNot,
+			StringConcat,
+			IntegerAdd,
+			FloatAdd,
+			IntegerSub,
+			FloatSub,
+			IntegerMul,
+			FloatMul,
+			IntegerDiv,
+			FloatDiv,
+			IntegerIntDiv,
+			IntegerMod,
+			IntegerEqual,
+			FloatEqual,
+			StringEqual,
+			BooleanEqual,
+			IntegerCompare,
+			FloatCompare,
+			StringCompare,
+			BooleanAnd,
+			BooleanOr,
+			IntegerToFloat,
+		};
+
+		class AstPrimitiveExpression : public AstExpression
+		{
+		public:
+			AstPrimitiveOperator					op;
+			AstExpression::List						operands;			// values of the proven operand types, the operation never dispatches
+			
+			static const AstNodeKind				NodeKind = AstNodeKind::PrimitiveExpression;
+
+			AstPrimitiveExpression();
+
 			void									Accept(AstExpressionVisitor* visitor)override;
 		};
 
@@ -275,6 +472,10 @@ namespace tinymoe
 		public:
 			AstStatement::List						statements;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::BlockStatement;
+
+			AstBlockStatement();
+
 			void									Accept(AstStatementVisitor* visitor)override;
 		};
 
@@ -283,6 +484,10 @@ namespace tinymoe
 		public:
 			AstExpression::Ptr						expression;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::ExpressionStatement;
+
+			AstExpressionStatement();
+
 			void									Accept(AstStatementVisitor* visitor)override;
 		};
 
@@ -291,6 +496,10 @@ namespace tinymoe
 		public:
 			AstDeclaration::Ptr						declaration;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::DeclarationStatement;
+
+			AstDeclarationStatement();
+
 			void									Accept(AstStatementVisitor* visitor)override;
 		};
 
@@ -303,6 +512,10 @@ namespace tinymoe
 																		//     AstArrayAccessExpression
 			AstExpression::Ptr						value;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::AssignmentStatement;
+
+			AstAssignmentStatement();
+
 			void									Accept(AstStatementVisitor* visitor)override;
 		};
 
@@ -314,6 +527,10 @@ namespace tinymoe
 			AstStatement::Ptr						trueBranch;
 			AstStatement::Ptr						falseBranch;		// (optional)
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::IfStatement;
+
+			AstIfStatement();
+
 			void									Accept(AstStatementVisitor* visitor)override;
 		};
 
@@ -338,6 +555,10 @@ namespace tinymoe
 		public:
 			AstPredefinedTypeName					typeName;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::PredefinedType;
+
+			AstPredefinedType();
+
 			void									Accept(AstTypeVisitor* visitor)override;
 		};
 
@@ -346,6 +567,10 @@ namespace tinymoe
 		public:
 			weak_ptr<AstTypeDeclaration>			typeDeclaration;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::ReferenceType;
+
+			AstReferenceType();
+
 			void									Accept(AstTypeVisitor* visitor)override;
 		};
 
@@ -360,6 +585,10 @@ namespace tinymoe
 
 			AstDeclaration::List					declarations;
 			
+			static const AstNodeKind				NodeKind = AstNodeKind::Assembly;
+
+			AstAssembly();
+
 			void									Accept(AstVisitor* visitor)override;
 		};
 
@@ -411,6 +640,8 @@ namespace tinymoe
 			virtual void							Visit(AstFieldAccessExpression* node) = 0;
 			virtual void							Visit(AstInvokeExpression* node) = 0;
 			virtual void							Visit(AstLambdaExpression* node) = 0;
+			virtual void							Visit(AstDispatchExpression* node) = 0;
+			virtual void							Visit(AstPrimitiveExpression* node) = 0;
 		};
 
 		class AstStatementVisitor
@@ -435,6 +666,439 @@ namespace tinymoe
 			virtual void							Visit(AstSymbolDeclaration* node) = 0;
 			virtual void							Visit(AstTypeDeclaration* node) = 0;
 			virtual void							Visit(AstFunctionDeclaration* node) = 0;
+			virtual void							Visit(AstDispatchTableDeclaration* node) = 0;
+		};
+
+		/*************************************************************
+		Kind Dispatching
+		*************************************************************/
+
+		// the range of kinds of a node class, a concrete class has only one kind
+		template<typename T>
+		struct AstNodeKindRange
+		{
+			static const AstNodeKind				First = T::NodeKind;
+			static const AstNodeKind				Last = T::NodeKind;
+		};
+
+		template<>
+		struct AstNodeKindRange<AstNode>
+		{
+			static const AstNodeKind				First = AstNodeKind::SymbolDeclaration;
+			static const AstNodeKind				Last = AstNodeKind::Assembly;
+		};
+
+		template<>
+		struct AstNodeKindRange<AstDeclaration>
+		{
+			static const AstNodeKind				First = AstNodeKind::SymbolDeclaration;
+			static const AstNodeKind				Last = AstNodeKind::DispatchTableDeclaration;
+		};
+
+		template<>
+		struct AstNodeKindRange<AstExpression>
+		{
+			static const AstNodeKind				First = AstNodeKind::LiteralExpression;
+			static const AstNodeKind				Last = AstNodeKind::PrimitiveExpression;
+		};
+
+		template<>
+		struct AstNodeKindRange<AstStatement>
+		{
+			static const AstNodeKind				First = AstNodeKind::BlockStatement;
+			static const AstNodeKind				Last = AstNodeKind::IfStatement;
+		};
+
+		template<>
+		struct AstNodeKindRange<AstType>
+		{
+			static const AstNodeKind				First = AstNodeKind::PredefinedType;
+			static const AstNodeKind				Last = AstNodeKind::ReferenceType;
+		};
+
+		template<typename T>
+		bool IsAstNode(const AstNode* node)
+		{
+			return node && AstNodeKindRange<T>::First <= node->kind && node->kind <= AstNodeKindRange<T>::Last;
+		}
+
+		// works like dynamic_pointer_cast, but only compares the kind
+		template<typename T, typename U>
+		shared_ptr<T> AstNodeCast(const shared_ptr<U>& node)
+		{
+			return IsAstNode<T>(node.get()) ? static_pointer_cast<T>(node) : nullptr;
+		}
+
+		// the Dispatch functions call visitor.Visit with the concrete class of the node by switching on the kind,
+		// a visitor could be any class with these Visit functions, if it is an AstXXXVisitor it should be final, so that Visit is not called virtually
+
+		template<typename TVisitor>
+		void Dispatch(AstType* node, TVisitor& visitor)
+		{
+			switch (node->kind)
+			{
+			case AstNodeKind::PredefinedType:				visitor.Visit(static_cast<AstPredefinedType*>(node)); break;
+			case AstNodeKind::ReferenceType:				visitor.Visit(static_cast<AstReferenceType*>(node)); break;
+			default:										ASSERT(false);
+			}
+		}
+
+		template<typename TVisitor>
+		void Dispatch(AstExpression* node, TVisitor& visitor)
+		{
+			switch (node->kind)
+			{
+			case AstNodeKind::LiteralExpression:			visitor.Visit(static_cast<AstLiteralExpression*>(node)); break;
+			case AstNodeKind::IntegerExpression:			visitor.Visit(static_cast<AstIntegerExpression*>(node)); break;
+			case AstNodeKind::FloatExpression:				visitor.Visit(static_cast<AstFloatExpression*>(node)); break;
+			case AstNodeKind::StringExpression:				visitor.Visit(static_cast<AstStringExpression*>(node)); break;
+			case AstNodeKind::ExternalSymbolExpression:		visitor.Visit(static_cast<AstExternalSymbolExpression*>(node)); break;
+			case AstNodeKind::ReferenceExpression:			visitor.Visit(static_cast<AstReferenceExpression*>(node)); break;
+			case AstNodeKind::NewTypeExpression:			visitor.Visit(static_cast<AstNewTypeExpression*>(node)); break;
+			case AstNodeKind::TestTypeExpression:			visitor.Visit(static_cast<AstTestTypeExpression*>(node)); break;
+			case AstNodeKind::NewArrayExpression:			visitor.Visit(static_cast<AstNewArrayExpression*>(node)); break;
+			case AstNodeKind::NewArrayLiteralExpression:	visitor.Visit(static_cast<AstNewArrayLiteralExpression*>(node)); break;
+			case AstNodeKind::ArrayLengthExpression:		visitor.Visit(static_cast<AstArrayLengthExpression*>(node)); break;
+			case AstNodeKind::ArrayAccessExpression:		visitor.Visit(static_cast<AstArrayAccessExpression*>(node)); break;
+			case AstNodeKind::FieldAccessExpression:		visitor.Visit(static_cast<AstFieldAccessExpression*>(node)); break;
+			case AstNodeKind::InvokeExpression:				visitor.Visit(static_cast<AstInvokeExpression*>(node)); break;
+			case AstNodeKind::LambdaExpression:				visitor.Visit(static_cast<AstLambdaExpression*>(node)); break;
+			case AstNodeKind::DispatchExpression:			visitor.Visit(static_cast<AstDispatchExpression*>(node)); break;
+			case AstNodeKind::PrimitiveExpression:			visitor.Visit(static_cast<AstPrimitiveExpression*>(node)); break;
+			default:										ASSERT(false);
+			}
+		}
+
+		template<typename TVisitor>
+		void Dispatch(AstStatement* node, TVisitor& visitor)
+		{
+			switch (node->kind)
+			{
+			case AstNodeKind::BlockStatement:				visitor.Visit(static_cast<AstBlockStatement*>(node)); break;
+			case AstNodeKind::ExpressionStatement:			visitor.Visit(static_cast<AstExpressionStatement*>(node)); break;
+			case AstNodeKind::DeclarationStatement:			visitor.Visit(static_cast<AstDeclarationStatement*>(node)); break;
+			case AstNodeKind::AssignmentStatement:			visitor.Visit(static_cast<AstAssignmentStatement*>(node)); break;
+			case AstNodeKind::IfStatement:					visitor.Visit(static_cast<AstIfStatement*>(node)); break;
+			default:										ASSERT(false);
+			}
+		}
+
+		template<typename TVisitor>
+		void Dispatch(AstDeclaration* node, TVisitor& visitor)
+		{
+			switch (node->kind)
+			{
+			case AstNodeKind::SymbolDeclaration:			visitor.Visit(static_cast<AstSymbolDeclaration*>(node)); break;
+			case AstNodeKind::TypeDeclaration:				visitor.Visit(static_cast<AstTypeDeclaration*>(node)); break;
+			case AstNodeKind::FunctionDeclaration:			visitor.Visit(static_cast<AstFunctionDeclaration*>(node)); break;
+			case AstNodeKind::DispatchTableDeclaration:		visitor.Visit(static_cast<AstDispatchTableDeclaration*>(node)); break;
+			default:										ASSERT(false);
+			}
+		}
+
+		// calls callback(child) with the shared_ptr of every node owned by the node, a weak reference is not a child,
+		// the callback should accept any shared_ptr<T>&, and it could replace the child with a node of the same category
+		template<typename TCallback>
+		void ForEachChildPtr(AstNode* node, TCallback&& callback)
+		{
+			switch (node->kind)
+			{
+			case AstNodeKind::TypeDeclaration:
+				{
+					auto decl = static_cast<AstTypeDeclaration*>(node);
+					for (auto& field : decl->fields)
+					{
+						callback(field);
+					}
+				}
+				break;
+			case AstNodeKind::FunctionDeclaration:
+				{
+					auto decl = static_cast<AstFunctionDeclaration*>(node);
+					if (decl->ownerType)
+					{
+						callback(decl->ownerType);
+					}
+					for (auto& argument : decl->arguments)
+					{
+						callback(argument);
+					}
+					callback(decl->statement);
+				}
+				break;
+			case AstNodeKind::DispatchTableDeclaration:
+				{
+					auto decl = static_cast<AstDispatchTableDeclaration*>(node);
+					for (auto& dimension : decl->dimensions)
+					{
+						for (auto& type : dimension)
+						{
+							callback(type);
+						}
+					}
+				}
+				break;
+			case AstNodeKind::NewTypeExpression:
+				{
+					auto expr = static_cast<AstNewTypeExpression*>(node);
+					callback(expr->type);
+					for (auto& field : expr->fields)
+					{
+						callback(field);
+					}
+				}
+				break;
+			case AstNodeKind::TestTypeExpression:
+				{
+					auto expr = static_cast<AstTestTypeExpression*>(node);
+					callback(expr->target);
+					callback(expr->type);
+				}
+				break;
+			case AstNodeKind::NewArrayExpression:
+				callback(static_cast<AstNewArrayExpression*>(node)->length);
+				break;
+			case AstNodeKind::NewArrayLiteralExpression:
+				for (auto& element : static_cast<AstNewArrayLiteralExpression*>(node)->elements)
+				{
+					callback(element);
+				}
+				break;
+			case AstNodeKind::ArrayLengthExpression:
+				callback(static_cast<AstArrayLengthExpression*>(node)->target);
+				break;
+			case AstNodeKind::ArrayAccessExpression:
+				{
+					auto expr = static_cast<AstArrayAccessExpression*>(node);
+					callback(expr->target);
+					callback(expr->index);
+				}
+				break;
+			case AstNodeKind::FieldAccessExpression:
+				callback(static_cast<AstFieldAccessExpression*>(node)->target);
+				break;
+			case AstNodeKind::InvokeExpression:
+				{
+					auto expr = static_cast<AstInvokeExpression*>(node);
+					callback(expr->function);
+					for (auto& argument : expr->arguments)
+					{
+						callback(argument);
+					}
+				}
+				break;
+			case AstNodeKind::LambdaExpression:
+				{
+					auto expr = static_cast<AstLambdaExpression*>(node);
+					for (auto& argument : expr->arguments)
+					{
+						callback(argument);
+					}
+					callback(expr->statement);
+				}
+				break;
+			case AstNodeKind::DispatchExpression:
+				for (auto& argument : static_cast<AstDispatchExpression*>(node)->arguments)
+				{
+					callback(argument);
+				}
+				break;
+			case AstNodeKind::PrimitiveExpression:
+				for (auto& operand : static_cast<AstPrimitiveExpression*>(node)->operands)
+				{
+					callback(operand);
+				}
+				break;
+			case AstNodeKind::BlockStatement:
+				for (auto& statement : static_cast<AstBlockStatement*>(node)->statements)
+				{
+					callback(statement);
+				}
+				break;
+			case AstNodeKind::ExpressionStatement:
+				callback(static_cast<AstExpressionStatement*>(node)->expression);
+				break;
+			case AstNodeKind::DeclarationStatement:
+				callback(static_cast<AstDeclarationStatement*>(node)->declaration);
+				break;
+			case AstNodeKind::AssignmentStatement:
+				{
+					auto stat = static_cast<AstAssignmentStatement*>(node);
+					callback(stat->target);
+					callback(stat->value);
+				}
+				break;
+			case AstNodeKind::IfStatement:
+				{
+					auto stat = static_cast<AstIfStatement*>(node);
+					callback(stat->condition);
+					callback(stat->trueBranch);
+					if (stat->falseBranch)
+					{
+						callback(stat->falseBranch);
+					}
+				}
+				break;
+			case AstNodeKind::Assembly:
+				for (auto& decl : static_cast<AstAssembly*>(node)->declarations)
+				{
+					callback(decl);
+				}
+				break;
+			default:;
+			}
+		}
+
+		template<typename TCallback>
+		struct AstChildPtrCallback
+		{
+			TCallback&								callback;
+
+			template<typename T>
+			void operator()(shared_ptr<T>& child)
+			{
+				callback(child.get());
+			}
+		};
+
+		// calls callback(child) for every node owned by the node, a weak reference is not a child
+		template<typename TCallback>
+		void ForEachChild(AstNode* node, TCallback&& callback)
+		{
+			AstChildPtrCallback<TCallback> adapter = { callback };
+			ForEachChildPtr(node, adapter);
+		}
+
+		/*************************************************************
+		Binary Format
+		*************************************************************/
+
+		// a binary AST file is an AstBinaryHeader followed by four arrays, each array begins at a multiple of 8 bytes:
+		//     AstBinaryString[stringCount]		strings, each one is a range in the character array
+		//     AstBinaryNode[nodeCount]			nodes, the assembly is always node 0
+		//     uint32_t[referenceCount]			references of all nodes, each node owns a range
+		//     char_t[characterCount]				characters of all strings, not terminated by zero
+		// nodes refer to other nodes and strings by indexes, AstBinaryNull means nullptr or an empty string,
+		// so the file can be mapped to memory and read without being parsed or copied
+
+		enum class AstBinaryKind : uint16_t
+		{
+			Assembly,							// [declaration...]
+			SymbolDeclaration,					// []
+			TypeDeclaration,					// [baseType, field...]
+			FunctionDeclaration,				// [ownerType, statement, resultVariable, stateArgument, signalArgument, blockBodyArgument, continuationArgument,
+												//  argumentCount, argument..., readCount, (key, value)..., writeCount, (key, value)...]
+			DispatchTableDeclaration,			// [rootFunction, dispatchArgumentCount, dispatchArgument..., dimensionCount, (typeCount, type...)..., target...]
+			LiteralExpression,					// flags is AstLiteralName, []
+			IntegerExpression,					// value is integer, []
+			FloatExpression,					// value is floating, []
+			StringExpression,					// name is the value, []
+			ExternalSymbolExpression,			// flags has DirectStyle and Asynchronous, []
+			ReferenceExpression,				// [reference]
+			NewTypeExpression,					// [type, field...]
+			TestTypeExpression,					// [target, type]
+			NewArrayExpression,					// [length]
+			NewArrayLiteralExpression,			// [element...]
+			ArrayLengthExpression,				// [target]
+			ArrayAccessExpression,				// [target, index]
+			FieldAccessExpression,				// name is composedFieldName, [target]
+			InvokeExpression,					// [function, argument...]
+			LambdaExpression,					// [statement, argument...]
+			DispatchExpression,					// [table, argument...]
+			PrimitiveExpression,				// flags is AstPrimitiveOperator, [operand...]
+			BlockStatement,						// [statement...]
+			ExpressionStatement,				// [expression]
+			DeclarationStatement,				// [declaration]
+			AssignmentStatement,				// [target, value]
+			IfStatement,						// [condition, trueBranch, falseBranch]
+			PredefinedType,						// flags is AstPredefinedTypeName, []
+			ReferenceType,						// [typeDeclaration]
+		};
+
+		const uint32_t							AstBinaryNull = 0xFFFFFFFF;
+		const uint32_t							AstBinaryVersion = 1;
+		const uint16_t							AstBinaryDirectStyle = 1;
+		const uint16_t							AstBinaryAsynchronous = 2;
+		const uint16_t							AstBinaryShared = 0x8000;		// the node is shared, only nodes without children could be shared
+
+		struct AstBinaryHeader
+		{
+			char									magic[8];			// "TMAST" followed by zeros
+			uint32_t								version;			// AstBinaryVersion
+			uint32_t								byteOrder;			// 0x01020304 written in the byte order of the writer
+			uint32_t								characterSize;		// sizeof(char_t) of the writer
+			uint32_t								stringCount;
+			uint32_t								nodeCount;
+			uint32_t								referenceCount;
+			uint64_t								characterCount;
+			uint64_t								stringOffset;		// offsets of arrays from the beginning of the file
+			uint64_t								nodeOffset;
+			uint64_t								referenceOffset;
+			uint64_t								characterOffset;
+		};
+
+		struct AstBinaryString
+		{
+			uint64_t								begin;
+			uint64_t								length;
+		};
+
+		struct AstBinaryNode
+		{
+			AstBinaryKind							kind;
+			uint16_t								flags;
+			uint32_t								name;				// composedName of declarations, or the string in the node
+			uint32_t								referenceBegin;
+			uint32_t								referenceCount;
+			union
+			{
+				int64_t								integer;
+				double								floating;
+			}										value;
+		};
+
+		// reads a binary AST file in memory, the memory should be kept until the reader is no longer used
+		class AstBinaryReader
+		{
+		private:
+			const char*								data;
+			size_t									size;
+			const AstBinaryHeader*					header = nullptr;
+
+		public:
+			AstBinaryReader(const void* _data, size_t _size);
+
+			bool									IsValid();			// checks the header and the range of all arrays, indexes in nodes are checked by ReadAssembly
+			uint32_t								GetNodeCount();
+			const AstBinaryNode&					GetNode(uint32_t index);
+			const uint32_t*							GetReferences(const AstBinaryNode& node);
+			uint32_t								GetStringCount();
+			const char_t*							GetString(uint32_t index, size_t& length);	// points to the memory, nullptr for AstBinaryNull
+			string_t								ReadString(uint32_t index);
+			AstAssembly::Ptr						ReadAssembly();		// creates the AST, nullptr is returned if the file is broken
+		};
+
+		// maps a file to memory for AstBinaryReader
+		class AstBinaryFile
+		{
+		private:
+			void*									data = nullptr;
+			size_t									size = 0;
+#ifdef _MSC_VER
+			void*									file = nullptr;
+			void*									mapping = nullptr;
+#else
+			int										file = -1;
+#endif
+
+		public:
+			AstBinaryFile(const string& fileName);
+			AstBinaryFile(const AstBinaryFile&) = delete;
+			~AstBinaryFile();
+
+			bool									IsOpened();
+			const void*								GetData();
+			size_t									GetSize();
 		};
 
 		/*************************************************************
@@ -443,6 +1107,18 @@ namespace tinymoe
 		
 		extern void						SetParent(AstNode::Ptr node, AstNode::WeakPtr _parent = AstNode::WeakPtr());
 		extern void						Print(AstNode::Ptr node, ostream_t& o, int indentation, AstNode::WeakPtr _parent = AstNode::WeakPtr());
+		extern void						Print(AstNode::Ptr node, Emitter& o, AstNode::WeakPtr _parent = AstNode::WeakPtr());		// indented by the indentation stack of the emitter
+		extern void						WriteBinary(AstAssembly::Ptr node, ostream& o);		// o should be opened in binary mode, AssertFailedException is thrown before writing if a weak reference is outside of the assembly
+
+		struct AstInternStatistics
+		{
+			int									internedNodes = 0;		// nodes kept and shared by equal nodes
+			int									removedNodes = 0;		// nodes replaced by an equal interned node
+			size_t								removedBytes = 0;		// sizeof of removed nodes, control blocks and string buffers are not counted
+		};
+
+		extern bool						IsInternableNode(AstNode* node);
+		extern void						InternAst(AstAssembly::Ptr node, AstInternStatistics& statistics);		// should be called after SetParent, no pass could change the AST after that
 
 		extern void						CollectSideEffectExpressions(AstExpression::Ptr node, AstExpression::List& exprs);
 		extern void						CollectUsedVariables(AstExpression::Ptr node, bool rightValue, set<shared_ptr<AstDeclaration>>& defined, set<shared_ptr<AstDeclaration>>& used);
@@ -456,6 +1132,11 @@ namespace tinymoe
 		extern void						RoughlyOptimize(AstExpression::Ptr node, AstExpression::Ptr& _replacement);
 		extern void						RoughlyOptimize(AstStatement::Ptr node, AstStatement::Ptr& _replacement);
 		extern void						RoughlyOptimize(AstAssembly::Ptr node);
+
+		extern bool						IsSameType(AstType::Ptr a, AstType::Ptr b);
+		extern AstType::Ptr				GetBaseType(AstType::Ptr type);
+		extern void						PropagateTypes(AstAssembly::Ptr node);
+		extern void						ConvertToDirectStyle(AstAssembly::Ptr node);
 	}
 }
 
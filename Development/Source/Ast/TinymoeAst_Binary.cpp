@@ -0,0 +1,1082 @@
+#include "TinymoeAst.h"
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tinymoe
+{
+	namespace ast
+	{
+		/*************************************************************
+		AstBinaryWriter
+		*************************************************************/
+
+		class AstBinaryWriter
+		{
+		public:
+			vector<AstNode*>						nodes;
+			map<AstNode*, uint32_t>					nodeIndexes;
+			vector<AstBinaryNode>					records;
+			vector<uint32_t>						references;
+			vector<pair<size_t, AstNode*>>			weakReferences;		// positions in references to fill after all nodes are indexed
+
+			map<string_t, uint32_t>					stringIndexes;
+			vector<AstBinaryString>					strings;
+			string_t								characters;
+
+			uint32_t AddNode(AstNode::Ptr node)
+			{
+				if (!node)
+				{
+					return AstBinaryNull;
+				}
+				auto it = nodeIndexes.find(node.get());
+				if (it != nodeIndexes.end())
+				{
+					return it->second;
+				}
+				uint32_t index = (uint32_t)nodes.size();
+				nodes.push_back(node.get());
+				nodeIndexes.insert(make_pair(node.get(), index));
+				return index;
+			}
+
+			uint32_t AddString(const string_t& value)
+			{
+				if (value == T(""))
+				{
+					return AstBinaryNull;
+				}
+				auto it = stringIndexes.find(value);
+				if (it != stringIndexes.end())
+				{
+					return it->second;
+				}
+				AstBinaryString s = { characters.size(), value.size() };
+				uint32_t index = (uint32_t)strings.size();
+				characters += value;
+				strings.push_back(s);
+				stringIndexes.insert(make_pair(value, index));
+				return index;
+			}
+
+			AstBinaryNode& Begin(AstBinaryKind kind)
+			{
+				AstBinaryNode record;
+				memset(&record, 0, sizeof(record));
+				record.kind = kind;
+				record.name = AstBinaryNull;
+				record.referenceBegin = (uint32_t)references.size();
+				records.push_back(record);
+				return records.back();
+			}
+
+			void Strong(AstNode::Ptr node)
+			{
+				references.push_back(AddNode(node));
+				records.back().referenceCount++;
+			}
+
+			template<typename T>
+			void Strong(const vector<shared_ptr<T>>& nodes)
+			{
+				for (auto node : nodes)
+				{
+					Strong(node);
+				}
+			}
+
+			// an empty weak reference is written as AstBinaryNull, a weak reference to a node outside of the assembly fails in Write
+			void Weak(AstNode::Ptr node)
+			{
+				if (node)
+				{
+					weakReferences.push_back(make_pair(references.size(), node.get()));
+				}
+				references.push_back(AstBinaryNull);
+				records.back().referenceCount++;
+			}
+
+			void Value(size_t value)
+			{
+				references.push_back((uint32_t)value);
+				records.back().referenceCount++;
+			}
+
+			void Values(const map<int, int>& values)
+			{
+				Value(values.size());
+				for (auto value : values)
+				{
+					Value(value.first);
+					Value(value.second);
+				}
+			}
+
+			void Write(AstAssembly::Ptr assembly);
+		};
+
+		/*************************************************************
+		AstDeclaration::WriteBinary
+		*************************************************************/
+
+		class AstDeclaration_WriteBinary final : public AstDeclarationVisitor
+		{
+		private:
+			AstBinaryWriter&		writer;
+		public:
+			AstDeclaration_WriteBinary(AstBinaryWriter& _writer)
+				:writer(_writer)
+			{
+			}
+
+			void Visit(AstSymbolDeclaration* node)override
+			{
+				writer.Begin(AstBinaryKind::SymbolDeclaration).name = writer.AddString(node->composedName);
+			}
+
+			void Visit(AstTypeDeclaration* node)override
+			{
+				writer.Begin(AstBinaryKind::TypeDeclaration).name = writer.AddString(node->composedName);
+				writer.Weak(node->baseType.lock());
+				writer.Strong(node->fields);
+			}
+
+			void Visit(AstFunctionDeclaration* node)override
+			{
+				writer.Begin(AstBinaryKind::FunctionDeclaration).name = writer.AddString(node->composedName);
+				writer.Strong(node->ownerType);
+				writer.Strong(node->statement);
+				writer.Strong(node->resultVariable);
+				writer.Strong(node->stateArgument);
+				writer.Strong(node->signalArgument);
+				writer.Strong(node->blockBodyArgument);
+				writer.Strong(node->continuationArgument);
+				writer.Value(node->arguments.size());
+				writer.Strong(node->arguments);
+				writer.Values(node->readArgumentAstMap);
+				writer.Values(node->writeArgumentAstMap);
+			}
+
+			void Visit(AstDispatchTableDeclaration* node)override
+			{
+				writer.Begin(AstBinaryKind::DispatchTableDeclaration).name = writer.AddString(node->composedName);
+				writer.Weak(node->rootFunction.lock());
+				writer.Value(node->dispatchArguments.size());
+				for (auto argument : node->dispatchArguments)
+				{
+					writer.Value(argument);
+				}
+				writer.Value(node->dimensions.size());
+				for (auto dimension : node->dimensions)
+				{
+					writer.Value(dimension.size());
+					writer.Strong(dimension);
+				}
+				for (auto target : node->targets)
+				{
+					writer.Weak(target.lock());
+				}
+			}
+		};
+
+		/*************************************************************
+		AstExpression::WriteBinary
+		*************************************************************/
+
+		class AstExpression_WriteBinary final : public AstExpressionVisitor
+		{
+		private:
+			AstBinaryWriter&		writer;
+		public:
+			AstExpression_WriteBinary(AstBinaryWriter& _writer)
+				:writer(_writer)
+			{
+			}
+
+			void Visit(AstLiteralExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::LiteralExpression).flags = (uint16_t)node->literalName;
+			}
+
+			void Visit(AstIntegerExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::IntegerExpression).value.integer = node->value;
+			}
+
+			void Visit(AstFloatExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::FloatExpression).value.floating = node->value;
+			}
+
+			void Visit(AstStringExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::StringExpression).name = writer.AddString(node->value);
+			}
+
+			void Visit(AstExternalSymbolExpression* node)override
+			{
+				auto& record = writer.Begin(AstBinaryKind::ExternalSymbolExpression);
+				record.name = writer.AddString(node->name);
+				record.flags = (node->directStyle ? AstBinaryDirectStyle : 0) | (node->asynchronous ? AstBinaryAsynchronous : 0);
+			}
+
+			void Visit(AstReferenceExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::ReferenceExpression);
+				writer.Weak(node->reference.lock());
+			}
+
+			void Visit(AstNewTypeExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::NewTypeExpression);
+				writer.Strong(node->type);
+				writer.Strong(node->fields);
+			}
+
+			void Visit(AstTestTypeExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::TestTypeExpression);
+				writer.Strong(node->target);
+				writer.Strong(node->type);
+			}
+
+			void Visit(AstNewArrayExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::NewArrayExpression);
+				writer.Strong(node->length);
+			}
+
+			void Visit(AstNewArrayLiteralExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::NewArrayLiteralExpression);
+				writer.Strong(node->elements);
+			}
+
+			void Visit(AstArrayLengthExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::ArrayLengthExpression);
+				writer.Strong(node->target);
+			}
+
+			void Visit(AstArrayAccessExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::ArrayAccessExpression);
+				writer.Strong(node->target);
+				writer.Strong(node->index);
+			}
+
+			void Visit(AstFieldAccessExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::FieldAccessExpression).name = writer.AddString(node->composedFieldName);
+				writer.Strong(node->target);
+			}
+
+			void Visit(AstInvokeExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::InvokeExpression);
+				writer.Strong(node->function);
+				writer.Strong(node->arguments);
+			}
+
+			void Visit(AstLambdaExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::LambdaExpression);
+				writer.Strong(node->statement);
+				writer.Strong(node->arguments);
+			}
+
+			void Visit(AstDispatchExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::DispatchExpression);
+				writer.Weak(node->table.lock());
+				writer.Strong(node->arguments);
+			}
+
+			void Visit(AstPrimitiveExpression* node)override
+			{
+				writer.Begin(AstBinaryKind::PrimitiveExpression).flags = (uint16_t)node->op;
+				writer.Strong(node->operands);
+			}
+		};
+
+		/*************************************************************
+		AstStatement::WriteBinary
+		*************************************************************/
+
+		class AstStatement_WriteBinary final : public AstStatementVisitor
+		{
+		private:
+			AstBinaryWriter&		writer;
+		public:
+			AstStatement_WriteBinary(AstBinaryWriter& _writer)
+				:writer(_writer)
+			{
+			}
+
+			void Visit(AstBlockStatement* node)override
+			{
+				writer.Begin(AstBinaryKind::BlockStatement);
+				writer.Strong(node->statements);
+			}
+
+			void Visit(AstExpressionStatement* node)override
+			{
+				writer.Begin(AstBinaryKind::ExpressionStatement);
+				writer.Strong(node->expression);
+			}
+
+			void Visit(AstDeclarationStatement* node)override
+			{
+				writer.Begin(AstBinaryKind::DeclarationStatement);
+				writer.Strong(node->declaration);
+			}
+
+			void Visit(AstAssignmentStatement* node)override
+			{
+				writer.Begin(AstBinaryKind::AssignmentStatement);
+				writer.Strong(node->target);
+				writer.Strong(node->value);
+			}
+
+			void Visit(AstIfStatement* node)override
+			{
+				writer.Begin(AstBinaryKind::IfStatement);
+				writer.Strong(node->condition);
+				writer.Strong(node->trueBranch);
+				writer.Strong(node->falseBranch);
+			}
+		};
+
+		/*************************************************************
+		AstType::WriteBinary
+		*************************************************************/
+
+		class AstType_WriteBinary final : public AstTypeVisitor
+		{
+		private:
+			AstBinaryWriter&		writer;
+		public:
+			AstType_WriteBinary(AstBinaryWriter& _writer)
+				:writer(_writer)
+			{
+			}
+
+			void Visit(AstPredefinedType* node)override
+			{
+				writer.Begin(AstBinaryKind::PredefinedType).flags = (uint16_t)node->typeName;
+			}
+
+			void Visit(AstReferenceType* node)override
+			{
+				writer.Begin(AstBinaryKind::ReferenceType);
+				writer.Weak(node->typeDeclaration.lock());
+			}
+		};
+
+		/*************************************************************
+		AstAssembly::WriteBinary
+		*************************************************************/
+
+		class AstNode_WriteBinary : public AstVisitor
+		{
+		private:
+			AstBinaryWriter&		writer;
+		public:
+			AstNode_WriteBinary(AstBinaryWriter& _writer)
+				:writer(_writer)
+			{
+			}
+
+			void Visit(AstType* node)override
+			{
+				AstType_WriteBinary visitor(writer);
+				Dispatch(node, visitor);
+			}
+
+			void Visit(AstExpression* node)override
+			{
+				AstExpression_WriteBinary visitor(writer);
+				Dispatch(node, visitor);
+			}
+
+			void Visit(AstStatement* node)override
+			{
+				AstStatement_WriteBinary visitor(writer);
+				Dispatch(node, visitor);
+			}
+
+			void Visit(AstDeclaration* node)override
+			{
+				AstDeclaration_WriteBinary visitor(writer);
+				Dispatch(node, visitor);
+			}
+
+			void Visit(AstAssembly* node)override
+			{
+				writer.Begin(AstBinaryKind::Assembly);
+				writer.Strong(node->declarations);
+			}
+		};
+
+		void AstBinaryWriter::Write(AstAssembly::Ptr assembly)
+		{
+			// records are written in the order of indexes, writing a record indexes all nodes it owns
+			AddNode(assembly);
+			AstNode_WriteBinary visitor(*this);
+			for (size_t i = 0; i < nodes.size(); i++)
+			{
+				nodes[i]->Accept(&visitor);
+				if (nodes[i]->shared)
+				{
+					records[i].flags |= AstBinaryShared;
+				}
+			}
+
+			for (auto weakRef : weakReferences)
+			{
+				auto it = nodeIndexes.find(weakRef.second);
+				ASSERT(it != nodeIndexes.end());
+				references[weakRef.first] = it->second;
+			}
+		}
+
+		/*************************************************************
+		WriteBinary
+		*************************************************************/
+
+		static uint64_t AlignBinaryOffset(uint64_t offset)
+		{
+			return (offset + 7) / 8 * 8;
+		}
+
+		static void WriteBinaryArray(ostream& o, uint64_t& offset, uint64_t arrayOffset, const void* data, size_t size)
+		{
+			static const char zeros[8] = { 0 };
+			o.write(zeros, (streamsize)(arrayOffset - offset));
+			o.write((const char*)data, (streamsize)size);
+			offset = arrayOffset + size;
+		}
+
+		void WriteBinary(AstAssembly::Ptr node, ostream& o)
+		{
+			AstBinaryWriter writer;
+			writer.Write(node);
+
+			AstBinaryHeader header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, "TMAST", 5);
+			header.version = AstBinaryVersion;
+			header.byteOrder = 0x01020304;
+			header.characterSize = sizeof(char_t);
+			header.stringCount = (uint32_t)writer.strings.size();
+			header.nodeCount = (uint32_t)writer.records.size();
+			header.referenceCount = (uint32_t)writer.references.size();
+			header.characterCount = writer.characters.size();
+			header.stringOffset = AlignBinaryOffset(sizeof(header));
+			header.nodeOffset = AlignBinaryOffset(header.stringOffset + header.stringCount * sizeof(AstBinaryString));
+			header.referenceOffset = AlignBinaryOffset(header.nodeOffset + header.nodeCount * sizeof(AstBinaryNode));
+			header.characterOffset = AlignBinaryOffset(header.referenceOffset + header.referenceCount * sizeof(uint32_t));
+
+			uint64_t offset = 0;
+			WriteBinaryArray(o, offset, 0, &header, sizeof(header));
+			WriteBinaryArray(o, offset, header.stringOffset, writer.strings.data(), writer.strings.size() * sizeof(AstBinaryString));
+			WriteBinaryArray(o, offset, header.nodeOffset, writer.records.data(), writer.records.size() * sizeof(AstBinaryNode));
+			WriteBinaryArray(o, offset, header.referenceOffset, writer.references.data(), writer.references.size() * sizeof(uint32_t));
+			WriteBinaryArray(o, offset, header.characterOffset, writer.characters.data(), writer.characters.size() * sizeof(char_t));
+		}
+
+		/*************************************************************
+		AstBinaryReader
+		*************************************************************/
+
+		AstBinaryReader::AstBinaryReader(const void* _data, size_t _size)
+			:data((const char*)_data)
+			, size(_size)
+		{
+			if (IsValid())
+			{
+				header = (const AstBinaryHeader*)data;
+			}
+		}
+
+		bool AstBinaryReader::IsValid()
+		{
+			// arrays are read in place, so the memory should be aligned like the file
+			if (!data || (uintptr_t)data % 8 != 0 || size < sizeof(AstBinaryHeader))
+			{
+				return false;
+			}
+
+			auto h = (const AstBinaryHeader*)data;
+			if (memcmp(h->magic, "TMAST\0\0\0", 8) != 0 || h->version != AstBinaryVersion || h->byteOrder != 0x01020304 || h->characterSize != sizeof(char_t))
+			{
+				return false;
+			}
+			if (h->nodeCount == 0)
+			{
+				return false;
+			}
+
+			auto inRange = [&](uint64_t offset, uint64_t count, uint64_t itemSize)
+			{
+				return offset % 8 == 0 && offset <= size && count <= (size - offset) / itemSize;
+			};
+			return
+				inRange(h->stringOffset, h->stringCount, sizeof(AstBinaryString)) &&
+				inRange(h->nodeOffset, h->nodeCount, sizeof(AstBinaryNode)) &&
+				inRange(h->referenceOffset, h->referenceCount, sizeof(uint32_t)) &&
+				inRange(h->characterOffset, h->characterCount, sizeof(char_t));
+		}
+
+		uint32_t AstBinaryReader::GetNodeCount()
+		{
+			return header ? header->nodeCount : 0;
+		}
+
+		const AstBinaryNode& AstBinaryReader::GetNode(uint32_t index)
+		{
+			ASSERT(index < GetNodeCount());
+			return ((const AstBinaryNode*)(data + header->nodeOffset))[index];
+		}
+
+		const uint32_t* AstBinaryReader::GetReferences(const AstBinaryNode& node)
+		{
+			ASSERT(header && node.referenceBegin <= header->referenceCount && node.referenceCount <= header->referenceCount - node.referenceBegin);
+			return (const uint32_t*)(data + header->referenceOffset) + node.referenceBegin;
+		}
+
+		uint32_t AstBinaryReader::GetStringCount()
+		{
+			return header ? header->stringCount : 0;
+		}
+
+		const char_t* AstBinaryReader::GetString(uint32_t index, size_t& length)
+		{
+			length = 0;
+			if (index == AstBinaryNull)
+			{
+				return nullptr;
+			}
+			ASSERT(index < GetStringCount());
+			auto& s = ((const AstBinaryString*)(data + header->stringOffset))[index];
+			ASSERT(s.begin <= header->characterCount && s.length <= header->characterCount - s.begin);
+			length = (size_t)s.length;
+			return (const char_t*)(data + header->characterOffset) + s.begin;
+		}
+
+		string_t AstBinaryReader::ReadString(uint32_t index)
+		{
+			size_t length = 0;
+			auto buffer = GetString(index, length);
+			return buffer ? string_t(buffer, length) : string_t();
+		}
+
+		/*************************************************************
+		AstBinaryReader::ReadAssembly
+		*************************************************************/
+
+		class AstBinaryNodeReader
+		{
+		private:
+			AstBinaryReader&						reader;
+			vector<AstNode::Ptr>&					nodes;
+			const uint32_t*							references;
+			uint32_t								count;
+			uint32_t								position = 0;
+
+		public:
+			AstBinaryNodeReader(AstBinaryReader& _reader, vector<AstNode::Ptr>& _nodes, const AstBinaryNode& record)
+				:reader(_reader)
+				, nodes(_nodes)
+				, references(_reader.GetReferences(record))
+				, count(record.referenceCount)
+			{
+			}
+
+			bool IsEnd()
+			{
+				return position == count;
+			}
+
+			uint32_t Value()
+			{
+				ASSERT(position < count);
+				return references[position++];
+			}
+
+			template<typename T>
+			shared_ptr<T> OptionalNode()
+			{
+				auto index = Value();
+				if (index == AstBinaryNull)
+				{
+					return nullptr;
+				}
+				ASSERT(index < nodes.size());
+				auto node = AstNodeCast<T>(nodes[index]);
+				ASSERT(node);
+				return node;
+			}
+
+			template<typename T>
+			shared_ptr<T> Node()
+			{
+				auto node = OptionalNode<T>();
+				ASSERT(node);
+				return node;
+			}
+
+			template<typename T>
+			void Nodes(vector<shared_ptr<T>>& list, uint32_t listCount)
+			{
+				for (uint32_t i = 0; i < listCount; i++)
+				{
+					list.push_back(Node<T>());
+				}
+			}
+
+			template<typename T>
+			void Nodes(vector<shared_ptr<T>>& list)
+			{
+				Nodes(list, count - position);
+			}
+
+			void Values(map<int, int>& values)
+			{
+				auto valueCount = Value();
+				for (uint32_t i = 0; i < valueCount; i++)
+				{
+					auto key = (int)Value();
+					values.insert(make_pair(key, (int)Value()));
+				}
+			}
+		};
+
+		static AstNode::Ptr CreateBinaryNode(const AstBinaryNode& record)
+		{
+			switch (record.kind)
+			{
+			case AstBinaryKind::Assembly:
+				return make_shared<AstAssembly>();
+			case AstBinaryKind::SymbolDeclaration:
+				return make_shared<AstSymbolDeclaration>();
+			case AstBinaryKind::TypeDeclaration:
+				return make_shared<AstTypeDeclaration>();
+			case AstBinaryKind::FunctionDeclaration:
+				return make_shared<AstFunctionDeclaration>();
+			case AstBinaryKind::DispatchTableDeclaration:
+				return make_shared<AstDispatchTableDeclaration>();
+			case AstBinaryKind::LiteralExpression:
+				return make_shared<AstLiteralExpression>();
+			case AstBinaryKind::IntegerExpression:
+				return make_shared<AstIntegerExpression>();
+			case AstBinaryKind::FloatExpression:
+				return make_shared<AstFloatExpression>();
+			case AstBinaryKind::StringExpression:
+				return make_shared<AstStringExpression>();
+			case AstBinaryKind::ExternalSymbolExpression:
+				return make_shared<AstExternalSymbolExpression>();
+			case AstBinaryKind::ReferenceExpression:
+				return make_shared<AstReferenceExpression>();
+			case AstBinaryKind::NewTypeExpression:
+				return make_shared<AstNewTypeExpression>();
+			case AstBinaryKind::TestTypeExpression:
+				return make_shared<AstTestTypeExpression>();
+			case AstBinaryKind::NewArrayExpression:
+				return make_shared<AstNewArrayExpression>();
+			case AstBinaryKind::NewArrayLiteralExpression:
+				return make_shared<AstNewArrayLiteralExpression>();
+			case AstBinaryKind::ArrayLengthExpression:
+				return make_shared<AstArrayLengthExpression>();
+			case AstBinaryKind::ArrayAccessExpression:
+				return make_shared<AstArrayAccessExpression>();
+			case AstBinaryKind::FieldAccessExpression:
+				return make_shared<AstFieldAccessExpression>();
+			case AstBinaryKind::InvokeExpression:
+				return make_shared<AstInvokeExpression>();
+			case AstBinaryKind::LambdaExpression:
+				return make_shared<AstLambdaExpression>();
+			case AstBinaryKind::DispatchExpression:
+				return make_shared<AstDispatchExpression>();
+			case AstBinaryKind::PrimitiveExpression:
+				return make_shared<AstPrimitiveExpression>();
+			case AstBinaryKind::BlockStatement:
+				return make_shared<AstBlockStatement>();
+			case AstBinaryKind::ExpressionStatement:
+				return make_shared<AstExpressionStatement>();
+			case AstBinaryKind::DeclarationStatement:
+				return make_shared<AstDeclarationStatement>();
+			case AstBinaryKind::AssignmentStatement:
+				return make_shared<AstAssignmentStatement>();
+			case AstBinaryKind::IfStatement:
+				return make_shared<AstIfStatement>();
+			case AstBinaryKind::PredefinedType:
+				return make_shared<AstPredefinedType>();
+			case AstBinaryKind::ReferenceType:
+				return make_shared<AstReferenceType>();
+			default:
+				ASSERT(false);
+				return nullptr;
+			}
+		}
+
+		static void FillBinaryNode(AstBinaryReader& reader, vector<AstNode::Ptr>& nodes, uint32_t index)
+		{
+			auto record = reader.GetNode(index);
+			auto node = nodes[index];
+			if (record.flags & AstBinaryShared)
+			{
+				node->shared = true;
+				record.flags &= ~AstBinaryShared;
+			}
+			AstBinaryNodeReader refs(reader, nodes, record);
+
+			if (auto decl = AstNodeCast<AstDeclaration>(node))
+			{
+				decl->composedName = reader.ReadString(record.name);
+			}
+
+			switch (record.kind)
+			{
+			case AstBinaryKind::Assembly:
+				refs.Nodes(AstNodeCast<AstAssembly>(node)->declarations);
+				break;
+			case AstBinaryKind::SymbolDeclaration:
+				break;
+			case AstBinaryKind::TypeDeclaration:
+				{
+					auto ast = AstNodeCast<AstTypeDeclaration>(node);
+					ast->baseType = refs.OptionalNode<AstType>();
+					refs.Nodes(ast->fields);
+				}
+				break;
+			case AstBinaryKind::FunctionDeclaration:
+				{
+					auto ast = AstNodeCast<AstFunctionDeclaration>(node);
+					ast->ownerType = refs.OptionalNode<AstType>();
+					ast->statement = refs.Node<AstStatement>();
+					ast->resultVariable = refs.OptionalNode<AstSymbolDeclaration>();
+					ast->stateArgument = refs.OptionalNode<AstSymbolDeclaration>();
+					ast->signalArgument = refs.OptionalNode<AstSymbolDeclaration>();
+					ast->blockBodyArgument = refs.OptionalNode<AstSymbolDeclaration>();
+					ast->continuationArgument = refs.OptionalNode<AstSymbolDeclaration>();
+					refs.Nodes(ast->arguments, refs.Value());
+					refs.Values(ast->readArgumentAstMap);
+					refs.Values(ast->writeArgumentAstMap);
+				}
+				break;
+			case AstBinaryKind::DispatchTableDeclaration:
+				{
+					auto ast = AstNodeCast<AstDispatchTableDeclaration>(node);
+					ast->rootFunction = refs.Node<AstFunctionDeclaration>();
+					auto argumentCount = refs.Value();
+					for (uint32_t i = 0; i < argumentCount; i++)
+					{
+						ast->dispatchArguments.push_back((int)refs.Value());
+					}
+					auto dimensionCount = refs.Value();
+					for (uint32_t i = 0; i < dimensionCount; i++)
+					{
+						AstType::List dimension;
+						refs.Nodes(dimension, refs.Value());
+						ast->dimensions.push_back(dimension);
+					}
+					while (!refs.IsEnd())
+					{
+						ast->targets.push_back(refs.Node<AstFunctionDeclaration>());
+					}
+				}
+				break;
+			case AstBinaryKind::LiteralExpression:
+				ASSERT(record.flags <= (uint16_t)AstLiteralName::False);
+				AstNodeCast<AstLiteralExpression>(node)->literalName = (AstLiteralName)record.flags;
+				break;
+			case AstBinaryKind::IntegerExpression:
+				AstNodeCast<AstIntegerExpression>(node)->value = record.value.integer;
+				break;
+			case AstBinaryKind::FloatExpression:
+				AstNodeCast<AstFloatExpression>(node)->value = record.value.floating;
+				break;
+			case AstBinaryKind::StringExpression:
+				AstNodeCast<AstStringExpression>(node)->value = reader.ReadString(record.name);
+				break;
+			case AstBinaryKind::ExternalSymbolExpression:
+				{
+					auto ast = AstNodeCast<AstExternalSymbolExpression>(node);
+					ast->name = reader.ReadString(record.name);
+					ast->directStyle = (record.flags & AstBinaryDirectStyle) != 0;
+					ast->asynchronous = (record.flags & AstBinaryAsynchronous) != 0;
+				}
+				break;
+			case AstBinaryKind::ReferenceExpression:
+				AstNodeCast<AstReferenceExpression>(node)->reference = refs.Node<AstDeclaration>();
+				break;
+			case AstBinaryKind::NewTypeExpression:
+				{
+					auto ast = AstNodeCast<AstNewTypeExpression>(node);
+					ast->type = refs.Node<AstType>();
+					refs.Nodes(ast->fields);
+				}
+				break;
+			case AstBinaryKind::TestTypeExpression:
+				{
+					auto ast = AstNodeCast<AstTestTypeExpression>(node);
+					ast->target = refs.Node<AstExpression>();
+					ast->type = refs.Node<AstType>();
+				}
+				break;
+			case AstBinaryKind::NewArrayExpression:
+				AstNodeCast<AstNewArrayExpression>(node)->length = refs.Node<AstExpression>();
+				break;
+			case AstBinaryKind::NewArrayLiteralExpression:
+				refs.Nodes(AstNodeCast<AstNewArrayLiteralExpression>(node)->elements);
+				break;
+			case AstBinaryKind::ArrayLengthExpression:
+				AstNodeCast<AstArrayLengthExpression>(node)->target = refs.Node<AstExpression>();
+				break;
+			case AstBinaryKind::ArrayAccessExpression:
+				{
+					auto ast = AstNodeCast<AstArrayAccessExpression>(node);
+					ast->target = refs.Node<AstExpression>();
+					ast->index = refs.Node<AstExpression>();
+				}
+				break;
+			case AstBinaryKind::FieldAccessExpression:
+				{
+					auto ast = AstNodeCast<AstFieldAccessExpression>(node);
+					ast->composedFieldName = reader.ReadString(record.name);
+					ast->target = refs.Node<AstExpression>();
+				}
+				break;
+			case AstBinaryKind::InvokeExpression:
+				{
+					auto ast = AstNodeCast<AstInvokeExpression>(node);
+					ast->function = refs.Node<AstExpression>();
+					refs.Nodes(ast->arguments);
+				}
+				break;
+			case AstBinaryKind::LambdaExpression:
+				{
+					auto ast = AstNodeCast<AstLambdaExpression>(node);
+					ast->statement = refs.Node<AstStatement>();
+					refs.Nodes(ast->arguments);
+				}
+				break;
+			case AstBinaryKind::DispatchExpression:
+				{
+					auto ast = AstNodeCast<AstDispatchExpression>(node);
+					ast->table = refs.Node<AstDispatchTableDeclaration>();
+					refs.Nodes(ast->arguments);
+				}
+				break;
+			case AstBinaryKind::PrimitiveExpression:
+				{
+					ASSERT(record.flags <= (uint16_t)AstPrimitiveOperator::IntegerToFloat);
+					auto ast = AstNodeCast<AstPrimitiveExpression>(node);
+					ast->op = (AstPrimitiveOperator)record.flags;
+					refs.Nodes(ast->operands);
+				}
+				break;
+			case AstBinaryKind::BlockStatement:
+				refs.Nodes(AstNodeCast<AstBlockStatement>(node)->statements);
+				break;
+			case AstBinaryKind::ExpressionStatement:
+				AstNodeCast<AstExpressionStatement>(node)->expression = refs.Node<AstExpression>();
+				break;
+			case AstBinaryKind::DeclarationStatement:
+				AstNodeCast<AstDeclarationStatement>(node)->declaration = refs.Node<AstDeclaration>();
+				break;
+			case AstBinaryKind::AssignmentStatement:
+				{
+					auto ast = AstNodeCast<AstAssignmentStatement>(node);
+					ast->target = refs.Node<AstExpression>();
+					ast->value = refs.Node<AstExpression>();
+				}
+				break;
+			case AstBinaryKind::IfStatement:
+				{
+					auto ast = AstNodeCast<AstIfStatement>(node);
+					ast->condition = refs.Node<AstExpression>();
+					ast->trueBranch = refs.Node<AstStatement>();
+					ast->falseBranch = refs.OptionalNode<AstStatement>();
+				}
+				break;
+			case AstBinaryKind::PredefinedType:
+				ASSERT(record.flags <= (uint16_t)AstPredefinedTypeName::Function);
+				AstNodeCast<AstPredefinedType>(node)->typeName = (AstPredefinedTypeName)record.flags;
+				break;
+			case AstBinaryKind::ReferenceType:
+				AstNodeCast<AstReferenceType>(node)->typeDeclaration = refs.Node<AstTypeDeclaration>();
+				break;
+			}
+			ASSERT(refs.IsEnd());
+			ASSERT(!node->shared || IsInternableNode(node.get()));
+		}
+
+		// checks what consumers of a dispatch table index without checking, after all nodes are filled
+		static void CheckBinaryDispatchTable(AstDispatchTableDeclaration* table)
+		{
+			auto rootFunction = table->rootFunction.lock();
+			ASSERT(table->dispatchArguments.size() == table->dimensions.size());
+			size_t targetCount = 1;
+			for (size_t i = 0; i < table->dimensions.size(); i++)
+			{
+				ASSERT(table->dispatchArguments[i] >= 0 && (size_t)table->dispatchArguments[i] < rootFunction->arguments.size());
+				ASSERT(table->dimensions[i].size() > 0 && table->dimensions[i].size() <= table->targets.size() / targetCount);
+				targetCount *= table->dimensions[i].size();
+			}
+			ASSERT(table->targets.size() == targetCount);
+		}
+
+		struct AstBinaryChildReleaser
+		{
+			template<typename T>
+			void operator()(shared_ptr<T>& child)
+			{
+				child = nullptr;
+			}
+		};
+
+		AstAssembly::Ptr AstBinaryReader::ReadAssembly()
+		{
+			if (!header)
+			{
+				return nullptr;
+			}
+
+			// all nodes are created before filling them, because a node could refer to a node after it
+			vector<AstNode::Ptr> nodes;
+			try
+			{
+				for (uint32_t i = 0; i < header->nodeCount; i++)
+				{
+					auto& record = GetNode(i);
+					ASSERT((record.kind == AstBinaryKind::Assembly) == (i == 0));
+					nodes.push_back(CreateBinaryNode(record));
+				}
+				for (uint32_t i = 0; i < header->nodeCount; i++)
+				{
+					FillBinaryNode(*this, nodes, i);
+				}
+				for (auto node : nodes)
+				{
+					if (auto table = AstNodeCast<AstDispatchTableDeclaration>(node))
+					{
+						CheckBinaryDispatchTable(table.get());
+					}
+				}
+
+				// SetParent fails if a node that is not shared is owned twice, so the AST is a tree,
+				// a node not reached from the assembly could only be a symbol owned by a function outside of its arguments (e.g. resultVariable),
+				// so every node, including targets of weak references, is kept alive by the assembly, and no nodes own each other
+				auto assembly = AstNodeCast<AstAssembly>(nodes[0]);
+				SetParent(assembly);
+				for (uint32_t i = 1; i < header->nodeCount; i++)
+				{
+					auto& node = nodes[i];
+					ASSERT(node.use_count() > 1);
+					ASSERT(node->shared || !node->parent.expired() || node->kind == AstNodeKind::SymbolDeclaration);
+				}
+				return assembly;
+			}
+			catch (const AssertFailedException&)
+			{
+				// nodes that own each other are released only after all children are removed
+				for (auto node : nodes)
+				{
+					ForEachChildPtr(node.get(), AstBinaryChildReleaser());
+				}
+				return nullptr;
+			}
+		}
+
+		/*************************************************************
+		AstBinaryFile
+		*************************************************************/
+
+#ifdef _MSC_VER
+		AstBinaryFile::AstBinaryFile(const string& fileName)
+		{
+			file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				file = nullptr;
+				return;
+			}
+
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+			{
+				return;
+			}
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (!mapping)
+			{
+				return;
+			}
+			data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (data)
+			{
+				size = (size_t)fileSize.QuadPart;
+			}
+		}
+
+		AstBinaryFile::~AstBinaryFile()
+		{
+			if (data) UnmapViewOfFile(data);
+			if (mapping) CloseHandle(mapping);
+			if (file) CloseHandle(file);
+		}
+#else
+		AstBinaryFile::AstBinaryFile(const string& fileName)
+		{
+			file = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+			if (file == -1)
+			{
+				return;
+			}
+
+			struct stat fileStat;
+			if (fstat(file, &fileStat) == -1 || fileStat.st_size == 0)
+			{
+				return;
+			}
+			auto mapped = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+			if (mapped != MAP_FAILED)
+			{
+				data = mapped;
+				size = (size_t)fileStat.st_size;
+			}
+		}
+
+		AstBinaryFile::~AstBinaryFile()
+		{
+			if (data) munmap(data, size);
+			if (file != -1) close(file);
+		}
+#endif
+
+		bool AstBinaryFile::IsOpened()
+		{
+			return data != nullptr;
+		}
+
+		const void* AstBinaryFile::GetData()
+		{
+			return data;
+		}
+
+		size_t AstBinaryFile::GetSize()
+		{
+			return size;
+		}
+	}
+}
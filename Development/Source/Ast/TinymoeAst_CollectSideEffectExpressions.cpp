@@ -8,7 +8,7 @@ namespace tinymoe
 		AstExpression::CollectSideEffectExpressions
 		*************************************************************/
 
-		class AstExpression_CollectSideEffectExpressions : public AstExpressionVisitor
+		class AstExpression_CollectSideEffectExpressions final : public AstExpressionVisitor
 		{
 		private:
 			AstExpression::List&			exprs;
@@ -87,12 +87,28 @@ namespace tinymoe
 
 			void Visit(AstInvokeExpression* node)override
 			{
-				exprs.push_back(dynamic_pointer_cast<AstExpression>(node->shared_from_this()));
+				exprs.push_back(AstNodeCast<AstExpression>(node->shared_from_this()));
 			}
 
 			void Visit(AstLambdaExpression* node)override
 			{
 			}
+
+			void Visit(AstDispatchExpression* node)override
+			{
+				for (auto argument : node->arguments)
+				{
+					CollectSideEffectExpressions(argument, exprs);
+				}
+			}
+
+			void Visit(AstPrimitiveExpression* node)override
+			{
+				for (auto operand : node->operands)
+				{
+					CollectSideEffectExpressions(operand, exprs);
+				}
+			}
 		};
 
 		/*************************************************************
@@ -102,7 +118,7 @@ namespace tinymoe
 		void CollectSideEffectExpressions(AstExpression::Ptr node, AstExpression::List& exprs)
 		{
 			AstExpression_CollectSideEffectExpressions visitor(exprs);
-			node->Accept(&visitor);
+			Dispatch(node.get(), visitor);
 		}
 	}
 }
\ No newline at end of file
@@ -8,7 +8,7 @@ namespace tinymoe
 		AstExpression::CollectUsedVariables
 		*************************************************************/
 
-		class AstExpression_CollectUsedVariables : public AstExpressionVisitor
+		class AstExpression_CollectUsedVariables final : public AstExpressionVisitor
 		{
 		private:
 			bool								rightValue;
@@ -107,13 +107,29 @@ namespace tinymoe
 			{
 				CollectUsedVariables(node->statement, defined, used);
 			}
+
+			void Visit(AstDispatchExpression* node)override
+			{
+				for (auto argument : node->arguments)
+				{
+					CollectUsedVariables(argument, true, defined, used);
+				}
+			}
+
+			void Visit(AstPrimitiveExpression* node)override
+			{
+				for (auto operand : node->operands)
+				{
+					CollectUsedVariables(operand, true, defined, used);
+				}
+			}
 		};
 
 		/*************************************************************
 		AstStatement::CollectUsedVariables
 		*************************************************************/
 
-		class AstStatement_CollectUsedVariables : public AstStatementVisitor
+		class AstStatement_CollectUsedVariables final : public AstStatementVisitor
 		{
 		private:
 			set<shared_ptr<AstDeclaration>>&	defined;
@@ -167,13 +183,13 @@ namespace tinymoe
 		void CollectUsedVariables(AstExpression::Ptr node, bool rightValue, set<shared_ptr<AstDeclaration>>& defined, set<shared_ptr<AstDeclaration>>& used)
 		{
 			AstExpression_CollectUsedVariables visitor(rightValue, defined, used);
-			node->Accept(&visitor);
+			Dispatch(node.get(), visitor);
 		}
 
 		void CollectUsedVariables(AstStatement::Ptr node, set<shared_ptr<AstDeclaration>>& defined, set<shared_ptr<AstDeclaration>>& used)
 		{
 			AstStatement_CollectUsedVariables visitor(defined, used);
-			node->Accept(&visitor);
+			Dispatch(node.get(), visitor);
 		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,742 @@
+#include "TinymoeAst.h"
+
+namespace tinymoe
+{
+	namespace ast
+	{
+		/*************************************************************
+		AstDirectStyleContext
+		*************************************************************/
+
+		typedef set<AstDeclaration*>		DirectFunctionSet;
+
+		AstExpression::Ptr CopyReferenceExpression(AstExpression::Ptr expression)
+		{
+			if (auto ref = AstNodeCast<AstReferenceExpression>(expression))
+			{
+				auto copy = make_shared<AstReferenceExpression>();
+				copy->reference = ref->reference;
+				return copy;
+			}
+			return nullptr;
+		}
+
+		struct AstDirectStyleContext
+		{
+			DirectFunctionSet&										directFunctions;
+			AstFunctionDeclaration*									function;
+			set<AstDeclaration*>									continuations;		// the function continuation and all join points, which could only be called at the end
+			map<AstDeclaration*, shared_ptr<AstLambdaExpression>>		joins;				// local variables holding continuations, which become code that is executed after jumping to the end
+
+			AstDirectStyleContext(DirectFunctionSet& _directFunctions, AstFunctionDeclaration* _function)
+				:directFunctions(_directFunctions)
+				, function(_function)
+			{
+				continuations.insert(function->continuationArgument.get());
+			}
+
+			bool IsValue(AstExpression::Ptr expression)
+			{
+				AstExpression::List exprs;
+				CollectSideEffectExpressions(expression, exprs);
+				if (exprs.size() > 0)
+				{
+					return false;
+				}
+
+				set<AstDeclaration::Ptr> defined, used;
+				CollectUsedVariables(expression, true, defined, used);
+				for (auto decl : used)
+				{
+					if (continuations.find(decl.get()) != continuations.end())
+					{
+						return false;
+					}
+				}
+				return true;
+			}
+
+			bool IsDirectFunction(AstInvokeExpression* invoke)
+			{
+				if (auto external = AstNodeCast<AstExternalSymbolExpression>(invoke->function))
+				{
+					return !external->asynchronous;
+				}
+				else if (auto ref = AstNodeCast<AstReferenceExpression>(invoke->function))
+				{
+					auto decl = ref->reference.lock();
+					if (directFunctions.find(decl.get()) != directFunctions.end())
+					{
+						return invoke->arguments.size() == AstNodeCast<AstFunctionDeclaration>(decl)->arguments.size();
+					}
+				}
+				return false;
+			}
+
+			void Assign(AstDeclaration::Ptr variable, AstExpression::Ptr value, AstStatement::List& stats)
+			{
+				auto ref = make_shared<AstReferenceExpression>();
+				ref->reference = variable;
+
+				auto stat = make_shared<AstAssignmentStatement>();
+				stat->target = ref;
+				stat->value = value;
+				stats.push_back(stat);
+			}
+
+			void Exit(AstDeclaration* continuation, AstExpression::Ptr state, AstExpression::Ptr result, AstStatement::List& stats)
+			{
+				auto it = joins.find(continuation);
+				if (it == joins.end())
+				{
+					if (auto ref = AstNodeCast<AstReferenceExpression>(result))
+					{
+						if (ref->reference.lock() == function->resultVariable)
+						{
+							return;
+						}
+					}
+					Assign(function->resultVariable, result, stats);
+				}
+				else
+				{
+					Assign(it->second->arguments[0], state, stats);
+					Assign(it->second->arguments[1], result, stats);
+				}
+			}
+		};
+
+		extern bool ConvertToDirectStyle(AstStatement::Ptr node, AstDirectStyleContext& context, AstDeclaration* continuation, AstStatement::List& stats);
+
+		/*************************************************************
+		AstStatement::ConvertToDirectStyle
+		*************************************************************/
+
+		class AstStatement_ConvertToDirectStyle final : public AstStatementVisitor
+		{
+		private:
+			AstDirectStyleContext&			context;
+			AstDeclaration*					continuation;		// the continuation to call at the end of this statement, or null if this statement is not at the end
+			AstStatement::List&				stats;
+
+		public:
+			bool							result = false;
+
+			AstStatement_ConvertToDirectStyle(AstDirectStyleContext& _context, AstDeclaration* _continuation, AstStatement::List& _stats)
+				:context(_context)
+				, continuation(_continuation)
+				, stats(_stats)
+			{
+			}
+
+			void Visit(AstBlockStatement* node)override
+			{
+				for (auto it = node->statements.begin(); it != node->statements.end(); it++)
+				{
+					bool lastStatement = it + 1 == node->statements.end();
+					if (continuation && !lastStatement)
+					{
+						// a continuation stored in a local variable becomes a join point, its body follows all code that calls it
+						if (auto assign = AstNodeCast<AstAssignmentStatement>(*it))
+						{
+							auto ref = AstNodeCast<AstReferenceExpression>(assign->target);
+							auto lambda = AstNodeCast<AstLambdaExpression>(assign->value);
+							if (ref && lambda && lambda->arguments.size() == 2)
+							{
+								auto join = ref->reference.lock().get();
+								context.continuations.insert(join);
+								context.joins.insert(make_pair(join, lambda));
+								for (auto argument : lambda->arguments)
+								{
+									auto stat = make_shared<AstDeclarationStatement>();
+									stat->declaration = argument;
+									stats.push_back(stat);
+								}
+
+								auto block = make_shared<AstBlockStatement>();
+								block->statements.insert(block->statements.end(), it + 1, node->statements.end());
+								result =
+									ConvertToDirectStyle(block, context, join, stats) &&
+									ConvertToDirectStyle(lambda->statement, context, continuation, stats);
+								return;
+							}
+						}
+					}
+
+					if (!ConvertToDirectStyle(*it, context, (lastStatement ? continuation : nullptr), stats))
+					{
+						return;
+					}
+				}
+				result = !continuation || node->statements.size() > 0;
+			}
+
+			void Visit(AstExpressionStatement* node)override
+			{
+				if (!continuation)
+				{
+					if ((result = context.IsValue(node->expression)))
+					{
+						stats.push_back(AstNodeCast<AstStatement>(node->shared_from_this()));
+					}
+					return;
+				}
+
+				auto invoke = AstNodeCast<AstInvokeExpression>(node->expression);
+				if (!invoke)
+				{
+					return;
+				}
+				for (auto argument : invoke->arguments)
+				{
+					if (argument != invoke->arguments.back() && !context.IsValue(argument))
+					{
+						return;
+					}
+				}
+
+				if (auto ref = AstNodeCast<AstReferenceExpression>(invoke->function))
+				{
+					if (ref->reference.lock().get() == continuation)
+					{
+						if (invoke->arguments.size() == 2 && context.IsValue(invoke->arguments[1]))
+						{
+							context.Exit(continuation, invoke->arguments[0], invoke->arguments[1], stats);
+							result = true;
+						}
+						return;
+					}
+				}
+
+				if (invoke->arguments.size() < 2 || !context.IsDirectFunction(invoke.get()))
+				{
+					return;
+				}
+				auto state = CopyReferenceExpression(invoke->arguments[0]);
+				if (!state)
+				{
+					return;
+				}
+
+				auto directInvoke = make_shared<AstInvokeExpression>();
+				if (auto external = AstNodeCast<AstExternalSymbolExpression>(invoke->function))
+				{
+					auto directExternal = make_shared<AstExternalSymbolExpression>();
+					directExternal->name = external->name;
+					directExternal->directStyle = true;
+					directInvoke->function = directExternal;
+				}
+				else
+				{
+					directInvoke->function = invoke->function;
+				}
+				directInvoke->arguments.insert(directInvoke->arguments.end(), invoke->arguments.begin(), invoke->arguments.end() - 1);
+
+				auto invokeContinuation = invoke->arguments.back();
+				if (auto ref = AstNodeCast<AstReferenceExpression>(invokeContinuation))
+				{
+					if (ref->reference.lock().get() == continuation)
+					{
+						context.Exit(continuation, state, directInvoke, stats);
+						result = true;
+					}
+				}
+				else if (auto lambda = AstNodeCast<AstLambdaExpression>(invokeContinuation))
+				{
+					if (lambda->arguments.size() == 2)
+					{
+						for (int i = 0; i < 2; i++)
+						{
+							auto stat = make_shared<AstDeclarationStatement>();
+							stat->declaration = lambda->arguments[i];
+							stats.push_back(stat);
+							context.Assign(lambda->arguments[i], (i == 0 ? state : directInvoke), stats);
+						}
+						result = ConvertToDirectStyle(lambda->statement, context, continuation, stats);
+					}
+				}
+			}
+
+			void Visit(AstDeclarationStatement* node)override
+			{
+				if (!continuation)
+				{
+					stats.push_back(AstNodeCast<AstStatement>(node->shared_from_this()));
+					result = true;
+				}
+			}
+
+			void Visit(AstAssignmentStatement* node)override
+			{
+				if (!continuation)
+				{
+					if (context.continuations.find(GetRootLeftValue(node->target).get()) != context.continuations.end())
+					{
+						return;
+					}
+
+					AstExpression::List exprs;
+					CollectSideEffectExpressions(node->target, exprs);
+					set<AstDeclaration::Ptr> defined, used;
+					CollectUsedVariables(node->target, false, defined, used);
+					for (auto decl : used)
+					{
+						if (context.continuations.find(decl.get()) != context.continuations.end())
+						{
+							return;
+						}
+					}
+
+					if (exprs.size() == 0 && context.IsValue(node->value))
+					{
+						stats.push_back(AstNodeCast<AstStatement>(node->shared_from_this()));
+						result = true;
+					}
+				}
+			}
+
+			void Visit(AstIfStatement* node)override
+			{
+				if (!context.IsValue(node->condition) || (continuation && !node->falseBranch))
+				{
+					return;
+				}
+
+				auto stat = make_shared<AstIfStatement>();
+				stat->condition = node->condition;
+				{
+					auto block = make_shared<AstBlockStatement>();
+					if (!ConvertToDirectStyle(node->trueBranch, context, continuation, block->statements))
+					{
+						return;
+					}
+					stat->trueBranch = block;
+				}
+				if (node->falseBranch)
+				{
+					auto block = make_shared<AstBlockStatement>();
+					if (!ConvertToDirectStyle(node->falseBranch, context, continuation, block->statements))
+					{
+						return;
+					}
+					stat->falseBranch = block;
+				}
+				stats.push_back(stat);
+				result = true;
+			}
+		};
+
+		/*************************************************************
+		AstExpression::AdaptCallingConvention
+		*************************************************************/
+
+		typedef map<AstDeclaration*, AstFunctionDeclaration::Ptr>		CpsWrapperMap;
+
+		AstFunctionDeclaration::Ptr GetCpsWrapper(AstFunctionDeclaration* function, CpsWrapperMap& wrappers)
+		{
+			auto it = wrappers.find(function);
+			if (it != wrappers.end())
+			{
+				return it->second;
+			}
+
+			auto wrapper = make_shared<AstFunctionDeclaration>();
+			wrapper->composedName = T("$cps<>") + function->composedName;
+			wrapper->readArgumentAstMap = function->readArgumentAstMap;
+			wrapper->writeArgumentAstMap = function->writeArgumentAstMap;
+			wrappers.insert(make_pair(function, wrapper));
+
+			{
+				auto argument = make_shared<AstSymbolDeclaration>();
+				argument->composedName = function->resultVariable->composedName;
+				wrapper->resultVariable = argument;
+			}
+
+			auto invoke = make_shared<AstInvokeExpression>();
+			{
+				auto ref = make_shared<AstReferenceExpression>();
+				ref->reference = AstNodeCast<AstDeclaration>(function->shared_from_this());
+				invoke->function = ref;
+			}
+			for (auto argument : function->arguments)
+			{
+				auto wrapperArgument = make_shared<AstSymbolDeclaration>();
+				wrapperArgument->composedName = argument->composedName;
+				wrapper->arguments.push_back(wrapperArgument);
+				if (argument == function->stateArgument)
+				{
+					wrapper->stateArgument = wrapperArgument;
+				}
+
+				auto ref = make_shared<AstReferenceExpression>();
+				ref->reference = wrapperArgument;
+				invoke->arguments.push_back(ref);
+			}
+			{
+				auto argument = make_shared<AstSymbolDeclaration>();
+				argument->composedName = T("$continuation");
+				wrapper->arguments.push_back(argument);
+				wrapper->continuationArgument = argument;
+			}
+
+			auto continuationInvoke = make_shared<AstInvokeExpression>();
+			{
+				auto ref = make_shared<AstReferenceExpression>();
+				ref->reference = wrapper->continuationArgument;
+				continuationInvoke->function = ref;
+			}
+			{
+				auto ref = make_shared<AstReferenceExpression>();
+				ref->reference = wrapper->stateArgument;
+				continuationInvoke->arguments.push_back(ref);
+			}
+			continuationInvoke->arguments.push_back(invoke);
+
+			auto stat = make_shared<AstExpressionStatement>();
+			stat->expression = continuationInvoke;
+			auto block = make_shared<AstBlockStatement>();
+			block->statements.push_back(stat);
+			wrapper->statement = block;
+			return wrapper;
+		}
+
+		extern void AdaptCallingConvention(AstExpression::Ptr node, DirectFunctionSet& directFunctions, CpsWrapperMap& wrappers);
+		extern void AdaptCallingConvention(AstStatement::Ptr node, DirectFunctionSet& directFunctions, CpsWrapperMap& wrappers);
+
+		class AstExpression_AdaptCallingConvention final : public AstExpressionVisitor
+		{
+		private:
+			DirectFunctionSet&				directFunctions;
+			CpsWrapperMap&					wrappers;
+
+		public:
+			AstExpression_AdaptCallingConvention(DirectFunctionSet& _directFunctions, CpsWrapperMap& _wrappers)
+				:directFunctions(_directFunctions)
+				, wrappers(_wrappers)
+			{
+			}
+
+			void Visit(AstLiteralExpression* node)override
+			{
+			}
+
+			void Visit(AstIntegerExpression* node)override
+			{
+			}
+
+			void Visit(AstFloatExpression* node)override
+			{
+			}
+
+			void Visit(AstStringExpression* node)override
+			{
+			}
+
+			void Visit(AstExternalSymbolExpression* node)override
+			{
+			}
+
+			void Visit(AstReferenceExpression* node)override
+			{
+				auto decl = node->reference.lock();
+				if (directFunctions.find(decl.get()) != directFunctions.end())
+				{
+					node->reference = GetCpsWrapper(AstNodeCast<AstFunctionDeclaration>(decl).get(), wrappers);
+				}
+			}
+
+			void Visit(AstNewTypeExpression* node)override
+			{
+				for (auto field : node->fields)
+				{
+					AdaptCallingConvention(field, directFunctions, wrappers);
+				}
+			}
+
+			void Visit(AstTestTypeExpression* node)override
+			{
+				AdaptCallingConvention(node->target, directFunctions, wrappers);
+			}
+
+			void Visit(AstNewArrayExpression* node)override
+			{
+				AdaptCallingConvention(node->length, directFunctions, wrappers);
+			}
+
+			void Visit(AstNewArrayLiteralExpression* node)override
+			{
+				for (auto element : node->elements)
+				{
+					AdaptCallingConvention(element, directFunctions, wrappers);
+				}
+			}
+
+			void Visit(AstArrayLengthExpression* node)override
+			{
+				AdaptCallingConvention(node->target, directFunctions, wrappers);
+			}
+
+			void Visit(AstArrayAccessExpression* node)override
+			{
+				AdaptCallingConvention(node->target, directFunctions, wrappers);
+				AdaptCallingConvention(node->index, directFunctions, wrappers);
+			}
+
+			void Visit(AstFieldAccessExpression* node)override
+			{
+				AdaptCallingConvention(node->target, directFunctions, wrappers);
+			}
+
+			void Visit(AstInvokeExpression* node)override
+			{
+				bool directInvoke = false;
+				if (auto ref = AstNodeCast<AstReferenceExpression>(node->function))
+				{
+					if (auto function = AstNodeCast<AstFunctionDeclaration>(ref->reference.lock()))
+					{
+						directInvoke = !function->continuationArgument && node->arguments.size() == function->arguments.size();
+					}
+				}
+
+				if (!directInvoke)
+				{
+					AdaptCallingConvention(node->function, directFunctions, wrappers);
+				}
+				for (auto argument : node->arguments)
+				{
+					AdaptCallingConvention(argument, directFunctions, wrappers);
+				}
+			}
+
+			void Visit(AstLambdaExpression* node)override
+			{
+				AdaptCallingConvention(node->statement, directFunctions, wrappers);
+			}
+
+			void Visit(AstDispatchExpression* node)override
+			{
+				for (auto argument : node->arguments)
+				{
+					AdaptCallingConvention(argument, directFunctions, wrappers);
+				}
+			}
+
+			void Visit(AstPrimitiveExpression* node)override
+			{
+				for (auto operand : node->operands)
+				{
+					AdaptCallingConvention(operand, directFunctions, wrappers);
+				}
+			}
+		};
+
+		/*************************************************************
+		AstStatement::AdaptCallingConvention
+		*************************************************************/
+
+		class AstStatement_AdaptCallingConvention final : public AstStatementVisitor
+		{
+		private:
+			DirectFunctionSet&				directFunctions;
+			CpsWrapperMap&					wrappers;
+
+		public:
+			AstStatement_AdaptCallingConvention(DirectFunctionSet& _directFunctions, CpsWrapperMap& _wrappers)
+				:directFunctions(_directFunctions)
+				, wrappers(_wrappers)
+			{
+			}
+
+			void Visit(AstBlockStatement* node)override
+			{
+				for (auto stat : node->statements)
+				{
+					AdaptCallingConvention(stat, directFunctions, wrappers);
+				}
+			}
+
+			void Visit(AstExpressionStatement* node)override
+			{
+				// a CPS call to a direct-style function f(state, arguments..., k) becomes k(state, f(state, arguments...))
+				if (auto invoke = AstNodeCast<AstInvokeExpression>(node->expression))
+				{
+					AstExpression::Ptr directFunction;
+					if (auto external = AstNodeCast<AstExternalSymbolExpression>(invoke->function))
+					{
+						if (!external->directStyle && !external->asynchronous && invoke->arguments.size() >= 2)
+						{
+							auto directExternal = make_shared<AstExternalSymbolExpression>();
+							directExternal->name = external->name;
+							directExternal->directStyle = true;
+							directFunction = directExternal;
+						}
+					}
+					else if (auto ref = AstNodeCast<AstReferenceExpression>(invoke->function))
+					{
+						auto decl = ref->reference.lock();
+						if (directFunctions.find(decl.get()) != directFunctions.end())
+						{
+							if (invoke->arguments.size() == AstNodeCast<AstFunctionDeclaration>(decl)->arguments.size() + 1)
+							{
+								directFunction = invoke->function;
+							}
+						}
+					}
+
+					AstExpression::Ptr state;
+					if (directFunction)
+					{
+						state = CopyReferenceExpression(invoke->arguments[0]);
+					}
+					if (state)
+					{
+						auto directInvoke = make_shared<AstInvokeExpression>();
+						directInvoke->function = directFunction;
+						directInvoke->arguments.insert(directInvoke->arguments.end(), invoke->arguments.begin(), invoke->arguments.end() - 1);
+
+						auto continuationInvoke = make_shared<AstInvokeExpression>();
+						continuationInvoke->function = invoke->arguments.back();
+						continuationInvoke->arguments.push_back(state);
+						continuationInvoke->arguments.push_back(directInvoke);
+						node->expression = continuationInvoke;
+					}
+				}
+				AdaptCallingConvention(node->expression, directFunctions, wrappers);
+			}
+
+			void Visit(AstDeclarationStatement* node)override
+			{
+			}
+
+			void Visit(AstAssignmentStatement* node)override
+			{
+				AdaptCallingConvention(node->target, directFunctions, wrappers);
+				AdaptCallingConvention(node->value, directFunctions, wrappers);
+			}
+
+			void Visit(AstIfStatement* node)override
+			{
+				AdaptCallingConvention(node->condition, directFunctions, wrappers);
+				AdaptCallingConvention(node->trueBranch, directFunctions, wrappers);
+				if (node->falseBranch)
+				{
+					AdaptCallingConvention(node->falseBranch, directFunctions, wrappers);
+				}
+			}
+		};
+
+		/*************************************************************
+		ConvertToDirectStyle
+		*************************************************************/
+
+		bool ConvertToDirectStyle(AstStatement::Ptr node, AstDirectStyleContext& context, AstDeclaration* continuation, AstStatement::List& stats)
+		{
+			AstStatement_ConvertToDirectStyle visitor(context, continuation, stats);
+			Dispatch(node.get(), visitor);
+			return visitor.result;
+		}
+
+		void AdaptCallingConvention(AstExpression::Ptr node, DirectFunctionSet& directFunctions, CpsWrapperMap& wrappers)
+		{
+			AstExpression_AdaptCallingConvention visitor(directFunctions, wrappers);
+			Dispatch(node.get(), visitor);
+		}
+
+		void AdaptCallingConvention(AstStatement::Ptr node, DirectFunctionSet& directFunctions, CpsWrapperMap& wrappers)
+		{
+			AstStatement_AdaptCallingConvention visitor(directFunctions, wrappers);
+			Dispatch(node.get(), visitor);
+		}
+
+		void ConvertToDirectStyle(AstAssembly::Ptr node)
+		{
+			// assume all functions could be direct-style, and remove those that need to capture a continuation until nothing changes
+			vector<AstFunctionDeclaration::Ptr> functions;
+			DirectFunctionSet directFunctions;
+			for (auto decl : node->declarations)
+			{
+				if (auto function = AstNodeCast<AstFunctionDeclaration>(decl))
+				{
+					functions.push_back(function);
+					if (function->continuationArgument && !function->signalArgument && !function->blockBodyArgument)
+					{
+						directFunctions.insert(function.get());
+					}
+				}
+			}
+
+			while (true)
+			{
+				bool modified = false;
+				for (auto function : functions)
+				{
+					if (directFunctions.find(function.get()) != directFunctions.end())
+					{
+						AstDirectStyleContext context(directFunctions, function.get());
+						AstStatement::List stats;
+						if (!ConvertToDirectStyle(function->statement, context, function->continuationArgument.get(), stats))
+						{
+							directFunctions.erase(function.get());
+							modified = true;
+						}
+					}
+				}
+				if (!modified) break;
+			}
+
+			map<AstFunctionDeclaration*, AstStatement::Ptr> directStatements;
+			for (auto function : functions)
+			{
+				if (directFunctions.find(function.get()) != directFunctions.end())
+				{
+					AstDirectStyleContext context(directFunctions, function.get());
+					auto block = make_shared<AstBlockStatement>();
+					ConvertToDirectStyle(function->statement, context, function->continuationArgument.get(), block->statements);
+					directStatements.insert(make_pair(function.get(), block));
+				}
+			}
+
+			for (auto dsp : directStatements)
+			{
+				auto function = dsp.first;
+				function->statement = dsp.second;
+				function->arguments.pop_back();
+				function->continuationArgument = nullptr;
+			}
+
+			// CPS callers call direct-style functions and pass the result to the continuation, function values become CPS wrappers
+			CpsWrapperMap wrappers;
+			for (auto function : functions)
+			{
+				AdaptCallingConvention(function->statement, directFunctions, wrappers);
+			}
+			for (auto decl : node->declarations)
+			{
+				if (auto table = AstNodeCast<AstDispatchTableDeclaration>(decl))
+				{
+					for (auto& target : table->targets)
+					{
+						auto function = target.lock();
+						if (directFunctions.find(function.get()) != directFunctions.end())
+						{
+							target = GetCpsWrapper(function.get(), wrappers);
+						}
+					}
+				}
+			}
+
+			for (auto function : functions)
+			{
+				RoughlyOptimize(function);
+			}
+			for (auto function : functions)
+			{
+				auto it = wrappers.find(function.get());
+				if (it != wrappers.end())
+				{
+					node->declarations.push_back(it->second);
+				}
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -8,7 +8,7 @@ namespace tinymoe
 		AstStatement::ExpandBlock
 		*************************************************************/
 
-		class AstStatement_ExpandBlock : public AstStatementVisitor
+		class AstStatement_ExpandBlock final : public AstStatementVisitor
 		{
 		private:
 			AstStatement::List&			stats;
@@ -27,9 +27,9 @@ namespace tinymoe
 				{
 					for (auto stat : node->statements)
 					{
-						if (dynamic_pointer_cast<AstDeclarationStatement>(stat))
+						if (AstNodeCast<AstDeclarationStatement>(stat))
 						{
-							stats.push_back(dynamic_pointer_cast<AstStatement>(node->shared_from_this()));
+							stats.push_back(AstNodeCast<AstStatement>(node->shared_from_this()));
 							return;
 						}
 					}
@@ -43,22 +43,22 @@ namespace tinymoe
 
 			void Visit(AstExpressionStatement* node)override
 			{
-				stats.push_back(dynamic_pointer_cast<AstStatement>(node->shared_from_this()));
+				stats.push_back(AstNodeCast<AstStatement>(node->shared_from_this()));
 			}
 
 			void Visit(AstDeclarationStatement* node)override
 			{
-				stats.push_back(dynamic_pointer_cast<AstStatement>(node->shared_from_this()));
+				stats.push_back(AstNodeCast<AstStatement>(node->shared_from_this()));
 			}
 
 			void Visit(AstAssignmentStatement* node)override
 			{
-				stats.push_back(dynamic_pointer_cast<AstStatement>(node->shared_from_this()));
+				stats.push_back(AstNodeCast<AstStatement>(node->shared_from_this()));
 			}
 
 			void Visit(AstIfStatement* node)override
 			{
-				stats.push_back(dynamic_pointer_cast<AstStatement>(node->shared_from_this()));
+				stats.push_back(AstNodeCast<AstStatement>(node->shared_from_this()));
 			}
 		};
 
@@ -69,7 +69,7 @@ namespace tinymoe
 		void ExpandBlock(AstStatement::Ptr node, AstStatement::List& stats, bool lastStatement)
 		{
 			AstStatement_ExpandBlock visitor(stats, lastStatement);
-			node->Accept(&visitor);
+			Dispatch(node.get(), visitor);
 		}
 	}
 }
\ No newline at end of file
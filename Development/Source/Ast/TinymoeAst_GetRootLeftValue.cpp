@@ -8,7 +8,7 @@ namespace tinymoe
 		AstExpression::GetRootLeftValue
 		*************************************************************/
 
-		class AstExpression_GetRootLeftValue : public AstExpressionVisitor
+		class AstExpression_GetRootLeftValue final : public AstExpressionVisitor
 		{
 		public:
 			shared_ptr<AstDeclaration>			result;
@@ -75,6 +75,14 @@ namespace tinymoe
 			void Visit(AstLambdaExpression* node)override
 			{
 			}
+
+			void Visit(AstDispatchExpression* node)override
+			{
+			}
+
+			void Visit(AstPrimitiveExpression* node)override
+			{
+			}
 		};
 		
 		/*************************************************************
@@ -84,7 +92,7 @@ namespace tinymoe
 		AstDeclaration::Ptr GetRootLeftValue(AstExpression::Ptr node)
 		{
 			AstExpression_GetRootLeftValue visitor;
-			node->Accept(&visitor);
+			Dispatch(node.get(), visitor);
 			return visitor.result;
 		}
 	}
@@ -0,0 +1,155 @@
+#include "TinymoeAst.h"
+#include <cstring>
+
+namespace tinymoe
+{
+	namespace ast
+	{
+		/*************************************************************
+		AstInternKey
+		*************************************************************/
+
+		// two internable nodes are structurally equal if and only if their keys are equal
+		struct AstInternKey
+		{
+			AstNodeKind								kind;
+			int64_t									value = 0;			// enum items, integers and bits of floats
+			string_t								text;
+			AstNode*								target = nullptr;	// the weak reference, compared by identity
+
+			bool operator<(const AstInternKey& key)const
+			{
+				if (kind != key.kind) return kind < key.kind;
+				if (value != key.value) return value < key.value;
+				if (target != key.target) return target < key.target;
+				return text < key.text;
+			}
+		};
+
+		// only nodes without children are interned, and they are never changed after the AST is generated,
+		// a lambda expression is not interned, because it owns argument declarations, which are identified by code generators
+		static bool GetInternKey(AstNode* node, AstInternKey& key)
+		{
+			key.kind = node->kind;
+			switch (node->kind)
+			{
+			case AstNodeKind::LiteralExpression:
+				key.value = (int64_t)static_cast<AstLiteralExpression*>(node)->literalName;
+				return true;
+			case AstNodeKind::IntegerExpression:
+				key.value = static_cast<AstIntegerExpression*>(node)->value;
+				return true;
+			case AstNodeKind::FloatExpression:
+				// bits are compared, so 0.0 and -0.0 are different, and a NaN is equal to itself
+				memcpy(&key.value, &static_cast<AstFloatExpression*>(node)->value, sizeof(key.value));
+				return true;
+			case AstNodeKind::StringExpression:
+				key.text = static_cast<AstStringExpression*>(node)->value;
+				return true;
+			case AstNodeKind::ExternalSymbolExpression:
+				{
+					auto expr = static_cast<AstExternalSymbolExpression*>(node);
+					key.value = (expr->directStyle ? 1 : 0) | (expr->asynchronous ? 2 : 0);
+					key.text = expr->name;
+				}
+				return true;
+			case AstNodeKind::ReferenceExpression:
+				key.target = static_cast<AstReferenceExpression*>(node)->reference.lock().get();
+				return true;
+			case AstNodeKind::PredefinedType:
+				key.value = (int64_t)static_cast<AstPredefinedType*>(node)->typeName;
+				return true;
+			case AstNodeKind::ReferenceType:
+				key.target = static_cast<AstReferenceType*>(node)->typeDeclaration.lock().get();
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		static size_t GetInternNodeSize(AstNodeKind kind)
+		{
+			switch (kind)
+			{
+			case AstNodeKind::LiteralExpression:		return sizeof(AstLiteralExpression);
+			case AstNodeKind::IntegerExpression:		return sizeof(AstIntegerExpression);
+			case AstNodeKind::FloatExpression:			return sizeof(AstFloatExpression);
+			case AstNodeKind::StringExpression:			return sizeof(AstStringExpression);
+			case AstNodeKind::ExternalSymbolExpression:	return sizeof(AstExternalSymbolExpression);
+			case AstNodeKind::ReferenceExpression:		return sizeof(AstReferenceExpression);
+			case AstNodeKind::PredefinedType:			return sizeof(AstPredefinedType);
+			case AstNodeKind::ReferenceType:			return sizeof(AstReferenceType);
+			default:									return 0;
+			}
+		}
+
+		/*************************************************************
+		AstInternTable
+		*************************************************************/
+
+		class AstInternTable
+		{
+		public:
+			map<AstInternKey, AstNode::Ptr>			nodes;
+			AstInternStatistics&					statistics;
+
+			AstInternTable(AstInternStatistics& _statistics)
+				:statistics(_statistics)
+			{
+			}
+
+			template<typename T>
+			void operator()(shared_ptr<T>& child)
+			{
+				if (!child)
+				{
+					return;
+				}
+
+				AstInternKey key;
+				if (!GetInternKey(child.get(), key))
+				{
+					ForEachChildPtr(child.get(), *this);
+					return;
+				}
+
+				auto it = nodes.find(key);
+				if (it == nodes.end())
+				{
+					nodes.insert(make_pair(key, child));
+				}
+				else if (it->second != child)
+				{
+					auto shared = it->second;
+					if (!shared->shared)
+					{
+						shared->shared = true;
+						shared->parent.reset();
+						statistics.internedNodes++;
+					}
+					statistics.removedNodes++;
+					statistics.removedBytes += GetInternNodeSize(key.kind);
+
+					// the kind of the interned node is the same, so it is a T
+					child = static_pointer_cast<T>(shared);
+				}
+			}
+		};
+
+		/*************************************************************
+		InternAst
+		*************************************************************/
+
+		bool IsInternableNode(AstNode* node)
+		{
+			AstInternKey key;
+			return GetInternKey(node, key);
+		}
+
+		void InternAst(AstAssembly::Ptr node, AstInternStatistics& statistics)
+		{
+			AstInternTable table(statistics);
+			ForEachChildPtr(node.get(), table);
+		}
+	}
+}
@@ -7,60 +7,54 @@ namespace tinymoe
 {
 	namespace ast
 	{
-		string_t Indent(int indentation)
-		{
-			string_t s;
-			for (int i = 0; i < indentation; i++)
-			{
-				s += T("    ");
-			}
-			return s;
-		}
+		const char_t* const		PrintIndentation = T("    ");
 
 		/*************************************************************
 		AstDeclaration::Print
 		*************************************************************/
 
-		class AstDeclaration_Print : public AstDeclarationVisitor
+		class AstDeclaration_Print final : public AstDeclarationVisitor
 		{
 		private:
-			ostream_t&			o;
-			int					indentation;
+			Emitter&			o;
 		public:
-			AstDeclaration_Print(ostream_t& _o, int _indentation)
-				:o(_o), indentation(_indentation)
+			AstDeclaration_Print(Emitter& _o)
+				:o(_o)
 			{
 			}
 
 			void Visit(AstSymbolDeclaration* node)override
 			{
-				o << Indent(indentation) << T("$symbol ") << node->composedName << T(";");
+				o.Indent() << T("$symbol ") << node->composedName << T(";");
 			}
 
 			void Visit(AstTypeDeclaration* node)override
 			{
-				o << Indent(indentation) << T("$type ") << node->composedName;
+				o.Indent() << T("$type ") << node->composedName;
 				if (!node->baseType.expired())
 				{
 					o << T(" : ");
-					Print(node->baseType.lock(), o, indentation);
+					Print(node->baseType.lock(), o);
 				}
-				o << endl << Indent(indentation) << T("{") << endl;
+				o << T("\n");
+				o.Indent() << T("{\n");
+				o.PushIndentation(PrintIndentation);
 				for (auto field : node->fields)
 				{
-					Print(field, o, indentation + 1, node->shared_from_this());
-					o << endl;
+					Print(field, o, node->shared_from_this());
+					o << T("\n");
 				}
-				o << Indent(indentation) << T("}");
+				o.PopIndentation();
+				o.Indent() << T("}");
 			}
 
 			void Visit(AstFunctionDeclaration* node)override
 			{
-				o << Indent(indentation) << T("$procedure ");
+				o.Indent() << (node->continuationArgument ? T("$procedure ") : T("$function "));
 				if (node->ownerType)
 				{
 					o << T("(");
-					Print(node->ownerType, o, indentation, node->shared_from_this());
+					Print(node->ownerType, o, node->shared_from_this());
 					o << T(").");
 				}
 				o << node->composedName << T("(");
@@ -73,8 +67,46 @@ namespace tinymoe
 					}
 				}
 
-				o << T(")") << endl;
-				Print(node->statement, o, indentation, node->shared_from_this());
+				o << T(")\n");
+				Print(node->statement, o, node->shared_from_this());
+			}
+
+			void Visit(AstDispatchTableDeclaration* node)override
+			{
+				auto rootFunction = node->rootFunction.lock();
+				o.Indent() << T("$dispatch_table ") << node->composedName << T("(");
+				for (auto it = node->dispatchArguments.begin(); it != node->dispatchArguments.end(); it++)
+				{
+					o << rootFunction->arguments[*it]->composedName;
+					if (it + 1 != node->dispatchArguments.end())
+					{
+						o << T(", ");
+					}
+				}
+				o << T(")\n");
+				o.Indent() << T("{\n");
+
+				vector<int> indexes(node->dimensions.size(), 0);
+				for (auto target : node->targets)
+				{
+					o.Indent() << PrintIndentation << T("[");
+					for (int i = 0; (size_t)i < indexes.size(); i++)
+					{
+						Print(node->dimensions[i][indexes[i]], o, node->shared_from_this());
+						if ((size_t)i + 1 != indexes.size())
+						{
+							o << T(", ");
+						}
+					}
+					o << T("] = ") << target.lock()->composedName << T(";\n");
+
+					for (int i = indexes.size() - 1; i >= 0; i--)
+					{
+						if ((size_t)++indexes[i] < node->dimensions[i].size()) break;
+						indexes[i] = 0;
+					}
+				}
+				o.Indent() << T("}");
 			}
 		};
 
@@ -82,14 +114,13 @@ namespace tinymoe
 		AstExpression::Print
 		*************************************************************/
 
-		class AstExpression_Print : public AstExpressionVisitor
+		class AstExpression_Print final : public AstExpressionVisitor
 		{
 		private:
-			ostream_t&			o;
-			int					indentation;
+			Emitter&			o;
 		public:
-			AstExpression_Print(ostream_t& _o, int _indentation)
-				:o(_o), indentation(_indentation)
+			AstExpression_Print(Emitter& _o)
+				:o(_o)
 			{
 			}
 
@@ -126,7 +157,7 @@ namespace tinymoe
 
 			void Visit(AstExternalSymbolExpression* node)override
 			{
-				o << T("$external (\"") << node->name << T("\")");
+				o << (node->directStyle ? T("$direct_external (\"") : node->asynchronous ? T("$async_external (\"") : T("$external (\"")) << node->name << T("\")");
 			}
 
 			void Visit(AstReferenceExpression* node)override
@@ -137,11 +168,11 @@ namespace tinymoe
 			void Visit(AstNewTypeExpression* node)override
 			{
 				o << T("new ");
-				Print(node->type, o, indentation, node->shared_from_this());
+				Print(node->type, o, node->shared_from_this());
 				o << T("(");
 				for (auto it = node->fields.begin(); it != node->fields.end(); it++)
 				{
-					Print((*it), o, indentation, node->shared_from_this());
+					Print((*it), o, node->shared_from_this());
 					if (it + 1 != node->fields.end())
 					{
 						o << T(", ");
@@ -153,16 +184,16 @@ namespace tinymoe
 			void Visit(AstTestTypeExpression* node)override
 			{
 				o << T("(");
-				Print(node->target, o, indentation, node->shared_from_this());
+				Print(node->target, o, node->shared_from_this());
 				o << T(" is ");
-				Print(node->type, o, indentation, node->shared_from_this());
+				Print(node->type, o, node->shared_from_this());
 				o << T(")");
 			}
 
 			void Visit(AstNewArrayExpression* node)override
 			{
 				o << T("new $Array(");
-				Print(node->length, o, indentation, node->shared_from_this());
+				Print(node->length, o, node->shared_from_this());
 				o << T(")");
 			}
 
@@ -171,7 +202,7 @@ namespace tinymoe
 				o << T("[");
 				for (auto it = node->elements.begin(); it != node->elements.end(); it++)
 				{
-					Print((*it), o, indentation, node->shared_from_this());
+					Print((*it), o, node->shared_from_this());
 					if (it + 1 != node->elements.end())
 					{
 						o << T(", ");
@@ -183,39 +214,41 @@ namespace tinymoe
 			void Visit(AstArrayLengthExpression* node)override
 			{
 				o << T("$ArrayLength(");
-				Print(node->target, o, indentation, node->shared_from_this());
+				Print(node->target, o, node->shared_from_this());
 				o << T(")");
 			}
 
 			void Visit(AstArrayAccessExpression* node)override
 			{
-				Print(node->target, o, indentation, node->shared_from_this());
+				Print(node->target, o, node->shared_from_this());
 				o << T("[");
-				Print(node->index, o, indentation, node->shared_from_this());
+				Print(node->index, o, node->shared_from_this());
 				o << T("]");
 			}
 
 			void Visit(AstFieldAccessExpression* node)override
 			{
-				Print(node->target, o, indentation, node->shared_from_this());
+				Print(node->target, o, node->shared_from_this());
 				o << T(".") << node->composedFieldName;
 			}
 
 			void Visit(AstInvokeExpression* node)override
 			{
-				Print(node->function, o, indentation, node->shared_from_this());
-				o << T("(") << endl;
+				Print(node->function, o, node->shared_from_this());
+				o << T("(\n");
+				o.PushIndentation(PrintIndentation);
 				for (auto it = node->arguments.begin(); it != node->arguments.end(); it++)
 				{
-					o << Indent(indentation + 1);
-					Print((*it), o, indentation + 1, node->shared_from_this());
+					o.Indent();
+					Print((*it), o, node->shared_from_this());
 					if (it + 1 != node->arguments.end())
 					{
 						o << T(", ");
 					}
-					o << endl;
+					o << T("\n");
 				}
-				o << Indent(indentation + 1) << T(")");
+				o.Indent() << T(")");
+				o.PopIndentation();
 			}
 
 			void Visit(AstLambdaExpression* node)override
@@ -229,8 +262,120 @@ namespace tinymoe
 						o << T(", ");
 					}
 				}
-				o << T(")") << endl;
-				Print(node->statement, o, indentation + 1, node->shared_from_this());
+				o << T(")\n");
+				o.PushIndentation(PrintIndentation);
+				Print(node->statement, o, node->shared_from_this());
+				o.PopIndentation();
+			}
+
+			void Visit(AstDispatchExpression* node)override
+			{
+				o << T("$dispatch ") << node->table.lock()->composedName << T("(");
+				for (auto it = node->arguments.begin(); it != node->arguments.end(); it++)
+				{
+					Print((*it), o, node->shared_from_this());
+					if (it + 1 != node->arguments.end())
+					{
+						o << T(", ");
+					}
+				}
+				o << T(")");
+			}
+
+			void Visit(AstPrimitiveExpression* node)override
+			{
+				o << T("$primitive ");
+				switch (node->op)
+				{
+				case AstPrimitiveOperator::IntegerPositive:
+					o << T("integer_positive");
+					break;
+				case AstPrimitiveOperator::FloatPositive:
+					o << T("float_positive");
+					break;
+				case AstPrimitiveOperator::IntegerNegative:
+					o << T("integer_negative");
+					break;
+				case AstPrimitiveOperator::FloatNegative:
+					o << T("float_negative");
+					break;
+				case AstPrimitiveOperator::BooleanNot:
+					o << T("boolean_not");
+					break;
+				case AstPrimitiveOperator::StringConcat:
+					o << T("string_concat");
+					break;
+				case AstPrimitiveOperator::IntegerAdd:
+					o << T("integer_add");
+					break;
+				case AstPrimitiveOperator::FloatAdd:
+					o << T("float_add");
+					break;
+				case AstPrimitiveOperator::IntegerSub:
+					o << T("integer_sub");
+					break;
+				case AstPrimitiveOperator::FloatSub:
+					o << T("float_sub");
+					break;
+				case AstPrimitiveOperator::IntegerMul:
+					o << T("integer_mul");
+					break;
+				case AstPrimitiveOperator::FloatMul:
+					o << T("float_mul");
+					break;
+				case AstPrimitiveOperator::IntegerDiv:
+					o << T("integer_div");
+					break;
+				case AstPrimitiveOperator::FloatDiv:
+					o << T("float_div");
+					break;
+				case AstPrimitiveOperator::IntegerIntDiv:
+					o << T("integer_int_div");
+					break;
+				case AstPrimitiveOperator::IntegerMod:
+					o << T("integer_mod");
+					break;
+				case AstPrimitiveOperator::IntegerEqual:
+					o << T("integer_equal");
+					break;
+				case AstPrimitiveOperator::FloatEqual:
+					o << T("float_equal");
+					break;
+				case AstPrimitiveOperator::StringEqual:
+					o << T("string_equal");
+					break;
+				case AstPrimitiveOperator::BooleanEqual:
+					o << T("boolean_equal");
+					break;
+				case AstPrimitiveOperator::IntegerCompare:
+					o << T("integer_compare");
+					break;
+				case AstPrimitiveOperator::FloatCompare:
+					o << T("float_compare");
+					break;
+				case AstPrimitiveOperator::StringCompare:
+					o << T("string_compare");
+					break;
+				case AstPrimitiveOperator::BooleanAnd:
+					o << T("boolean_and");
+					break;
+				case AstPrimitiveOperator::BooleanOr:
+					o << T("boolean_or");
+					break;
+				case AstPrimitiveOperator::IntegerToFloat:
+					o << T("integer_to_float");
+					break;
+				}
+				o << T("(");
+				for (auto it = node->operands.begin(); it != node->operands.end(); it++)
+				{
+					Print((*it), o, node->shared_from_this());
+					if (it + 1 != node->operands.end())
+					{
+						o << T(", ");
+					}
+				}
+				o << T(")");
 			}
 		};
 
@@ -238,59 +383,65 @@ namespace tinymoe
 		AstStatement::Print
 		*************************************************************/
 
-		class AstStatement_Print : public AstStatementVisitor
+		class AstStatement_Print final : public AstStatementVisitor
 		{
 		private:
-			ostream_t&			o;
-			int					indentation;
+			Emitter&			o;
 		public:
-			AstStatement_Print(ostream_t& _o, int _indentation)
-				:o(_o), indentation(_indentation)
+			AstStatement_Print(Emitter& _o)
+				:o(_o)
 			{
 			}
 
 			void Visit(AstBlockStatement* node)override
 			{
-				o << Indent(indentation) << T("{") << endl;
+				o.Indent() << T("{\n");
+				o.PushIndentation(PrintIndentation);
 				for (auto statement : node->statements)
 				{
-					Print(statement, o, indentation + 1, node->shared_from_this());
-					o << endl;
+					Print(statement, o, node->shared_from_this());
+					o << T("\n");
 				}
-				o << Indent(indentation) << T("}");
+				o.PopIndentation();
+				o.Indent() << T("}");
 			}
 
 			void Visit(AstExpressionStatement* node)override
 			{
-				o << Indent(indentation);
-				Print(node->expression, o, indentation, node->shared_from_this());
+				o.Indent();
+				Print(node->expression, o, node->shared_from_this());
 				o << T(";");
 			}
 
 			void Visit(AstDeclarationStatement* node)override
 			{
-				Print(node->declaration, o, indentation, node->shared_from_this());
+				Print(node->declaration, o, node->shared_from_this());
 			}
 
 			void Visit(AstAssignmentStatement* node)override
 			{
-				o << Indent(indentation);
-				Print(node->target, o, indentation, node->shared_from_this());
+				o.Indent();
+				Print(node->target, o, node->shared_from_this());
 				o << T(" = ");
-				Print(node->value, o, indentation, node->shared_from_this());
+				Print(node->value, o, node->shared_from_this());
 				o << T(";");
 			}
 
 			void Visit(AstIfStatement* node)override
 			{
-				o << Indent(indentation) << T("if (");
-				Print(node->condition, o, indentation, node->shared_from_this());
-				o << endl;
-				Print(node->trueBranch, o, indentation + 1, node->shared_from_this());
+				o.Indent() << T("if (");
+				Print(node->condition, o, node->shared_from_this());
+				o << T("\n");
+				o.PushIndentation(PrintIndentation);
+				Print(node->trueBranch, o, node->shared_from_this());
+				o.PopIndentation();
 				if (node->falseBranch)
 				{
-					o << endl << Indent(indentation) << T("else") << endl;
-					Print(node->falseBranch, o, indentation + 1, node->shared_from_this());
+					o << T("\n");
+					o.Indent() << T("else\n");
+					o.PushIndentation(PrintIndentation);
+					Print(node->falseBranch, o, node->shared_from_this());
+					o.PopIndentation();
 				}
 			}
 		};
@@ -299,14 +450,13 @@ namespace tinymoe
 		AstType::Print
 		*************************************************************/
 
-		class AstType_Print : public AstTypeVisitor
+		class AstType_Print final : public AstTypeVisitor
 		{
 		private:
-			ostream_t&			o;
-			int					indentation;
+			Emitter&			o;
 		public:
-			AstType_Print(ostream_t& _o, int _indentation)
-				:o(_o), indentation(_indentation)
+			AstType_Print(Emitter& _o)
+				:o(_o)
 			{
 			}
 
@@ -351,44 +501,43 @@ namespace tinymoe
 		class AstNode_Print : public AstVisitor
 		{
 		private:
-			ostream_t&			o;
-			int					indentation;
+			Emitter&			o;
 		public:
-			AstNode_Print(ostream_t& _o, int _indentation)
-				:o(_o), indentation(_indentation)
+			AstNode_Print(Emitter& _o)
+				:o(_o)
 			{
 			}
 			
 			void Visit(AstType* node)override
 			{
-				AstType_Print visitor(o, indentation);
-				node->Accept(&visitor);
+				AstType_Print visitor(o);
+				Dispatch(node, visitor);
 			}
 
 			void Visit(AstExpression* node)override
 			{
-				AstExpression_Print visitor(o, indentation);
-				node->Accept(&visitor);
+				AstExpression_Print visitor(o);
+				Dispatch(node, visitor);
 			}
 
 			void Visit(AstStatement* node)override
 			{
-				AstStatement_Print visitor(o, indentation);
-				node->Accept(&visitor);
+				AstStatement_Print visitor(o);
+				Dispatch(node, visitor);
 			}
 
 			void Visit(AstDeclaration* node)override
 			{
-				AstDeclaration_Print visitor(o, indentation);
-				node->Accept(&visitor);
+				AstDeclaration_Print visitor(o);
+				Dispatch(node, visitor);
 			}
 
 			void Visit(AstAssembly* node)override
 			{
 				for (auto decl : node->declarations)
 				{
-					Print(decl, o, indentation, node->shared_from_this());
-					o << endl << endl;
+					Print(decl, o, node->shared_from_this());
+					o << T("\n\n");
 				}
 			}
 		};
@@ -399,8 +548,18 @@ namespace tinymoe
 
 		void Print(AstNode::Ptr node, ostream_t& o, int indentation, AstNode::WeakPtr _parent)
 		{
-			ASSERT(_parent.expired() || node->parent.lock() == _parent.lock());
-			AstNode_Print visitor(o, indentation);
+			Emitter emitter(o);
+			for (int i = 0; i < indentation; i++)
+			{
+				emitter.PushIndentation(PrintIndentation);
+			}
+			Print(node, emitter, _parent);
+		}
+
+		void Print(AstNode::Ptr node, Emitter& o, AstNode::WeakPtr _parent)
+		{
+			ASSERT(_parent.expired() || node->shared || node->parent.lock() == _parent.lock());
+			AstNode_Print visitor(o);
 			node->Accept(&visitor);
 		}
 	}
@@ -0,0 +1,720 @@
+#include "TinymoeAst.h"
+
+namespace tinymoe
+{
+	namespace ast
+	{
+		/*************************************************************
+		Type Relationship
+		*************************************************************/
+
+		AstType::Ptr MakePredefinedType(AstPredefinedTypeName typeName)
+		{
+			auto type = make_shared<AstPredefinedType>();
+			type->typeName = typeName;
+			return type;
+		}
+
+		bool IsSameType(AstType::Ptr a, AstType::Ptr b)
+		{
+			auto predefinedA = AstNodeCast<AstPredefinedType>(a);
+			auto predefinedB = AstNodeCast<AstPredefinedType>(b);
+			if (predefinedA && predefinedB)
+			{
+				return predefinedA->typeName == predefinedB->typeName;
+			}
+
+			auto referenceA = AstNodeCast<AstReferenceType>(a);
+			auto referenceB = AstNodeCast<AstReferenceType>(b);
+			if (referenceA && referenceB)
+			{
+				return referenceA->typeDeclaration.lock() == referenceB->typeDeclaration.lock();
+			}
+			return false;
+		}
+
+		AstType::Ptr GetBaseType(AstType::Ptr type)
+		{
+			if (auto predefinedType = AstNodeCast<AstPredefinedType>(type))
+			{
+				if (predefinedType->typeName == AstPredefinedTypeName::Object)
+				{
+					return nullptr;
+				}
+			}
+			else if (auto referenceType = AstNodeCast<AstReferenceType>(type))
+			{
+				auto typeDecl = referenceType->typeDeclaration.lock();
+				if (!typeDecl->baseType.expired())
+				{
+					return typeDecl->baseType.lock();
+				}
+			}
+
+			return MakePredefinedType(AstPredefinedTypeName::Object);
+		}
+
+		/*************************************************************
+		Primitive Operators
+		*************************************************************/
+
+		struct AstPrimitiveOperatorInfo
+		{
+			const char_t*					externalName;
+			AstPrimitiveOperator			op;
+			int								operandCount;
+			AstPredefinedTypeName			operandType;
+			AstPredefinedTypeName			resultType;
+		};
+
+		// external functions from the standard library that could be replaced by machine instructions
+		static const AstPrimitiveOperatorInfo primitiveOperators[] =
+		{
+			{ T("pos_i"),		AstPrimitiveOperator::IntegerPositive,	1,	AstPredefinedTypeName::Integer,	AstPredefinedTypeName::Integer },
+			{ T("pos_f"),		AstPrimitiveOperator::FloatPositive,	1,	AstPredefinedTypeName::Float,	AstPredefinedTypeName::Float },
+			{ T("neg_i"),		AstPrimitiveOperator::IntegerNegative,	1,	AstPredefinedTypeName::Integer,	AstPredefinedTypeName::Integer },
+			{ T("neg_f"),		AstPrimitiveOperator::FloatNegative,	1,	AstPredefinedTypeName::Float,	AstPredefinedTypeName::Float },
+			{ T("not_b"),		AstPrimitiveOperator::BooleanNot,		1,	AstPredefinedTypeName::Boolean,	AstPredefinedTypeName::Boolean },
+			{ T("s_concat_s"),	AstPrimitiveOperator::StringConcat,		2,	AstPredefinedTypeName::String,	AstPredefinedTypeName::String },
+			{ T("i_add_i"),		AstPrimitiveOperator::IntegerAdd,		2,	AstPredefinedTypeName::Integer,	AstPredefinedTypeName::Integer },
+			{ T("f_add_f"),		AstPrimitiveOperator::FloatAdd,			2,	AstPredefinedTypeName::Float,	AstPredefinedTypeName::Float },
+			{ T("i_sub_i"),		AstPrimitiveOperator::IntegerSub,		2,	AstPredefinedTypeName::Integer,	AstPredefinedTypeName::Integer },
+			{ T("f_sub_f"),		AstPrimitiveOperator::FloatSub,			2,	AstPredefinedTypeName::Float,	AstPredefinedTypeName::Float },
+			{ T("i_mul_i"),		AstPrimitiveOperator::IntegerMul,		2,	AstPredefinedTypeName::Integer,	AstPredefinedTypeName::Integer },
+			{ T("f_mul_f"),		AstPrimitiveOperator::FloatMul,			2,	AstPredefinedTypeName::Float,	AstPredefinedTypeName::Float },
+			{ T("i_div_i"),		AstPrimitiveOperator::IntegerDiv,		2,	AstPredefinedTypeName::Integer,	AstPredefinedTypeName::Float },
+			{ T("f_div_f"),		AstPrimitiveOperator::FloatDiv,			2,	AstPredefinedTypeName::Float,	AstPredefinedTypeName::Float },
+			{ T("i_intdiv_i"),	AstPrimitiveOperator::IntegerIntDiv,	2,	AstPredefinedTypeName::Integer,	AstPredefinedTypeName::Integer },
+			{ T("i_mod_i"),		AstPrimitiveOperator::IntegerMod,		2,	AstPredefinedTypeName::Integer,	AstPredefinedTypeName::Integer },
+			{ T("i_e_i"),		AstPrimitiveOperator::IntegerEqual,		2,	AstPredefinedTypeName::Integer,	AstPredefinedTypeName::Boolean },
+			{ T("f_e_f"),		AstPrimitiveOperator::FloatEqual,		2,	AstPredefinedTypeName::Float,	AstPredefinedTypeName::Boolean },
+			{ T("s_e_s"),		AstPrimitiveOperator::StringEqual,		2,	AstPredefinedTypeName::String,	AstPredefinedTypeName::Boolean },
+			{ T("b_e_b"),		AstPrimitiveOperator::BooleanEqual,		2,	AstPredefinedTypeName::Boolean,	AstPredefinedTypeName::Boolean },
+			{ T("i_c_i"),		AstPrimitiveOperator::IntegerCompare,	2,	AstPredefinedTypeName::Integer,	AstPredefinedTypeName::Integer },
+			{ T("f_c_f"),		AstPrimitiveOperator::FloatCompare,		2,	AstPredefinedTypeName::Float,	AstPredefinedTypeName::Integer },
+			{ T("s_c_s"),		AstPrimitiveOperator::StringCompare,	2,	AstPredefinedTypeName::String,	AstPredefinedTypeName::Integer },
+			{ T("b_and_b"),		AstPrimitiveOperator::BooleanAnd,		2,	AstPredefinedTypeName::Boolean,	AstPredefinedTypeName::Boolean },
+			{ T("b_or_b"),		AstPrimitiveOperator::BooleanOr,		2,	AstPredefinedTypeName::Boolean,	AstPredefinedTypeName::Boolean },
+			{ T("i_to_f"),		AstPrimitiveOperator::IntegerToFloat,	1,	AstPredefinedTypeName::Integer,	AstPredefinedTypeName::Float },
+		};
+
+		bool IsForwardingContinuation(AstExpression::Ptr continuation, AstFunctionDeclaration* function)
+		{
+			if (auto ref = AstNodeCast<AstReferenceExpression>(continuation))
+			{
+				return ref->reference.lock() == function->continuationArgument;
+			}
+
+			// $lambda ($state_0, $result_1) { $the_result = $result_1; $continuation($state, $the_result); }
+			auto lambda = AstNodeCast<AstLambdaExpression>(continuation);
+			if (!lambda || lambda->arguments.size() != 2) return false;
+			auto block = AstNodeCast<AstBlockStatement>(lambda->statement);
+			if (!block || block->statements.size() == 0 || block->statements.size() > 2) return false;
+
+			AstDeclaration::Ptr result = lambda->arguments[1];
+			if (block->statements.size() == 2)
+			{
+				auto assign = AstNodeCast<AstAssignmentStatement>(block->statements[0]);
+				if (!assign) return false;
+				auto target = AstNodeCast<AstReferenceExpression>(assign->target);
+				auto value = AstNodeCast<AstReferenceExpression>(assign->value);
+				if (!target || !value || target->reference.lock() != function->resultVariable || value->reference.lock() != result) return false;
+				result = function->resultVariable;
+			}
+
+			auto stat = AstNodeCast<AstExpressionStatement>(block->statements.back());
+			if (!stat) return false;
+			auto invoke = AstNodeCast<AstInvokeExpression>(stat->expression);
+			if (!invoke || invoke->arguments.size() != 2) return false;
+			auto ref = AstNodeCast<AstReferenceExpression>(invoke->function);
+			auto state = AstNodeCast<AstReferenceExpression>(invoke->arguments[0]);
+			auto value = AstNodeCast<AstReferenceExpression>(invoke->arguments[1]);
+			return ref && state && value && ref->reference.lock() == function->continuationArgument && value->reference.lock() == result;
+		}
+
+		const AstPrimitiveOperatorInfo* GetPrimitiveOperator(AstFunctionDeclaration* function)
+		{
+			// a function generated from "redirect to" calls the external function and passes the result to the continuation
+			if (!function->continuationArgument || function->signalArgument || function->blockBodyArgument) return nullptr;
+			auto block = AstNodeCast<AstBlockStatement>(function->statement);
+			if (!block) return nullptr;
+
+			shared_ptr<AstExpressionStatement> stat;
+			for (auto statement : block->statements)
+			{
+				if (AstNodeCast<AstDeclarationStatement>(statement)) continue;
+				if (stat) return nullptr;
+				if (!(stat = AstNodeCast<AstExpressionStatement>(statement))) return nullptr;
+			}
+			if (!stat) return nullptr;
+
+			auto invoke = AstNodeCast<AstInvokeExpression>(stat->expression);
+			if (!invoke || invoke->arguments.size() != function->arguments.size()) return nullptr;
+			auto external = AstNodeCast<AstExternalSymbolExpression>(invoke->function);
+			if (!external || external->directStyle) return nullptr;
+			for (int i = 0; (size_t)i < invoke->arguments.size() - 1; i++)
+			{
+				auto ref = AstNodeCast<AstReferenceExpression>(invoke->arguments[i]);
+				if (!ref || ref->reference.lock() != function->arguments[i]) return nullptr;
+			}
+			if (!IsForwardingContinuation(invoke->arguments.back(), function)) return nullptr;
+
+			for (auto& info : primitiveOperators)
+			{
+				if (external->name == info.externalName && (size_t)info.operandCount + 2 == function->arguments.size())
+				{
+					return &info;
+				}
+			}
+			return nullptr;
+		}
+
+		/*************************************************************
+		AstTypePropagationContext
+		*************************************************************/
+
+		typedef set<AstDeclaration*>		AssignedVariableSet;
+
+		struct AstTypePropagationContext
+		{
+			map<AstDeclaration*, AstDispatchTableDeclaration*>&		dispatchTables;
+			map<AstDeclaration*, AstType::Ptr>						variableTypes;		// types of variables that all assignments agree on, from the previous iteration
+			map<AstDeclaration*, AstType::Ptr>						assignedTypes;		// types of assigned values, collected in the current iteration
+			set<AstDeclaration*>									unknownVariables;	// variables with at least one assigned value of an unknown type
+			bool													specialized = false;	// true if any call is replaced by a primitive operation
+
+			AstTypePropagationContext(map<AstDeclaration*, AstDispatchTableDeclaration*>& _dispatchTables)
+				:dispatchTables(_dispatchTables)
+			{
+			}
+
+			void RecordAssignment(AstDeclaration* variable, AstType::Ptr type)
+			{
+				if (!type)
+				{
+					unknownVariables.insert(variable);
+					return;
+				}
+
+				auto it = assignedTypes.find(variable);
+				if (it == assignedTypes.end())
+				{
+					assignedTypes.insert(make_pair(variable, type));
+				}
+				else if (!IsSameType(it->second, type))
+				{
+					unknownVariables.insert(variable);
+				}
+			}
+		};
+
+		bool IsSameVariableTypes(const map<AstDeclaration*, AstType::Ptr>& a, const map<AstDeclaration*, AstType::Ptr>& b)
+		{
+			if (a.size() != b.size()) return false;
+			for (auto ita = a.begin(), itb = b.begin(); ita != a.end(); ita++, itb++)
+			{
+				if (ita->first != itb->first || !IsSameType(ita->second, itb->second))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		AstType::Ptr PropagateTypes(AstExpression::Ptr node, AstTypePropagationContext& context, AssignedVariableSet& assigned);
+		void PropagateTypes(AstStatement::Ptr node, AstTypePropagationContext& context, AssignedVariableSet& assigned);
+
+		/*************************************************************
+		AstExpression::PropagateTypes
+		*************************************************************/
+
+		class AstExpression_PropagateTypes final : public AstExpressionVisitor
+		{
+		private:
+			AstTypePropagationContext&		context;
+			AssignedVariableSet&			assigned;
+
+		public:
+			AstType::Ptr					type;
+
+			AstExpression_PropagateTypes(AstTypePropagationContext& _context, AssignedVariableSet& _assigned)
+				:context(_context), assigned(_assigned)
+			{
+			}
+
+			void Devirtualize(AstInvokeExpression* node, vector<AstType::Ptr>& argumentTypes)
+			{
+				auto ref = AstNodeCast<AstReferenceExpression>(node->function);
+				if (!ref) return;
+				auto it = context.dispatchTables.find(ref->reference.lock().get());
+				if (it == context.dispatchTables.end()) return;
+
+				auto table = it->second;
+				if (argumentTypes.size() != table->rootFunction.lock()->arguments.size()) return;
+
+				int offset = 0;
+				for (int i = 0; (size_t)i < table->dispatchArguments.size(); i++)
+				{
+					auto& dimension = table->dimensions[i];
+					auto argumentType = argumentTypes[table->dispatchArguments[i]];
+					if (!argumentType) return;
+
+					// $Object is always the first candidate, so an index is always found
+					int index = -1;
+					for (auto type = argumentType; type && index == -1; type = GetBaseType(type))
+					{
+						for (int j = 0; (size_t)j < dimension.size(); j++)
+						{
+							if (IsSameType(dimension[j], type))
+							{
+								index = j;
+								break;
+							}
+						}
+					}
+					offset = offset * dimension.size() + index;
+				}
+
+				auto target = make_shared<AstReferenceExpression>();
+				target->reference = table->targets[offset].lock();
+				node->function = target;
+			}
+
+			void Specialize(AstInvokeExpression* node, vector<AstType::Ptr>& argumentTypes)
+			{
+				auto ref = AstNodeCast<AstReferenceExpression>(node->function);
+				if (!ref) return;
+				auto function = AstNodeCast<AstFunctionDeclaration>(ref->reference.lock());
+				if (!function || node->arguments.size() != function->arguments.size()) return;
+				auto info = GetPrimitiveOperator(function.get());
+				if (!info) return;
+
+				auto primitive = make_shared<AstPrimitiveExpression>();
+				primitive->op = info->op;
+				for (int i = 1; (size_t)i < node->arguments.size() - 1; i++)
+				{
+					auto predefinedType = AstNodeCast<AstPredefinedType>(argumentTypes[i]);
+					if (!predefinedType || predefinedType->typeName != info->operandType) return;
+					primitive->operands.push_back(node->arguments[i]);
+				}
+
+				// f(state, operands..., k) becomes k(state, primitive(operands...))
+				node->function = node->arguments.back();
+				node->arguments = { node->arguments[0], primitive };
+				argumentTypes = { argumentTypes[0], MakePredefinedType(info->resultType) };
+				context.specialized = true;
+			}
+
+			void Visit(AstLiteralExpression* node)override
+			{
+				switch (node->literalName)
+				{
+				case AstLiteralName::True:
+				case AstLiteralName::False:
+					type = MakePredefinedType(AstPredefinedTypeName::Boolean);
+					break;
+				default:;
+				}
+			}
+
+			void Visit(AstIntegerExpression* node)override
+			{
+				type = MakePredefinedType(AstPredefinedTypeName::Integer);
+			}
+
+			void Visit(AstFloatExpression* node)override
+			{
+				type = MakePredefinedType(AstPredefinedTypeName::Float);
+			}
+
+			void Visit(AstStringExpression* node)override
+			{
+				type = MakePredefinedType(AstPredefinedTypeName::String);
+			}
+
+			void Visit(AstExternalSymbolExpression* node)override
+			{
+			}
+
+			void Visit(AstReferenceExpression* node)override
+			{
+				auto decl = node->reference.lock();
+				if (AstNodeCast<AstFunctionDeclaration>(decl))
+				{
+					type = MakePredefinedType(AstPredefinedTypeName::Function);
+				}
+				else if (assigned.find(decl.get()) != assigned.end())
+				{
+					auto it = context.variableTypes.find(decl.get());
+					if (it != context.variableTypes.end())
+					{
+						type = it->second;
+					}
+				}
+			}
+
+			void Visit(AstNewTypeExpression* node)override
+			{
+				for (auto field : node->fields)
+				{
+					PropagateTypes(field, context, assigned);
+				}
+				type = node->type;
+			}
+
+			void Visit(AstTestTypeExpression* node)override
+			{
+				PropagateTypes(node->target, context, assigned);
+				type = MakePredefinedType(AstPredefinedTypeName::Boolean);
+			}
+
+			void Visit(AstNewArrayExpression* node)override
+			{
+				PropagateTypes(node->length, context, assigned);
+				type = MakePredefinedType(AstPredefinedTypeName::Array);
+			}
+
+			void Visit(AstNewArrayLiteralExpression* node)override
+			{
+				for (auto element : node->elements)
+				{
+					PropagateTypes(element, context, assigned);
+				}
+				type = MakePredefinedType(AstPredefinedTypeName::Array);
+			}
+
+			void Visit(AstArrayLengthExpression* node)override
+			{
+				PropagateTypes(node->target, context, assigned);
+				type = MakePredefinedType(AstPredefinedTypeName::Integer);
+			}
+
+			void Visit(AstArrayAccessExpression* node)override
+			{
+				PropagateTypes(node->target, context, assigned);
+				PropagateTypes(node->index, context, assigned);
+			}
+
+			void Visit(AstFieldAccessExpression* node)override
+			{
+				PropagateTypes(node->target, context, assigned);
+			}
+
+			void Visit(AstInvokeExpression* node)override
+			{
+				// the continuation is visited after the call is resolved, because a primitive operation invokes it immediately
+				shared_ptr<AstLambdaExpression> continuation;
+				if (node->arguments.size() > 0)
+				{
+					continuation = AstNodeCast<AstLambdaExpression>(node->arguments.back());
+				}
+
+				if (!AstNodeCast<AstLambdaExpression>(node->function))
+				{
+					PropagateTypes(node->function, context, assigned);
+				}
+				vector<AstType::Ptr> argumentTypes;
+				for (auto argument : node->arguments)
+				{
+					if (argument == continuation)
+					{
+						argumentTypes.push_back(MakePredefinedType(AstPredefinedTypeName::Function));
+					}
+					else
+					{
+						argumentTypes.push_back(PropagateTypes(argument, context, assigned));
+					}
+				}
+				Devirtualize(node, argumentTypes);
+				Specialize(node, argumentTypes);
+
+				auto lambda = AstNodeCast<AstLambdaExpression>(node->function);
+				if (lambda && lambda->arguments.size() == argumentTypes.size())
+				{
+					// a lambda that is invoked immediately only receives these arguments
+					AssignedVariableSet lambdaAssigned = assigned;
+					for (int i = 0; (size_t)i < argumentTypes.size(); i++)
+					{
+						context.RecordAssignment(lambda->arguments[i].get(), argumentTypes[i]);
+						lambdaAssigned.insert(lambda->arguments[i].get());
+					}
+					PropagateTypes(lambda->statement, context, lambdaAssigned);
+				}
+				else if (lambda)
+				{
+					PropagateTypes(lambda, context, assigned);
+				}
+
+				if (continuation && continuation != lambda)
+				{
+					PropagateTypes(continuation, context, assigned);
+				}
+			}
+
+			void Visit(AstLambdaExpression* node)override
+			{
+				for (auto argument : node->arguments)
+				{
+					context.unknownVariables.insert(argument.get());
+				}
+
+				// the body runs after the lambda is created, so everything assigned here is still assigned there
+				AssignedVariableSet lambdaAssigned = assigned;
+				PropagateTypes(node->statement, context, lambdaAssigned);
+				type = MakePredefinedType(AstPredefinedTypeName::Function);
+			}
+
+			void Visit(AstDispatchExpression* node)override
+			{
+				for (auto argument : node->arguments)
+				{
+					PropagateTypes(argument, context, assigned);
+				}
+				type = MakePredefinedType(AstPredefinedTypeName::Function);
+			}
+
+			void Visit(AstPrimitiveExpression* node)override
+			{
+				for (auto operand : node->operands)
+				{
+					PropagateTypes(operand, context, assigned);
+				}
+				for (auto& info : primitiveOperators)
+				{
+					if (info.op == node->op)
+					{
+						type = MakePredefinedType(info.resultType);
+						break;
+					}
+				}
+			}
+		};
+
+		/*************************************************************
+		AstStatement::PropagateTypes
+		*************************************************************/
+
+		class AstStatement_PropagateTypes final : public AstStatementVisitor
+		{
+		private:
+			AstTypePropagationContext&		context;
+			AssignedVariableSet&			assigned;
+
+		public:
+			AstStatement_PropagateTypes(AstTypePropagationContext& _context, AssignedVariableSet& _assigned)
+				:context(_context), assigned(_assigned)
+			{
+			}
+
+			void Visit(AstBlockStatement* node)override
+			{
+				for (auto stat : node->statements)
+				{
+					PropagateTypes(stat, context, assigned);
+				}
+			}
+
+			void Visit(AstExpressionStatement* node)override
+			{
+				PropagateTypes(node->expression, context, assigned);
+			}
+
+			void Visit(AstDeclarationStatement* node)override
+			{
+				assigned.erase(node->declaration.get());
+			}
+
+			void Visit(AstAssignmentStatement* node)override
+			{
+				auto type = PropagateTypes(node->value, context, assigned);
+				if (auto ref = AstNodeCast<AstReferenceExpression>(node->target))
+				{
+					auto decl = ref->reference.lock().get();
+					context.RecordAssignment(decl, type);
+					assigned.insert(decl);
+				}
+				else
+				{
+					PropagateTypes(node->target, context, assigned);
+				}
+			}
+
+			void Visit(AstIfStatement* node)override
+			{
+				PropagateTypes(node->condition, context, assigned);
+
+				AssignedVariableSet trueAssigned = assigned;
+				PropagateTypes(node->trueBranch, context, trueAssigned);
+
+				AssignedVariableSet falseAssigned = assigned;
+				if (node->falseBranch)
+				{
+					PropagateTypes(node->falseBranch, context, falseAssigned);
+				}
+
+				assigned.clear();
+				set_intersection(
+					trueAssigned.begin(), trueAssigned.end(),
+					falseAssigned.begin(), falseAssigned.end(),
+					inserter(assigned, assigned.begin())
+					);
+			}
+		};
+
+		/*************************************************************
+		AstDeclaration::PropagateTypes
+		*************************************************************/
+
+		class AstDeclaration_PropagateTypes final : public AstDeclarationVisitor
+		{
+		private:
+			map<AstDeclaration*, AstDispatchTableDeclaration*>&	dispatchTables;
+			map<AstDeclaration*, AstType::Ptr>&					argumentTypes;
+
+		public:
+			AstDeclaration_PropagateTypes(map<AstDeclaration*, AstDispatchTableDeclaration*>& _dispatchTables, map<AstDeclaration*, AstType::Ptr>& _argumentTypes)
+				:dispatchTables(_dispatchTables)
+				, argumentTypes(_argumentTypes)
+			{
+			}
+
+			void Visit(AstSymbolDeclaration* node)override
+			{
+			}
+
+			void Visit(AstTypeDeclaration* node)override
+			{
+			}
+
+			void Visit(AstFunctionDeclaration* node)override
+			{
+				AstTypePropagationContext context(dispatchTables);
+
+				// start from knowing nothing, and repeat until no more variable types are discovered
+				while (true)
+				{
+					context.assignedTypes.clear();
+					context.unknownVariables.clear();
+					AssignedVariableSet assigned;
+					for (auto argument : node->arguments)
+					{
+						auto it = argumentTypes.find(argument.get());
+						if (it == argumentTypes.end())
+						{
+							context.unknownVariables.insert(argument.get());
+						}
+						else
+						{
+							context.RecordAssignment(argument.get(), it->second);
+							assigned.insert(argument.get());
+						}
+					}
+
+					PropagateTypes(node->statement, context, assigned);
+
+					map<AstDeclaration*, AstType::Ptr> variableTypes;
+					for (auto vtp : context.assignedTypes)
+					{
+						if (context.unknownVariables.find(vtp.first) == context.unknownVariables.end())
+						{
+							variableTypes.insert(vtp);
+						}
+					}
+
+					if (IsSameVariableTypes(variableTypes, context.variableTypes))
+					{
+						break;
+					}
+					context.variableTypes = variableTypes;
+				}
+
+				if (context.specialized)
+				{
+					// continuations that are invoked immediately by primitive operations are inlined
+					RoughlyOptimize(AstNodeCast<AstDeclaration>(node->shared_from_this()));
+				}
+			}
+
+			void Visit(AstDispatchTableDeclaration* node)override
+			{
+			}
+		};
+
+		/*************************************************************
+		PropagateTypes
+		*************************************************************/
+
+		AstType::Ptr PropagateTypes(AstExpression::Ptr node, AstTypePropagationContext& context, AssignedVariableSet& assigned)
+		{
+			AstExpression_PropagateTypes visitor(context, assigned);
+			Dispatch(node.get(), visitor);
+			return visitor.type;
+		}
+
+		void PropagateTypes(AstStatement::Ptr node, AstTypePropagationContext& context, AssignedVariableSet& assigned)
+		{
+			AstStatement_PropagateTypes visitor(context, assigned);
+			Dispatch(node.get(), visitor);
+		}
+
+		void PropagateTypes(AstAssembly::Ptr node)
+		{
+			map<AstDeclaration*, AstDispatchTableDeclaration*> dispatchTables;
+			for (auto decl : node->declarations)
+			{
+				if (auto table = AstNodeCast<AstDispatchTableDeclaration>(decl))
+				{
+					dispatchTables.insert(make_pair(table->rootFunction.lock().get(), table.get()));
+				}
+			}
+
+			// a function selected by a dispatch table knows the types of its dispatched arguments, if they are never subtyped
+			map<AstDeclaration*, AstType::Ptr> argumentTypes;
+			set<AstDeclaration*> unknownArguments;
+			for (auto dtp : dispatchTables)
+			{
+				auto table = dtp.second;
+				for (int offset = 0; (size_t)offset < table->targets.size(); offset++)
+				{
+					auto target = table->targets[offset].lock();
+					int index = offset;
+					for (int i = table->dispatchArguments.size() - 1; i >= 0; i--)
+					{
+						auto& dimension = table->dimensions[i];
+						auto type = dimension[index % dimension.size()];
+						index /= dimension.size();
+
+						auto argument = target->arguments[table->dispatchArguments[i]].get();
+						auto predefinedType = AstNodeCast<AstPredefinedType>(type);
+						if (!predefinedType || predefinedType->typeName == AstPredefinedTypeName::Object)
+						{
+							unknownArguments.insert(argument);
+						}
+						else
+						{
+							auto it = argumentTypes.find(argument);
+							if (it == argumentTypes.end())
+							{
+								argumentTypes.insert(make_pair(argument, type));
+							}
+							else if (!IsSameType(it->second, type))
+							{
+								unknownArguments.insert(argument);
+							}
+						}
+					}
+				}
+			}
+			for (auto argument : unknownArguments)
+			{
+				argumentTypes.erase(argument);
+			}
+
+			AstDeclaration_PropagateTypes visitor(dispatchTables, argumentTypes);
+			for (auto decl : node->declarations)
+			{
+				Dispatch(decl.get(), visitor);
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -8,7 +8,7 @@ namespace tinymoe
 		AstExpression::RemoveUnnecessaryVariables
 		*************************************************************/
 
-		class AstExpression_RemoveUnnecessaryVariables : public AstExpressionVisitor
+		class AstExpression_RemoveUnnecessaryVariables final : public AstExpressionVisitor
 		{
 		private:
 			set<shared_ptr<AstDeclaration>>&	defined;
@@ -98,13 +98,29 @@ namespace tinymoe
 			{
 				RemoveUnnecessaryVariables(node->statement, defined, used, node->statement);
 			}
+
+			void Visit(AstDispatchExpression* node)override
+			{
+				for (auto argument : node->arguments)
+				{
+					RemoveUnnecessaryVariables(argument, defined, used);
+				}
+			}
+
+			void Visit(AstPrimitiveExpression* node)override
+			{
+				for (auto operand : node->operands)
+				{
+					RemoveUnnecessaryVariables(operand, defined, used);
+				}
+			}
 		};
 
 		/*************************************************************
 		AstStatement::RemoveUnnecessaryVariables
 		*************************************************************/
 
-		class AstStatement_RemoveUnnecessaryVariables : public AstStatementVisitor
+		class AstStatement_RemoveUnnecessaryVariables final : public AstStatementVisitor
 		{
 		private:
 			set<shared_ptr<AstDeclaration>>&	defined;
@@ -174,13 +190,13 @@ namespace tinymoe
 		void RemoveUnnecessaryVariables(AstExpression::Ptr node, set<shared_ptr<AstDeclaration>>& defined, set<shared_ptr<AstDeclaration>>& used)
 		{
 			AstExpression_RemoveUnnecessaryVariables visitor(defined, used);
-			node->Accept(&visitor);
+			Dispatch(node.get(), visitor);
 		}
 
 		void RemoveUnnecessaryVariables(AstStatement::Ptr node, set<shared_ptr<AstDeclaration>>& defined, set<shared_ptr<AstDeclaration>>& used, AstStatement::Ptr& replacement)
 		{
 			AstStatement_RemoveUnnecessaryVariables visitor(defined, used, replacement);
-			node->Accept(&visitor);
+			Dispatch(node.get(), visitor);
 		}
 	}
 }
\ No newline at end of file
@@ -8,7 +8,7 @@ namespace tinymoe
 		AstDeclaration::RoughlyOptimize
 		*************************************************************/
 
-		class AstDeclaration_RoughlyOptimize : public AstDeclarationVisitor
+		class AstDeclaration_RoughlyOptimize final : public AstDeclarationVisitor
 		{
 		public:
 			void Visit(AstSymbolDeclaration* node)override
@@ -25,17 +25,25 @@ namespace tinymoe
 
 				set<AstDeclaration::Ptr> defined, used;
 				CollectUsedVariables(node->statement, defined, used);
+				if (!node->continuationArgument)
+				{
+					used.insert(node->resultVariable);
+				}
 				RemoveUnnecessaryVariables(node->statement, defined, used, node->statement);
 
 				RoughlyOptimize(node->statement, node->statement);
 			}
+
+			void Visit(AstDispatchTableDeclaration* node)override
+			{
+			}
 		};
 
 		/*************************************************************
 		AstExpression::RoughlyOptimize
 		*************************************************************/
 
-		class AstExpression_RoughlyOptimize : public AstExpressionVisitor
+		class AstExpression_RoughlyOptimize final : public AstExpressionVisitor
 		{
 		private:
 			AstExpression::Ptr&				replacement;
@@ -125,28 +133,35 @@ namespace tinymoe
 			void Visit(AstLambdaExpression* node)override
 			{
 				shared_ptr<AstExpressionStatement> stat;
-				if (!(stat = dynamic_pointer_cast<AstExpressionStatement>(node->statement)))
+				if (!(stat = AstNodeCast<AstExpressionStatement>(node->statement)))
 				{
-					if (auto block = dynamic_pointer_cast<AstBlockStatement>(node->statement))
+					if (auto block = AstNodeCast<AstBlockStatement>(node->statement))
 					{
 						if (block->statements.size() == 1)
 						{
-							stat = dynamic_pointer_cast<AstExpressionStatement>(block->statements[0]);
+							stat = AstNodeCast<AstExpressionStatement>(block->statements[0]);
 						}
 					}
 				}
 
 				if (stat)
 				{
-					if (auto invoke = dynamic_pointer_cast<AstInvokeExpression>(stat->expression))
+					if (auto invoke = AstNodeCast<AstInvokeExpression>(stat->expression))
 					{
 						if (node->arguments.size() != invoke->arguments.size())
 						{
 							goto FAIL_TO_OPTIMIZE;
 						}
-						if (auto ref = dynamic_pointer_cast<AstReferenceExpression>(invoke->function))
+						if (auto ref = AstNodeCast<AstReferenceExpression>(invoke->function))
 						{
 							auto decl = ref->reference.lock();
+							if (auto function = AstNodeCast<AstFunctionDeclaration>(decl))
+							{
+								if (!function->continuationArgument)
+								{
+									goto FAIL_TO_OPTIMIZE;
+								}
+							}
 							for (auto argument : node->arguments)
 							{
 								if (decl == argument)
@@ -157,7 +172,7 @@ namespace tinymoe
 
 							for (int i = 0; (size_t)i < node->arguments.size(); i++)
 							{
-								if (auto arg = dynamic_pointer_cast<AstReferenceExpression>(invoke->arguments[i]))
+								if (auto arg = AstNodeCast<AstReferenceExpression>(invoke->arguments[i]))
 								{
 									if (arg->reference.lock() != node->arguments[i])
 									{
@@ -179,13 +194,29 @@ namespace tinymoe
 			FAIL_TO_OPTIMIZE:
 				RoughlyOptimize(node->statement, node->statement);
 			}
+
+			void Visit(AstDispatchExpression* node)override
+			{
+				for (auto& argument : node->arguments)
+				{
+					RoughlyOptimize(argument, argument);
+				}
+			}
+
+			void Visit(AstPrimitiveExpression* node)override
+			{
+				for (auto& operand : node->operands)
+				{
+					RoughlyOptimize(operand, operand);
+				}
+			}
 		};
 
 		/*************************************************************
 		AstStatement::RoughlyOptimize
 		*************************************************************/
 
-		class AstStatement_RoughlyOptimize : public AstStatementVisitor
+		class AstStatement_RoughlyOptimize final : public AstStatementVisitor
 		{
 		private:
 			AstStatement::Ptr&				replacement;
@@ -215,9 +246,9 @@ namespace tinymoe
 			void Visit(AstExpressionStatement* node)override
 			{
 				RoughlyOptimize(node->expression, node->expression);
-				if (auto invoke = dynamic_pointer_cast<AstInvokeExpression>(node->expression))
+				if (auto invoke = AstNodeCast<AstInvokeExpression>(node->expression))
 				{
-					if (auto lambda = dynamic_pointer_cast<AstLambdaExpression>(invoke->function))
+					if (auto lambda = AstNodeCast<AstLambdaExpression>(invoke->function))
 					{
 						auto block = make_shared<AstBlockStatement>();
 						for (int i = 0; (size_t)i < lambda->arguments.size(); i++)
@@ -300,19 +331,19 @@ namespace tinymoe
 		void RoughlyOptimize(AstDeclaration::Ptr node)
 		{
 			AstDeclaration_RoughlyOptimize visitor;
-			node->Accept(&visitor);
+			Dispatch(node.get(), visitor);
 		}
 
 		void RoughlyOptimize(AstExpression::Ptr node, AstExpression::Ptr& _replacement)
 		{
 			AstExpression_RoughlyOptimize visitor(_replacement);
-			node->Accept(&visitor);
+			Dispatch(node.get(), visitor);
 		}
 
 		void RoughlyOptimize(AstStatement::Ptr node, AstStatement::Ptr& _replacement)
 		{
 			AstStatement_RoughlyOptimize visitor(_replacement);
-			node->Accept(&visitor);
+			Dispatch(node.get(), visitor);
 		}
 
 		void RoughlyOptimize(AstAssembly::Ptr node)
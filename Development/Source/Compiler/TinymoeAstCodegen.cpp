@@ -16,7 +16,7 @@ namespace tinymoe
 			if (symbol->target == GrammarSymbolTarget::Custom)
 			{
 				auto type = make_shared<AstReferenceType>();
-				type->typeDeclaration = dynamic_pointer_cast<AstTypeDeclaration>(readAsts.find(symbol)->second);
+				type->typeDeclaration = AstNodeCast<AstTypeDeclaration>(readAsts.find(symbol)->second);
 				return type;
 			}
 			else
@@ -107,6 +107,18 @@ namespace tinymoe
 			return SymbolAstResult(_value, statement, _continuation);
 		}
 
+		bool SymbolAstResult::IsConstantExpression(AstExpression::Ptr expr)
+		{
+			if (auto ref = AstNodeCast<AstReferenceExpression>(expr))
+			{
+				return (bool)AstNodeCast<AstFunctionDeclaration>(ref->reference.lock());
+			}
+			return AstNodeCast<AstLiteralExpression>(expr)
+				|| AstNodeCast<AstIntegerExpression>(expr)
+				|| AstNodeCast<AstFloatExpression>(expr)
+				|| AstNodeCast<AstStringExpression>(expr);
+		}
+
 		void SymbolAstResult::MergeForExpression(const SymbolAstResult& result, SymbolAstContext& context, vector<AstExpression::Ptr>& exprs, int& exprStart, AstDeclaration::Ptr& state)
 		{
 			if (result.RequireCps())
@@ -114,6 +126,11 @@ namespace tinymoe
 				auto block = make_shared<AstBlockStatement>();
 				for (int i = exprStart; (size_t)i < exprs.size(); i++)
 				{
+					if (IsConstantExpression(exprs[i]))
+					{
+						continue;
+					}
+
 					auto var = make_shared<AstDeclarationStatement>();
 					{
 						auto decl = make_shared<AstSymbolDeclaration>();
@@ -161,7 +178,7 @@ namespace tinymoe
 			{
 				target = statement;
 			}
-			else if (auto block = dynamic_pointer_cast<AstBlockStatement>(target))
+			else if (auto block = AstNodeCast<AstBlockStatement>(target))
 			{
 				block->statements.push_back(statement);
 			}
@@ -332,7 +349,7 @@ namespace tinymoe
 						auto itfunc = module->declarationFunctions.find(sdp.second);
 						if (itfunc != module->declarationFunctions.end())
 						{
-							auto func = dynamic_pointer_cast<AstFunctionDeclaration>(ast);
+							auto func = AstNodeCast<AstFunctionDeclaration>(ast);
 							functionAsts.insert(make_pair(itfunc->second, func));
 							scope->functionPrototypes.insert(make_pair(sdp.first, func));
 						}
@@ -345,7 +362,7 @@ namespace tinymoe
 						if (itfunc != module->declarationFunctions.end())
 						{
 							auto ast = decls.find(sdp.second)->second;
-							auto func = dynamic_pointer_cast<AstFunctionDeclaration>(ast);
+							auto func = AstNodeCast<AstFunctionDeclaration>(ast);
 							scope->functionPrototypes.insert(make_pair(sdp.first, func));
 						}
 					}
@@ -368,9 +385,9 @@ namespace tinymoe
 			}
 		}
 
-		void FillMultipleDispatchRedirectAst(
+		void FillMultipleDispatchTableAst(
 			AstFunctionDeclaration::Ptr ast,
-			AstFunctionDeclaration::Ptr function
+			AstDispatchTableDeclaration::Ptr table
 			)
 		{
 			auto astBlock = make_shared<AstBlockStatement>();
@@ -382,40 +399,16 @@ namespace tinymoe
 			auto astInvoke = make_shared<AstInvokeExpression>();
 			astExprStat->expression = astInvoke;
 
-			auto astFunction = make_shared<AstReferenceExpression>();
-			astFunction->reference = function;
-			astInvoke->function = astFunction;
+			auto astDispatch = make_shared<AstDispatchExpression>();
+			astDispatch->table = table;
+			astInvoke->function = astDispatch;
 
-			for (auto argument : ast->arguments)
+			for (auto index : table->dispatchArguments)
 			{
 				auto astArgument = make_shared<AstReferenceExpression>();
-				astArgument->reference = argument;
-				astInvoke->arguments.push_back(astArgument);
+				astArgument->reference = ast->arguments[index];
+				astDispatch->arguments.push_back(astArgument);
 			}
-		}
-
-		void FillMultipleDispatchStepAst(
-			AstFunctionDeclaration::Ptr ast,
-			string_t functionName,
-			int dispatch
-			)
-		{
-			auto astBlock = make_shared<AstBlockStatement>();
-			ast->statement = astBlock;
-
-			auto astExprStat = make_shared<AstExpressionStatement>();
-			astBlock->statements.push_back(astExprStat);
-
-			auto astInvoke = make_shared<AstInvokeExpression>();
-			astExprStat->expression = astInvoke;
-
-			auto astFieldAccess = make_shared<AstFieldAccessExpression>();
-			astFieldAccess->composedFieldName = functionName;
-			astInvoke->function = astFieldAccess;
-
-			auto astTargetObject = make_shared<AstReferenceExpression>();
-			astTargetObject->reference = ast->arguments[dispatch];
-			astFieldAccess->target = astTargetObject;
 
 			for (auto argument : ast->arguments)
 			{
@@ -457,83 +450,96 @@ namespace tinymoe
 					}
 				}
 				
-				FillMultipleDispatchStepAst(rootAst, T("$dispatch<>") + rootAst->composedName, rootAst->readArgumentAstMap.find(*dispatches.begin())->second);
 				{
 					auto ast = rootFunc->function->GenerateAst(module);
 					ast->composedName = T("$dispatch_fail<>") + rootAst->composedName;
 					assembly->declarations.push_back(ast);
-					dispatchFailAst = dynamic_pointer_cast<AstFunctionDeclaration>(ast);
+					dispatchFailAst = AstNodeCast<AstFunctionDeclaration>(ast);
+				}
+
+				auto table = make_shared<AstDispatchTableDeclaration>();
+				table->composedName = T("$dispatch_table<>") + rootAst->composedName;
+				table->rootFunction = rootAst;
+				assembly->declarations.push_back(table);
+				for (auto dispatch : dispatches)
+				{
+					auto type = make_shared<AstPredefinedType>();
+					type->typeName = AstPredefinedTypeName::Object;
+					table->dispatchArguments.push_back(rootAst->readArgumentAstMap.find(dispatch)->second);
+					table->dimensions.push_back(AstType::List(1, type));
 				}
 
-				set<string_t> createdFunctions, typeFunctions, objectFunctions;
+				// collect the type of each dispatched argument for each overloading
+				vector<AstFunctionDeclaration::Ptr> childAsts;
+				vector<AstType::List> childSignatures;
 				for (it = lower; it != upper; it++)
 				{
 					auto func = it->second;
-					auto module = functionModules.find(func)->second;
-					string_t signature;
-					for (auto itd = dispatches.begin(); itd != dispatches.end(); itd++)
+					AstType::List signature;
+					int dimension = 0;
+					for (auto itd = dispatches.begin(); itd != dispatches.end(); itd++, dimension++)
 					{
-						string_t methodName = T("$dispatch<") + signature + T(">") + rootAst->composedName;
-						auto ast = dynamic_pointer_cast<AstFunctionDeclaration>(func->function->GenerateAst(module));
-						ast->composedName = methodName;
-
+						AstType::Ptr type;
 						auto ita = func->argumentTypes.find(func->function->name[*itd]);
 						if (ita == func->argumentTypes.end())
 						{
-							auto type = make_shared<AstPredefinedType>();
-							type->typeName = AstPredefinedTypeName::Object;
-							ast->ownerType = type;
-							objectFunctions.insert(methodName);
+							auto objectType = make_shared<AstPredefinedType>();
+							objectType->typeName = AstPredefinedTypeName::Object;
+							type = objectType;
 						}
 						else
 						{
-							ast->ownerType = scope->GetType(ita->second);
-							typeFunctions.insert(methodName);
+							type = scope->GetType(ita->second);
 						}
 
-						if (itd != dispatches.begin())
-						{
-							signature += T(", ");
-						}
+						auto& types = table->dimensions[dimension];
+						if (find_if(types.begin(), types.end(), [&](AstType::Ptr candidate){ return IsSameType(candidate, type); }) == types.end())
 						{
-							stringstream_t o;
-							Print(ast->ownerType, o, 0);
-							signature += o.str();
+							types.push_back(type);
 						}
+						signature.push_back(type);
+					}
+					childAsts.push_back(functionAsts.find(func)->second);
+					childSignatures.push_back(signature);
+				}
 
-						string_t functionName = T("$dispatch<") + signature + T(">") + rootAst->composedName;
-						if (createdFunctions.insert(functionName).second)
+				// for each type tuple, select dispatched arguments from left to right, each one picks the closest type among the remaining overloadings
+				vector<int> indexes(dispatches.size(), 0);
+				while (true)
+				{
+					vector<int> candidates;
+					for (int i = 0; (size_t)i < childAsts.size(); i++)
+					{
+						candidates.push_back(i);
+					}
+
+					for (int dimension = 0; (size_t)dimension < indexes.size() && candidates.size() > 0; dimension++)
+					{
+						vector<int> selected;
+						for (auto type = table->dimensions[dimension][indexes[dimension]]; type && selected.size() == 0; type = GetBaseType(type))
 						{
-							assembly->declarations.push_back(ast);
-							auto itd2 = itd;
-							if (++itd2 == dispatches.end())
-							{
-								FillMultipleDispatchRedirectAst(ast, functionAsts.find(func)->second);
-							}
-							else
+							for (auto candidate : candidates)
 							{
-								FillMultipleDispatchStepAst(ast, functionName, ast->readArgumentAstMap.find(*itd2)->second);
+								if (IsSameType(childSignatures[candidate][dimension], type))
+								{
+									selected.push_back(candidate);
+								}
 							}
 						}
+						candidates = selected;
 					}
-				}
+					table->targets.push_back(candidates.size() > 0 ? childAsts[candidates[0]] : dispatchFailAst);
 
-				for (auto name : typeFunctions)
-				{
-					if (objectFunctions.find(name) == objectFunctions.end())
+					int dimension = indexes.size() - 1;
+					for (; dimension >= 0; dimension--)
 					{
-						auto ast = dynamic_pointer_cast<AstFunctionDeclaration>(rootFunc->function->GenerateAst(module));
-						ast->composedName = name;
-						{
-							auto type = make_shared<AstPredefinedType>();
-							type->typeName = AstPredefinedTypeName::Object;
-							ast->ownerType = type;
-						}
-						assembly->declarations.push_back(ast);
-						FillMultipleDispatchRedirectAst(ast, dispatchFailAst);
+						if ((size_t)++indexes[dimension] < table->dimensions[dimension].size()) break;
+						indexes[dimension] = 0;
 					}
+					if (dimension < 0) break;
 				}
 
+				FillMultipleDispatchTableAst(rootAst, table);
 				functionAsts.find(rootFunc)->second = dispatchFailAst;
 				it = upper;
 			}
@@ -603,6 +609,7 @@ namespace tinymoe
 				if (func->cpsContinuationVariable)
 				{
 					context.createdVariables.push_back(func->cpsContinuationVariable);
+					context.asynchronousRedirection = true;
 					scope->readAsts.insert(make_pair(func->cpsContinuationVariable, ast->continuationArgument));
 				}
 				if (func->resultVariable)
@@ -640,7 +647,7 @@ namespace tinymoe
 
 					if (auto func = dynamic_pointer_cast<FunctionArgumentFragment>(argFragment))
 					{
-						auto ast = dynamic_pointer_cast<AstFunctionDeclaration>(func->declaration->GenerateAst(module));
+						auto ast = AstNodeCast<AstFunctionDeclaration>(func->declaration->GenerateAst(module));
 						scope->functionPrototypes.insert(make_pair(arg, ast));
 					}
 				}
@@ -655,7 +662,7 @@ namespace tinymoe
 					auto stat = make_shared<AstDeclarationStatement>();
 					stat->declaration = ast->resultVariable;
 
-					if (auto block = dynamic_pointer_cast<AstBlockStatement>(ast->statement))
+					if (auto block = AstNodeCast<AstBlockStatement>(ast->statement))
 					{
 						block->statements.insert(block->statements.begin(), stat);
 					}
@@ -667,7 +674,7 @@ namespace tinymoe
 						ast->statement = block;
 					}
 				}
-				if (!dynamic_pointer_cast<AstBlockStatement>(ast->statement))
+				if (!AstNodeCast<AstBlockStatement>(ast->statement))
 				{
 					auto block = make_shared<AstBlockStatement>();
 					block->statements.push_back(ast->statement);
@@ -683,6 +690,8 @@ namespace tinymoe
 			}
 
 			RoughlyOptimize(assembly);
+			PropagateTypes(assembly);
+			ConvertToDirectStyle(assembly);
 			SetParent(assembly);
 			return assembly;
 		}
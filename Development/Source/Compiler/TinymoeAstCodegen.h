@@ -29,6 +29,7 @@ namespace tinymoe
 			ast::AstFunctionDeclaration::Ptr		function;
 			ast::AstSymbolDeclaration::Ptr			continuation;
 			GrammarSymbol::List						createdVariables;
+			bool									asynchronousRedirection = false;	// the function is declared with "cps (state) (continuation)", so "redirect to" may suspend
 
 			string_t								GetUniquePostfix();
 		};
@@ -45,6 +46,7 @@ namespace tinymoe
 			SymbolAstResult(shared_ptr<ast::AstExpression> _value, shared_ptr<ast::AstStatement> _statement, shared_ptr<ast::AstLambdaExpression> _continuation);
 
 			bool									RequireCps()const;
+			static bool								IsConstantExpression(shared_ptr<ast::AstExpression> expr);
 			SymbolAstResult							ReplaceValue(shared_ptr<ast::AstExpression> _value);
 			SymbolAstResult							ReplaceValue(shared_ptr<ast::AstExpression> _value, shared_ptr<ast::AstLambdaExpression> _continuation);
 			void									MergeForExpression(const SymbolAstResult& result, SymbolAstContext& context, vector<ast::AstExpression::Ptr>& exprs, int& exprStart, ast::AstDeclaration::Ptr& state);
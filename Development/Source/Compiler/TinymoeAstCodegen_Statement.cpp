@@ -446,6 +446,7 @@ namespace tinymoe
 
 					auto external = make_shared<AstExternalSymbolExpression>();
 					external->name = dynamic_pointer_cast<LiteralExpression>(statementExpression->arguments[0])->token.value;
+					external->asynchronous = context.asynchronousRedirection;
 					invoke->function = external;
 
 					for (auto decl : context.function->arguments)
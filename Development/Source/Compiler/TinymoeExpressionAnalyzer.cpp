@@ -56,6 +56,12 @@ namespace tinymoe
 
 		void GrammarSymbol::CalculateUniqueId()
 		{
+			if (uniqueIdCalculated)
+			{
+				return;
+			}
+			uniqueIdCalculated = true;
+
 			uniqueId = T("");
 			for (auto i = fragments.begin(); i != fragments.end(); i++)
 			{
@@ -65,6 +71,28 @@ namespace tinymoe
 					uniqueId += T(" ");
 				}
 			}
+
+			// 64-bit FNV-1a
+			uniqueIdHash = 14695981039346656037ULL;
+			for (auto c : uniqueId)
+			{
+				uniqueIdHash = (uniqueIdHash ^ (unsigned long long)c) * 1099511628211ULL;
+			}
+		}
+
+		GrammarSymbol::Key::Key(const Ptr& symbol)
+			:hash(symbol->uniqueIdHash)
+			, uniqueId(&symbol->uniqueId)
+		{
+		}
+
+		bool GrammarSymbol::Key::operator<(const Key& key)const
+		{
+			if (hash != key.hash)
+			{
+				return hash < key.hash;
+			}
+			return uniqueId != key.uniqueId && *uniqueId < *key.uniqueId;
 		}
 
 		GrammarSymbol::Ptr operator+(GrammarSymbol::Ptr symbol, const string_t& name)
@@ -562,20 +590,22 @@ namespace tinymoe
 		}
 
 		/*************************************************************
-		GrammarStack
+		GrammarScope
 		*************************************************************/
 
-		void GrammarStack::Push(GrammarStackItem::Ptr stackItem)
+		GrammarScope::GrammarScope(Ptr _parent, GrammarStackItem::Ptr _item)
+			:parent(_parent)
+			, item(_item)
 		{
-			for (auto symbol : stackItem->symbols)
+			if (parent)
 			{
-				symbol->CalculateUniqueId();
+				resultSymbol = parent->resultSymbol;
 			}
 
-			stackItems.push_back(stackItem);
-			for (auto symbol : stackItem->symbols)
+			for (auto symbol : item->symbols)
 			{
-				availableSymbols.insert(make_pair(symbol->uniqueId, symbol));
+				symbol->CalculateUniqueId();
+				symbols.insert(make_pair(GrammarSymbol::Key(symbol), symbol));
 				if (symbol->target == GrammarSymbolTarget::TheResult)
 				{
 					resultSymbol = symbol;
@@ -583,27 +613,95 @@ namespace tinymoe
 			}
 		}
 
-		GrammarStackItem::Ptr GrammarStack::Pop()
+		const GrammarSymbol::List& GrammarScope::GetVisibleSymbols()
 		{
-			auto stackItem = stackItems.back();
-			stackItems.pop_back();
-
-			for (auto symbol : stackItem->symbols)
+			call_once(visibleSymbolsBuilt, [this]()
 			{
-				auto begin = availableSymbols.lower_bound(symbol->uniqueId);
-				auto end = availableSymbols.upper_bound(symbol->uniqueId);
-				auto it = find_if(begin, end, [symbol](pair<string_t, GrammarSymbol::Ptr> x){return x.second == symbol; });
-				while (it != availableSymbols.end())
+				static const GrammarSymbol::List empty;
+				auto& inherited = parent ? parent->GetVisibleSymbols() : empty;
+				if (symbols.size() == 0 && parent)
+				{
+					visibleSymbols = parent->visibleSymbols;
+					return;
+				}
+
+				// the last symbol of a group in this scope overrides inherited symbols in the same group
+				GrammarSymbol::List overriding;
+				for (auto it = symbols.begin(); it != symbols.end();)
 				{
-					if (it->second == symbol) break;
-					it++;
+					auto upper = symbols.upper_bound(it->first);
+					overriding.push_back((--upper)->second);
+					it = ++upper;
 				}
-				availableSymbols.erase(it);
+
+				// groups are ordered by hash, sort them by the unique id so that candidates are tried in a stable order
+				sort(overriding.begin(), overriding.end(), [](const GrammarSymbol::Ptr& a, const GrammarSymbol::Ptr& b)
+				{
+					return a->uniqueId < b->uniqueId;
+				});
+
+				// merge two lists ordered by the unique id
+				auto visible = make_shared<GrammarSymbol::List>();
+				auto ita = inherited.begin();
+				auto enda = inherited.end();
+				for (auto symbol : overriding)
+				{
+					while (ita != enda && (*ita)->uniqueId < symbol->uniqueId)
+					{
+						visible->push_back(*ita++);
+					}
+					if (ita != enda && (*ita)->uniqueIdHash == symbol->uniqueIdHash && (*ita)->uniqueId == symbol->uniqueId)
+					{
+						ita++;
+					}
+					visible->push_back(symbol);
+				}
+				visible->insert(visible->end(), ita, enda);
+				visibleSymbols = visible;
+			});
+			return *visibleSymbols;
+		}
+
+		int GrammarScope::CountSymbols(const GrammarSymbol::Key& key)
+		{
+			int count = 0;
+			for (auto current = this; current; current = current->parent.get())
+			{
+				count += current->symbols.count(key);
 			}
+			return count;
+		}
+
+		/*************************************************************
+		GrammarStack
+		*************************************************************/
 
+		void GrammarStack::Push(GrammarStackItem::Ptr stackItem)
+		{
+			scope = make_shared<GrammarScope>(scope, stackItem);
+		}
+
+		GrammarStackItem::Ptr GrammarStack::Pop()
+		{
+			auto stackItem = scope->item;
+			scope = scope->parent;
 			return stackItem;
 		}
 
+		GrammarStack::Ptr GrammarStack::Snapshot()
+		{
+			auto stack = make_shared<GrammarStack>();
+			stack->scope = scope;
+			stack->maxAlternatives = maxAlternatives;
+			return stack;
+		}
+
+		const GrammarSymbol::List& GrammarStack::GetVisibleSymbols()
+		{
+			static const GrammarSymbol::List empty;
+			return scope ? scope->GetVisibleSymbols() : empty;
+		}
+
 		CodeError GrammarStack::SuccessError()
 		{
 			return CodeError();
@@ -642,6 +740,18 @@ namespace tinymoe
 			return error1.position.column > error2.position.column ? error1 : error2;
 		}
 
+		void GrammarStack::CountAlternatives(size_t count)
+		{
+			if (alternativesLeft != -1)
+			{
+				if ((size_t)alternativesLeft < count)
+				{
+					throw TooManyAlternativesException();
+				}
+				alternativesLeft -= count;
+			}
+		}
+
 		CodeError GrammarStack::ParseGrammarFragment(GrammarFragment::Ptr fragment, Iterator input, Iterator end, ResultList& result)
 		{
 			switch (fragment->type)
@@ -684,6 +794,7 @@ namespace tinymoe
 			auto fragment = symbol->fragments[fragmentIndex];
 			vector<pair<Iterator, Expression::Ptr>> fragmentResult;
 			auto error = ParseGrammarFragment(fragment, input, end, fragmentResult);
+			CountAlternatives(fragmentResult.size());
 
 			for (auto fr : fragmentResult)
 			{
@@ -692,6 +803,11 @@ namespace tinymoe
 					auto link = make_shared<ExpressionLink>();
 					link->expression = fr.second;
 					link->previous = previousExpression;
+					link->cost = previousExpression ? previousExpression->cost : 0;
+					if (fragment->type == GrammarFragmentType::Assignable && dynamic_pointer_cast<ArgumentExpression>(fr.second))
+					{
+						link->cost++;
+					}
 					result.push_back(make_pair(fr.first, link));
 				}
 				else
@@ -702,7 +818,7 @@ namespace tinymoe
 			return error;
 		}
 
-		CodeError GrammarStack::ParseGrammarSymbol(GrammarSymbol::Ptr symbol, int beginFragment, ExpressionLink::Ptr previousExpression, Iterator input, Iterator end, ResultList& result)
+		CodeError GrammarStack::ParseGrammarSymbol(GrammarSymbol::Ptr symbol, int beginFragment, ExpressionLink::Ptr previousExpression, Iterator input, Iterator end, ResultList& result, int maxCost)
 		{
 			vector<pair<Iterator, ExpressionLink::Ptr>> stepResult;
 			stepResult.push_back(make_pair(input, previousExpression));
@@ -716,6 +832,10 @@ namespace tinymoe
 				{
 					auto it = stepResult[j].first;
 					auto expr = stepResult[j].second;
+					if (maxCost != -1 && expr && expr->cost > maxCost)
+					{
+						continue;
+					}
 					auto error = ParseGrammarSymbolStep(symbol, i, expr, it, end, stepResult);
 					resultError = FoldError(resultError, error);
 				}
@@ -728,6 +848,10 @@ namespace tinymoe
 			{
 				auto it = stepResult[j].first;
 				auto expr = stepResult[j].second;
+				if (maxCost != -1 && expr && expr->cost > maxCost)
+				{
+					continue;
+				}
 				Expression::List arguments;
 				while (expr)
 				{
@@ -773,17 +897,13 @@ namespace tinymoe
 		CodeError GrammarStack::ParseType(Iterator input, Iterator end, ResultList& result)
 		{
 			CodeError resultError;
-			auto it = availableSymbols.begin();
-			while (it != availableSymbols.end())
+			for (auto symbol : GetVisibleSymbols())
 			{
-				it = availableSymbols.upper_bound(it->first);
-				it--;
-				if (it->second->type == GrammarSymbolType::Type)
+				if (symbol->type == GrammarSymbolType::Type)
 				{
-					auto error = ParseGrammarSymbol(it->second, input, end, result);
+					auto error = ParseGrammarSymbol(symbol, input, end, result);
 					resultError = FoldError(resultError, error);
 				}
-				it++;
 			}
 			return resultError;
 		}
@@ -868,14 +988,10 @@ namespace tinymoe
 			}
 
 			CodeError resultError;
-			auto it = availableSymbols.begin();
-			while (it != availableSymbols.end())
+			for (auto symbol : GetVisibleSymbols())
 			{
-				it = availableSymbols.upper_bound(it->first);
-				it--;
-				if (it->second->type == GrammarSymbolType::Symbol || it->second->type == GrammarSymbolType::Phrase)
+				if (symbol->type == GrammarSymbolType::Symbol || symbol->type == GrammarSymbolType::Phrase)
 				{
-					auto symbol = it->second;
 					switch (symbol->fragments[0]->type)
 					{
 					case GrammarFragmentType::Primitive:
@@ -886,7 +1002,6 @@ namespace tinymoe
 						resultError = FoldError(resultError, error);
 					}
 				}
-				it++;
 			}
 			return resultError;
 		}
@@ -903,14 +1018,10 @@ namespace tinymoe
 				{
 					if (result[i].first != end)
 					{
-						auto it = availableSymbols.begin();
-						while (it != availableSymbols.end())
+						for (auto symbol : GetVisibleSymbols())
 						{
-							it = availableSymbols.upper_bound(it->first);
-							it--;
-							if (it->second->type == GrammarSymbolType::Phrase)
+							if (symbol->type == GrammarSymbolType::Phrase)
 							{
-								auto symbol = it->second;
 								switch (symbol->fragments[0]->type)
 								{
 								case GrammarFragmentType::Primitive:
@@ -923,7 +1034,6 @@ namespace tinymoe
 									break;
 								}
 							}
-							it++;
 						}
 					}
 				}
@@ -966,6 +1076,7 @@ namespace tinymoe
 					auto previousExpression = linkResult[i].second;
 					ResultList expressionResult;
 					ParseExpression(it, end, expressionResult);
+					CountAlternatives(expressionResult.size());
 
 					for (auto er : expressionResult)
 					{
@@ -1019,17 +1130,13 @@ namespace tinymoe
 			int resultBegin = result.size();
 
 			CodeError resultError;
-			auto it = availableSymbols.begin();
-			while (it != availableSymbols.end())
+			for (auto symbol : GetVisibleSymbols())
 			{
-				it = availableSymbols.upper_bound(it->first);
-				it--;
-				if (it->second->type == GrammarSymbolType::Symbol)
+				if (symbol->type == GrammarSymbolType::Symbol)
 				{
-					auto error = ParseGrammarSymbol(it->second, input, end, result);
+					auto error = ParseGrammarSymbol(symbol, input, end, result);
 					resultError = FoldError(resultError, error);
 				}
-				it++;
 			}
 
 			int resultEnd = result.size();
@@ -1105,6 +1212,7 @@ namespace tinymoe
 								ResultList expressionResult;
 								auto error = (this->*parser)(++it, end, expressionResult);
 								resultError = FoldError(resultError, error);
+								CountAlternatives(expressionResult.size());
 								for (auto er : expressionResult)
 								{
 									auto binary = make_shared<BinaryExpression>();
@@ -1177,26 +1285,56 @@ namespace tinymoe
 		{
 			CodeError resultError;
 			ResultList expressionResult;
-			auto it = availableSymbols.begin();
-			while (it != availableSymbols.end())
+			// ParseBlock only accepts legal statements creating the fewest new variables,
+			// so partial statements creating more than the best one found so far are discarded
+			int bestCost = -1;
+			alternativesLeft = maxAlternatives > 0 ? maxAlternatives : -1;
+			try
 			{
-				it = availableSymbols.upper_bound(it->first);
-				it--;
-				if (it->second->type == GrammarSymbolType::Sentence || it->second->type == GrammarSymbolType::Block)
+				for (auto symbol : GetVisibleSymbols())
 				{
-					auto symbol = it->second;
-					switch (symbol->fragments[0]->type)
+					if (symbol->type == GrammarSymbolType::Sentence || symbol->type == GrammarSymbolType::Block)
 					{
-					case GrammarFragmentType::Primitive:
-					case GrammarFragmentType::Expression:
-						break;
-					default:
-						auto error = ParseGrammarSymbol(symbol, input, end, expressionResult);
-						resultError = FoldError(resultError, error);
+						switch (symbol->fragments[0]->type)
+						{
+						case GrammarFragmentType::Primitive:
+						case GrammarFragmentType::Expression:
+							break;
+						default:
+							int resultBegin = expressionResult.size();
+							auto error = ParseGrammarSymbol(symbol, 0, nullptr, input, end, expressionResult, bestCost);
+							resultError = FoldError(resultError, error);
+
+							for (int i = resultBegin; (size_t)i < expressionResult.size(); i++)
+							{
+								if (expressionResult[i].first == end)
+								{
+									Expression::List assignables, arguments, modifiedAssignables;
+									expressionResult[i].second->CollectNewAssignable(assignables, arguments, modifiedAssignables);
+									int cost = assignables.size();
+									if ((bestCost == -1 || cost < bestCost) && CountStatementAssignables(assignables) != -1)
+									{
+										bestCost = cost;
+									}
+								}
+							}
+						}
 					}
 				}
-				it++;
 			}
+			catch (const TooManyAlternativesException&)
+			{
+				alternativesLeft = -1;
+				stringstream_t ss;
+				ss << T("Statement is too ambiguous, it has more than ") << maxAlternatives << T(" partial parses.");
+				CodeError error =
+				{
+					*input,
+					ss.str(),
+				};
+				return error;
+			}
+			alternativesLeft = -1;
 
 			for (auto er : expressionResult)
 			{
@@ -105,18 +105,32 @@ namespace tinymoe
 		public:
 			typedef shared_ptr<GrammarSymbol>			Ptr;
 			typedef vector<Ptr>							List;
-			typedef multimap<string_t, Ptr>				MultiMap;
+
+			// groups symbols by the unique id, the hash is compared first and the unique id is only compared when hashes are equal
+			// keys are not in the order of the unique id, sort by the unique id where the order is visible to users
+			struct Key
+			{
+				unsigned long long						hash;
+				const string_t*							uniqueId;
+
+				Key(const Ptr& symbol);
+
+				bool									operator<(const Key& key)const;
+			};
+			typedef multimap<Key, Ptr>					MultiMap;
 
 			GrammarFragment::List						fragments;		// grammar fragments for this symbol
 			// a statement cannot be an expression
 			// the top invoke expression's function of a statement should reference to a statement symbol
 			string_t									uniqueId;		// a string_t that identifies the grammar structure
+			unsigned long long							uniqueIdHash = 0;
+			bool										uniqueIdCalculated = false;
 			GrammarSymbolTarget							target;
 			GrammarSymbolType							type;
 
 			GrammarSymbol(GrammarSymbolType _type, GrammarSymbolTarget _target = GrammarSymbolTarget::Custom);
 
-			void										CalculateUniqueId();
+			void										CalculateUniqueId();	// called when all fragments are added, the unique id does not change after that
 		};
 
 		GrammarSymbol::Ptr								operator+(GrammarSymbol::Ptr symbol, const string_t& name);
@@ -270,6 +284,27 @@ namespace tinymoe
 			void										FillPredefinedSymbols();
 		};
 
+		// a pushed stack item, a scope never changes after it is created, so a scope chain can be shared by any number of stacks
+		class GrammarScope
+		{
+		public:
+			typedef shared_ptr<GrammarScope>			Ptr;
+
+			Ptr											parent;
+			GrammarStackItem::Ptr						item;
+			GrammarSymbol::MultiMap						symbols;				// symbols in this item grouped by GrammarSymbol::Key
+			GrammarSymbol::Ptr							resultSymbol;			// the result symbol in this scope or parent scopes
+
+			GrammarScope(Ptr _parent, GrammarStackItem::Ptr _item);
+
+			const GrammarSymbol::List&					GetVisibleSymbols();	// one symbol per group ordered by the unique id, built on first use
+			int											CountSymbols(const GrammarSymbol::Key& key);
+
+		private:
+			once_flag									visibleSymbolsBuilt;
+			shared_ptr<const GrammarSymbol::List>		visibleSymbols;			// shared with the parent scope when this item has no symbols
+		};
+
 		class GrammarStack
 		{
 		public:
@@ -279,10 +314,11 @@ namespace tinymoe
 			typedef vector<ResultItem>					ResultList;
 			typedef CodeError(GrammarStack::* ParseFunctionType)(Iterator, Iterator, ResultList&);
 
-			GrammarStackItem::List						stackItems;				// available symbols organized in a scope based structure
-			GrammarSymbol::MultiMap						availableSymbols;		// available symbols grouped by the unique identifier
-			GrammarSymbol::Ptr							resultSymbol;
-			// the last symbol overrides all other symbols in the same group
+			static const int							DefaultMaxAlternatives = 0;		// no limit, a host that parses untrusted code passes one to SymbolAssembly::Parse
+
+			GrammarScope::Ptr							scope;					// the innermost scope, pushing and popping only replace this pointer
+			int											maxAlternatives = DefaultMaxAlternatives;	// partial parses a statement can create, 0 means no limit
+			int											alternativesLeft = -1;	// -1 outside ParseStatement
 
 			struct ExpressionLink
 			{
@@ -290,18 +326,24 @@ namespace tinymoe
 
 				Expression::Ptr							expression;
 				Ptr										previous;
+				int										cost = 0;				// new variables created by <assignable> in this and previous links
 			};
 
+			struct TooManyAlternativesException{};
+
 			void										Push(GrammarStackItem::Ptr stackItem);
 			GrammarStackItem::Ptr						Pop();
+			GrammarStack::Ptr							Snapshot();				// a stack sharing all current scopes, it can be used by another thread
+			const GrammarSymbol::List&					GetVisibleSymbols();
 
 			CodeError									SuccessError();
 			CodeError									ParseToken(const string_t& token, Iterator input, Iterator end, vector<Iterator>& result);
 			CodeError									FoldError(CodeError error1, CodeError error2);
+			void										CountAlternatives(size_t count);	// throws TooManyAlternativesException when the budget runs out
 
 			CodeError									ParseGrammarFragment(GrammarFragment::Ptr fragment, Iterator input, Iterator end, ResultList& result);
 			CodeError									ParseGrammarSymbolStep(GrammarSymbol::Ptr symbol, int fragmentIndex, ExpressionLink::Ptr previousExpression, Iterator input, Iterator end, vector<pair<Iterator, ExpressionLink::Ptr>>& result);
-			CodeError									ParseGrammarSymbol(GrammarSymbol::Ptr symbol, int beginFragment, ExpressionLink::Ptr previousExpression, Iterator input, Iterator end, ResultList& result);
+			CodeError									ParseGrammarSymbol(GrammarSymbol::Ptr symbol, int beginFragment, ExpressionLink::Ptr previousExpression, Iterator input, Iterator end, ResultList& result, int maxCost = -1);	// -1: no pruning
 			CodeError									ParseGrammarSymbol(GrammarSymbol::Ptr symbol, Iterator input, Iterator end, ResultList& result);
 
 			CodeError									ParseType(Iterator input, Iterator end, ResultList& result);			// <type>
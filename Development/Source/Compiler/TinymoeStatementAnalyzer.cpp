@@ -262,13 +262,14 @@ namespace tinymoe
 		{
 			for (auto declaration : module->declarations)
 			{
-				if (auto symbol = declaration->CreateSymbol(false))
+				for (auto symbol : { declaration->CreateSymbol(false), declaration->CreateSymbol(true) })
 				{
-					symbolDeclarations.insert(make_pair(symbol, declaration));
-				}
-				if (auto symbol = declaration->CreateSymbol(true))
-				{
-					symbolDeclarations.insert(make_pair(symbol, declaration));
+					if (symbol)
+					{
+						symbol->CalculateUniqueId();
+						symbolDeclarations.insert(make_pair(symbol, declaration));
+						symbolUniqueIds.insert(make_pair(GrammarSymbol::Key(symbol), symbol));
+					}
 				}
 			}
 		}
@@ -306,11 +307,31 @@ namespace tinymoe
 
 		void SymbolModule::BuildFunctionLinkings(CodeError::List& errors)
 		{
-			for (auto ita = symbolDeclarations.begin(); ita != symbolDeclarations.end(); ita++)
+			// IsOverloading only returns true for symbols with the same unique id, so only symbols in the same group are compared
+			// groups are ordered by hash, they are visited in the order of the unique id so that errors are reported in a stable order
+			typedef pair<GrammarSymbol::MultiMap::iterator, GrammarSymbol::MultiMap::iterator> SymbolGroup;
+			vector<SymbolGroup> groups;
+			for (auto lower = symbolUniqueIds.begin(); lower != symbolUniqueIds.end();)
 			{
-				for (auto itb = ita; ++itb != symbolDeclarations.end();)
+				auto upper = symbolUniqueIds.upper_bound(lower->first);
+				groups.push_back(make_pair(lower, upper));
+				lower = upper;
+			}
+			sort(groups.begin(), groups.end(), [](const SymbolGroup& a, const SymbolGroup& b)
+			{
+				return *a.first->first.uniqueId < *b.first->first.uniqueId;
+			});
+
+			for (auto group : groups)
+			{
+				for (auto ita = group.first; ita != group.second; ita++)
 				{
-					CheckOverloading(this, ita->first, ita->second, this, itb->first, itb->second, false, errors);
+					auto decla = symbolDeclarations.find(ita->second)->second;
+					for (auto itb = ita; ++itb != group.second;)
+					{
+						auto declb = symbolDeclarations.find(itb->second)->second;
+						CheckOverloading(this, ita->second, decla, this, itb->second, declb, false, errors);
+					}
 				}
 			}
 
@@ -327,9 +348,11 @@ namespace tinymoe
 							for (auto weakRef : usingSymbolModules)
 							{
 								auto ref = weakRef.lock();
-								for (auto itb = ref->symbolDeclarations.begin(); itb != ref->symbolDeclarations.end(); itb++)
+								auto range = ref->symbolUniqueIds.equal_range(GrammarSymbol::Key(ita->first));
+								for (auto itb = range.first; itb != range.second; itb++)
 								{
-									CheckOverloading(this, ita->first, ita->second, ref.get(), itb->first, itb->second, true, errors);
+									auto declb = ref->symbolDeclarations.find(itb->second)->second;
+									CheckOverloading(this, ita->first, ita->second, ref.get(), itb->second, declb, true, errors);
 								}
 							}
 						}
@@ -352,21 +375,9 @@ namespace tinymoe
 		{
 			for (auto symbol : item->symbols)
 			{
-				auto lower = stack->availableSymbols.lower_bound(symbol->uniqueId);
-				auto upper = stack->availableSymbols.upper_bound(symbol->uniqueId);
-
-				bool found = false;
-				for (auto it = lower; it != upper; it++)
+				if (stack->scope->CountSymbols(GrammarSymbol::Key(symbol)) > 1)
 				{
-					if (!found)
-					{
-						found = true;
-					}
-					else
-					{
-						symbols.push_back(symbol);
-						break;
-					}
+					symbols.push_back(symbol);
 				}
 			}
 		}
@@ -916,7 +927,7 @@ namespace tinymoe
 			{
 				auto funcdecl = dynamic_pointer_cast<FunctionDeclaration>(dfp.first);
 				auto func = dfp.second;
-				func->resultVariable = stack->resultSymbol;
+				func->resultVariable = stack->scope->resultSymbol;
 				for (auto sfp : func->argumentFragments)
 				{
 					if (auto var = dynamic_pointer_cast<VariableArgumentFragment>(sfp.second))
@@ -998,27 +1009,8 @@ namespace tinymoe
 					}
 					else
 					{
-						int lineIndex = funcdecl->codeLineIndex;
-						int endLineIndex = funcdecl->endLineIndex;
-						auto statement = make_shared<Statement>();
-						func->statement = statement;
-					
-						try
-						{
-							ParseBlock(codeFile, stack, statement, lineIndex, endLineIndex, errors);
-							if (lineIndex <= endLineIndex)
-							{
-								CodeError error =
-								{
-									codeFile->lines[lineIndex]->tokens[0],
-									T("Too many code.")
-								};
-								errors.push_back(error);
-							}
-						}
-						catch (const ParsingFailedException&)
-						{
-						}
+						func->bodyStack = stack->Snapshot();
+						BuildFunctionBody(func, errors);
 					}
 
 					stack->Pop();
@@ -1029,16 +1021,70 @@ namespace tinymoe
 			stack->Pop();
 		}
 
+		void SymbolModule::BuildFunctionBody(SymbolFunction::Ptr func, CodeError::List& errors)
+		{
+			auto funcdecl = func->function;
+			int lineIndex = funcdecl->codeLineIndex;
+			int endLineIndex = funcdecl->endLineIndex;
+			auto statement = make_shared<Statement>();
+			func->statement = statement;
+
+			try
+			{
+				// ParseBlock pushes and pops on the stack, so bodyStack is kept unchanged for the next time
+				ParseBlock(codeFile, func->bodyStack->Snapshot(), statement, lineIndex, endLineIndex, errors);
+				if (lineIndex <= endLineIndex)
+				{
+					CodeError error =
+					{
+						codeFile->lines[lineIndex]->tokens[0],
+						T("Too many code.")
+					};
+					errors.push_back(error);
+				}
+			}
+			catch (const ParsingFailedException&)
+			{
+			}
+		}
+
+		SymbolFunction::Ptr SymbolModule::FindFunctionBody(int lineIndex)
+		{
+			for (auto dfp : declarationFunctions)
+			{
+				auto funcdecl = dynamic_pointer_cast<FunctionDeclaration>(dfp.first);
+				if (funcdecl->codeLineIndex != -1 && funcdecl->codeLineIndex <= lineIndex && lineIndex <= funcdecl->endLineIndex)
+				{
+					return dfp.second;
+				}
+			}
+			return nullptr;
+		}
+
 		/*************************************************************
 		SymbolAssembly
 		*************************************************************/
 
-		SymbolAssembly::Ptr SymbolAssembly::Parse(vector<string_t>& codes, CodeError::List& errors)
+		SymbolAssembly::Ptr SymbolAssembly::Parse(vector<string_t>& codes, CodeError::List& errors, int maxAlternatives)
 		{
+			return Parse(nullptr, codes, errors, maxAlternatives);
+		}
+
+		SymbolAssembly::Ptr SymbolAssembly::Parse(SymbolAssembly::Ptr base, vector<string_t>& codes, CodeError::List& errors, int maxAlternatives)
+		{
+			if (base && (!base->statementsBuilt || base->errors.size() > 0))
+			{
+				// modules with errors are not completely built and cannot be shared, so all modules are parsed again
+				vector<string_t> allCodes = base->codes;
+				allCodes.insert(allCodes.end(), codes.begin(), codes.end());
+				return Parse(allCodes, errors, maxAlternatives);
+			}
+
+			auto errorBegin = errors.size();
 			Module::List modules;
 			CodeFile::List codeFiles;
 
-			int codeIndex = 0;
+			int codeIndex = base ? (int)base->codes.size() : 0;
 			for (auto code : codes)
 			{
 				auto codeFile = CodeFile::Parse(code, codeIndex++, errors);
@@ -1049,12 +1095,24 @@ namespace tinymoe
 			}
 
 			auto assembly = make_shared<SymbolAssembly>();
+			assembly->baseAssembly = base;
+			if (base)
+			{
+				assembly->codes = base->codes;
+				assembly->symbolModules = base->symbolModules;
+			}
+			assembly->codes.insert(assembly->codes.end(), codes.begin(), codes.end());
+			assembly->maxAlternatives = maxAlternatives;
+
+			// only new modules are built, modules from the base assembly are shared and never changed
+			SymbolModule::List newModules;
 			for (int i = 0; (size_t)i < modules.size(); i++)
 			{
 				auto symbolModule = make_shared<SymbolModule>();
 				symbolModule->codeFile = codeFiles[i];
 				symbolModule->module = modules[i];
 				assembly->symbolModules.push_back(symbolModule);
+				newModules.push_back(symbolModule);
 			}
 
 			if (errors.size() == 0)
@@ -1066,9 +1124,21 @@ namespace tinymoe
 					moduleMap.insert(make_pair(module->module->name->GetName(), module));
 				}
 
-				for (auto module : assembly->symbolModules)
+				for (auto module : newModules)
 				{
 					string_t moduleName = module->module->name->GetName();
+					if (base && moduleMap.lower_bound(moduleName)->second != module)
+					{
+						// a module in the base assembly cannot see symbols in a new module with the same name
+						CodeError error =
+						{
+							module->module->name->identifiers[0],
+							T("Module \"") + moduleName + T("\" is already built and cannot be extended."),
+						};
+						errors.push_back(error);
+						continue;
+					}
+
 					auto lower = moduleMap.lower_bound(moduleName);
 					auto upper = moduleMap.upper_bound(moduleName);
 					for (auto it = lower; it != upper; it++)
@@ -1105,7 +1175,7 @@ namespace tinymoe
 
 			if (errors.size() == 0)
 			{
-				for (auto module : assembly->symbolModules)
+				for (auto module : newModules)
 				{
 					module->BuildSymbols(errors);
 				}
@@ -1113,7 +1183,7 @@ namespace tinymoe
 
 			if (errors.size() == 0)
 			{
-				for (auto module : assembly->symbolModules)
+				for (auto module : newModules)
 				{
 					module->BuildFunctions(errors);
 				}
@@ -1121,7 +1191,7 @@ namespace tinymoe
 
 			if (errors.size() == 0)
 			{
-				for (auto module : assembly->symbolModules)
+				for (auto module : newModules)
 				{
 					module->BuildFunctionLinkings(errors);
 				}
@@ -1132,14 +1202,172 @@ namespace tinymoe
 				auto item = make_shared<GrammarStackItem>();
 				item->FillPredefinedSymbols();
 				auto stack = make_shared<GrammarStack>();
+				stack->maxAlternatives = maxAlternatives;
 				stack->Push(item);
 
-				for (auto module : assembly->symbolModules)
+				for (auto module : newModules)
 				{
 					module->BuildStatements(stack, errors);
 				}
+				assembly->statementsBuilt = true;
+			}
+
+			assembly->errors.assign(errors.begin() + errorBegin, errors.end());
+			return assembly;
+		}
+
+		// replaces a row in the source code, rows are added if the code is not long enough
+		static void ReplaceCodeRow(string_t& code, int row, const string_t& content)
+		{
+			size_t begin = 0;
+			for (int i = 1; i < row; i++)
+			{
+				auto lineBreak = code.find(T('\n'), begin);
+				if (lineBreak == string_t::npos)
+				{
+					code += T('\n');
+					lineBreak = code.size() - 1;
+				}
+				begin = lineBreak + 1;
+			}
+
+			auto end = code.find(T('\n'), begin);
+			if (end == string_t::npos)
+			{
+				end = code.size();
+			}
+			if (end > begin && code[end - 1] == T('\r'))
+			{
+				end--;
+			}
+			code.replace(begin, end - begin, content);
+		}
+
+		SymbolAssembly::Ptr SymbolAssembly::Update(SymbolAssembly::Ptr assembly, const CodeLineEdit::List& edits, CodeError::List& errors)
+		{
+			// declarations are parsed again if any edited row is not in a function body, or an edited row starts or stops being code
+			bool rebuild = !assembly->statementsBuilt;
+			// modules from the base assembly are shared, editing them parses all modules again without the base assembly
+			int baseCodes = assembly->baseAssembly ? (int)assembly->baseAssembly->codes.size() : 0;
+			bool rebuildBase = false;
+			vector<pair<SymbolModule::Ptr, SymbolFunction::Ptr>> changedFunctions;
+
+			// all edits are checked before changing the assembly, so the assembly is unchanged if it is parsed again
+			vector<string_t> codes = assembly->codes;
+			vector<pair<CodeLine::Ptr*, CodeLine::Ptr>> changedLines;
+
+			for (auto edit : edits)
+			{
+				ASSERT(0 <= edit.codeIndex && (size_t)edit.codeIndex < codes.size() && edit.row > 0);
+				ReplaceCodeRow(codes[edit.codeIndex], edit.row, edit.code);
+				if (edit.codeIndex < baseCodes)
+				{
+					rebuild = true;
+					rebuildBase = true;
+				}
+				if (rebuild)
+				{
+					continue;
+				}
+				if (edit.code.find_first_of(T("\r\n")) != string_t::npos)
+				{
+					rebuild = true;
+					continue;
+				}
+
+				CodeError::List lineErrors;
+				auto lineFile = CodeFile::Parse(edit.code, edit.codeIndex, lineErrors);
+				if (lineErrors.size() > 0)
+				{
+					rebuild = true;
+					continue;
+				}
+				auto line = lineFile->lines.size() > 0 ? lineFile->lines[0] : nullptr;
+				if (line)
+				{
+					for (auto& token : line->tokens)
+					{
+						token.row = edit.row;
+					}
+				}
+
+				auto module = assembly->symbolModules[edit.codeIndex];
+				auto& lines = module->codeFile->lines;
+				auto itLine = lower_bound(lines.begin(), lines.end(), edit.row, [](const CodeLine::Ptr& line, int row){return line->tokens[0].row < row; });
+				bool existing = itLine != lines.end() && (*itLine)->tokens[0].row == edit.row;
+				if (!existing && !line)
+				{
+					continue;
+				}
+				if (!existing || !line)
+				{
+					rebuild = true;
+					continue;
+				}
+
+				switch (line->tokens[0].type)
+				{
+				case CodeTokenType::Symbol:
+				case CodeTokenType::Type:
+				case CodeTokenType::CPS:
+				case CodeTokenType::Category:
+				case CodeTokenType::Phrase:
+				case CodeTokenType::Sentence:
+				case CodeTokenType::Block:
+					rebuild = true;
+					continue;
+				default:
+					break;
+				}
+
+				auto func = module->FindFunctionBody(itLine - lines.begin());
+				if (!func)
+				{
+					rebuild = true;
+					continue;
+				}
+				changedLines.push_back(make_pair(&*itLine, line));
+				if (find(changedFunctions.begin(), changedFunctions.end(), make_pair(module, func)) == changedFunctions.end())
+				{
+					changedFunctions.push_back(make_pair(module, func));
+				}
+			}
+
+			if (rebuild)
+			{
+				if (baseCodes > 0 && !rebuildBase)
+				{
+					vector<string_t> newCodes(codes.begin() + baseCodes, codes.end());
+					return Parse(assembly->baseAssembly, newCodes, errors, assembly->maxAlternatives);
+				}
+				return Parse(codes, errors, assembly->maxAlternatives);
+			}
+
+			assembly->codes = codes;
+			for (auto changed : changedLines)
+			{
+				*changed.first = changed.second;
+			}
+
+			for (auto changed : changedFunctions)
+			{
+				auto module = changed.first;
+				auto funcdecl = changed.second->function;
+				auto& lines = module->codeFile->lines;
+				int codeIndex = lines[funcdecl->codeLineIndex]->tokens[0].codeIndex;
+				int beginRow = lines[funcdecl->codeLineIndex]->tokens[0].row;
+				int endRow = lines[funcdecl->endLineIndex]->tokens[0].row;
+
+				// errors in the body are only reported by BuildFunctionBody
+				auto& assemblyErrors = assembly->errors;
+				assemblyErrors.erase(remove_if(assemblyErrors.begin(), assemblyErrors.end(), [=](const CodeError& error)
+				{
+					return error.position.codeIndex == codeIndex && beginRow <= error.position.row && error.position.row <= endRow;
+				}), assemblyErrors.end());
+				module->BuildFunctionBody(changed.second, assemblyErrors);
 			}
 
+			errors.insert(errors.end(), assembly->errors.begin(), assembly->errors.end());
 			return assembly;
 		}
 	}
@@ -78,6 +78,7 @@ namespace tinymoe
 			GrammarSymbol::Ptr				categorySignalVariable;
 
 			Statement::Ptr					statement;					// the function body
+			GrammarStack::Ptr				bodyStack;					// a snapshot of the stack before parsing the body, for parsing the body again
 		};
 
 		class SymbolModule
@@ -97,6 +98,7 @@ namespace tinymoe
 			Module::Ptr						module;						// the original module
 			WeakList						usingSymbolModules;			// all referenced modules
 			SymbolDeclarationMap			symbolDeclarations;			// map a grammar symbol to the creator declaration
+			GrammarSymbol::MultiMap			symbolUniqueIds;			// map a unique id to all grammar symbols having it, only symbols with the same unique id can overload each other
 			DeclarationFunctionMap			declarationFunctions;		// map a declaration to the symbol function
 			DeclarationSymbolMap			baseTypes;					// map a type to its base type
 
@@ -114,6 +116,17 @@ namespace tinymoe
 			GrammarSymbol::Ptr				FindType(SymbolName::Ptr name, GrammarStack::Ptr stack, CodeError::List& errors);
 			Declaration::Ptr				FindDeclaration(GrammarSymbol::Ptr symbol);
 			void							BuildStatements(GrammarStack::Ptr stack, CodeError::List& errors);		// sync step: parse all statements
+			void							BuildFunctionBody(SymbolFunction::Ptr func, CodeError::List& errors);	// parse the function body using SymbolFunction::bodyStack
+			SymbolFunction::Ptr				FindFunctionBody(int lineIndex);
+		};
+
+		struct CodeLineEdit
+		{
+			typedef vector<CodeLineEdit>			List;
+
+			int								codeIndex = -1;				// the module to change
+			int								row = -1;					// the row to replace, starting from 1 like CodeToken::row
+			string_t						code;						// the new content of the row, a line break here inserts rows
 		};
 
 		class SymbolAssembly
@@ -121,9 +134,19 @@ namespace tinymoe
 		public:
 			typedef shared_ptr<SymbolAssembly>		Ptr;
 
+			SymbolAssembly::Ptr				baseAssembly;				// modules in the base assembly are at the beginning of symbolModules and shared
 			SymbolModule::List				symbolModules;
-
-			static SymbolAssembly::Ptr		Parse(vector<string_t>& codes, CodeError::List& errors);
+			vector<string_t>				codes;						// the source code of all modules
+			int								maxAlternatives = GrammarStack::DefaultMaxAlternatives;
+			bool							statementsBuilt = false;	// false if errors in declarations stopped parsing statements
+			CodeError::List					errors;						// all errors found by the last Parse or Update
+
+			static SymbolAssembly::Ptr		Parse(vector<string_t>& codes, CodeError::List& errors, int maxAlternatives = GrammarStack::DefaultMaxAlternatives);
+			// parses new modules on top of an assembly without errors, modules in the base assembly are not parsed again or changed, so the base assembly can be shared between threads
+			static SymbolAssembly::Ptr		Parse(SymbolAssembly::Ptr base, vector<string_t>& codes, CodeError::List& errors, int maxAlternatives = GrammarStack::DefaultMaxAlternatives);
+			// applies edits and parses again only function bodies containing edited rows, the returned assembly is the same one unless a declaration is changed,
+			// in which case a new assembly is parsed and the input assembly is not changed
+			static SymbolAssembly::Ptr		Update(SymbolAssembly::Ptr assembly, const CodeLineEdit::List& edits, CodeError::List& errors);
 		};
 	}
 }
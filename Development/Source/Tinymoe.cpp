@@ -5,4 +5,34 @@ namespace tinymoe
 	/*************************************************************
 	Helper Functions
 	*************************************************************/
+
+	static ast::AstAssembly::Ptr GenerateInternedAst(compiler::SymbolAssembly::Ptr assembly)
+	{
+		auto ast = compiler::GenerateAst(assembly);
+		ast::AstInternStatistics statistics;
+		ast::InternAst(ast, statistics);
+		return ast;
+	}
+
+	ast::AstAssembly::Ptr Compile(const vector<string_t>& codes, compiler::CodeError::List& errors, int maxAlternatives)
+	{
+		vector<string_t> modules = codes;
+		auto assembly = compiler::SymbolAssembly::Parse(modules, errors, maxAlternatives);
+		if (errors.size() > 0)
+		{
+			return nullptr;
+		}
+		return GenerateInternedAst(assembly);
+	}
+
+	ast::AstAssembly::Ptr Compile(compiler::SymbolAssembly::Ptr base, const vector<string_t>& codes, compiler::CodeError::List& errors, int maxAlternatives)
+	{
+		vector<string_t> modules = codes;
+		auto assembly = compiler::SymbolAssembly::Parse(base, modules, errors, maxAlternatives);
+		if (errors.size() > 0)
+		{
+			return nullptr;
+		}
+		return GenerateInternedAst(assembly);
+	}
 }
\ No newline at end of file
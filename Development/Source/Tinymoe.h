@@ -11,6 +11,13 @@
 
 namespace tinymoe
 {
+	// parses all modules and generates the optimized AST of the whole program, nullptr is returned if there is any error,
+	// the AST is not changed after that, so code generators on different threads can read it at the same time,
+	// equal types, literals and references in the AST are interned, so a node could be shared by many nodes
+	// maxAlternatives limits the partial parses of a statement, 0 means no limit
+	extern ast::AstAssembly::Ptr				Compile(const vector<string_t>& codes, compiler::CodeError::List& errors, int maxAlternatives = compiler::GrammarStack::DefaultMaxAlternatives);
+	// parses modules on top of a base assembly, usually the standard library parsed once by compiler::SymbolAssembly::Parse
+	extern ast::AstAssembly::Ptr				Compile(compiler::SymbolAssembly::Ptr base, const vector<string_t>& codes, compiler::CodeError::List& errors, int maxAlternatives = compiler::GrammarStack::DefaultMaxAlternatives);
 }
 
 #endif
\ No newline at end of file
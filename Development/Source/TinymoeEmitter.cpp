@@ -0,0 +1,152 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "TinymoeEmitter.h"
+#include <cstdio>
+
+#ifdef _MSC_VER
+#include <io.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+namespace tinymoe
+{
+	/*************************************************************
+	Emitter
+	*************************************************************/
+
+	Emitter::Emitter(ostream_t& _stream)
+		:stream(&_stream)
+		, buffer(BufferSize)
+	{
+	}
+
+	Emitter::Emitter(int _fd)
+		:fd(_fd)
+		, buffer(BufferSize)
+	{
+	}
+
+	Emitter::~Emitter()
+	{
+		Flush();
+	}
+
+	void Emitter::WriteBuffer()
+	{
+		if (stream)
+		{
+			stream->write(&buffer[0], (streamsize)used);
+		}
+		else if (!failed)
+		{
+			auto data = (const char*)&buffer[0];
+			auto size = used * sizeof(char_t);
+			while (size > 0)
+			{
+#ifdef _MSC_VER
+				auto written = _write(fd, data, (unsigned int)size);
+#else
+				auto written = write(fd, data, size);
+				if (written == -1 && errno == EINTR) continue;
+#endif
+				if (written <= 0)
+				{
+					failed = true;
+					break;
+				}
+				data += written;
+				size -= (size_t)written;
+			}
+		}
+		used = 0;
+	}
+
+	void Emitter::WriteText(const char_t* text, size_t length)
+	{
+		while (length > 0)
+		{
+			if (used == BufferSize)
+			{
+				WriteBuffer();
+			}
+			auto count = min(length, BufferSize - used);
+			memcpy(&buffer[used], text, count * sizeof(char_t));
+			used += count;
+			text += count;
+			length -= count;
+		}
+	}
+
+	bool Emitter::IsFailed()
+	{
+		return failed;
+	}
+
+	void Emitter::Flush()
+	{
+		if (used > 0)
+		{
+			WriteBuffer();
+		}
+		if (stream)
+		{
+			stream->flush();
+		}
+	}
+
+	void Emitter::PushIndentation(const char_t* item)
+	{
+		indentationLengths.push_back(indentation.size());
+		indentation += item;
+	}
+
+	void Emitter::PopIndentation()
+	{
+		ASSERT(indentationLengths.size() > 0);
+		indentation.resize(indentationLengths.back());
+		indentationLengths.pop_back();
+	}
+
+	Emitter& Emitter::Indent()
+	{
+		Write(indentation.c_str(), indentation.size());
+		return *this;
+	}
+
+	void Emitter::WriteInteger(int64_t value)
+	{
+		if (value < 0)
+		{
+			Write(T("-"), 1);
+			WriteUnsigned(0 - (uint64_t)value);
+		}
+		else
+		{
+			WriteUnsigned((uint64_t)value);
+		}
+	}
+
+	void Emitter::WriteUnsigned(uint64_t value)
+	{
+		char_t digits[20];
+		size_t begin = sizeof(digits) / sizeof(*digits);
+		do
+		{
+			digits[--begin] = (char_t)(T('0') + value % 10);
+			value /= 10;
+		} while (value > 0);
+		Write(digits + begin, sizeof(digits) / sizeof(*digits) - begin);
+	}
+
+	void Emitter::WriteFloat(double value)
+	{
+		char digits[32];
+		int length = snprintf(digits, sizeof(digits), "%g", value);
+		for (int i = 0; i < length; i++)
+		{
+			char_t c = (char_t)digits[i];
+			Write(&c, 1);
+		}
+	}
+}
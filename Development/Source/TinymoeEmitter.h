@@ -0,0 +1,104 @@
+#ifndef VCZH_TINYMOEEMITTER
+#define VCZH_TINYMOEEMITTER
+
+#include "TinymoeSTL.h"
+#include <cstring>
+#include <type_traits>
+
+namespace tinymoe
+{
+	/*************************************************************
+	Emitter
+	*************************************************************/
+
+	// collects text in a buffer, and writes the buffer to a stream or a file descriptor only when it is full or flushed,
+	// so a line break is T("\n") instead of endl, and emitting text never allocates memory
+	class Emitter
+	{
+	private:
+		static const size_t						BufferSize = 65536;
+
+		ostream_t*								stream = nullptr;
+		int										fd = -1;
+		bool									failed = false;
+		vector<char_t>							buffer;
+		size_t									used = 0;
+
+		string_t								indentation;			// all items in the indentation stack
+		vector<size_t>							indentationLengths;		// the length of indentation before each item is pushed
+
+		void									WriteBuffer();
+		void									WriteText(const char_t* text, size_t length);
+	public:
+		Emitter(ostream_t& _stream);
+		Emitter(int _fd);												// characters are written to the file descriptor as they are in memory
+		~Emitter();
+
+		Emitter(const Emitter&) = delete;
+		Emitter&								operator=(const Emitter&) = delete;
+
+		bool									IsFailed();				// true if writing to the file descriptor failed
+		void									Flush();
+
+		void									PushIndentation(const char_t* item = T("\t"));
+		void									PopIndentation();
+		Emitter&								Indent();				// writes all items in the indentation stack
+
+		void									WriteInteger(int64_t value);
+		void									WriteUnsigned(uint64_t value);
+		void									WriteFloat(double value);		// formatted like ostream_t with the default precision
+
+		void Write(const char_t* text, size_t length)
+		{
+			if (length <= BufferSize - used)
+			{
+				memcpy(&buffer[used], text, length * sizeof(char_t));
+				used += length;
+			}
+			else
+			{
+				WriteText(text, length);
+			}
+		}
+
+		Emitter& operator<<(const char_t* text)
+		{
+			Write(text, char_traits<char_t>::length(text));
+			return *this;
+		}
+
+		Emitter& operator<<(const string_t& text)
+		{
+			Write(text.c_str(), text.size());
+			return *this;
+		}
+
+		Emitter& operator<<(char_t c)
+		{
+			Write(&c, 1);
+			return *this;
+		}
+
+		Emitter& operator<<(double value)
+		{
+			WriteFloat(value);
+			return *this;
+		}
+
+		template<typename T>
+		typename enable_if<is_integral<T>::value && is_signed<T>::value, Emitter&>::type operator<<(T value)
+		{
+			WriteInteger(value);
+			return *this;
+		}
+
+		template<typename T>
+		typename enable_if<is_integral<T>::value && is_unsigned<T>::value, Emitter&>::type operator<<(T value)
+		{
+			WriteUnsigned(value);
+			return *this;
+		}
+	};
+}
+
+#endif
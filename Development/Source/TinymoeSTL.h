@@ -6,6 +6,7 @@
 #include <set>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <sstream>
 #include <algorithm>
@@ -0,0 +1,675 @@
+/*************************************************************
+Tinymoe Compile Server
+
+Keeps the standard library (and other libraries given by --library) parsed in memory,
+and compiles modules on top of them for every request.
+
+Usage:
+	TinymoeServer [--library FILE]... [--socket PATH] [--jobs N] [--queue N] [--cache N] [--max-alternatives N]
+	Requests are read from stdin and responses are written to stdout unless --socket is given.
+	A socket accepts any number of connections, each connection sends requests one by one.
+	--max-alternatives limits the partial parses of a statement in untrusted code, 0 means no limit.
+
+Requests:
+	compile OUTPUT COUNT\n	followed by COUNT modules, each module is "LENGTH\n" and LENGTH bytes of code
+							OUTPUT is errors, ast, csharp or cpp
+	stats\n					latency and cache statistics
+	quit\n					closes the connection
+
+Responses:
+	ok LENGTH\n				followed by LENGTH bytes of the output
+	failed LENGTH\n			followed by LENGTH bytes of errors, one "MODULE:ROW:COLUMN: MESSAGE" in a line,
+							MODULE is the index of the module in the request, starting from 0
+	busy\n					too many requests are waiting for a job
+	bad LENGTH\n			followed by LENGTH bytes of the reason why the request is not understood
+*************************************************************/
+
+#include "../Source/Tinymoe.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace tinymoe;
+using namespace tinymoe::compiler;
+using namespace tinymoe::ast;
+
+extern void GenerateCSharpCode(AstAssembly::Ptr assembly, ostream_t& o);
+extern void GenerateCppCode(AstAssembly::Ptr assembly, ostream_t& o);
+
+#ifdef _UNICODE_TINYMOE
+string_t atow(const string& s)
+{
+	wstring buffer;
+	buffer.resize(s.size() + 1);
+	mbstowcs(&buffer[0], &s[0], s.size());
+	return buffer.c_str();
+}
+
+string wtoa(const string_t& s)
+{
+	string buffer;
+	buffer.resize(s.size() * 3 + 1);
+	wcstombs(&buffer[0], &s[0], s.size());
+	return buffer.c_str();
+}
+#else
+string_t atow(const string& s)
+{
+	return s;
+}
+
+string wtoa(const string_t& s)
+{
+	return s;
+}
+#endif
+
+typedef chrono::steady_clock				Clock;
+
+double MillisecondsSince(Clock::time_point begin)
+{
+	return chrono::duration<double, milli>(Clock::now() - begin).count();
+}
+
+/*************************************************************
+Channel
+*************************************************************/
+
+// a buffered connection on file descriptors, stdin/stdout or both ends of a socket
+class Channel
+{
+private:
+	int										input;
+	int										output;
+	string									buffer;
+	size_t									position = 0;
+
+	bool Fill()
+	{
+		if (position > 0)
+		{
+			buffer.erase(0, position);
+			position = 0;
+		}
+		char block[65536];
+		auto size = read(input, block, sizeof(block));
+		if (size <= 0)
+		{
+			return false;
+		}
+		buffer.append(block, (size_t)size);
+		return true;
+	}
+
+public:
+	Channel(int _input, int _output)
+		:input(_input)
+		, output(_output)
+	{
+	}
+
+	bool ReadLine(string& line)
+	{
+		while (true)
+		{
+			auto lineBreak = buffer.find('\n', position);
+			if (lineBreak != string::npos)
+			{
+				line = buffer.substr(position, lineBreak - position);
+				position = lineBreak + 1;
+				if (line.size() > 0 && line.back() == '\r')
+				{
+					line.pop_back();
+				}
+				return true;
+			}
+			if (!Fill())
+			{
+				return false;
+			}
+		}
+	}
+
+	bool ReadBytes(size_t size, string& bytes)
+	{
+		while (buffer.size() - position < size)
+		{
+			if (!Fill())
+			{
+				return false;
+			}
+		}
+		bytes = buffer.substr(position, size);
+		position += size;
+		return true;
+	}
+
+	bool Write(const string& bytes)
+	{
+		size_t written = 0;
+		while (written < bytes.size())
+		{
+			auto size = write(output, &bytes[written], bytes.size() - written);
+			if (size <= 0)
+			{
+				return false;
+			}
+			written += (size_t)size;
+		}
+		return true;
+	}
+};
+
+/*************************************************************
+Statistics
+*************************************************************/
+
+// keeps the latest samples for percentiles, count, mean and max are for all samples
+class LatencyStatistics
+{
+private:
+	static const int						MaxSamples = 4096;
+
+	mutex									lock;
+	vector<double>							samples;
+	uint64_t								count = 0;
+	double									total = 0;
+	double									max = 0;
+
+public:
+	void Add(double milliseconds)
+	{
+		lock_guard<mutex> guard(lock);
+		if (samples.size() < MaxSamples)
+		{
+			samples.push_back(milliseconds);
+		}
+		else
+		{
+			samples[count % MaxSamples] = milliseconds;
+		}
+		count++;
+		total += milliseconds;
+		if (max < milliseconds)
+		{
+			max = milliseconds;
+		}
+	}
+
+	void Write(ostream& o, const string& name)
+	{
+		lock_guard<mutex> guard(lock);
+		auto sorted = samples;
+		sort(sorted.begin(), sorted.end());
+		auto percentile = [&](int p)
+		{
+			return sorted.size() == 0 ? 0 : sorted[(sorted.size() - 1) * p / 100];
+		};
+
+		o << name << ": " << count << " samples";
+		if (count > 0)
+		{
+			o << ", mean " << total / count << " ms";
+			o << ", p50 " << percentile(50) << " ms";
+			o << ", p95 " << percentile(95) << " ms";
+			o << ", p99 " << percentile(99) << " ms";
+			o << ", max " << max << " ms";
+		}
+		o << endl;
+	}
+};
+
+/*************************************************************
+Cache
+*************************************************************/
+
+// the compiled program of a request, outputs are generated when they are asked for the first time
+class CompileResult
+{
+public:
+	typedef shared_ptr<CompileResult>		Ptr;
+
+	once_flag								compiled;
+	AstAssembly::Ptr						ast;
+	string									errors;
+
+	mutex									lock;
+	map<string, string>						outputs;
+};
+
+// least recently used programs, keyed by the code of all modules in a request
+class CompileCache
+{
+	typedef list<pair<vector<string_t>, CompileResult::Ptr>>		EntryList;
+
+private:
+	mutex									lock;
+	size_t									capacity;
+	EntryList								entries;
+	map<vector<string_t>, EntryList::iterator>						entryMap;
+
+public:
+	CompileCache(size_t _capacity)
+		:capacity(_capacity)
+	{
+	}
+
+	// returns an existing result, or creates a result that is not compiled yet
+	CompileResult::Ptr Get(const vector<string_t>& codes, bool& hit)
+	{
+		lock_guard<mutex> guard(lock);
+		auto it = entryMap.find(codes);
+		if (it != entryMap.end())
+		{
+			entries.splice(entries.begin(), entries, it->second);
+			hit = true;
+			return it->second->second;
+		}
+
+		hit = false;
+		auto result = make_shared<CompileResult>();
+		if (capacity > 0)
+		{
+			entries.push_front(make_pair(codes, result));
+			entryMap.insert(make_pair(codes, entries.begin()));
+			if (entries.size() > capacity)
+			{
+				entryMap.erase(entries.back().first);
+				entries.pop_back();
+			}
+		}
+		return result;
+	}
+};
+
+/*************************************************************
+Server
+*************************************************************/
+
+class CompileServer
+{
+private:
+	SymbolAssembly::Ptr						library;
+	int										maxAlternatives;
+	CompileCache							cache;
+
+	// at most jobLimit requests compile at the same time, at most queueLimit requests wait for them
+	mutex									jobLock;
+	condition_variable						jobAvailable;
+	int										jobLimit;
+	int										queueLimit;
+	int										activeJobs = 0;
+	int										waitingJobs = 0;
+
+	atomic<uint64_t>						requests{ 0 };
+	atomic<uint64_t>						cacheHits{ 0 };
+	atomic<uint64_t>						rejected{ 0 };
+	atomic<uint64_t>						failures{ 0 };
+	LatencyStatistics						requestLatency;
+	LatencyStatistics						queueLatency;
+	LatencyStatistics						compileLatency;
+	LatencyStatistics						outputLatency;
+
+	bool AcquireJob()
+	{
+		unique_lock<mutex> guard(jobLock);
+		if (activeJobs >= jobLimit)
+		{
+			if (waitingJobs >= queueLimit)
+			{
+				return false;
+			}
+			waitingJobs++;
+			jobAvailable.wait(guard, [&]() { return activeJobs < jobLimit; });
+			waitingJobs--;
+		}
+		activeJobs++;
+		return true;
+	}
+
+	void ReleaseJob()
+	{
+		lock_guard<mutex> guard(jobLock);
+		activeJobs--;
+		jobAvailable.notify_one();
+	}
+
+	string FormatErrors(const CodeError::List& errors)
+	{
+		stringstream o;
+		int baseCodes = (int)library->codes.size();
+		for (auto& error : errors)
+		{
+			o << error.position.codeIndex - baseCodes << ":" << error.position.row << ":" << error.position.column << ": " << wtoa(error.message) << "\n";
+		}
+		return o.str();
+	}
+
+	void Compile(CompileResult& result, const vector<string_t>& codes)
+	{
+		auto begin = Clock::now();
+		CodeError::List errors;
+		result.ast = tinymoe::Compile(library, codes, errors, maxAlternatives);
+		result.errors = FormatErrors(errors);
+		compileLatency.Add(MillisecondsSince(begin));
+	}
+
+	string GenerateOutput(AstAssembly::Ptr ast, const string& output)
+	{
+		auto begin = Clock::now();
+		stringstream_t o;
+		if (output == "ast")
+		{
+			Print(ast, o, 0);
+		}
+		else if (output == "csharp")
+		{
+			GenerateCSharpCode(ast, o);
+		}
+		else if (output == "cpp")
+		{
+			GenerateCppCode(ast, o);
+		}
+		outputLatency.Add(MillisecondsSince(begin));
+		return wtoa(o.str());
+	}
+
+	static string Respond(const string& status, const string& content)
+	{
+		return status + " " + to_string(content.size()) + "\n" + content;
+	}
+
+	string HandleCompile(const string& output, const vector<string_t>& codes)
+	{
+		requests++;
+		auto begin = Clock::now();
+		bool hit = false;
+		auto result = cache.Get(codes, hit);
+		string response;
+
+		// a result in the cache is served without waiting for a job if the output is already generated
+		if (hit)
+		{
+			cacheHits++;
+			lock_guard<mutex> guard(result->lock);
+			auto it = result->outputs.find(output);
+			if (it != result->outputs.end())
+			{
+				response = it->second;
+			}
+		}
+
+		if (response == "")
+		{
+			auto queueBegin = Clock::now();
+			if (!AcquireJob())
+			{
+				rejected++;
+				return "busy\n";
+			}
+			queueLatency.Add(MillisecondsSince(queueBegin));
+
+			try
+			{
+				// requests for the same modules compile only once
+				call_once(result->compiled, [&]() { Compile(*result, codes); });
+				if (!result->ast)
+				{
+					response = Respond("failed", result->errors);
+				}
+				else
+				{
+					lock_guard<mutex> guard(result->lock);
+					auto it = result->outputs.find(output);
+					if (it == result->outputs.end())
+					{
+						it = result->outputs.insert(make_pair(output, Respond("ok", output == "errors" ? "" : GenerateOutput(result->ast, output)))).first;
+					}
+					response = it->second;
+				}
+			}
+			catch (...)
+			{
+				failures++;
+				response = Respond("failed", "0:0:0: Internal compiler error.\n");
+			}
+			ReleaseJob();
+		}
+
+		requestLatency.Add(MillisecondsSince(begin));
+		return response;
+	}
+
+public:
+	CompileServer(SymbolAssembly::Ptr _library, int _maxAlternatives, int _jobLimit, int _queueLimit, int cacheCapacity)
+		:library(_library)
+		, maxAlternatives(_maxAlternatives)
+		, cache(cacheCapacity)
+		, jobLimit(_jobLimit)
+		, queueLimit(_queueLimit)
+	{
+	}
+
+	void WriteStatistics(ostream& o)
+	{
+		{
+			lock_guard<mutex> guard(jobLock);
+			o << "jobs: " << activeJobs << " running, " << waitingJobs << " waiting, limits " << jobLimit << " running and " << queueLimit << " waiting" << endl;
+		}
+		o << "requests: " << requests << " received, " << cacheHits << " cache hits, " << rejected << " busy, " << failures << " internal errors" << endl;
+		requestLatency.Write(o, "request");
+		queueLatency.Write(o, "queue");
+		compileLatency.Write(o, "compile");
+		outputLatency.Write(o, "output");
+	}
+
+	// serves requests until the connection is closed or quit is received
+	void Serve(Channel& channel)
+	{
+		string line;
+		while (channel.ReadLine(line))
+		{
+			stringstream command(line);
+			string name, output;
+			int count = -1;
+			command >> name;
+
+			string response;
+			if (name == "")
+			{
+				continue;
+			}
+			else if (name == "quit")
+			{
+				return;
+			}
+			else if (name == "stats")
+			{
+				stringstream o;
+				WriteStatistics(o);
+				response = Respond("ok", o.str());
+			}
+			else if (name == "compile" && (command >> output >> count) && count >= 0)
+			{
+				vector<string_t> codes;
+				for (int i = 0; i < count; i++)
+				{
+					string length, code;
+					if (!channel.ReadLine(length) || !channel.ReadBytes((size_t)atoll(length.c_str()), code))
+					{
+						return;
+					}
+					codes.push_back(atow(code));
+				}
+
+				if (output == "errors" || output == "ast" || output == "csharp" || output == "cpp")
+				{
+					response = HandleCompile(output, codes);
+				}
+				else
+				{
+					response = Respond("bad", "Unknown output \"" + output + "\".\n");
+				}
+			}
+			else
+			{
+				response = Respond("bad", "Unknown request \"" + line + "\".\n");
+			}
+
+			if (!channel.Write(response))
+			{
+				return;
+			}
+		}
+	}
+};
+
+/*************************************************************
+Main
+*************************************************************/
+
+string_t ReadAnsiFile(const string& fileName)
+{
+	ifstream i(fileName, ios_base::binary);
+	stringstream o;
+	o << i.rdbuf();
+	return atow(o.str());
+}
+
+int ServeSocket(CompileServer& server, const string& path)
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+	{
+		cerr << "Socket path is too long: " << path << endl;
+		return 1;
+	}
+	strcpy(address.sun_path, path.c_str());
+
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	unlink(path.c_str());
+	if (listener == -1 || ::bind(listener, (sockaddr*)&address, sizeof(address)) == -1 || listen(listener, SOMAXCONN) == -1)
+	{
+		cerr << "Failed to listen on " << path << ": " << strerror(errno) << endl;
+		return 1;
+	}
+
+	while (true)
+	{
+		int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+		if (connection == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			cerr << "Failed to accept a connection: " << strerror(errno) << endl;
+			return 1;
+		}
+
+		// a connection only waits for reading and writing, compiling is limited by jobs in the server
+		thread([&server, connection]()
+		{
+			Channel channel(connection, connection);
+			server.Serve(channel);
+			close(connection);
+		}).detach();
+	}
+}
+
+int main(int argc, char* args[])
+{
+	vector<string> libraries;
+	string socketPath;
+	int jobs = (int)thread::hardware_concurrency();
+	int queue = 64;
+	int cacheCapacity = 32;
+	int maxAlternatives = 10000;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = args[i];
+		if (i + 1 == argc)
+		{
+			cerr << "Missing value for " << arg << endl;
+			return 1;
+		}
+		string value = args[++i];
+		if (arg == "--library")
+		{
+			libraries.push_back(value);
+		}
+		else if (arg == "--socket")
+		{
+			socketPath = value;
+		}
+		else if (arg == "--jobs")
+		{
+			jobs = atoi(value.c_str());
+		}
+		else if (arg == "--queue")
+		{
+			queue = atoi(value.c_str());
+		}
+		else if (arg == "--cache")
+		{
+			cacheCapacity = atoi(value.c_str());
+		}
+		else if (arg == "--max-alternatives")
+		{
+			maxAlternatives = atoi(value.c_str());
+		}
+		else
+		{
+			cerr << "Unknown option " << arg << endl;
+			return 1;
+		}
+	}
+	if (libraries.size() == 0)
+	{
+		libraries.push_back("../Library/StandardLibrary.txt");
+	}
+	if (jobs <= 0)
+	{
+		jobs = 1;
+	}
+
+	auto begin = Clock::now();
+	vector<string_t> codes;
+	for (auto library : libraries)
+	{
+		codes.push_back(ReadAnsiFile(library));
+	}
+	CodeError::List errors;
+	auto library = SymbolAssembly::Parse(codes, errors, maxAlternatives);
+	if (errors.size() > 0)
+	{
+		for (auto& error : errors)
+		{
+			cerr << libraries[error.position.codeIndex] << ":" << error.position.row << ":" << error.position.column << ": " << wtoa(error.message) << endl;
+		}
+		return 1;
+	}
+	cerr << "libraries are parsed in " << MillisecondsSince(begin) << " ms" << endl;
+
+	// a client closing the connection should not kill the server
+	signal(SIGPIPE, SIG_IGN);
+
+	CompileServer server(library, maxAlternatives, jobs, queue, cacheCapacity);
+	if (socketPath != "")
+	{
+		return ServeSocket(server, socketPath);
+	}
+
+	Channel channel(STDIN_FILENO, STDOUT_FILENO);
+	server.Serve(channel);
+	server.WriteStatistics(cerr);
+	return 0;
+}
@@ -30,6 +30,33 @@ private:
 	map<AstDeclaration*, string_t>					resolvedNames;
 	map<pair<AstDeclaration*, string_t>, int>		scopedAppearCount;
 public:
+	vector<tuple<string_t, string_t, string_t>>		sites;
+	set<AstDeclaration*>							dispatchRoots;
+	map<AstDeclaration*, string_t>					dispatchSiteArguments;
+
+	string_t AllocateSite(const string_t& typeName, const string_t& siteName, const string_t& arguments)
+	{
+		string_t name = Resolve(siteName, nullptr);
+		sites.push_back(make_tuple(typeName, name, arguments));
+		return name;
+	}
+
+	string_t AllocateFieldSite(const string_t& fieldName)
+	{
+		return AllocateSite(T("TinymoeFieldSite"), T("__field_site"), T("\"") + fieldName + T("\""));
+	}
+
+	string_t AllocateDispatchSite()
+	{
+		return AllocateSite(T("TinymoeDispatchSite"), T("__dispatch_site"), T(""));
+	}
+
+	// a root function of a dispatch table looks up its target with the site of its caller, so callers passing different types do not share one cache
+	string_t AllocateCallerDispatchSite(AstDeclaration* decl)
+	{
+		return dispatchRoots.find(decl) == dispatchRoots.end() ? T("") : AllocateDispatchSite();
+	}
+
 	void Scope(AstDeclaration* decl, AstDeclaration* scope)
 	{
 		declScopes.insert(make_pair(decl, scope));
@@ -57,33 +84,23 @@ public:
 		}
 	}
 
-	string_t Resolve(AstDeclaration* decl)
+	const string_t& Resolve(AstDeclaration* decl)
 	{
 		auto it = resolvedNames.find(decl);
 		if (it == resolvedNames.end())
 		{
-			stringstream_t ss;
-			for (auto c : decl->composedName)
+			string_t name = decl->composedName;
+			for (auto& c : name)
 			{
-				if (T('a') <= c && c <= T('z') || T('A') <= c && c <= T('Z') || T('0') <= c && c <= T('9') || c == T('_'))
+				if (!(T('a') <= c && c <= T('z') || T('A') <= c && c <= T('Z') || T('0') <= c && c <= T('9') || c == T('_')))
 				{
-					ss << c;
-				}
-				else
-				{
-					ss << T('_');
+					c = T('_');
 				}
 			}
-			string_t name = ss.str();
 			auto scope = declScopes.find(decl)->second;
-			string_t declName = Resolve(name, scope);
-			resolvedNames.insert(make_pair(decl, declName));
-			return declName;
-		}
-		else
-		{
-			return it->second;
+			it = resolvedNames.insert(make_pair(decl, Resolve(name, scope))).first;
 		}
+		return it->second;
 	}
 };
 
@@ -91,10 +108,11 @@ class CSharpTypeCodegen :public AstTypeVisitor
 {
 public:
 	CSharpNameResolver&		resolver;
-	string_t				result;
+	Emitter&				o;
 
-	CSharpTypeCodegen(CSharpNameResolver& _resolver)
+	CSharpTypeCodegen(CSharpNameResolver& _resolver, Emitter& _o)
 		:resolver(_resolver)
+		, o(_o)
 	{
 	}
 
@@ -103,91 +121,96 @@ public:
 		switch (node->typeName)
 		{
 		case AstPredefinedTypeName::Object:
-			result = T("TinymoeObject");
+			o << T("TinymoeObject");
 			break;
 		case AstPredefinedTypeName::Symbol:
-			result = T("TinymoeSymbol");
+			o << T("TinymoeSymbol");
 			break;
 		case AstPredefinedTypeName::Array:
-			result = T("TinymoeArray");
+			o << T("TinymoeArray");
 			break;
 		case AstPredefinedTypeName::Boolean:
-			result = T("TinymoeBoolean");
+			o << T("TinymoeBoolean");
 			break;
 		case AstPredefinedTypeName::Integer:
-			result = T("TinymoeInteger");
+			o << T("TinymoeInteger");
 			break;
 		case AstPredefinedTypeName::Float:
-			result = T("TinymoeFloat");
+			o << T("TinymoeFloat");
 			break;
 		case AstPredefinedTypeName::String:
-			result = T("TinymoeString");
+			o << T("TinymoeString");
 			break;
 		case AstPredefinedTypeName::Function:
-			result = T("TinymoeFunction");
+			o << T("TinymoeFunction");
 			break;
 		}
 	}
 
 	void Visit(AstReferenceType* node)override
 	{
-		result = resolver.Resolve(node->typeDeclaration.lock().get());
-	}
-
-	static string_t ToString(AstType::Ptr type, CSharpNameResolver& _resolver)
-	{
-		CSharpTypeCodegen codegen(_resolver);
-		type->Accept(&codegen);
-		return codegen.result;
+		o << resolver.Resolve(node->typeDeclaration.lock().get());
 	}
 };
 
-string_t FunctionToName(CSharpNameResolver& resolver, AstFunctionDeclaration* decl)
+void PrintType(AstType::Ptr type, CSharpNameResolver& resolver, Emitter& o)
+{
+	CSharpTypeCodegen codegen(resolver, o);
+	type->Accept(&codegen);
+}
+
+const string_t& FunctionToName(CSharpNameResolver& resolver, AstFunctionDeclaration* decl)
 {
 	return resolver.Resolve(decl);
 }
 
-string_t FunctionToTypedName(CSharpNameResolver& resolver, AstFunctionDeclaration* decl)
+void PrintFunctionTypedName(CSharpNameResolver& resolver, AstFunctionDeclaration* decl, Emitter& o)
 {
-	auto methodName = FunctionToName(resolver, decl);
-	return (decl->ownerType ? CSharpTypeCodegen::ToString(decl->ownerType, resolver) + T("__") : T("")) + methodName;
+	// resolving allocates names, so the method is resolved before the owner type
+	auto& methodName = FunctionToName(resolver, decl);
+	if (decl->ownerType)
+	{
+		PrintType(decl->ownerType, resolver, o);
+		o << T("__");
+	}
+	o << methodName;
 }
 
-string_t FunctionToValue(CSharpNameResolver& resolver, AstFunctionDeclaration* decl, AstDeclaration* scope)
+void PrintFunctionValue(CSharpNameResolver& resolver, AstFunctionDeclaration* decl, AstDeclaration* scope, Emitter& o)
 {
-	stringstream_t ss;
 	string_t argumentName = resolver.Resolve(T("__args__"), scope);
-	ss << T("new TinymoeFunction(") << argumentName << T(" => ") << FunctionToTypedName(resolver, decl) << T("(");
+	o << T("new TinymoeFunction(") << argumentName << T(" => ");
+	PrintFunctionTypedName(resolver, decl, o);
+	o << T("(");
 	for (auto it = decl->arguments.begin(); it != decl->arguments.end(); it++)
 	{
-		ss << argumentName << T("[") << it - decl->arguments.begin() << T("]");
-		if (it + 1 == decl->arguments.end())
-		{
-			ss << T("))");
-		}
-		else
+		if (it != decl->arguments.begin())
 		{
-			ss << T(", ");
+			o << T(", ");
 		}
+		o << argumentName << T("[") << it - decl->arguments.begin() << T("]");
 	}
-	return ss.str();
+	auto site = resolver.AllocateCallerDispatchSite(decl);
+	if (site != T(""))
+	{
+		o << T(", ") << site;
+	}
+	o << T("))");
 }
 
-void PrintExpression(AstExpression::Ptr expression, AstDeclaration* scope, CSharpNameResolver& resolver, ostream_t& o, string_t prefix);
-void PrintStatement(AstStatement::Ptr statement, AstDeclaration* scope, CSharpNameResolver& resolver, ostream_t& o, string_t prefix, bool block, bool last);
+void PrintExpression(AstExpression::Ptr expression, AstDeclaration* scope, CSharpNameResolver& resolver, Emitter& o);
+void PrintStatement(AstStatement::Ptr statement, AstDeclaration* scope, CSharpNameResolver& resolver, Emitter& o, bool block, bool last);
 
 class CSharpExpressionCodegen :public AstExpressionVisitor
 {
 public:
 	CSharpNameResolver&		resolver;
-	ostream_t&				o;
-	string_t				prefix;
+	Emitter&				o;
 	AstDeclaration*			scope;
 
-	CSharpExpressionCodegen(CSharpNameResolver& _resolver, ostream_t& _o, string_t _prefix, AstDeclaration* _scope)
+	CSharpExpressionCodegen(CSharpNameResolver& _resolver, Emitter& _o, AstDeclaration* _scope)
 		:resolver(_resolver)
 		, o(_o)
-		, prefix(_prefix)
 		, scope(_scope)
 	{
 	}
@@ -196,7 +219,7 @@ public:
 	{
 		for (auto it = exprs.begin(); it != exprs.end(); it++)
 		{
-			PrintExpression(*it, scope, resolver, o, prefix);
+			PrintExpression(*it, scope, resolver, o);
 			if (it + 1 != exprs.end())
 			{
 				o << T(", ");
@@ -243,9 +266,9 @@ public:
 	void Visit(AstReferenceExpression* node)
 	{
 		auto decl = node->reference.lock();
-		if (auto func = dynamic_pointer_cast<AstFunctionDeclaration>(decl))
+		if (auto func = AstNodeCast<AstFunctionDeclaration>(decl))
 		{
-			o << FunctionToValue(resolver, func.get(), scope);
+			PrintFunctionValue(resolver, func.get(), scope, o);
 		}
 		else
 		{
@@ -255,7 +278,9 @@ public:
 
 	void Visit(AstNewTypeExpression* node)
 	{
-		o << T("new ") << CSharpTypeCodegen::ToString(node->type, resolver) << T("().SetFields(new TinymoeObject[] {");
+		o << T("new ");
+		PrintType(node->type, resolver, o);
+		o << T("().SetFields(new TinymoeObject[] {");
 		PrintExpressionList(node->fields);
 		o << T("}).FinishConstruction()");
 	}
@@ -263,14 +288,16 @@ public:
 	void Visit(AstTestTypeExpression* node)
 	{
 		o << T("new TinymoeBoolean(");
-		PrintExpression(node->target, scope, resolver, o, prefix);
-		o << T(" is ") << CSharpTypeCodegen::ToString(node->type, resolver) << T(")");
+		PrintExpression(node->target, scope, resolver, o);
+		o << T(" is ");
+		PrintType(node->type, resolver, o);
+		o << T(")");
 	}
 
 	void Visit(AstNewArrayExpression* node)
 	{
 		o << T("new TinymoeArray(((TinymoeInteger)CastToInteger(");
-		PrintExpression(node->length, scope, resolver, o, prefix);
+		PrintExpression(node->length, scope, resolver, o);
 		o << T(")).Value)");
 	}
 
@@ -284,75 +311,284 @@ public:
 	void Visit(AstArrayLengthExpression* node)
 	{
 		o << T("ArrayLength(");
-		PrintExpression(node->target, scope, resolver, o, prefix);
+		PrintExpression(node->target, scope, resolver, o);
 		o << T(")");
 	}
 
 	void Visit(AstArrayAccessExpression* node)
 	{
 		o << T("ArrayGet(");
-		PrintExpression(node->target, scope, resolver, o, prefix);
+		PrintExpression(node->target, scope, resolver, o);
 		o << T(", ");
-		PrintExpression(node->index, scope, resolver, o, prefix);
+		PrintExpression(node->index, scope, resolver, o);
 		o << T(")");
 	}
 
 	void Visit(AstFieldAccessExpression* node)
 	{
-		o << T("GetField(");
-		PrintExpression(node->target, scope, resolver, o, prefix);
-		o << T(", \"") << node->composedFieldName << T("\")");
+		o << resolver.AllocateFieldSite(node->composedFieldName) << T(".Get(");
+		PrintExpression(node->target, scope, resolver, o);
+		o << T(")");
 	}
 
 	void Visit(AstInvokeExpression* node)
 	{
 		AstFunctionDeclaration::Ptr func;
-		if (auto ref = dynamic_pointer_cast<AstReferenceExpression>(node->function))
+		if (auto ref = AstNodeCast<AstReferenceExpression>(node->function))
 		{
-			func = dynamic_pointer_cast<AstFunctionDeclaration>(ref->reference.lock());
+			func = AstNodeCast<AstFunctionDeclaration>(ref->reference.lock());
 		}
 
+		auto external = AstNodeCast<AstExternalSymbolExpression>(node->function);
+		auto itbegin = node->arguments.begin();
 		if (func)
 		{
-			o << FunctionToName(resolver, func.get()) << T("(") << endl;
+			o << FunctionToName(resolver, func.get()) << T("(\n");
+		}
+		else if (external && external->directStyle)
+		{
+			o << T("InvokeExternal(\"") << external->name << T("\", new TinymoeObject[] {\n");
+			itbegin++;
 		}
 		else
 		{
 			o << T("Invoke(");
-			PrintExpression(node->function, scope, resolver, o, prefix);
-			o << T(", new TinymoeObject[] {") << endl;
+			PrintExpression(node->function, scope, resolver, o);
+			o << T(", new TinymoeObject[] {\n");
 		}
-		for (auto it = node->arguments.begin(); it != node->arguments.end(); it++)
+		o.PushIndentation();
+		for (auto it = itbegin; it != node->arguments.end(); it++)
 		{
-			o << prefix << T("\t");
-			PrintExpression(*it, scope, resolver, o, prefix + T("\t"));
+			o.Indent();
+			PrintExpression(*it, scope, resolver, o);
 			if (it + 1 != node->arguments.end())
 			{
-				o << T(",") << endl;
+				o << T(",\n");
 			}
 		}
 		if (func)
 		{
-			o << endl << prefix << T("\t)");
-		}
-		else
-		{
-			o << endl << prefix << T("\t})");
+			auto site = resolver.AllocateCallerDispatchSite(func.get());
+			if (site != T(""))
+			{
+				o << T(",\n");
+				o.Indent() << site;
+			}
 		}
+		o << T("\n");
+		o.Indent() << (func ? T(")") : T("})"));
+		o.PopIndentation();
 	}
 
 	void Visit(AstLambdaExpression* node)
 	{
 		string_t argumentName = resolver.Resolve(T("__args__"), scope);
-		o << T("new TinymoeFunction(") << argumentName << T(" => ") << endl;
-		o << prefix << T("{") << endl;
+		o << T("new TinymoeFunction(") << argumentName << T(" => \n");
+		o.Indent() << T("{\n");
 		for (auto it = node->arguments.begin(); it != node->arguments.end(); it++)
 		{
 			resolver.Scope(it->get(), scope);
-			o << prefix << T("\tTinymoeObject ") << resolver.Resolve(it->get()) << T(" = ") << argumentName << T("[") << it - node->arguments.begin() << T("];") << endl;
+			o.Indent() << T("\tTinymoeObject ") << resolver.Resolve(it->get()) << T(" = ") << argumentName << T("[") << it - node->arguments.begin() << T("];\n");
+		}
+		o.PushIndentation();
+		PrintStatement(node->statement, scope, resolver, o, true, true);
+		o.PopIndentation();
+		o << T("\n");
+		o.Indent() << T("})");
+	}
+
+	// a dispatch expression only appears in the body of the root function of its table, which takes the site of its caller
+	void Visit(AstDispatchExpression* node)
+	{
+		auto it = resolver.dispatchSiteArguments.find(scope);
+		auto site = it == resolver.dispatchSiteArguments.end() ? resolver.AllocateDispatchSite() : it->second;
+		o << resolver.Resolve(node->table.lock().get()) << T(".Lookup(") << site << T(", new TinymoeObject[] {");
+		PrintExpressionList(node->arguments);
+		o << T("})");
+	}
+
+	void PrintPrimitiveOperand(AstExpression::Ptr operand, const char_t* operandType)
+	{
+		o << T("((") << operandType << T(")");
+		PrintExpression(operand, scope, resolver, o);
+		o << T(").Value");
+	}
+
+	void Visit(AstPrimitiveExpression* node)
+	{
+		enum { Prefix, Infix, Call } style = Infix;
+		const char_t* operandType = nullptr;
+		const char_t* resultType = nullptr;
+		const char_t* op = nullptr;
+		switch (node->op)
+		{
+		case AstPrimitiveOperator::IntegerPositive:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("+");
+			style = Prefix;
+			break;
+		case AstPrimitiveOperator::FloatPositive:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeFloat");
+			op = T("+");
+			style = Prefix;
+			break;
+		case AstPrimitiveOperator::IntegerNegative:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("-");
+			style = Prefix;
+			break;
+		case AstPrimitiveOperator::FloatNegative:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeFloat");
+			op = T("-");
+			style = Prefix;
+			break;
+		case AstPrimitiveOperator::BooleanNot:
+			operandType = T("TinymoeBoolean");
+			resultType = T("TinymoeBoolean");
+			op = T("!");
+			style = Prefix;
+			break;
+		case AstPrimitiveOperator::StringConcat:
+			operandType = T("TinymoeString");
+			resultType = T("TinymoeString");
+			op = T("+");
+			break;
+		case AstPrimitiveOperator::IntegerAdd:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("+");
+			break;
+		case AstPrimitiveOperator::FloatAdd:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeFloat");
+			op = T("+");
+			break;
+		case AstPrimitiveOperator::IntegerSub:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("-");
+			break;
+		case AstPrimitiveOperator::FloatSub:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeFloat");
+			op = T("-");
+			break;
+		case AstPrimitiveOperator::IntegerMul:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("*");
+			break;
+		case AstPrimitiveOperator::FloatMul:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeFloat");
+			op = T("*");
+			break;
+		case AstPrimitiveOperator::IntegerDiv:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeFloat");
+			op = T("/");
+			break;
+		case AstPrimitiveOperator::FloatDiv:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeFloat");
+			op = T("/");
+			break;
+		case AstPrimitiveOperator::IntegerIntDiv:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("/");
+			break;
+		case AstPrimitiveOperator::IntegerMod:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("%");
+			break;
+		case AstPrimitiveOperator::IntegerEqual:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeBoolean");
+			op = T("==");
+			break;
+		case AstPrimitiveOperator::FloatEqual:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeBoolean");
+			op = T("==");
+			break;
+		case AstPrimitiveOperator::StringEqual:
+			operandType = T("TinymoeString");
+			resultType = T("TinymoeBoolean");
+			op = T("==");
+			break;
+		case AstPrimitiveOperator::BooleanEqual:
+			operandType = T("TinymoeBoolean");
+			resultType = T("TinymoeBoolean");
+			op = T("==");
+			break;
+		case AstPrimitiveOperator::IntegerCompare:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("i_c_i");
+			style = Call;
+			break;
+		case AstPrimitiveOperator::FloatCompare:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeInteger");
+			op = T("f_c_f");
+			style = Call;
+			break;
+		case AstPrimitiveOperator::StringCompare:
+			operandType = T("TinymoeString");
+			resultType = T("TinymoeInteger");
+			op = T("s_c_s");
+			style = Call;
+			break;
+		case AstPrimitiveOperator::BooleanAnd:
+			operandType = T("TinymoeBoolean");
+			resultType = T("TinymoeBoolean");
+			op = T("&&");
+			break;
+		case AstPrimitiveOperator::BooleanOr:
+			operandType = T("TinymoeBoolean");
+			resultType = T("TinymoeBoolean");
+			op = T("||");
+			break;
+		case AstPrimitiveOperator::IntegerToFloat:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeFloat");
+			op = T("(double)");
+			style = Prefix;
+			break;
+		}
+
+		// operands are proven to be of the operand type, so the operation is compiled to C# arithmetic without any dispatching
+		o << T("new ") << resultType << T("(");
+		switch (style)
+		{
+		case Prefix:
+			o << op;
+			PrintPrimitiveOperand(node->operands[0], operandType);
+			break;
+		case Infix:
+			if (node->op == AstPrimitiveOperator::IntegerDiv)
+			{
+				o << T("(double)");
+			}
+			PrintPrimitiveOperand(node->operands[0], operandType);
+			o << T(" ") << op << T(" ");
+			PrintPrimitiveOperand(node->operands[1], operandType);
+			break;
+		case Call:
+			o << op << T("(");
+			PrintPrimitiveOperand(node->operands[0], operandType);
+			o << T(", ");
+			PrintPrimitiveOperand(node->operands[1], operandType);
+			o << T(")");
+			break;
 		}
-		PrintStatement(node->statement, scope, resolver, o, prefix + T("\t"), true, true);
-		o << endl << prefix << T("})");
+		o << T(")");
 	}
 };
 
@@ -360,15 +596,13 @@ class CSharpSetExpressionCodegen :public AstExpressionVisitor
 {
 public:
 	CSharpNameResolver&		resolver;
-	ostream_t&				o;
-	string_t					prefix;
+	Emitter&				o;
 	AstDeclaration*			scope;
 	AstExpression::Ptr		value;
 
-	CSharpSetExpressionCodegen(CSharpNameResolver& _resolver, ostream_t& _o, string_t _prefix, AstDeclaration* _scope, AstExpression::Ptr _value)
+	CSharpSetExpressionCodegen(CSharpNameResolver& _resolver, Emitter& _o, AstDeclaration* _scope, AstExpression::Ptr _value)
 		:resolver(_resolver)
 		, o(_o)
-		, prefix(_prefix)
 		, scope(_scope)
 		, value(_value)
 	{
@@ -402,16 +636,16 @@ public:
 	void Visit(AstReferenceExpression* node)
 	{
 		auto decl = node->reference.lock();
-		if (auto func = dynamic_pointer_cast<AstFunctionDeclaration>(decl))
+		if (auto func = AstNodeCast<AstFunctionDeclaration>(decl))
 		{
-			o << FunctionToValue(resolver, func.get(), scope);
+			PrintFunctionValue(resolver, func.get(), scope, o);
 		}
 		else
 		{
 			o << resolver.Resolve(decl.get());
 		}
 		o << T(" = ");
-		PrintExpression(value, scope, resolver, o, prefix);
+		PrintExpression(value, scope, resolver, o);
 		o << T(";");
 	}
 
@@ -443,19 +677,20 @@ public:
 	void Visit(AstArrayAccessExpression* node)
 	{
 		o << T("ArraySet(");
-		PrintExpression(node->target, scope, resolver, o, prefix);
+		PrintExpression(node->target, scope, resolver, o);
 		o << T(", ");
-		PrintExpression(node->index, scope, resolver, o, prefix);
+		PrintExpression(node->index, scope, resolver, o);
 		o << T(", ");
-		PrintExpression(value, scope, resolver, o, prefix);
+		PrintExpression(value, scope, resolver, o);
 		o << T(");");
 	}
 
 	void Visit(AstFieldAccessExpression* node)
 	{
-		PrintExpression(node->target, scope, resolver, o, prefix);
-		o << T(".SetField(\"") << node->composedFieldName << T("\", ");
-		PrintExpression(value, scope, resolver, o, prefix);
+		o << resolver.AllocateFieldSite(node->composedFieldName) << T(".Set(");
+		PrintExpression(node->target, scope, resolver, o);
+		o << T(", ");
+		PrintExpression(value, scope, resolver, o);
 		o << T(");");
 	}
 
@@ -468,22 +703,30 @@ public:
 	{
 		throw 0;
 	}
+
+	void Visit(AstDispatchExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstPrimitiveExpression* node)
+	{
+		throw 0;
+	}
 };
 
 class CSharpStatementCodegen :public AstStatementVisitor
 {
 public:
 	CSharpNameResolver&		resolver;
-	ostream_t&				o;
-	string_t				prefix;
+	Emitter&				o;
 	bool					block;
 	bool					last;
 	AstDeclaration*			scope;
 
-	CSharpStatementCodegen(CSharpNameResolver& _resolver, ostream_t& _o, string_t _prefix, bool _block, bool _last, AstDeclaration* _scope)
+	CSharpStatementCodegen(CSharpNameResolver& _resolver, Emitter& _o, bool _block, bool _last, AstDeclaration* _scope)
 		:resolver(_resolver)
 		, o(_o)
-		, prefix(_prefix)
 		, block(_block)
 		, last(_last)
 		, scope(_scope)
@@ -497,88 +740,98 @@ public:
 			for (auto it = node->statements.begin(); it != node->statements.end(); it++)
 			{
 				bool lastStatement = it + 1 == node->statements.end();
-				PrintStatement(*it, scope, resolver, o, prefix, false, lastStatement && last);
+				PrintStatement(*it, scope, resolver, o, false, lastStatement && last);
 				if (!lastStatement)
 				{
-					o << endl;
+					o << T("\n");
 				}
 			}
 		}
 		else
 		{
-			o << prefix << T("{") << endl;
+			o.Indent() << T("{\n");
+			o.PushIndentation();
 			for (auto it = node->statements.begin(); it != node->statements.end(); it++)
 			{
 				bool lastStatement = it + 1 == node->statements.end();
-				PrintStatement(*it, scope, resolver, o, prefix + T("\t"), false, lastStatement && last);
-				o << endl;
+				PrintStatement(*it, scope, resolver, o, false, lastStatement && last);
+				o << T("\n");
 			}
-			o << prefix << T("}");
+			o.PopIndentation();
+			o.Indent() << T("}");
 		}
 	}
 
 	void Visit(AstExpressionStatement* node)
 	{
-		o << prefix;
+		o.Indent();
 		if (last)
 		{
-			o << "return () => ";
+			o << T("return () => ");
 		}
-		PrintExpression(node->expression, scope, resolver, o, prefix);
+		PrintExpression(node->expression, scope, resolver, o);
 		o << T(";");
 	}
 
 	void Visit(AstDeclarationStatement* node)
 	{
 		resolver.Scope(node->declaration.get(), scope);
-		o << prefix << T("TinymoeObject ") << resolver.Resolve(node->declaration.get()) << T(" = null;");
+		o.Indent() << T("TinymoeObject ") << resolver.Resolve(node->declaration.get()) << T(" = null;");
 	}
 
 	void Visit(AstAssignmentStatement* node)
 	{
-		o << prefix;
-		CSharpSetExpressionCodegen codegen(resolver, o, prefix, scope, node->value);
+		o.Indent();
+		CSharpSetExpressionCodegen codegen(resolver, o, scope, node->value);
 		node->target->Accept(&codegen);
 	}
 
 	void Visit(AstIfStatement* node)
 	{
 		AstIfStatement* current = node;
-		o << prefix;
+		o.Indent();
 		while (true)
 		{
 			o << T("if (((TinymoeBoolean)CastToBoolean(");
-			PrintExpression(current->condition, scope, resolver, o, prefix);
-			o << T(")).Value)") << endl;
-			o << prefix << T("{") << endl;
-			PrintStatement(current->trueBranch, scope, resolver, o, prefix + T("\t"), true, last);
-			o << endl << prefix << T("}");
-
-			auto nextCurrent = dynamic_cast<AstIfStatement*>(current->falseBranch.get());
+			PrintExpression(current->condition, scope, resolver, o);
+			o << T(")).Value)\n");
+			o.Indent() << T("{\n");
+			o.PushIndentation();
+			PrintStatement(current->trueBranch, scope, resolver, o, true, last);
+			o.PopIndentation();
+			o << T("\n");
+			o.Indent() << T("}");
+
+			auto nextCurrent = AstNodeCast<AstIfStatement>(current->falseBranch).get();
 			if (!nextCurrent) break;
-			o << endl << prefix << T("else ");
+			o << T("\n");
+			o.Indent() << T("else ");
 			current = nextCurrent;
 		}
 
 		if (current->falseBranch)
 		{
-			o << endl << prefix << T("else") << endl;
-			o << prefix << T("{") << endl;
-			PrintStatement(current->falseBranch, scope, resolver, o, prefix + T("\t"), true, last);
-			o << endl << prefix << T("}");
+			o << T("\n");
+			o.Indent() << T("else\n");
+			o.Indent() << T("{\n");
+			o.PushIndentation();
+			PrintStatement(current->falseBranch, scope, resolver, o, true, last);
+			o.PopIndentation();
+			o << T("\n");
+			o.Indent() << T("}");
 		}
 	}
 };
 
-void PrintExpression(AstExpression::Ptr expression, AstDeclaration* scope, CSharpNameResolver& resolver, ostream_t& o, string_t prefix)
+void PrintExpression(AstExpression::Ptr expression, AstDeclaration* scope, CSharpNameResolver& resolver, Emitter& o)
 {
-	CSharpExpressionCodegen codegen(resolver, o, prefix, scope);
+	CSharpExpressionCodegen codegen(resolver, o, scope);
 	expression->Accept(&codegen);
 }
 
-void PrintStatement(AstStatement::Ptr statement, AstDeclaration* scope, CSharpNameResolver& resolver, ostream_t& o, string_t prefix, bool block, bool last)
+void PrintStatement(AstStatement::Ptr statement, AstDeclaration* scope, CSharpNameResolver& resolver, Emitter& o, bool block, bool last)
 {
-	CSharpStatementCodegen codegen(resolver, o, prefix, block, last, scope);
+	CSharpStatementCodegen codegen(resolver, o, block, last, scope);
 	statement->Accept(&codegen);
 }
 
@@ -586,64 +839,80 @@ class CSharpDeclarationCodegen :public AstDeclarationVisitor
 {
 public:
 	CSharpNameResolver&		resolver;
-	ostream_t&				o;
-	string_t					prefix;
+	Emitter&				o;
 
-	CSharpDeclarationCodegen(CSharpNameResolver& _resolver, ostream_t& _o, string_t _prefix)
+	CSharpDeclarationCodegen(CSharpNameResolver& _resolver, Emitter& _o)
 		:resolver(_resolver)
 		, o(_o)
-		, prefix(_prefix)
 	{
 	}
 
 	void Visit(AstSymbolDeclaration* node)override
 	{
-		o << prefix << T("public readonly TinymoeObject ") << resolver.Resolve(node) << T(" = new TinymoeSymbol(\"") << resolver.Resolve(node) << T("\");") << endl << endl;
+		o.Indent() << T("public readonly TinymoeObject ") << resolver.Resolve(node) << T(" = new TinymoeSymbol(\"") << resolver.Resolve(node) << T("\");\n\n");
 	}
 
 	void Visit(AstTypeDeclaration* node)override
 	{
-		o << prefix << T("public class ") << resolver.Resolve(node);
+		o.Indent() << T("public class ") << resolver.Resolve(node);
 		if (node->baseType.expired())
 		{
-			o << T(" : TinymoeObject") << endl;
+			o << T(" : TinymoeObject\n");
 		}
 		else
 		{
-			o << T(" : ") << CSharpTypeCodegen::ToString(node->baseType.lock(), resolver) << endl;
+			o << T(" : ");
+			PrintType(node->baseType.lock(), resolver, o);
+			o << T("\n");
 		}
-		o << prefix << T("{") << endl;
-		o << prefix << T("\tpublic ") << resolver.Resolve(node) << T("()") << endl;
-		o << prefix << T("\t{") << endl;
+		o.Indent() << T("{\n");
+		o.Indent() << T("\tpublic ") << resolver.Resolve(node) << T("()\n");
+		o.Indent() << T("\t{\n");
 		for (auto field : node->fields)
 		{
 			resolver.Scope(field.get(), node);
-			o << prefix << T("\t\tSetField(\"") << resolver.Resolve(field.get()) << T("\", null);") << endl;
+			o.Indent() << T("\t\tSetField(\"") << resolver.Resolve(field.get()) << T("\", null);\n");
 		}
-		o << prefix << T("\t}") << endl;
-		o << prefix << T("}") << endl << endl;
+		o.Indent() << T("\t}\n");
+		o.Indent() << T("}\n\n");
 	}
 
 	void Visit(AstFunctionDeclaration* node)override
 	{
-		o << prefix << T("public TinymoeContinuation ") << FunctionToTypedName(resolver, node) << T("(");
+		o.Indent() << (node->continuationArgument ? T("public TinymoeContinuation ") : T("public TinymoeObject "));
+		PrintFunctionTypedName(resolver, node, o);
+		o << T("(");
 		for (auto it = node->arguments.begin(); it != node->arguments.end(); it++)
 		{
 			resolver.Scope(it->get(), node);
-			o << T("TinymoeObject ") << resolver.Resolve(it->get());
-			if (it + 1 == node->arguments.end())
-			{
-				o << T(")") << endl;
-			}
-			else
+			if (it != node->arguments.begin())
 			{
 				o << T(", ");
 			}
+			o << T("TinymoeObject ") << resolver.Resolve(it->get());
+		}
+		if (resolver.dispatchRoots.find(node) != resolver.dispatchRoots.end())
+		{
+			auto site = resolver.Resolve(T("__site__"), node);
+			resolver.dispatchSiteArguments.insert(make_pair(node, site));
+			o << T(", TinymoeDispatchSite ") << site;
+		}
+		o << T(")\n");
+		o.Indent() << T("{\n");
+		o.PushIndentation();
+		PrintStatement(node->statement, node, resolver, o, true, (bool)node->continuationArgument);
+		o.PopIndentation();
+		o << T("\n");
+		if (!node->continuationArgument)
+		{
+			o.Indent() << T("\treturn ") << resolver.Resolve(node->resultVariable.get()) << T(";\n");
 		}
-		o << prefix << T("{") << endl;
-		PrintStatement(node->statement, node, resolver, o, prefix + T("\t"), true, true);
-		o << endl;
-		o << prefix << T("}") << endl << endl;
+		o.Indent() << T("}\n\n");
+	}
+
+	void Visit(AstDispatchTableDeclaration* node)override
+	{
+		o.Indent() << T("public readonly TinymoeDispatchTable ") << resolver.Resolve(node) << T(";\n\n");
 	}
 };
 
@@ -651,13 +920,11 @@ class CSharpExtensionDeclarationCodegen :public AstDeclarationVisitor
 {
 public:
 	CSharpNameResolver&		resolver;
-	ostream_t&				o;
-	string_t					prefix;
+	Emitter&				o;
 
-	CSharpExtensionDeclarationCodegen(CSharpNameResolver& _resolver, ostream_t& _o, string_t _prefix)
+	CSharpExtensionDeclarationCodegen(CSharpNameResolver& _resolver, Emitter& _o)
 		:resolver(_resolver)
 		, o(_o)
-		, prefix(_prefix)
 	{
 	}
 
@@ -673,53 +940,100 @@ public:
 	{
 		if (node->ownerType)
 		{
-			auto typeName = CSharpTypeCodegen::ToString(node->ownerType, resolver);
-			auto methodName = node->composedName;
-			auto targetName = FunctionToValue(resolver, node, nullptr);
-			o << prefix << T("SetExtension(") << endl;
-			o << prefix << T("\ttypeof(") << typeName << T("),") << endl;
-			o << prefix << T("\t\"") << methodName << T("\",") << endl;
-			o << prefix << T("\t") << targetName << endl;
-			o << prefix << T("\t); ") << endl;
+			o.Indent() << T("SetExtension(\n");
+			o.Indent() << T("\ttypeof(");
+			PrintType(node->ownerType, resolver, o);
+			o << T("),\n");
+			o.Indent() << T("\t\"") << node->composedName << T("\",\n");
+			o.Indent() << T("\t");
+			PrintFunctionValue(resolver, node, nullptr, o);
+			o << T("\n");
+			o.Indent() << T("\t); \n");
+		}
+	}
+
+	void Visit(AstDispatchTableDeclaration* node)override
+	{
+		o.Indent() << resolver.Resolve(node) << T(" = new TinymoeDispatchTable(\n");
+		o.Indent() << T("\tnew Type[][] {\n");
+		for (auto dimension : node->dimensions)
+		{
+			o.Indent() << T("\t\tnew Type[] {");
+			for (auto it = dimension.begin(); it != dimension.end(); it++)
+			{
+				o << T("typeof(");
+				PrintType(*it, resolver, o);
+				o << T(")");
+				if (it + 1 != dimension.end())
+				{
+					o << T(", ");
+				}
+			}
+			o << T("},\n");
+		}
+		o.Indent() << T("\t},\n");
+		o.Indent() << T("\tnew TinymoeObject[] {\n");
+		for (auto target : node->targets)
+		{
+			o.Indent() << T("\t\t");
+			PrintFunctionValue(resolver, target.lock().get(), nullptr, o);
+			o << T(",\n");
 		}
+		o.Indent() << T("\t}\n");
+		o.Indent() << T("\t);\n");
 	}
 };
 
-void GenerateCSharpCode(AstAssembly::Ptr assembly, ostream_t& o)
+void GenerateCSharpCode(AstAssembly::Ptr assembly, Emitter& o)
 {
 	CSharpNameResolver resolver;
-	o << T("using System;") << endl;
-	o << T("using System.Collections.Generic;") << endl;
-	o << T("using TinymoeDotNet;") << endl;
-	o << T("") << endl;
-	o << T("namespace TinymoeProgramNamespace") << endl;
-	o << T("{") << endl;
-	o << T("\tpublic class TinymoeProgram : TinymoeOperations") << endl;
-	o << T("\t{") << endl;
+	o << T("using System;\n");
+	o << T("using System.Collections.Generic;\n");
+	o << T("using TinymoeDotNet;\n");
+	o << T("\n");
+	o << T("namespace TinymoeProgramNamespace\n");
+	o << T("{\n");
+	o << T("\tpublic class TinymoeProgram : TinymoeOperations\n");
+	o << T("\t{\n");
 	{
 		for (auto decl : assembly->declarations)
 		{
 			resolver.Scope(decl.get(), nullptr);
+			if (auto table = AstNodeCast<AstDispatchTableDeclaration>(decl))
+			{
+				resolver.dispatchRoots.insert(table->rootFunction.lock().get());
+			}
 		}
-		CSharpDeclarationCodegen codegen(resolver, o, T("\t\t"));
+		CSharpDeclarationCodegen codegen(resolver, o);
+		o.PushIndentation(T("\t\t"));
 		for (auto decl : assembly->declarations)
 		{
 			decl->Accept(&codegen);
 		}
+		o.PopIndentation();
 	}
-	o << T("\t\tpublic TinymoeProgram()") << endl;
-	o << T("\t\t{") << endl;
+	o << T("\t\tpublic TinymoeProgram()\n");
+	o << T("\t\t{\n");
 	{
-		CSharpExtensionDeclarationCodegen codegen(resolver, o, T("\t\t\t"));
+		CSharpExtensionDeclarationCodegen codegen(resolver, o);
+		o.PushIndentation(T("\t\t\t"));
 		for (auto decl : assembly->declarations)
 		{
 			decl->Accept(&codegen);
 		}
+		o.PopIndentation();
 	}
-	o << T("\t\t}") << endl;
-	o << endl;
+	o << T("\t\t}\n");
+	o << T("\n");
+	// the constructor also allocates sites, so they are declared after it is printed
+	for (auto site : resolver.sites)
+	{
+		o << T("\t\tstatic readonly ") << get<0>(site) << T(" ") << get<1>(site) << T(" = new ") << get<0>(site) << T("(") << get<2>(site) << T(");\n");
+	}
+	o << T("\n");
 	{
 		string_t mainName;
+		bool mainDirectStyle = false;
 		for (auto decl : assembly->declarations)
 		{
 			if (decl->composedName.size() >= 6)
@@ -727,24 +1041,42 @@ void GenerateCSharpCode(AstAssembly::Ptr assembly, ostream_t& o)
 				if (decl->composedName.substr(decl->composedName.size() - 6, 6) == T("::main"))
 				{
 					mainName = resolver.Resolve(decl.get());
+					mainDirectStyle = !AstNodeCast<AstFunctionDeclaration>(decl)->continuationArgument;
 					break;
 				}
 			}
 		}
-		o << T("\t\tstatic void Main(string[] args)") << endl;
-		o << T("\t\t{") << endl;
-		o << T("\t\t\tvar program = new TinymoeProgram();") << endl;
-		o << T("\t\t\tvar continuation = new TinymoeFunction((TinymoeObject[] arguments) =>") << endl;
-		o << T("\t\t\t{") << endl;
-		o << T("\t\t\t\treturn null;") << endl;
-		o << T("\t\t\t});") << endl;
-		o << T("\t\t\tvar trap = new TinymoeProgram.standard_library__continuation_trap();") << endl;
-		o << T("\t\t\ttrap.SetField(\"continuation\", continuation);") << endl;
-		o << T("\t\t\tvar state = new TinymoeProgram.standard_library__continuation_state();") << endl;
-		o << T("\t\t\tstate.SetField(\"trap\", trap);") << endl;
-		o << T("\t\t\tRunContinuation(() => program.") << mainName << T("(state, continuation));") << endl;
-		o << T("\t\t}") << endl;
-	}
-	o << T("\t}") << endl;
-	o << T("}") << endl;
+		o << T("\t\tstatic void Main(string[] args)\n");
+		o << T("\t\t{\n");
+		o << T("\t\t\tvar program = new TinymoeProgram();\n");
+		o << T("\t\t\tvar continuation = new TinymoeFunction((TinymoeObject[] arguments) =>\n");
+		o << T("\t\t\t{\n");
+		o << T("\t\t\t\treturn null;\n");
+		o << T("\t\t\t});\n");
+		o << T("\t\t\tvar trap = new TinymoeProgram.standard_library__continuation_trap();\n");
+		o << T("\t\t\ttrap.SetField(\"continuation\", continuation);\n");
+		o << T("\t\t\tvar state = new TinymoeProgram.standard_library__continuation_state();\n");
+		o << T("\t\t\tstate.SetField(\"trap\", trap);\n");
+		if (mainDirectStyle)
+		{
+			o << T("\t\t\tprogram.") << mainName << T("(state);\n");
+		}
+		else
+		{
+			o << T("\t\t\tRunContinuation(() => program.") << mainName << T("(state, continuation));\n");
+		}
+		o << T("\t\t\tif (Environment.GetEnvironmentVariable(\"TINYMOE_FIELD_SITE_STATISTICS\") != null)\n");
+		o << T("\t\t\t{\n");
+		o << T("\t\t\t\tTinymoeFieldSite.WriteStatistics(Console.Error);\n");
+		o << T("\t\t\t}\n");
+		o << T("\t\t}\n");
+	}
+	o << T("\t}\n");
+	o << T("}\n");
+}
+
+void GenerateCSharpCode(AstAssembly::Ptr assembly, ostream_t& o)
+{
+	Emitter emitter(o);
+	GenerateCSharpCode(assembly, emitter);
 }
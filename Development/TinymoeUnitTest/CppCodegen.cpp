@@ -0,0 +1,1521 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "UnitTest.h"
+#include "../Source/Tinymoe.h"
+
+#ifndef _MSC_VER
+#include <stdlib.h>
+
+template<int Size>
+void _itoa(int value, char (&buffer)[Size], int base)
+{
+	sprintf(buffer, "%d", value);
+}
+
+template<int Size>
+void _itow(int value, char (&buffer)[Size], int base)
+{
+	sqprintf(buffer, Size - 1, "%d", value);
+}
+
+#endif
+
+using namespace tinymoe;
+using namespace tinymoe::compiler;
+using namespace tinymoe::ast;
+
+class CppNameResolver
+{
+private:
+	map<AstDeclaration*, AstDeclaration*>			declScopes;
+	map<AstDeclaration*, string_t>					resolvedNames;
+	map<pair<AstDeclaration*, string_t>, int>		scopedAppearCount;
+public:
+	vector<tuple<string_t, string_t, string_t>>		sites;
+	set<AstDeclaration*>							cellVariables;
+	set<AstDeclaration*>							dispatchRoots;
+	map<AstDeclaration*, string_t>					dispatchSiteArguments;
+
+	string_t AllocateSite(const string_t& typeName, const string_t& siteName, const string_t& arguments)
+	{
+		string_t name = Resolve(siteName, nullptr);
+		sites.push_back(make_tuple(typeName, name, arguments));
+		return name;
+	}
+
+	string_t AllocateFieldSite(const string_t& fieldName)
+	{
+		return AllocateSite(T("TinymoeFieldSite"), T("__field_site"), T("\"") + fieldName + T("\""));
+	}
+
+	string_t AllocateDispatchSite()
+	{
+		return AllocateSite(T("TinymoeDispatchSite"), T("__dispatch_site"), T(""));
+	}
+
+	// a root function of a dispatch table looks up its target with the site of its caller, so callers passing different types do not share one cache
+	string_t AllocateCallerDispatchSite(AstDeclaration* decl)
+	{
+		return dispatchRoots.find(decl) == dispatchRoots.end() ? T("") : T("&") + AllocateDispatchSite();
+	}
+
+	string_t AllocateExternalSite(const string_t& externalName)
+	{
+		return AllocateSite(T("TinymoeExternalSite"), T("__external_site"), T("\"") + externalName + T("\""));
+	}
+
+	void Scope(AstDeclaration* decl, AstDeclaration* scope)
+	{
+		declScopes.insert(make_pair(decl, scope));
+	}
+
+	string_t Resolve(string_t name, AstDeclaration* scope)
+	{
+		auto scopeName = make_pair(scope, name);
+		auto itappear = scopedAppearCount.find(scopeName);
+		if (itappear == scopedAppearCount.end())
+		{
+			scopedAppearCount.insert(make_pair(scopeName, 1));
+			return name;
+		}
+		else
+		{
+			int counter = ++itappear->second;
+			char_t buffer[20] = { 0 };
+#ifdef _UNICODE_TINYMOE
+			_itow(counter, buffer, 10);
+#else
+			_itoa(counter, buffer, 10);
+#endif
+			return name + string_t(T("_x")) + buffer;
+		}
+	}
+
+	string_t Resolve(AstDeclaration* decl)
+	{
+		static const char_t* reservedNames[] =
+		{
+			T("auto"), T("bool"), T("break"), T("case"), T("catch"), T("char"), T("class"), T("const"), T("continue"),
+			T("default"), T("delete"), T("do"), T("double"), T("else"), T("enum"), T("explicit"), T("extern"),
+			T("false"), T("float"), T("for"), T("friend"), T("goto"), T("if"), T("inline"), T("int"), T("long"),
+			T("namespace"), T("new"), T("nullptr"), T("operator"), T("private"), T("protected"), T("public"),
+			T("register"), T("return"), T("short"), T("signed"), T("sizeof"), T("static"), T("struct"), T("switch"),
+			T("template"), T("this"), T("throw"), T("true"), T("try"), T("typedef"), T("typename"), T("union"),
+			T("unsigned"), T("using"), T("virtual"), T("void"), T("volatile"), T("while"),
+			T("main"), T("Type"), T("GetType"), T("SetField"),
+		};
+
+		auto it = resolvedNames.find(decl);
+		if (it == resolvedNames.end())
+		{
+			stringstream_t ss;
+			for (auto c : decl->composedName)
+			{
+				if ((T('a') <= c && c <= T('z')) || (T('A') <= c && c <= T('Z')) || (T('0') <= c && c <= T('9')) || c == T('_'))
+				{
+					ss << c;
+				}
+				else
+				{
+					ss << T('_');
+				}
+			}
+			string_t name = ss.str();
+			for (auto reservedName : reservedNames)
+			{
+				if (name == reservedName)
+				{
+					name += T("_");
+					break;
+				}
+			}
+			auto scope = declScopes.find(decl)->second;
+			string_t declName = Resolve(name, scope);
+			resolvedNames.insert(make_pair(decl, declName));
+			return declName;
+		}
+		else
+		{
+			return it->second;
+		}
+	}
+
+	string_t ResolveVariable(AstDeclaration* decl)
+	{
+		auto name = Resolve(decl);
+		return cellVariables.find(decl) == cellVariables.end() ? name : T("Cell(") + name + T(")");
+	}
+};
+
+/*************************************************************
+Captured Variables
+*************************************************************/
+
+bool ReferencesDeclaration(AstNode* node, AstDeclaration* decl)
+{
+	if (IsAstNode<AstReferenceExpression>(node) && static_cast<AstReferenceExpression*>(node)->reference.lock().get() == decl)
+	{
+		return true;
+	}
+	bool result = false;
+	ForEachChild(node, [&](AstNode* child)
+	{
+		result = result || ReferencesDeclaration(child, decl);
+	});
+	return result;
+}
+
+// "declare x; x = value" is printed as one initialization when value does not read x, so the assignment does not make x a cell
+AstExpression::Ptr GetInitialization(AstStatement::Ptr statement, AstStatement::Ptr next)
+{
+	auto declaration = AstNodeCast<AstDeclarationStatement>(statement);
+	auto assignment = AstNodeCast<AstAssignmentStatement>(next);
+	if (!declaration || !assignment) return nullptr;
+	auto target = AstNodeCast<AstReferenceExpression>(assignment->target);
+	if (!target || target->reference.lock() != declaration->declaration) return nullptr;
+	if (ReferencesDeclaration(assignment->value.get(), declaration->declaration.get())) return nullptr;
+	return assignment->value;
+}
+
+// C++ lambdas capture by value, so a variable that is used in a lambda other than the one declaring it,
+// and is assigned after it is initialized, is stored in a shared cell, other variables are plain locals
+class CppCaptureAnalyzer : public AstExpressionVisitor, public AstStatementVisitor
+{
+public:
+	map<AstDeclaration*, AstLambdaExpression*>		owners;
+	set<AstDeclaration*>							captured;
+	set<AstDeclaration*>							assigned;
+	AstLambdaExpression*							currentLambda = nullptr;
+
+	void CollectCells(set<AstDeclaration*>& cells)
+	{
+		for (auto decl : captured)
+		{
+			if (assigned.find(decl) != assigned.end())
+			{
+				cells.insert(decl);
+			}
+		}
+	}
+
+	void Analyze(AstExpression::Ptr node)
+	{
+		if (node) node->Accept(static_cast<AstExpressionVisitor*>(this));
+	}
+
+	void Analyze(AstStatement::Ptr node)
+	{
+		if (node) node->Accept(static_cast<AstStatementVisitor*>(this));
+	}
+
+	void Analyze(AstExpression::List& nodes)
+	{
+		for (auto node : nodes)
+		{
+			Analyze(node);
+		}
+	}
+
+	void Visit(AstLiteralExpression* node)override
+	{
+	}
+
+	void Visit(AstIntegerExpression* node)override
+	{
+	}
+
+	void Visit(AstFloatExpression* node)override
+	{
+	}
+
+	void Visit(AstStringExpression* node)override
+	{
+	}
+
+	void Visit(AstExternalSymbolExpression* node)override
+	{
+	}
+
+	void Visit(AstReferenceExpression* node)override
+	{
+		auto it = owners.find(node->reference.lock().get());
+		if (it != owners.end() && it->second != currentLambda)
+		{
+			captured.insert(it->first);
+		}
+	}
+
+	void Visit(AstNewTypeExpression* node)override
+	{
+		Analyze(node->fields);
+	}
+
+	void Visit(AstTestTypeExpression* node)override
+	{
+		Analyze(node->target);
+	}
+
+	void Visit(AstNewArrayExpression* node)override
+	{
+		Analyze(node->length);
+	}
+
+	void Visit(AstNewArrayLiteralExpression* node)override
+	{
+		Analyze(node->elements);
+	}
+
+	void Visit(AstArrayLengthExpression* node)override
+	{
+		Analyze(node->target);
+	}
+
+	void Visit(AstArrayAccessExpression* node)override
+	{
+		Analyze(node->target);
+		Analyze(node->index);
+	}
+
+	void Visit(AstFieldAccessExpression* node)override
+	{
+		Analyze(node->target);
+	}
+
+	void Visit(AstInvokeExpression* node)override
+	{
+		Analyze(node->function);
+		Analyze(node->arguments);
+	}
+
+	void Visit(AstLambdaExpression* node)override
+	{
+		for (auto argument : node->arguments)
+		{
+			owners.insert(make_pair(argument.get(), node));
+		}
+		auto outerLambda = currentLambda;
+		currentLambda = node;
+		Analyze(node->statement);
+		currentLambda = outerLambda;
+	}
+
+	void Visit(AstDispatchExpression* node)override
+	{
+		Analyze(node->arguments);
+	}
+
+	void Visit(AstPrimitiveExpression* node)override
+	{
+		Analyze(node->operands);
+	}
+
+	void Visit(AstBlockStatement* node)override
+	{
+		for (auto it = node->statements.begin(); it != node->statements.end(); it++)
+		{
+			Analyze(*it);
+			if (it + 1 != node->statements.end())
+			{
+				if (auto value = GetInitialization(*it, *(it + 1)))
+				{
+					Analyze(value);
+					it++;
+				}
+			}
+		}
+	}
+
+	void Visit(AstExpressionStatement* node)override
+	{
+		Analyze(node->expression);
+	}
+
+	void Visit(AstDeclarationStatement* node)override
+	{
+		owners.insert(make_pair(node->declaration.get(), currentLambda));
+	}
+
+	void Visit(AstAssignmentStatement* node)override
+	{
+		if (auto target = AstNodeCast<AstReferenceExpression>(node->target))
+		{
+			assigned.insert(target->reference.lock().get());
+		}
+		Analyze(node->target);
+		Analyze(node->value);
+	}
+
+	void Visit(AstIfStatement* node)override
+	{
+		Analyze(node->condition);
+		Analyze(node->trueBranch);
+		Analyze(node->falseBranch);
+	}
+};
+
+/*************************************************************
+Codegen
+*************************************************************/
+
+class CppTypeCodegen :public AstTypeVisitor
+{
+public:
+	CppNameResolver&		resolver;
+	string_t				result;
+
+	CppTypeCodegen(CppNameResolver& _resolver)
+		:resolver(_resolver)
+	{
+	}
+
+	void Visit(AstPredefinedType* node)override
+	{
+		switch (node->typeName)
+		{
+		case AstPredefinedTypeName::Object:
+			result = T("TinymoeObject");
+			break;
+		case AstPredefinedTypeName::Symbol:
+			result = T("TinymoeSymbol");
+			break;
+		case AstPredefinedTypeName::Array:
+			result = T("TinymoeArray");
+			break;
+		case AstPredefinedTypeName::Boolean:
+			result = T("TinymoeBoolean");
+			break;
+		case AstPredefinedTypeName::Integer:
+			result = T("TinymoeInteger");
+			break;
+		case AstPredefinedTypeName::Float:
+			result = T("TinymoeFloat");
+			break;
+		case AstPredefinedTypeName::String:
+			result = T("TinymoeString");
+			break;
+		case AstPredefinedTypeName::Function:
+			result = T("TinymoeFunction");
+			break;
+		}
+	}
+
+	void Visit(AstReferenceType* node)override
+	{
+		result = resolver.Resolve(node->typeDeclaration.lock().get());
+	}
+
+	static string_t ToString(AstType::Ptr type, CppNameResolver& _resolver)
+	{
+		CppTypeCodegen codegen(_resolver);
+		type->Accept(&codegen);
+		return codegen.result;
+	}
+};
+
+string_t FunctionToName(CppNameResolver& resolver, AstFunctionDeclaration* decl)
+{
+	return resolver.Resolve(decl);
+}
+
+string_t FunctionToTypedName(CppNameResolver& resolver, AstFunctionDeclaration* decl)
+{
+	auto methodName = FunctionToName(resolver, decl);
+	return (decl->ownerType ? CppTypeCodegen::ToString(decl->ownerType, resolver) + T("__") : T("")) + methodName;
+}
+
+string_t FunctionToValue(CppNameResolver& resolver, AstFunctionDeclaration* decl, AstDeclaration* scope)
+{
+	stringstream_t ss;
+	string_t argumentName = resolver.Resolve(T("__args__"), scope);
+	ss << T("NewFunction([=](TinymoeArgumentSpan ") << argumentName << T(") { return ") << FunctionToTypedName(resolver, decl) << T("(");
+	for (auto it = decl->arguments.begin(); it != decl->arguments.end(); it++)
+	{
+		if (it != decl->arguments.begin())
+		{
+			ss << T(", ");
+		}
+		ss << argumentName << T("[") << it - decl->arguments.begin() << T("]");
+	}
+	auto site = resolver.AllocateCallerDispatchSite(decl);
+	if (site != T(""))
+	{
+		ss << T(", ") << site;
+	}
+	ss << T("); })");
+	return ss.str();
+}
+
+void PrintExpression(AstExpression::Ptr expression, AstDeclaration* scope, CppNameResolver& resolver, ostream_t& o, string_t prefix);
+void PrintStatement(AstStatement::Ptr statement, AstDeclaration* scope, CppNameResolver& resolver, ostream_t& o, string_t prefix, bool block, bool last);
+
+void PrintVariable(AstDeclaration* decl, const string_t& value, CppNameResolver& resolver, ostream_t& o, string_t prefix)
+{
+	if (resolver.cellVariables.find(decl) == resolver.cellVariables.end())
+	{
+		o << prefix << T("TinymoeObject::Ptr ") << resolver.Resolve(decl) << T(" = ") << value << T(";");
+	}
+	else
+	{
+		o << prefix << T("auto ") << resolver.Resolve(decl) << T(" = NewCell(") << value << T(");");
+	}
+}
+
+class CppExpressionCodegen :public AstExpressionVisitor
+{
+public:
+	CppNameResolver&		resolver;
+	ostream_t&				o;
+	string_t				prefix;
+	AstDeclaration*			scope;
+
+	CppExpressionCodegen(CppNameResolver& _resolver, ostream_t& _o, string_t _prefix, AstDeclaration* _scope)
+		:resolver(_resolver)
+		, o(_o)
+		, prefix(_prefix)
+		, scope(_scope)
+	{
+	}
+
+	void PrintExpressionList(AstExpression::List& exprs)
+	{
+		for (auto it = exprs.begin(); it != exprs.end(); it++)
+		{
+			PrintExpression(*it, scope, resolver, o, prefix);
+			if (it + 1 != exprs.end())
+			{
+				o << T(", ");
+			}
+		}
+	}
+
+	void Visit(AstLiteralExpression* node)
+	{
+		switch (node->literalName)
+		{
+		case AstLiteralName::Null:
+			o << T("nullptr");
+			break;
+		case AstLiteralName::True:
+			o << T("New<TinymoeBoolean>(true)");
+			break;
+		case AstLiteralName::False:
+			o << T("New<TinymoeBoolean>(false)");
+			break;
+		}
+	}
+
+	void Visit(AstIntegerExpression* node)
+	{
+		o << T("New<TinymoeInteger>(") << node->value << T(")");
+	}
+
+	void Visit(AstFloatExpression* node)
+	{
+		o << T("New<TinymoeFloat>(") << node->value << T(")");
+	}
+
+	void Visit(AstStringExpression* node)
+	{
+		o << T("New<TinymoeString>(\"") << node->value << T("\")");
+	}
+
+	void Visit(AstExternalSymbolExpression* node)
+	{
+		o << T("GetExternalFunction(\"") << node->name << T("\")");
+	}
+
+	void Visit(AstReferenceExpression* node)
+	{
+		auto decl = node->reference.lock();
+		if (auto func = AstNodeCast<AstFunctionDeclaration>(decl))
+		{
+			o << FunctionToValue(resolver, func.get(), scope);
+		}
+		else
+		{
+			o << resolver.ResolveVariable(decl.get());
+		}
+	}
+
+	void Visit(AstNewTypeExpression* node)
+	{
+		o << T("NewObject<") << CppTypeCodegen::ToString(node->type, resolver) << T(">({");
+		PrintExpressionList(node->fields);
+		o << T("})");
+	}
+
+	void Visit(AstTestTypeExpression* node)
+	{
+		o << T("New<TinymoeBoolean>(dynamic_cast<") << CppTypeCodegen::ToString(node->type, resolver) << T("*>((");
+		PrintExpression(node->target, scope, resolver, o, prefix);
+		o << T(").get()) != nullptr)");
+	}
+
+	void Visit(AstNewArrayExpression* node)
+	{
+		o << T("New<TinymoeArray>(CastToInteger(");
+		PrintExpression(node->length, scope, resolver, o, prefix);
+		o << T(")->value)");
+	}
+
+	void Visit(AstNewArrayLiteralExpression* node)
+	{
+		o << T("New<TinymoeArray>(TinymoeArguments {");
+		PrintExpressionList(node->elements);
+		o << T("})");
+	}
+
+	void Visit(AstArrayLengthExpression* node)
+	{
+		o << T("ArrayLength(");
+		PrintExpression(node->target, scope, resolver, o, prefix);
+		o << T(")");
+	}
+
+	void Visit(AstArrayAccessExpression* node)
+	{
+		o << T("ArrayGet(");
+		PrintExpression(node->target, scope, resolver, o, prefix);
+		o << T(", ");
+		PrintExpression(node->index, scope, resolver, o, prefix);
+		o << T(")");
+	}
+
+	void Visit(AstFieldAccessExpression* node)
+	{
+		o << resolver.AllocateFieldSite(node->composedFieldName) << T(".Get(");
+		PrintExpression(node->target, scope, resolver, o, prefix);
+		o << T(")");
+	}
+
+	void Visit(AstInvokeExpression* node)
+	{
+		AstFunctionDeclaration::Ptr func;
+		if (auto ref = AstNodeCast<AstReferenceExpression>(node->function))
+		{
+			func = AstNodeCast<AstFunctionDeclaration>(ref->reference.lock());
+		}
+
+		auto external = AstNodeCast<AstExternalSymbolExpression>(node->function);
+		auto itbegin = node->arguments.begin();
+		if (func)
+		{
+			o << FunctionToName(resolver, func.get()) << T("(") << endl;
+		}
+		else if (external && external->directStyle)
+		{
+			// the site resolves the function once, instead of looking up the name in every call
+			o << resolver.AllocateExternalSite(external->name) << T(".Invoke({") << endl;
+			itbegin++;
+		}
+		else
+		{
+			o << T("Invoke(");
+			PrintExpression(node->function, scope, resolver, o, prefix);
+			o << T(", {") << endl;
+		}
+		for (auto it = itbegin; it != node->arguments.end(); it++)
+		{
+			o << prefix << T("\t");
+			PrintExpression(*it, scope, resolver, o, prefix + T("\t"));
+			if (it + 1 != node->arguments.end())
+			{
+				o << T(",") << endl;
+			}
+		}
+		if (func)
+		{
+			auto site = resolver.AllocateCallerDispatchSite(func.get());
+			if (site != T(""))
+			{
+				o << T(",") << endl << prefix << T("\t") << site;
+			}
+			o << endl << prefix << T("\t)");
+		}
+		else
+		{
+			o << endl << prefix << T("\t})");
+		}
+	}
+
+	void Visit(AstLambdaExpression* node)
+	{
+		string_t argumentName = resolver.Resolve(T("__args__"), scope);
+		o << T("NewFunction([=](TinymoeArgumentSpan ") << argumentName << T(") -> TinymoeContinuation") << endl;
+		o << prefix << T("{") << endl;
+		for (auto it = node->arguments.begin(); it != node->arguments.end(); it++)
+		{
+			resolver.Scope(it->get(), scope);
+			stringstream_t value;
+			value << argumentName << T("[") << it - node->arguments.begin() << T("]");
+			PrintVariable(it->get(), value.str(), resolver, o, prefix + T("\t"));
+			o << endl;
+		}
+		PrintStatement(node->statement, scope, resolver, o, prefix + T("\t"), true, true);
+		o << endl << prefix << T("})");
+	}
+
+	// a dispatch expression only appears in the body of the root function of its table, which takes the site of its caller
+	void Visit(AstDispatchExpression* node)
+	{
+		auto it = resolver.dispatchSiteArguments.find(scope);
+		auto site = it == resolver.dispatchSiteArguments.end() ? resolver.AllocateDispatchSite() : T("*") + it->second;
+		o << resolver.Resolve(node->table.lock().get()) << T(".Lookup(") << site << T(", {");
+		PrintExpressionList(node->arguments);
+		o << T("})");
+	}
+
+	void PrintPrimitiveOperand(AstExpression::Ptr operand, const char_t* operandType)
+	{
+		o << T("Unbox<") << operandType << T(">(");
+		PrintExpression(operand, scope, resolver, o, prefix);
+		o << T(")");
+	}
+
+	void Visit(AstPrimitiveExpression* node)
+	{
+		if (node->op == AstPrimitiveOperator::StringConcat)
+		{
+			// the runtime appends in place or builds a rope, unboxing would copy both operands
+			o << T("ConcatStrings(");
+			PrintExpression(node->operands[0], scope, resolver, o, prefix);
+			o << T(", ");
+			PrintExpression(node->operands[1], scope, resolver, o, prefix);
+			o << T(")");
+			return;
+		}
+
+		enum { Prefix, Infix, Call } style = Infix;
+		const char_t* operandType = nullptr;
+		const char_t* resultType = nullptr;
+		const char_t* op = nullptr;
+		switch (node->op)
+		{
+		case AstPrimitiveOperator::IntegerPositive:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("+");
+			style = Prefix;
+			break;
+		case AstPrimitiveOperator::FloatPositive:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeFloat");
+			op = T("+");
+			style = Prefix;
+			break;
+		case AstPrimitiveOperator::IntegerNegative:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("-");
+			style = Prefix;
+			break;
+		case AstPrimitiveOperator::FloatNegative:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeFloat");
+			op = T("-");
+			style = Prefix;
+			break;
+		case AstPrimitiveOperator::BooleanNot:
+			operandType = T("TinymoeBoolean");
+			resultType = T("TinymoeBoolean");
+			op = T("!");
+			style = Prefix;
+			break;
+		case AstPrimitiveOperator::IntegerAdd:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("+");
+			break;
+		case AstPrimitiveOperator::FloatAdd:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeFloat");
+			op = T("+");
+			break;
+		case AstPrimitiveOperator::IntegerSub:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("-");
+			break;
+		case AstPrimitiveOperator::FloatSub:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeFloat");
+			op = T("-");
+			break;
+		case AstPrimitiveOperator::IntegerMul:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("*");
+			break;
+		case AstPrimitiveOperator::FloatMul:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeFloat");
+			op = T("*");
+			break;
+		case AstPrimitiveOperator::IntegerDiv:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeFloat");
+			op = T("/");
+			break;
+		case AstPrimitiveOperator::FloatDiv:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeFloat");
+			op = T("/");
+			break;
+		case AstPrimitiveOperator::IntegerIntDiv:
+			// integer division by zero is undefined behavior in C++, the runtime helper reports it instead
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("i_intdiv_i");
+			style = Call;
+			break;
+		case AstPrimitiveOperator::IntegerMod:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("i_mod_i");
+			style = Call;
+			break;
+		case AstPrimitiveOperator::IntegerEqual:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeBoolean");
+			op = T("==");
+			break;
+		case AstPrimitiveOperator::FloatEqual:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeBoolean");
+			op = T("==");
+			break;
+		case AstPrimitiveOperator::StringEqual:
+			operandType = T("TinymoeString");
+			resultType = T("TinymoeBoolean");
+			op = T("==");
+			break;
+		case AstPrimitiveOperator::BooleanEqual:
+			operandType = T("TinymoeBoolean");
+			resultType = T("TinymoeBoolean");
+			op = T("==");
+			break;
+		case AstPrimitiveOperator::IntegerCompare:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeInteger");
+			op = T("i_c_i");
+			style = Call;
+			break;
+		case AstPrimitiveOperator::FloatCompare:
+			operandType = T("TinymoeFloat");
+			resultType = T("TinymoeInteger");
+			op = T("f_c_f");
+			style = Call;
+			break;
+		case AstPrimitiveOperator::StringCompare:
+			operandType = T("TinymoeString");
+			resultType = T("TinymoeInteger");
+			op = T("s_c_s");
+			style = Call;
+			break;
+		case AstPrimitiveOperator::BooleanAnd:
+			operandType = T("TinymoeBoolean");
+			resultType = T("TinymoeBoolean");
+			op = T("&&");
+			break;
+		case AstPrimitiveOperator::BooleanOr:
+			operandType = T("TinymoeBoolean");
+			resultType = T("TinymoeBoolean");
+			op = T("||");
+			break;
+		case AstPrimitiveOperator::IntegerToFloat:
+			operandType = T("TinymoeInteger");
+			resultType = T("TinymoeFloat");
+			op = T("(double)");
+			style = Prefix;
+			break;
+		case AstPrimitiveOperator::StringConcat:
+			// generated before the switch
+			throw 0;
+		}
+
+		// operands are proven to be of the operand type, so they are unboxed without checking
+		o << T("New<") << resultType << T(">(");
+		switch (style)
+		{
+		case Prefix:
+			o << op;
+			PrintPrimitiveOperand(node->operands[0], operandType);
+			break;
+		case Infix:
+			if (node->op == AstPrimitiveOperator::IntegerDiv)
+			{
+				o << T("(double)");
+			}
+			PrintPrimitiveOperand(node->operands[0], operandType);
+			o << T(" ") << op << T(" ");
+			PrintPrimitiveOperand(node->operands[1], operandType);
+			break;
+		case Call:
+			o << op << T("(");
+			PrintPrimitiveOperand(node->operands[0], operandType);
+			o << T(", ");
+			PrintPrimitiveOperand(node->operands[1], operandType);
+			o << T(")");
+			break;
+		}
+		o << T(")");
+	}
+};
+
+class CppSetExpressionCodegen :public AstExpressionVisitor
+{
+public:
+	CppNameResolver&		resolver;
+	ostream_t&				o;
+	string_t				prefix;
+	AstDeclaration*			scope;
+	AstExpression::Ptr		value;
+
+	CppSetExpressionCodegen(CppNameResolver& _resolver, ostream_t& _o, string_t _prefix, AstDeclaration* _scope, AstExpression::Ptr _value)
+		:resolver(_resolver)
+		, o(_o)
+		, prefix(_prefix)
+		, scope(_scope)
+		, value(_value)
+	{
+	}
+
+	void Visit(AstLiteralExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstIntegerExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstFloatExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstStringExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstExternalSymbolExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstReferenceExpression* node)
+	{
+		auto decl = node->reference.lock();
+		if (AstNodeCast<AstFunctionDeclaration>(decl))
+		{
+			throw 0;
+		}
+		if (resolver.cellVariables.find(decl.get()) == resolver.cellVariables.end())
+		{
+			o << resolver.Resolve(decl.get()) << T(" = ");
+			PrintExpression(value, scope, resolver, o, prefix);
+			o << T(";");
+		}
+		else
+		{
+			o << T("SetCell(") << resolver.Resolve(decl.get()) << T(", ");
+			PrintExpression(value, scope, resolver, o, prefix);
+			o << T(");");
+		}
+	}
+
+	void Visit(AstNewTypeExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstTestTypeExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstNewArrayExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstNewArrayLiteralExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstArrayLengthExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstArrayAccessExpression* node)
+	{
+		o << T("ArraySet(");
+		PrintExpression(node->target, scope, resolver, o, prefix);
+		o << T(", ");
+		PrintExpression(node->index, scope, resolver, o, prefix);
+		o << T(", ");
+		PrintExpression(value, scope, resolver, o, prefix);
+		o << T(");");
+	}
+
+	void Visit(AstFieldAccessExpression* node)
+	{
+		o << resolver.AllocateFieldSite(node->composedFieldName) << T(".Set(");
+		PrintExpression(node->target, scope, resolver, o, prefix);
+		o << T(", ");
+		PrintExpression(value, scope, resolver, o, prefix);
+		o << T(");");
+	}
+
+	void Visit(AstInvokeExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstLambdaExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstDispatchExpression* node)
+	{
+		throw 0;
+	}
+
+	void Visit(AstPrimitiveExpression* node)
+	{
+		throw 0;
+	}
+};
+
+class CppStatementCodegen :public AstStatementVisitor
+{
+public:
+	CppNameResolver&		resolver;
+	ostream_t&				o;
+	string_t				prefix;
+	bool					block;
+	bool					last;
+	AstDeclaration*			scope;
+
+	CppStatementCodegen(CppNameResolver& _resolver, ostream_t& _o, string_t _prefix, bool _block, bool _last, AstDeclaration* _scope)
+		:resolver(_resolver)
+		, o(_o)
+		, prefix(_prefix)
+		, block(_block)
+		, last(_last)
+		, scope(_scope)
+	{
+	}
+
+	// prints the statement, or the declaration and its initialization when GetInitialization accepts them, and returns the last printed statement
+	AstStatement::List::iterator PrintBlockItem(AstBlockStatement* node, AstStatement::List::iterator it, string_t itemPrefix)
+	{
+		if (it + 1 != node->statements.end())
+		{
+			if (auto value = GetInitialization(*it, *(it + 1)))
+			{
+				auto decl = AstNodeCast<AstDeclarationStatement>(*it)->declaration.get();
+				resolver.Scope(decl, scope);
+				resolver.Resolve(decl);
+				stringstream_t ss;
+				PrintExpression(value, scope, resolver, ss, itemPrefix);
+				PrintVariable(decl, ss.str(), resolver, o, itemPrefix);
+				return it + 1;
+			}
+		}
+		PrintStatement(*it, scope, resolver, o, itemPrefix, false, it + 1 == node->statements.end() && last);
+		return it;
+	}
+
+	void Visit(AstBlockStatement* node)
+	{
+		if (block)
+		{
+			for (auto it = node->statements.begin(); it != node->statements.end(); it++)
+			{
+				it = PrintBlockItem(node, it, prefix);
+				if (it + 1 != node->statements.end())
+				{
+					o << endl;
+				}
+			}
+		}
+		else
+		{
+			o << prefix << T("{") << endl;
+			for (auto it = node->statements.begin(); it != node->statements.end(); it++)
+			{
+				it = PrintBlockItem(node, it, prefix + T("\t"));
+				o << endl;
+			}
+			o << prefix << T("}");
+		}
+	}
+
+	void Visit(AstExpressionStatement* node)
+	{
+		o << prefix;
+		if (last)
+		{
+			// TailCall returns the call to RunContinuation when the C++ stack is deep
+			o << T("return TailCall([=]() { return ");
+			PrintExpression(node->expression, scope, resolver, o, prefix);
+			o << T("; });");
+		}
+		else
+		{
+			PrintExpression(node->expression, scope, resolver, o, prefix);
+			o << T(";");
+		}
+	}
+
+	void Visit(AstDeclarationStatement* node)
+	{
+		resolver.Scope(node->declaration.get(), scope);
+		PrintVariable(node->declaration.get(), T("nullptr"), resolver, o, prefix);
+	}
+
+	void Visit(AstAssignmentStatement* node)
+	{
+		o << prefix;
+		CppSetExpressionCodegen codegen(resolver, o, prefix, scope, node->value);
+		node->target->Accept(&codegen);
+	}
+
+	void Visit(AstIfStatement* node)
+	{
+		AstIfStatement* current = node;
+		o << prefix;
+		while (true)
+		{
+			o << T("if (CastToBoolean(");
+			PrintExpression(current->condition, scope, resolver, o, prefix);
+			o << T(")->value)") << endl;
+			o << prefix << T("{") << endl;
+			PrintStatement(current->trueBranch, scope, resolver, o, prefix + T("\t"), true, last);
+			o << endl << prefix << T("}");
+
+			auto nextCurrent = AstNodeCast<AstIfStatement>(current->falseBranch).get();
+			if (!nextCurrent) break;
+			o << endl << prefix << T("else ");
+			current = nextCurrent;
+		}
+
+		if (current->falseBranch)
+		{
+			o << endl << prefix << T("else") << endl;
+			o << prefix << T("{") << endl;
+			PrintStatement(current->falseBranch, scope, resolver, o, prefix + T("\t"), true, last);
+			o << endl << prefix << T("}");
+		}
+	}
+};
+
+void PrintExpression(AstExpression::Ptr expression, AstDeclaration* scope, CppNameResolver& resolver, ostream_t& o, string_t prefix)
+{
+	CppExpressionCodegen codegen(resolver, o, prefix, scope);
+	expression->Accept(&codegen);
+}
+
+void PrintStatement(AstStatement::Ptr statement, AstDeclaration* scope, CppNameResolver& resolver, ostream_t& o, string_t prefix, bool block, bool last)
+{
+	CppStatementCodegen codegen(resolver, o, prefix, block, last, scope);
+	statement->Accept(&codegen);
+}
+
+class CppDeclarationCodegen :public AstDeclarationVisitor
+{
+public:
+	CppNameResolver&		resolver;
+	ostream_t&				o;
+	string_t				prefix;
+
+	CppDeclarationCodegen(CppNameResolver& _resolver, ostream_t& _o, string_t _prefix)
+		:resolver(_resolver)
+		, o(_o)
+		, prefix(_prefix)
+	{
+	}
+
+	void Visit(AstSymbolDeclaration* node)override
+	{
+		o << prefix << T("TinymoeObject::Ptr ") << resolver.Resolve(node) << T(" = New<TinymoeSymbol>(\"") << resolver.Resolve(node) << T("\");") << endl << endl;
+	}
+
+	void Visit(AstTypeDeclaration* node)override
+	{
+		// types are printed by PrintType, before any function uses them
+	}
+
+	void Visit(AstFunctionDeclaration* node)override
+	{
+		{
+			CppCaptureAnalyzer analyzer;
+			for (auto argument : node->arguments)
+			{
+				analyzer.owners.insert(make_pair(argument.get(), nullptr));
+			}
+			analyzer.Analyze(node->statement);
+			analyzer.CollectCells(resolver.cellVariables);
+		}
+
+		o << prefix << (node->continuationArgument ? T("TinymoeContinuation ") : T("TinymoeObject::Ptr ")) << FunctionToTypedName(resolver, node) << T("(");
+		for (auto it = node->arguments.begin(); it != node->arguments.end(); it++)
+		{
+			resolver.Scope(it->get(), node);
+			bool cell = resolver.cellVariables.find(it->get()) != resolver.cellVariables.end();
+			if (it != node->arguments.begin())
+			{
+				o << T(", ");
+			}
+			o << T("TinymoeObject::Ptr ") << (cell ? T("__arg__") : T("")) << resolver.Resolve(it->get());
+		}
+		if (resolver.dispatchRoots.find(node) != resolver.dispatchRoots.end())
+		{
+			auto site = resolver.Resolve(T("__site__"), node);
+			resolver.dispatchSiteArguments.insert(make_pair(node, site));
+			o << T(", TinymoeDispatchSite* ") << site;
+		}
+		o << T(")") << endl;
+		o << prefix << T("{") << endl;
+		for (auto argument : node->arguments)
+		{
+			if (resolver.cellVariables.find(argument.get()) != resolver.cellVariables.end())
+			{
+				PrintVariable(argument.get(), T("__arg__") + resolver.Resolve(argument.get()), resolver, o, prefix + T("\t"));
+				o << endl;
+			}
+		}
+		PrintStatement(node->statement, node, resolver, o, prefix + T("\t"), true, (bool)node->continuationArgument);
+		o << endl;
+		if (!node->continuationArgument)
+		{
+			o << prefix << T("\treturn ") << resolver.ResolveVariable(node->resultVariable.get()) << T(";") << endl;
+		}
+		o << prefix << T("}") << endl << endl;
+	}
+
+	void Visit(AstDispatchTableDeclaration* node)override
+	{
+		o << prefix << T("TinymoeDispatchTable ") << resolver.Resolve(node) << T(";") << endl << endl;
+	}
+
+	void PrintType(AstTypeDeclaration* node, set<AstTypeDeclaration*>& printed)
+	{
+		if (!printed.insert(node).second) return;
+		if (auto baseType = AstNodeCast<AstReferenceType>(node->baseType.lock()))
+		{
+			// a C++ base class must be complete before it is derived from
+			PrintType(baseType->typeDeclaration.lock().get(), printed);
+		}
+
+		auto typeName = resolver.Resolve(node);
+		auto baseTypeName = node->baseType.expired() ? T("TinymoeObject") : CppTypeCodegen::ToString(node->baseType.lock(), resolver);
+		o << prefix << T("struct ") << typeName << T(" : public ") << baseTypeName << endl;
+		o << prefix << T("{") << endl;
+		for (auto field : node->fields)
+		{
+			resolver.Scope(field.get(), node);
+			o << prefix << T("\tTinymoeObject::Ptr ") << resolver.Resolve(field.get()) << T(";") << endl;
+		}
+		o << prefix << T("\tTINYMOE_TYPE(") << typeName << T(", ") << baseTypeName;
+		for (auto field : node->fields)
+		{
+			o << T(",") << endl << prefix << T("\t\tTINYMOE_FIELD(") << typeName << T(", ") << resolver.Resolve(field.get()) << T(")");
+		}
+		o << T(")") << endl;
+		o << prefix << T("};") << endl << endl;
+	}
+};
+
+class CppExtensionDeclarationCodegen :public AstDeclarationVisitor
+{
+public:
+	CppNameResolver&		resolver;
+	ostream_t&				o;
+	string_t				prefix;
+
+	CppExtensionDeclarationCodegen(CppNameResolver& _resolver, ostream_t& _o, string_t _prefix)
+		:resolver(_resolver)
+		, o(_o)
+		, prefix(_prefix)
+	{
+	}
+
+	void Visit(AstSymbolDeclaration* node)override
+	{
+	}
+
+	void Visit(AstTypeDeclaration* node)override
+	{
+	}
+
+	void Visit(AstFunctionDeclaration* node)override
+	{
+		if (node->ownerType)
+		{
+			auto typeName = CppTypeCodegen::ToString(node->ownerType, resolver);
+			auto methodName = node->composedName;
+			auto targetName = FunctionToValue(resolver, node, nullptr);
+			o << prefix << T("SetExtension(") << endl;
+			o << prefix << T("\t") << typeName << T("::Type(),") << endl;
+			o << prefix << T("\t\"") << methodName << T("\",") << endl;
+			o << prefix << T("\t") << targetName << endl;
+			o << prefix << T("\t);") << endl;
+		}
+	}
+
+	void Visit(AstDispatchTableDeclaration* node)override
+	{
+		// the layout is built by the first program instance, every instance creates its own targets on demand
+		o << prefix << T("{") << endl;
+		o << prefix << T("\tstatic const TinymoeDispatchLayout layout(") << endl;
+		o << prefix << T("\t\t{") << endl;
+		for (auto dimension : node->dimensions)
+		{
+			o << prefix << T("\t\t\t{");
+			for (auto it = dimension.begin(); it != dimension.end(); it++)
+			{
+				o << CppTypeCodegen::ToString(*it, resolver) << T("::Type()");
+				if (it + 1 != dimension.end())
+				{
+					o << T(", ");
+				}
+			}
+			o << T("},") << endl;
+		}
+		o << prefix << T("\t\t});") << endl;
+		o << prefix << T("\t") << resolver.Resolve(node) << T(" = TinymoeDispatchTable(layout, [=](int offset) -> TinymoeObject::Ptr") << endl;
+		o << prefix << T("\t{") << endl;
+		o << prefix << T("\t\tswitch (offset)") << endl;
+		o << prefix << T("\t\t{") << endl;
+		int offset = 0;
+		for (auto target : node->targets)
+		{
+			o << prefix << T("\t\tcase ") << offset++ << T(": return ") << FunctionToValue(resolver, target.lock().get(), nullptr) << T(";") << endl;
+		}
+		o << prefix << T("\t\t}") << endl;
+		o << prefix << T("\t\treturn nullptr;") << endl;
+		o << prefix << T("\t});") << endl;
+		o << prefix << T("}") << endl;
+	}
+};
+
+void GenerateCppCode(AstAssembly::Ptr assembly, ostream_t& o)
+{
+	CppNameResolver resolver;
+	o << T("#include \"TinymoeNative/TinymoeScheduler.h\"") << endl;
+	o << T("") << endl;
+	o << T("using namespace tinymoe::native;") << endl;
+	o << T("") << endl;
+	o << T("namespace TinymoeProgramNamespace") << endl;
+	o << T("{") << endl;
+	o << T("\tclass TinymoeProgram : public TinymoeOperations") << endl;
+	o << T("\t{") << endl;
+	o << T("\tpublic:") << endl;
+	{
+		for (auto decl : assembly->declarations)
+		{
+			resolver.Scope(decl.get(), nullptr);
+			if (auto table = AstNodeCast<AstDispatchTableDeclaration>(decl))
+			{
+				resolver.dispatchRoots.insert(table->rootFunction.lock().get());
+			}
+		}
+		CppDeclarationCodegen codegen(resolver, o, T("\t\t"));
+		set<AstTypeDeclaration*> printed;
+		for (auto decl : assembly->declarations)
+		{
+			if (auto type = AstNodeCast<AstTypeDeclaration>(decl))
+			{
+				codegen.PrintType(type.get(), printed);
+			}
+		}
+		for (auto decl : assembly->declarations)
+		{
+			decl->Accept(&codegen);
+		}
+	}
+	o << T("\t\tTinymoeProgram()") << endl;
+	o << T("\t\t{") << endl;
+	{
+		CppExtensionDeclarationCodegen codegen(resolver, o, T("\t\t\t"));
+		for (auto decl : assembly->declarations)
+		{
+			decl->Accept(&codegen);
+		}
+	}
+	o << T("\t\t}") << endl;
+	o << endl;
+	o << T("\t\tTinymoeObject::Ptr NewState(const TinymoeObject::Ptr& continuation)") << endl;
+	o << T("\t\t{") << endl;
+	o << T("\t\t\tauto trap = New<standard_library__continuation_trap>();") << endl;
+	o << T("\t\t\ttrap->SetField(\"continuation\", continuation);") << endl;
+	o << T("\t\t\tauto state = New<standard_library__continuation_state>();") << endl;
+	o << T("\t\t\tstate->SetField(\"trap\", trap);") << endl;
+	o << T("\t\t\treturn state;") << endl;
+	o << T("\t\t}") << endl;
+	{
+		// functions that an embedding host can call by name, the value of a function takes the state, the arguments and the continuation
+		vector<AstFunctionDeclaration::Ptr> functions;
+		for (auto decl : assembly->declarations)
+		{
+			if (auto func = AstNodeCast<AstFunctionDeclaration>(decl))
+			{
+				if (!func->ownerType && func->composedName.size() > 0 && func->composedName[0] != T('$'))
+				{
+					functions.push_back(func);
+				}
+			}
+		}
+
+		o << endl;
+		o << T("\t\tstatic const map<string, pair<int, int>>& GetFunctionTable()") << endl;
+		o << T("\t\t{") << endl;
+		o << T("\t\t\tstatic const map<string, pair<int, int>> functions =") << endl;
+		o << T("\t\t\t{") << endl;
+		for (auto it = functions.begin(); it != functions.end(); it++)
+		{
+			auto func = *it;
+			auto arguments = func->arguments.size() + (func->continuationArgument ? 0 : 1);
+			o << T("\t\t\t\t{ \"") << func->composedName << T("\", { ") << it - functions.begin() << T(", ") << arguments << T(" } },") << endl;
+		}
+		o << T("\t\t\t};") << endl;
+		o << T("\t\t\treturn functions;") << endl;
+		o << T("\t\t}") << endl;
+
+		o << endl;
+		o << T("\t\tTinymoeObject::Ptr NewFunctionValue(int index)") << endl;
+		o << T("\t\t{") << endl;
+		o << T("\t\t\tswitch (index)") << endl;
+		o << T("\t\t\t{") << endl;
+		for (auto it = functions.begin(); it != functions.end(); it++)
+		{
+			auto func = *it;
+			o << T("\t\t\tcase ") << it - functions.begin() << T(": return ");
+			if (func->continuationArgument)
+			{
+				o << FunctionToValue(resolver, func.get(), nullptr);
+			}
+			else
+			{
+				o << T("BuildDirectFunction([=](TinymoeArgumentSpan __args__) { return ") << FunctionToTypedName(resolver, func.get()) << T("(");
+				for (auto itArgument = func->arguments.begin(); itArgument != func->arguments.end(); itArgument++)
+				{
+					if (itArgument != func->arguments.begin())
+					{
+						o << T(", ");
+					}
+					o << T("__args__[") << itArgument - func->arguments.begin() << T("]");
+				}
+				auto site = resolver.AllocateCallerDispatchSite(func.get());
+				if (site != T(""))
+				{
+					o << T(", ") << site;
+				}
+				o << T("); })");
+			}
+			o << T(";") << endl;
+		}
+		o << T("\t\t\t}") << endl;
+		o << T("\t\t\treturn nullptr;") << endl;
+		o << T("\t\t}") << endl;
+	}
+	{
+		// the constructor and the function values also allocate sites, so they are declared after every member function is printed
+		o << endl;
+		for (auto site : resolver.sites)
+		{
+			o << T("\t\t") << get<0>(site) << T(" ") << get<1>(site) << T("{") << get<2>(site) << T("};") << endl;
+		}
+	}
+	o << T("\t};") << endl;
+	o << T("}") << endl;
+	o << endl;
+	{
+		string_t mainName;
+		bool mainDirectStyle = false;
+		for (auto decl : assembly->declarations)
+		{
+			if (decl->composedName.size() >= 6)
+			{
+				if (decl->composedName.substr(decl->composedName.size() - 6, 6) == T("::main"))
+				{
+					mainName = resolver.Resolve(decl.get());
+					mainDirectStyle = !AstNodeCast<AstFunctionDeclaration>(decl)->continuationArgument;
+					break;
+				}
+			}
+		}
+		o << T("namespace TinymoeProgramNamespace") << endl;
+		o << T("{") << endl;
+		o << T("\tTinymoeContinuation StartProgram(TinymoeProgram& program)") << endl;
+		o << T("\t{") << endl;
+		o << T("\t\tTinymoeObject::Ptr continuation = NewFunction([](TinymoeArgumentSpan arguments)") << endl;
+		o << T("\t\t{") << endl;
+		o << T("\t\t\treturn TinymoeContinuation();") << endl;
+		o << T("\t\t});") << endl;
+		o << T("\t\tauto state = program.NewState(continuation);") << endl;
+		if (mainDirectStyle)
+		{
+			o << T("\t\tprogram.") << mainName << T("(state);") << endl;
+			o << T("\t\treturn TinymoeContinuation();") << endl;
+		}
+		else
+		{
+			o << T("\t\treturn program.") << mainName << T("(state, continuation);") << endl;
+		}
+		o << T("\t}") << endl;
+		o << T("}") << endl;
+		o << endl;
+		// a host that embeds the program through TinymoeEmbedding.h defines TINYMOE_EMBEDDED and provides its own main
+		o << T("#ifndef TINYMOE_EMBEDDED") << endl;
+		o << T("int main()") << endl;
+		o << T("{") << endl;
+		o << T("\tusing namespace TinymoeProgramNamespace;") << endl;
+		o << T("\ttry") << endl;
+		o << T("\t{") << endl;
+		o << T("\t\tif (auto instances = getenv(\"TINYMOE_INSTANCES\"))") << endl;
+		o << T("\t\t{") << endl;
+		o << T("\t\t\tTinymoeScheduler scheduler;") << endl;
+		o << T("\t\t\tfor (int i = 0; i < atoi(instances); i++)") << endl;
+		o << T("\t\t\t{") << endl;
+		o << T("\t\t\t\tscheduler.Spawn(StartProgram);") << endl;
+		o << T("\t\t\t}") << endl;
+		o << T("\t\t\tscheduler.Wait();") << endl;
+		o << T("\t\t\tif (getenv(\"TINYMOE_SCHEDULER_STATISTICS\"))") << endl;
+		o << T("\t\t\t{") << endl;
+		o << T("\t\t\t\tscheduler.WriteStatistics(cerr);") << endl;
+		o << T("\t\t\t}") << endl;
+		o << T("\t\t\treturn 0;") << endl;
+		o << T("\t\t}") << endl;
+		o << endl;
+		o << T("\t\tTinymoeProgram program;") << endl;
+		o << T("\t\tTinymoeArena arena;") << endl;
+		o << T("\t\t{") << endl;
+		o << T("\t\t\tTinymoeArenaScope scope(getenv(\"TINYMOE_ARENA\") ? &arena : nullptr);") << endl;
+		o << T("\t\t\tTinymoeOperations::RunContinuation(StartProgram(program));") << endl;
+		o << T("\t\t}") << endl;
+		o << T("\t\tif (getenv(\"TINYMOE_FIELD_SITE_STATISTICS\"))") << endl;
+		o << T("\t\t{") << endl;
+		o << T("\t\t\tTinymoeFieldSite::WriteStatistics(cerr);") << endl;
+		o << T("\t\t}") << endl;
+		o << T("\t\tif (getenv(\"TINYMOE_GC_STATISTICS\"))") << endl;
+		o << T("\t\t{") << endl;
+		o << T("\t\t\tTinymoeHeap::Current().WriteStatistics(cerr);") << endl;
+		o << T("\t\t}") << endl;
+		o << T("\t}") << endl;
+		o << T("\tcatch (const exception& ex)") << endl;
+		o << T("\t{") << endl;
+		o << T("\t\tcerr << ex.what() << endl;") << endl;
+		o << T("\t\treturn 1;") << endl;
+		o << T("\t}") << endl;
+		o << T("\treturn 0;") << endl;
+		o << T("}") << endl;
+		o << T("#endif") << endl;
+	}
+}
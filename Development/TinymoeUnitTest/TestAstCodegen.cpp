@@ -9,8 +9,28 @@ extern void WriteAnsiFile(string_t fileName, stringstream_t& ss);
 extern string_t ReadAnsiFile(string_t fileName);
 extern string_t GetCodeForStandardLibrary();
 extern void GenerateCSharpCode(AstAssembly::Ptr assembly, ostream_t& o);
+extern void GenerateCppCode(AstAssembly::Ptr assembly, ostream_t& o);
 
-void CodeGen(vector<string_t>& codes, string_t name)
+// replaces the first reference of the first node of the kind, and reads the corrupted file,
+// the first reference of all kinds used in the test is required, so the file should be rejected
+bool ReadCorruptedReference(AstBinaryFile& file, AstBinaryKind kind, uint32_t reference)
+{
+	vector<uint64_t> data((file.GetSize() + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+	memcpy(&data[0], file.GetData(), file.GetSize());
+	AstBinaryReader reader(&data[0], file.GetSize());
+	for (uint32_t i = 0; i < reader.GetNodeCount(); i++)
+	{
+		auto& record = reader.GetNode(i);
+		if (record.kind == kind && record.referenceCount > 0)
+		{
+			*const_cast<uint32_t*>(reader.GetReferences(record)) = reference;
+			return reader.ReadAssembly() != nullptr;
+		}
+	}
+	return false;
+}
+
+AstAssembly::Ptr CodeGen(vector<string_t>& codes, string_t name)
 {
 	CodeError::List errors;
 	auto assembly = SymbolAssembly::Parse(codes, errors);
@@ -18,6 +38,16 @@ void CodeGen(vector<string_t>& codes, string_t name)
 	TEST_ASSERT(assembly->symbolModules.size() == codes.size());
 
 	auto ast = GenerateAst(assembly);
+	{
+		stringstream_t expected, actual;
+		Print(ast, expected, 0);
+		AstInternStatistics statistics;
+		InternAst(ast, statistics);
+		Print(ast, actual, 0);
+		TEST_ASSERT(expected.str() == actual.str());
+		TEST_ASSERT(statistics.removedNodes > 0);
+		TEST_PRINT("    interned " + to_string(statistics.internedNodes) + " nodes, removed " + to_string(statistics.removedNodes) + " nodes (" + to_string(statistics.removedBytes) + " bytes)");
+	}
 	{
 		stringstream_t o;
 		Print(ast, o, 0);
@@ -28,6 +58,75 @@ void CodeGen(vector<string_t>& codes, string_t name)
 		GenerateCSharpCode(ast, o);
 		WriteAnsiFile(T("../CSharpCodegenTest/") + name + T("/TinymoeProgram.cs"), o);
 	}
+	{
+		stringstream_t o;
+		GenerateCppCode(ast, o);
+		WriteAnsiFile(T("../CppCodegenTest/") + name + T(".cpp"), o);
+	}
+	{
+		string fileName = "../CSharpCodegenTest/" + string(name.begin(), name.end()) + "/GeneratedAst.bin";
+		{
+			ofstream o(fileName, ios_base::binary);
+			WriteBinary(ast, o);
+		}
+
+		AstBinaryFile file(fileName);
+		TEST_ASSERT(file.IsOpened());
+		AstBinaryReader reader(file.GetData(), file.GetSize());
+		TEST_ASSERT(reader.IsValid());
+		auto loadedAst = reader.ReadAssembly();
+		TEST_ASSERT(loadedAst);
+
+		stringstream_t expected, actual;
+		Print(ast, expected, 0);
+		Print(loadedAst, actual, 0);
+		TEST_ASSERT(expected.str() == actual.str());
+		TEST_ASSERT(!AstBinaryReader(file.GetData(), file.GetSize() / 2).ReadAssembly());
+
+		// required references could not be null, and the assembly is not a declaration of any kind
+		AstBinaryKind requiredKinds[] =
+		{
+			AstBinaryKind::ReferenceExpression,
+			AstBinaryKind::DispatchExpression,
+			AstBinaryKind::ReferenceType,
+			AstBinaryKind::DispatchTableDeclaration,
+		};
+		for (auto kind : requiredKinds)
+		{
+			TEST_ASSERT(!ReadCorruptedReference(file, kind, AstBinaryNull));
+			TEST_ASSERT(!ReadCorruptedReference(file, kind, 0));
+		}
+	}
+	return ast;
+}
+
+AstFunctionDeclaration::Ptr FindFunction(AstAssembly::Ptr ast, const string_t& composedName)
+{
+	for (auto decl : ast->declarations)
+	{
+		if (decl->composedName == composedName)
+		{
+			if (auto func = AstNodeCast<AstFunctionDeclaration>(decl))
+			{
+				return func;
+			}
+		}
+	}
+	return nullptr;
+}
+
+// collects all nodes of type T in the node, including itself
+template<typename T>
+void CollectNodes(AstNode* node, vector<T*>& nodes)
+{
+	if (node->kind == T::NodeKind)
+	{
+		nodes.push_back(static_cast<T*>(node));
+	}
+	ForEachChild(node, [&](AstNode* child)
+	{
+		CollectNodes(child, nodes);
+	});
 }
 
 /*************************************************************
@@ -51,7 +150,45 @@ TEST_CASE(TestMultipleDispatchAstCodegen)
 	vector<string_t> codes;
 	codes.push_back(GetCodeForStandardLibrary());
 	codes.push_back(ReadAnsiFile(T("../TestCases/MultipleDispatch.txt")));
-	CodeGen(codes, T("MultipleDispatchAst"));
+	auto ast = CodeGen(codes, T("MultipleDispatchAst"));
+
+	// the types of "shape one and shape two are the same shape" are proven to be triangle and rectangle,
+	// so the call goes to the target in the dispatch table directly, which is the dispatch fail function
+	auto main = FindFunction(ast, T("geometry::main"));
+	TEST_ASSERT(main);
+	vector<AstDispatchExpression*> dispatches;
+	CollectNodes(main.get(), dispatches);
+	TEST_ASSERT(dispatches.size() == 0);
+
+	auto root = FindFunction(ast, T("geometry::$primitive_and_$expression_are_the_same_shape"));
+	auto target = FindFunction(ast, T("$dispatch_fail<>geometry::$primitive_and_$expression_are_the_same_shape"));
+	TEST_ASSERT(root && target);
+	vector<AstInvokeExpression*> invokes;
+	CollectNodes(main.get(), invokes);
+	int targetCalls = 0;
+	for (auto invoke : invokes)
+	{
+		if (auto ref = AstNodeCast<AstReferenceExpression>(invoke->function))
+		{
+			auto function = ref->reference.lock();
+			TEST_ASSERT(function != root);
+			if (function == target)
+			{
+				targetCalls++;
+			}
+		}
+	}
+	TEST_ASSERT(targetCalls == 1);
+
+	// a phrase that never captures its continuation returns the result directly,
+	// and a CPS wrapper is only created for the dispatch table, main still calls "if" in CPS
+	auto direct = FindFunction(ast, T("geometry::$primitive<rectangle>_and_$expression<rectangle>_are_the_same_shape"));
+	auto wrapper = FindFunction(ast, T("$cps<>geometry::$primitive<rectangle>_and_$expression<rectangle>_are_the_same_shape"));
+	TEST_ASSERT(direct && wrapper);
+	TEST_ASSERT(!direct->continuationArgument);
+	TEST_ASSERT(direct->arguments.back()->composedName == T("b"));
+	TEST_ASSERT(wrapper->continuationArgument);
+	TEST_ASSERT(main->continuationArgument);
 }
 
 /*************************************************************
@@ -76,4 +213,87 @@ TEST_CASE(TestUnitTestAstCodegen)
 	codes.push_back(GetCodeForStandardLibrary());
 	codes.push_back(ReadAnsiFile(T("../TestCases/UnitTest.txt")));
 	CodeGen(codes, T("UnitTestAst"));
+}
+
+/*************************************************************
+Asynchronous IO
+*************************************************************/
+
+TEST_CASE(TestAsynchronousIOAstCodegen)
+{
+	vector<string_t> codes;
+	codes.push_back(GetCodeForStandardLibrary());
+	codes.push_back(ReadAnsiFile(T("../TestCases/AsynchronousIO.txt")));
+
+	CodeError::List errors;
+	auto assembly = SymbolAssembly::Parse(codes, errors);
+	TEST_ASSERT(errors.size() == 0);
+	auto ast = GenerateAst(assembly);
+
+	// asynchronous external functions only exist in the native runtime, so only the C++ program is generated, CppCodegenTest/AsynchronousIO.cpp embeds it
+	stringstream_t o;
+	GenerateCppCode(ast, o);
+	WriteAnsiFile(T("../CppCodegenTest/AsynchronousIOAst.cpp"), o);
+}
+
+/*************************************************************
+Array Benchmark
+*************************************************************/
+
+TEST_CASE(TestArrayBenchmarkAstCodegen)
+{
+	vector<string_t> codes;
+	codes.push_back(GetCodeForStandardLibrary());
+	codes.push_back(ReadAnsiFile(T("../TestCases/ArrayBenchmark.txt")));
+
+	CodeError::List errors;
+	auto assembly = SymbolAssembly::Parse(codes, errors);
+	TEST_ASSERT(errors.size() == 0);
+	auto ast = GenerateAst(assembly);
+
+	// the benchmark runs in the native runtime, CppCodegenTest/ArrayBenchmark.cpp embeds it
+	stringstream_t o;
+	GenerateCppCode(ast, o);
+	WriteAnsiFile(T("../CppCodegenTest/ArrayBenchmarkAst.cpp"), o);
+}
+
+/*************************************************************
+Primitive Operators
+*************************************************************/
+
+TEST_CASE(TestPrimitiveOperatorAstCodegen)
+{
+	string_t code = T(R"tinymoe(
+module primitive operators
+using standard library
+
+sentence print (message)
+	redirect to "Print"
+end
+
+phrase main
+	print (1 + 2)
+end
+)tinymoe");
+
+	vector<string_t> codes;
+	CodeError::List errors;
+	codes.push_back(GetCodeForStandardLibrary());
+	codes.push_back(code);
+	auto assembly = SymbolAssembly::Parse(codes, errors);
+	TEST_ASSERT(errors.size() == 0);
+	auto ast = GenerateAst(assembly);
+
+	// both operands are integer literals, so the standard library operator is replaced by an integer addition
+	auto main = FindFunction(ast, T("primitive_operators::main"));
+	TEST_ASSERT(main);
+	vector<AstPrimitiveExpression*> primitives;
+	CollectNodes(main.get(), primitives);
+	TEST_ASSERT(primitives.size() == 1);
+	TEST_ASSERT(primitives[0]->op == AstPrimitiveOperator::IntegerAdd);
+	TEST_ASSERT(primitives[0]->operands.size() == 2);
+	auto first = AstNodeCast<AstIntegerExpression>(primitives[0]->operands[0]);
+	auto second = AstNodeCast<AstIntegerExpression>(primitives[0]->operands[1]);
+	TEST_ASSERT(first && first->value == 1);
+	TEST_ASSERT(second && second->value == 2);
 }
\ No newline at end of file
@@ -20,19 +20,39 @@ TEST_CASE(TestGrammarStack)
 	item->FillPredefinedSymbols();
 
 	stack->Push(item);
-	TEST_ASSERT(stack->stackItems.size() == 1);
-	TEST_ASSERT(stack->availableSymbols.size() == item->symbols.size());
+	TEST_ASSERT(stack->scope->item == item);
+	TEST_ASSERT(stack->scope->symbols.size() == item->symbols.size());
+	TEST_ASSERT(stack->GetVisibleSymbols().size() == item->symbols.size());
 	for (auto symbol : item->symbols)
 	{
-		auto it = stack->availableSymbols.find(symbol->uniqueId);
-		TEST_ASSERT(it != stack->availableSymbols.end());
-		TEST_ASSERT(it->first == symbol->uniqueId);
+		auto it = stack->scope->symbols.find(GrammarSymbol::Key(symbol));
+		TEST_ASSERT(it != stack->scope->symbols.end());
+		TEST_ASSERT(*it->first.uniqueId == symbol->uniqueId);
+		TEST_ASSERT(it->first.hash == symbol->uniqueIdHash);
 		TEST_ASSERT(it->second == symbol);
 	}
 
+	auto snapshot = stack->Snapshot();
+	auto inner = make_shared<GrammarStackItem>();
+	inner->symbols.push_back(item->symbols[0]);
+	stack->Push(inner);
+	TEST_ASSERT(stack->scope->parent == snapshot->scope);
+	TEST_ASSERT(stack->scope->CountSymbols(GrammarSymbol::Key(item->symbols[0])) == 2);
+	TEST_ASSERT(stack->GetVisibleSymbols().size() == item->symbols.size());
+
+	// visible symbols are ordered by the unique id, not by the hash that groups them
+	auto& visible = stack->GetVisibleSymbols();
+	for (int i = 1; (size_t)i < visible.size(); i++)
+	{
+		TEST_ASSERT(visible[i - 1]->uniqueId < visible[i]->uniqueId);
+	}
+	TEST_ASSERT(visible == snapshot->GetVisibleSymbols());
+	TEST_ASSERT(stack->Pop() == inner);
+	TEST_ASSERT(stack->scope == snapshot->scope);
+
 	TEST_ASSERT(stack->Pop() == item);
-	TEST_ASSERT(stack->stackItems.size() == 0);
-	TEST_ASSERT(stack->availableSymbols.size() == 0);
+	TEST_ASSERT(!stack->scope);
+	TEST_ASSERT(snapshot->scope->item == item);
 }
 
 TEST_CASE(TestParseNameExpression)
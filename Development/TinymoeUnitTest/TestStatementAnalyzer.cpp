@@ -4,6 +4,7 @@
 using namespace tinymoe;
 using namespace tinymoe::compiler;
 
+extern string_t ReadAnsiFile(string_t fileName);
 extern string_t GetCodeForStandardLibrary();
 
 TEST_CASE(TestParseStandardLibraryModule)
@@ -122,6 +123,178 @@ end
 	TEST_ASSERT(dynamic_pointer_cast<NameFragment>(func->function->name[0])->name->GetName() == T("main"));
 }
 
+TEST_CASE(TestParsePotentialAmbiguousModuleWithoutLimit)
+{
+	string_t code = T(R"tinymoe(
+module hello world
+using standard library
+
+type dog
+	name
+end
+
+sentence print (message)
+	redirect to "printf"
+end
+
+phrase console input
+	redirect to "scanf"
+end
+
+phrase main
+    set kula to new dog of ()
+	set field name of kula to console input
+	print "kula's name is " & field name of kula & "."
+end
+)tinymoe");
+
+	// a limit that is not reached never changes the accepted statement
+	vector<string_t> codes;
+	codes.push_back(GetCodeForStandardLibrary());
+	codes.push_back(code);
+	CodeError::List limitedErrors, unlimitedErrors;
+	auto limited = SymbolAssembly::Parse(codes, limitedErrors, 10000);
+	auto unlimited = SymbolAssembly::Parse(codes, unlimitedErrors);
+	TEST_ASSERT(limitedErrors.size() == 0);
+	TEST_ASSERT(unlimitedErrors.size() == 0);
+
+	auto limitedDecl = limited->symbolModules[1]->module->declarations[3];
+	auto unlimitedDecl = unlimited->symbolModules[1]->module->declarations[3];
+	auto& limitedStats = limited->symbolModules[1]->declarationFunctions.find(limitedDecl)->second->statement->statements;
+	auto& unlimitedStats = unlimited->symbolModules[1]->declarationFunctions.find(unlimitedDecl)->second->statement->statements;
+	TEST_ASSERT(limitedStats.size() == 3);
+	TEST_ASSERT(unlimitedStats.size() == 3);
+	for (int i = 0; i < 3; i++)
+	{
+		TEST_ASSERT(limitedStats[i]->statementExpression->ToLog() == unlimitedStats[i]->statementExpression->ToLog());
+	}
+}
+
+// the statements that ParseBlock accepts from the results of ParseStatement, which are the legal ones creating the fewest new variables
+vector<string_t> SelectStatements(GrammarStack::Ptr stack, GrammarStack::ResultList& result)
+{
+	multimap<int, string_t> scores;
+	for (auto r : result)
+	{
+		Expression::List assignables, arguments, modifiedAssignables;
+		r.second->CollectNewAssignable(assignables, arguments, modifiedAssignables);
+		int score = stack->CountStatementAssignables(assignables);
+		if (score != -1)
+		{
+			scores.insert(make_pair(score, r.second->ToLog()));
+		}
+	}
+
+	vector<string_t> selected;
+	if (scores.size() > 0)
+	{
+		auto range = scores.equal_range(scores.begin()->first);
+		for (auto it = range.first; it != range.second; it++)
+		{
+			selected.push_back(it->second);
+		}
+	}
+	sort(selected.begin(), selected.end());
+	return selected;
+}
+
+// ParseStatement before partial parses were pruned by the number of new variables
+void ParseStatementWithoutPruning(GrammarStack::Ptr stack, CodeToken::List& tokens, GrammarStack::ResultList& result)
+{
+	GrammarStack::ResultList expressionResult;
+	for (auto symbol : stack->GetVisibleSymbols())
+	{
+		if (symbol->type == GrammarSymbolType::Sentence || symbol->type == GrammarSymbolType::Block)
+		{
+			switch (symbol->fragments[0]->type)
+			{
+			case GrammarFragmentType::Primitive:
+			case GrammarFragmentType::Expression:
+				break;
+			default:
+				stack->ParseGrammarSymbol(symbol, tokens.begin(), tokens.end(), expressionResult);
+			}
+		}
+	}
+
+	for (auto er : expressionResult)
+	{
+		if (er.first == tokens.end())
+		{
+			result.push_back(er);
+		}
+	}
+}
+
+TEST_CASE(TestPruningKeepsSelectedStatements)
+{
+	// every line of every function body is parsed on the stack of the function, with and without pruning,
+	// variables declared by previous lines are not in the stack, so they are parsed as new variables again, which makes lines more ambiguous
+	const char_t* testCases[] = { T("HelloWorld"), T("MultipleDispatch"), T("Coroutine"), T("UnitTest"), T("ArrayBenchmark") };
+	int statements = 0;
+	for (auto testCase : testCases)
+	{
+		vector<string_t> codes;
+		CodeError::List errors;
+		codes.push_back(GetCodeForStandardLibrary());
+		codes.push_back(ReadAnsiFile(T("../TestCases/") + string_t(testCase) + T(".txt")));
+		auto assembly = SymbolAssembly::Parse(codes, errors);
+		TEST_ASSERT(errors.size() == 0);
+
+		for (auto symbolModule : assembly->symbolModules)
+		{
+			// the standard library is only checked with the first test case
+			if (symbolModule != assembly->symbolModules.back() && testCase != testCases[0]) continue;
+			for (auto df : symbolModule->declarationFunctions)
+			{
+				auto func = df.second;
+				if (!func->bodyStack) continue;
+				for (int i = func->function->codeLineIndex; i <= func->function->endLineIndex; i++)
+				{
+					auto& tokens = symbolModule->codeFile->lines[i]->tokens;
+					auto stack = func->bodyStack->Snapshot();
+					GrammarStack::ResultList pruned, unpruned;
+					stack->ParseStatement(tokens.begin(), tokens.end(), pruned);
+					ParseStatementWithoutPruning(stack, tokens, unpruned);
+					TEST_ASSERT(pruned.size() <= unpruned.size());
+					TEST_ASSERT(SelectStatements(stack, pruned) == SelectStatements(stack, unpruned));
+					statements++;
+				}
+			}
+		}
+	}
+	TEST_ASSERT(statements > 500);
+}
+
+TEST_CASE(TestParseTooAmbiguousStatement)
+{
+	string_t code = T(R"tinymoe(
+module hello world
+using standard library
+
+sentence say (a) x (b) x (c) x (d) x (e)
+end
+
+phrase (p) x (q)
+	set the result to p
+end
+
+phrase main
+	say 1 x 2 x 3 x 4 x 5 x 6 x 7 x 8 x 9 x 10 x 11 x 12
+end
+)tinymoe");
+
+	// the standard library needs less than 200 partial parses for a statement, but each "x" multiplies partial parses of the last line
+	vector<string_t> codes;
+	CodeError::List errors;
+	codes.push_back(GetCodeForStandardLibrary());
+	codes.push_back(code);
+	auto assembly = SymbolAssembly::Parse(codes, errors, 1000);
+	TEST_ASSERT(errors.size() == 1);
+	TEST_ASSERT(errors[0].position.row == 13);
+	TEST_ASSERT(errors[0].message == T("Statement is too ambiguous, it has more than 1000 partial parses."));
+}
+
 TEST_CASE(TestParseConnectedBlocksModule)
 {
 	string_t code = T(R"tinymoe(
@@ -245,4 +418,302 @@ end
 		TEST_ASSERT(errors.size() == 1);
 		TEST_ASSERT(assembly->symbolModules.size() == 2);
 	}
+	{
+		string_t code = T(R"tinymoe(
+module hello world
+using standard library
+
+phrase zebra
+end
+
+phrase mango
+end
+
+phrase apple
+end
+
+phrase kiwi
+end
+
+phrase zebra
+end
+
+phrase mango
+end
+
+phrase apple
+end
+
+phrase kiwi
+end
+)tinymoe");
+
+		vector<string_t> codes;
+		CodeError::List errors;
+		codes.push_back(GetCodeForStandardLibrary());
+		codes.push_back(code);
+		auto assembly = SymbolAssembly::Parse(codes, errors);
+
+		// redefinitions are reported in the order of the unique id: apple, kiwi, mango, zebra
+		TEST_ASSERT(errors.size() == 4);
+		TEST_ASSERT(errors[0].position.row == 23);
+		TEST_ASSERT(errors[1].position.row == 26);
+		TEST_ASSERT(errors[2].position.row == 20);
+		TEST_ASSERT(errors[3].position.row == 17);
+	}
+}
+
+TEST_CASE(TestUpdateModule)
+{
+	string_t code = T(R"tinymoe(
+module hello world
+using standard library
+
+sentence print (message)
+	redirect to "printf"
+end
+
+phrase main
+	print "Hello, world!"
+end
+)tinymoe");
+
+	vector<string_t> codes;
+	CodeError::List errors;
+	codes.push_back(GetCodeForStandardLibrary());
+	codes.push_back(code);
+	auto assembly = SymbolAssembly::Parse(codes, errors);
+	TEST_ASSERT(errors.size() == 0);
+
+	CodeLineEdit edit;
+	edit.codeIndex = 1;
+	edit.row = 10;
+	{
+		edit.code = T("\tprint \"Hello, \" & \"world!\"");
+		errors.clear();
+		auto updated = SymbolAssembly::Update(assembly, CodeLineEdit::List{ edit }, errors);
+		TEST_ASSERT(updated == assembly);
+		TEST_ASSERT(errors.size() == 0);
+	}
+	{
+		edit.code = T("\tprnt \"Hello, world!\"");
+		errors.clear();
+		auto updated = SymbolAssembly::Update(assembly, CodeLineEdit::List{ edit }, errors);
+		TEST_ASSERT(updated == assembly);
+		TEST_ASSERT(errors.size() == 1);
+		TEST_ASSERT(errors[0].position.row == 10);
+	}
+	{
+		edit.code = T("\tprint \"Hello, world!\"");
+		errors.clear();
+		auto updated = SymbolAssembly::Update(assembly, CodeLineEdit::List{ edit }, errors);
+		TEST_ASSERT(updated == assembly);
+		TEST_ASSERT(errors.size() == 0);
+	}
+	{
+		// the body is edited before the declaration, but the assembly is parsed again and the input is unchanged
+		CodeLineEdit bodyEdit = edit;
+		bodyEdit.code = T("\tprint \"Hello, \" & \"world!\"");
+		edit.row = 9;
+		edit.code = T("phrase hello");
+		errors.clear();
+		auto updated = SymbolAssembly::Update(assembly, CodeLineEdit::List{ bodyEdit, edit }, errors);
+		TEST_ASSERT(updated != assembly);
+		TEST_ASSERT(errors.size() == 0);
+		TEST_ASSERT(updated->codes[1].find(T("phrase hello")) != string_t::npos);
+		TEST_ASSERT(updated->codes[1].find(T("\"Hello, \" & \"world!\"")) != string_t::npos);
+		TEST_ASSERT(assembly->codes[1] == code);
+		for (auto line : assembly->symbolModules[1]->codeFile->lines)
+		{
+			if (line->tokens[0].row == 10)
+			{
+				TEST_ASSERT(line->tokens.size() == 2);
+			}
+		}
+	}
+}
+
+TEST_CASE(TestParseModuleOnBase)
+{
+	string_t helloCode = T(R"tinymoe(
+module hello world
+using standard library
+
+sentence print (message)
+	redirect to "printf"
+end
+
+phrase main
+	print "Hello, world!"
+end
+)tinymoe");
+
+	string_t goodbyeCode = T(R"tinymoe(
+module goodbye world
+using standard library
+
+phrase main
+	set the result to "Goodbye, world!"
+end
+)tinymoe");
+
+	vector<string_t> baseCodes;
+	CodeError::List errors;
+	baseCodes.push_back(GetCodeForStandardLibrary());
+	auto base = SymbolAssembly::Parse(baseCodes, errors);
+	TEST_ASSERT(errors.size() == 0);
+
+	// modules in the base assembly are shared by all assemblies built on it
+	vector<string_t> helloCodes, goodbyeCodes;
+	helloCodes.push_back(helloCode);
+	goodbyeCodes.push_back(goodbyeCode);
+	auto hello = SymbolAssembly::Parse(base, helloCodes, errors);
+	auto goodbye = SymbolAssembly::Parse(base, goodbyeCodes, errors);
+	TEST_ASSERT(errors.size() == 0);
+	TEST_ASSERT(hello->baseAssembly == base);
+	TEST_ASSERT(goodbye->baseAssembly == base);
+	TEST_ASSERT(hello->symbolModules.size() == 2);
+	TEST_ASSERT(goodbye->symbolModules.size() == 2);
+	TEST_ASSERT(hello->symbolModules[0] == base->symbolModules[0]);
+	TEST_ASSERT(goodbye->symbolModules[0] == base->symbolModules[0]);
+	TEST_ASSERT(hello->codes.size() == 2 && hello->codes[1] == helloCode);
+	TEST_ASSERT(hello->symbolModules[1]->codeFile->lines[0]->tokens[0].codeIndex == 1);
+	TEST_ASSERT(base->symbolModules.size() == 1);
+}
+
+TEST_CASE(TestParseModuleExtendingBase)
+{
+	string_t code = T(R"tinymoe(
+module standard library
+
+phrase hello
+	set the result to "Hello, world!"
+end
+)tinymoe");
+
+	vector<string_t> baseCodes;
+	CodeError::List errors;
+	baseCodes.push_back(GetCodeForStandardLibrary());
+	auto base = SymbolAssembly::Parse(baseCodes, errors);
+	TEST_ASSERT(errors.size() == 0);
+
+	// the standard library is built, so a new module with the same name cannot add symbols to it
+	vector<string_t> codes;
+	codes.push_back(code);
+	auto assembly = SymbolAssembly::Parse(base, codes, errors);
+	TEST_ASSERT(errors.size() == 1);
+	TEST_ASSERT(errors[0].message == T("Module \"standard library\" is already built and cannot be extended."));
+	TEST_ASSERT(errors[0].position.codeIndex == 1);
+
+	// without a base assembly, modules with the same name are merged
+	errors.clear();
+	baseCodes.push_back(code);
+	SymbolAssembly::Parse(baseCodes, errors);
+	TEST_ASSERT(errors.size() == 0);
+}
+
+TEST_CASE(TestParseModuleOnBaseWithErrors)
+{
+	string_t wrongCode = T(R"tinymoe(
+module wrong world
+using standard library
+
+phrase main
+	if true
+		break
+	end
+end
+)tinymoe");
+
+	string_t code = T(R"tinymoe(
+module hello world
+using standard library
+
+phrase main
+	set the result to "Hello, world!"
+end
+)tinymoe");
+
+	vector<string_t> baseCodes;
+	CodeError::List errors;
+	baseCodes.push_back(GetCodeForStandardLibrary());
+	baseCodes.push_back(wrongCode);
+	auto base = SymbolAssembly::Parse(baseCodes, errors);
+	TEST_ASSERT(errors.size() == 1);
+	TEST_ASSERT(base->errors.size() == 1);
+
+	// modules with errors cannot be shared, so all modules are parsed again, and errors in the base assembly are reported again
+	errors.clear();
+	vector<string_t> codes;
+	codes.push_back(code);
+	auto assembly = SymbolAssembly::Parse(base, codes, errors);
+	TEST_ASSERT(errors.size() == 1);
+	TEST_ASSERT(errors[0].position.codeIndex == 1);
+	TEST_ASSERT(!assembly->baseAssembly);
+	TEST_ASSERT(assembly->codes.size() == 3);
+	TEST_ASSERT(assembly->symbolModules.size() == 3);
+	TEST_ASSERT(assembly->symbolModules[0] != base->symbolModules[0]);
+}
+
+TEST_CASE(TestUpdateModuleOnBase)
+{
+	string_t code = T(R"tinymoe(
+module hello world
+using standard library
+
+sentence print (message)
+	redirect to "printf"
+end
+
+phrase main
+	print "Hello, world!"
+end
+)tinymoe");
+
+	vector<string_t> baseCodes;
+	CodeError::List errors;
+	baseCodes.push_back(GetCodeForStandardLibrary());
+	auto base = SymbolAssembly::Parse(baseCodes, errors);
+	vector<string_t> codes;
+	codes.push_back(code);
+	auto assembly = SymbolAssembly::Parse(base, codes, errors);
+	TEST_ASSERT(errors.size() == 0);
+
+	CodeLineEdit edit;
+	edit.codeIndex = 1;
+	edit.row = 10;
+	{
+		// only the function body in the new module is parsed again
+		edit.code = T("\tprint \"Hello, \" & \"world!\"");
+		errors.clear();
+		auto updated = SymbolAssembly::Update(assembly, CodeLineEdit::List{ edit }, errors);
+		TEST_ASSERT(updated == assembly);
+		TEST_ASSERT(errors.size() == 0);
+		TEST_ASSERT(updated->baseAssembly == base);
+	}
+	{
+		// a declaration in the new module is changed, the new module is parsed again on the same base assembly
+		edit.row = 9;
+		edit.code = T("phrase hello");
+		errors.clear();
+		auto updated = SymbolAssembly::Update(assembly, CodeLineEdit::List{ edit }, errors);
+		TEST_ASSERT(updated != assembly);
+		TEST_ASSERT(errors.size() == 0);
+		TEST_ASSERT(updated->baseAssembly == base);
+		TEST_ASSERT(updated->symbolModules[0] == base->symbolModules[0]);
+	}
+	{
+		// a module in the base assembly is changed, all modules are parsed again without the base assembly, and the base assembly is unchanged
+		edit.codeIndex = 0;
+		edit.row = 1;
+		edit.code = T("module standard library");
+		errors.clear();
+		auto updated = SymbolAssembly::Update(assembly, CodeLineEdit::List{ edit }, errors);
+		TEST_ASSERT(updated != assembly);
+		TEST_ASSERT(errors.size() == 0);
+		TEST_ASSERT(!updated->baseAssembly);
+		TEST_ASSERT(updated->symbolModules.size() == 2);
+		TEST_ASSERT(updated->symbolModules[0] != base->symbolModules[0]);
+		TEST_ASSERT(base->codes[0] == GetCodeForStandardLibrary());
+	}
 }
\ No newline at end of file